@@ -5,6 +5,7 @@ function reset_game()
     sprf.set_ball_position(ball_start_pos.x,ball_start_pos.y,ball_start_pos.z)
     sprf.set_ball_rotation(ball_start_rot.x,ball_start_rot.y,ball_start_rot.z)
     sprf.set_ball_angular_velocity(0,0,0)
+    sprf.emit_event("reset")
 end
 
 sprf.tracelog(sprf.log_info,"server loaded")
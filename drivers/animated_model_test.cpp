@@ -102,9 +102,9 @@ class MyScene : public TestScene {
         auto hands_model_entity = hands_entity->create_child("hands_model");
         auto hands_model_component = hands_model_entity->add_component<Model>(hands_model);
         hands_model_entity->add_component<Selectable>(true,true);
-        hands_entity->get_component<Transform>()->scale = vec3(0.01,0.01,0.01);
-        hands_entity->get_component<Transform>()->rotation = vec3(M_PI_2,-0.7,0);
-        hands_entity->get_component<Transform>()->position = vec3(-0.1,-1.7,0.2);
+        hands_entity->get_component<Transform>()->scale(vec3(0.01,0.01,0.01));
+        hands_entity->get_component<Transform>()->rotation(vec3(M_PI_2,-0.7,0));
+        hands_entity->get_component<Transform>()->position(vec3(-0.1,-1.7,0.2));
         hands_entity->add_component<Selectable>(true,true);
         auto model_animator = hands_model_entity->add_component<ModelAnimator>(hands_model_entity,"assets/xbot_hands.glb",hands_model_component);
         model_animator->play_animation("idle");
@@ -114,16 +114,16 @@ class MyScene : public TestScene {
         auto gun_entity = player_model_entity->find_entity("mixamorig:RightHand")->create_child();
         gun_entity->add_component<Model>(gun_model);
         gun_entity->add_component<Selectable>(true,true);
-        gun_entity->get_component<Transform>()->position = vec3(4,6,-18);
-        gun_entity->get_component<Transform>()->rotation = vec3(-M_PI_2,0,M_PI_2);
-        gun_entity->get_component<Transform>()->scale = vec3(20,20,20);
+        gun_entity->get_component<Transform>()->position(vec3(4,6,-18));
+        gun_entity->get_component<Transform>()->rotation(vec3(-M_PI_2,0,M_PI_2));
+        gun_entity->get_component<Transform>()->scale(vec3(20,20,20));
 
         auto gun_entity2 = hands_model_entity->find_entity("mixamorig:RightHand")->create_child();
         gun_entity2->add_component<Model>(gun_model);
         gun_entity2->add_component<Selectable>(true,true);
-        gun_entity2->get_component<Transform>()->position = vec3(6,0,-18);
-        gun_entity2->get_component<Transform>()->rotation = vec3(-M_PI_2,0.1,0.8);
-        gun_entity2->get_component<Transform>()->scale = vec3(20,20,20);
+        gun_entity2->get_component<Transform>()->position(vec3(6,0,-18));
+        gun_entity2->get_component<Transform>()->rotation(vec3(-M_PI_2,0.1,0.8));
+        gun_entity2->get_component<Transform>()->scale(vec3(20,20,20));
 
         auto& anim_states = animator->state_manager();
 
@@ -157,8 +157,8 @@ class MyScene : public TestScene {
 
         player_entity->add_component<TestModelInput>(animator);
 
-        player_entity->get_component<Transform>()->scale = vec3(0.01,0.01,0.01);
-        player_entity->get_component<Transform>()->rotation = vec3(M_PI_2,M_PI,0);
+        player_entity->get_component<Transform>()->scale(vec3(0.01,0.01,0.01));
+        player_entity->get_component<Transform>()->rotation(vec3(M_PI_2,M_PI,0));
         player_model_entity->add_component<Selectable>(true,true);
 
         //animator->play_animation("sprint");
@@ -1,25 +1,37 @@
 #ifndef _SPRF_ANIMATION_HPP_
 #define _SPRF_ANIMATION_HPP_
 
+#include "engine/animation_clip.hpp"
 #include "engine/engine.hpp"
 
 namespace SPRF{
 
 class AnimationState{
     private:
-        ModelAnimation m_anim;
+        /** @brief Compressed clip, owned by the manager's `AnimationClipSet` */
+        const AnimationClip* m_clip;
         std::string m_animation_name;
         bool m_loop;
         bool m_playing = false;
-        std::unordered_map<std::string,AnimationState*> m_actions;
-        std::unordered_map<std::string,bool> m_force;
+        /** @brief Event names, shared by every state of a manager */
+        NameTable* m_events;
+        /** @brief State each event leads to, by event id (NULL for none) */
+        std::vector<AnimationState*> m_actions;
+        std::vector<bool> m_force;
         float m_current_frame = 0;
+        /** @brief Where each track of the clip was last sampled */
+        std::vector<uint32_t> m_cursors;
         float m_frame_rate;
         bool m_currently_looping = false;
         AnimationState* m_next = NULL;
 
+        AnimationState* action(name_id_t event_id){
+            if (event_id >= m_actions.size())return NULL;
+            return m_actions[event_id];
+        }
+
     public:
-        AnimationState(ModelAnimation anim, bool loop = true, float frame_rate = 60.0f) : m_anim(anim), m_animation_name(std::string(m_anim.name)), m_loop(loop), m_frame_rate(frame_rate){
+        AnimationState(const AnimationClip* clip, NameTable* events, bool loop = true, float frame_rate = 60.0f) : m_clip(clip), m_animation_name(clip->name()), m_loop(loop), m_events(events), m_frame_rate(frame_rate){
 
         }
 
@@ -33,19 +45,20 @@ class AnimationState{
         }
 
         int bone_count(){
-            return m_anim.boneCount;
+            return m_clip->bones();
         }
 
-        BoneInfo* bones(){
-            return m_anim.bones;
+        const AnimationClip* clip(){
+            return m_clip;
         }
 
         AnimationState* play(){
             m_current_frame = 0;
             m_playing = true;
             m_currently_looping = m_loop;
-            if (KEY_EXISTS(m_actions,"next")){
-                m_next = m_actions["next"];
+            AnimationState* next = action(m_events->find("next"));
+            if (next){
+                m_next = next;
             }
             return this;
         }
@@ -58,14 +71,15 @@ class AnimationState{
             return this;
         }
 
-        AnimationState* event(std::string event_name){
-            if (!KEY_EXISTS(m_actions,event_name)){
+        AnimationState* event(name_id_t event_id){
+            AnimationState* next = action(event_id);
+            if (!next){
                 return this;
             }
             //m_playing = false;
-            m_next = m_actions[event_name];
+            m_next = next;
             m_currently_looping = false;
-            if (m_playing && (!m_force[event_name])){
+            if (m_playing && (!m_force[event_id])){
                 return this;
             } /*else if (m_playing){
                 m_current_frame = m_anim.frameCount - 3;
@@ -74,9 +88,18 @@ class AnimationState{
             return m_next->play();
         }
 
+        AnimationState* event(std::string event_name){
+            return event(m_events->find(event_name));
+        }
+
         void add_event(std::string event_name, AnimationState* state, bool force = false){
-            m_actions[event_name] = state;
-            m_force[event_name] = force;
+            name_id_t id = m_events->intern(event_name);
+            if (id >= m_actions.size()){
+                m_actions.resize(id + 1, NULL);
+                m_force.resize(id + 1, false);
+            }
+            m_actions[id] = state;
+            m_force[id] = force;
         }
 
         bool loop(){
@@ -88,43 +111,61 @@ class AnimationState{
             return loop();
         }
 
-        ::Transform** frame_poses(){
-            return m_anim.framePoses;
-        }
-
-        AnimationState* update_animation(ModelAnimation to_update){
-            if (!m_playing)return this;
+        /**
+         * @brief Sample the current frame into `out`.
+         *
+         * @param scratch Pose to sample the next state into when blending
+         * into it.
+         */
+        void sample(BonePose& out, BonePose& scratch){
+            if (!m_playing)return;
+            int frame_count = m_clip->frames();
             int this_frame_idx = (int)m_current_frame;
-            int next_frame_idx = (this_frame_idx + 1) % (m_anim.frameCount-1);
-
-            auto this_frame = m_anim.framePoses[this_frame_idx];
-            auto next_frame = m_anim.framePoses[next_frame_idx];
-
-            if ((this_frame_idx == (m_anim.frameCount - 2)) && !m_currently_looping){
-                if (m_next){
-                    next_frame = m_next->frame_poses()[0];
-                }
-            }
-
             float lerp = m_current_frame - this_frame_idx;
 
-            for (int i = 0; i < m_anim.boneCount; i++){
-                to_update.framePoses[0][i].scale = Vector3Lerp(this_frame[i].scale,next_frame[i].scale,lerp);
-                to_update.framePoses[0][i].translation = Vector3Lerp(this_frame[i].translation,next_frame[i].translation,lerp);
-                to_update.framePoses[0][i].rotation = QuaternionSlerp(this_frame[i].rotation,next_frame[i].rotation,lerp);
+            if ((this_frame_idx == (frame_count - 2)) && !m_currently_looping && m_next){
+                // blend the last frame into the start of the next state
+                m_clip->sample(this_frame_idx, out);
+                m_next->clip()->sample(0, scratch);
+                blend_poses(out, scratch, lerp, out);
+            } else {
+                m_clip->sample(m_current_frame, out, &m_cursors);
             }
+        }
 
-            m_current_frame += game_info.frame_time * m_frame_rate;
+        /**
+         * @brief Sample the current frame into `out`, then advance time by
+         * `game_info.frame_time`.
+         *
+         * @return AnimationState* The state playing now.
+         */
+        AnimationState* update_animation(BonePose& out, BonePose& scratch){
+            sample(out, scratch);
+            return advance(game_info.frame_time);
+        }
+
+        /**
+         * @brief Advance time by `dt` seconds without sampling, moving on to
+         * the next state if this one ends.
+         *
+         * @return AnimationState* The state playing now.
+         */
+        AnimationState* advance(float dt){
+            if (!m_playing)return this;
+            int frame_count = m_clip->frames();
+            m_current_frame += dt * m_frame_rate;
             AnimationState* next = this;
             if (!m_currently_looping){
-                if (m_current_frame >= (float)(m_anim.frameCount - 1)){
+                if (m_current_frame >= (float)(frame_count - 1)){
                     m_playing = false;
                     if (m_next){
                         next = m_next->play();
                     }
                 }
             }
-            m_current_frame = fmod(m_current_frame,m_anim.frameCount - 1);
+            if (frame_count > 1){
+                m_current_frame = fmod(m_current_frame,frame_count - 1);
+            }
             return next;
         }
 
@@ -135,69 +176,134 @@ class AnimationState{
 
 class AnimationStateManager{
     private:
-        std::unordered_map<std::string,AnimationState*> m_states;
+        /** @brief Clips the states play, shared with every manager using the
+         * same file */
+        std::shared_ptr<const AnimationClipSet> m_clips;
+        /** @brief State names, a state's id indexes `m_states` */
+        NameTable m_names;
+        NameTable m_events;
+        std::vector<AnimationState*> m_states;
         AnimationState* m_playing = NULL;
         bool m_initialized = false;
-        ModelAnimation m_cur_anim;
+        /** @brief Current pose */
+        BonePose m_pose;
+        /** @brief Pose before the last `update`, for `interpolate` */
+        BonePose m_previous;
+        /** @brief Scratch for blending between states */
+        BonePose m_scratch;
+        /** @brief `m_pose`, as `m_cur_anim` hands it out */
+        std::vector<::Transform> m_transforms;
+        ::Transform* m_frame_poses[1];
+        ModelAnimation m_cur_anim = {};
     public:
-        AnimationStateManager(){
+        AnimationStateManager(std::shared_ptr<const AnimationClipSet> clips) : m_clips(clips){
         }
 
-        void add_animation_state(ModelAnimation anim, bool loop = true, float frame_rate = 60.0f){
-            auto state = new AnimationState(anim,loop,frame_rate);
-            assert(!KEY_EXISTS(m_states,state->name()));
-            m_states[state->name()] = state;
+        const AnimationClipSet& clips(){
+            return *m_clips;
+        }
+
+        void add_animation_state(const AnimationClip* clip, bool loop = true, float frame_rate = 60.0f){
+            auto state = new AnimationState(clip,&m_events,loop,frame_rate);
+            name_id_t id = m_names.intern(state->name());
+            assert(id == m_states.size());
+            m_states.push_back(state);
             if (m_playing == NULL){
                 m_playing = state->play();
             }
             if (!m_initialized){
                 m_cur_anim.boneCount = state->bone_count();
-                m_cur_anim.bones = state->bones();
+                m_cur_anim.bones = (BoneInfo*)m_clips->bones().data();
                 m_cur_anim.frameCount = 1;
-                m_cur_anim.framePoses = (::Transform**)malloc(sizeof(::Transform*));
-                m_cur_anim.framePoses[0] = (::Transform*)malloc(sizeof(::Transform) * state->bone_count());
+                m_transforms.resize(state->bone_count());
+                m_frame_poses[0] = m_transforms.data();
+                m_cur_anim.framePoses = m_frame_poses;
                 strcpy(m_cur_anim.name,"base_anim");
-                for (int i = 0; i < m_cur_anim.boneCount; i++){
-                    m_cur_anim.framePoses[0][i] = state->frame_poses()[0][i];
-                }
+                clip->sample(0, m_pose);
+                m_pose.to_transforms(m_transforms.data());
                 m_initialized = true;
             }
         }
 
         AnimationState* get_animation_state(std::string name){
-            assert(KEY_EXISTS(m_states,name));
-            return m_states[name];
+            name_id_t id = m_names.find(name);
+            assert(id != NAME_ID_NONE);
+            return m_states[id];
         }
 
         ~AnimationStateManager(){
-            for (auto& i : m_states){
-                delete i.second;
-            }
-            if (m_initialized){
-                free(m_cur_anim.framePoses[0]);
-                free(m_cur_anim.framePoses);
+            for (auto i : m_states){
+                delete i;
             }
         }
 
+        int bones(){
+            return m_transforms.size();
+        }
+
         ModelAnimation update(){
             if (m_playing != NULL){
-                m_playing = m_playing->update_animation(m_cur_anim);
+                m_playing = m_playing->update_animation(m_pose, m_scratch);
+                m_pose.to_transforms(m_transforms.data());
             }
             return m_cur_anim;
         }
 
-        void event(std::string event_name){
+        /**
+         * @brief Advance time by `dt` seconds, then sample the pose there.
+         * The pose before is kept for `interpolate`.
+         */
+        ModelAnimation update(float dt){
             if (m_playing != NULL){
-                m_playing = m_playing->event(event_name);
+                m_previous = m_pose;
+                m_playing = m_playing->advance(dt);
+                m_playing->sample(m_pose, m_scratch);
+                m_pose.to_transforms(m_transforms.data());
             }
+            return m_cur_anim;
+        }
+
+        /**
+         * @brief Advance time by `dt` seconds without sampling, e.g. while
+         * nobody can see the model. The pose is left as it was.
+         */
+        void advance(float dt){
+            if (m_playing != NULL){
+                m_playing = m_playing->advance(dt);
+            }
+        }
+
+        /**
+         * @brief The pose `t` of the way from the one before the last
+         * `update(float)` to the current one.
+         */
+        ModelAnimation interpolate(float t){
+            if ((t >= 1.0f) || (m_previous.bones() != m_pose.bones())){
+                m_pose.to_transforms(m_transforms.data());
+                return m_cur_anim;
+            }
+            blend_poses(m_previous, m_pose, t, m_scratch);
+            m_scratch.to_transforms(m_transforms.data());
+            return m_cur_anim;
+        }
+
+        void event(name_id_t event_id){
+            if (m_playing != NULL){
+                m_playing = m_playing->event(event_id);
+            }
+        }
+
+        void event(std::string event_name){
+            event(m_events.find(event_name));
         }
 
         void play_animation(std::string name){
-            if (KEY_EXISTS(m_states,name)){
+            name_id_t id = m_names.find(name);
+            if (id != NAME_ID_NONE){
                 if (m_playing){
                     m_playing->stop();
                 }
-                m_playing = m_states[name]->play();
+                m_playing = m_states[id]->play();
             }
         }
 
@@ -212,33 +318,60 @@ class AnimationStateManager{
 class ModelAnimator : public Component{
     private:
         Model* m_model;
-        RenderModel* m_render_model;
-        ::Model m_raylib_model;
-        int m_anim_count;
-        ModelAnimation* m_anims;
         std::vector<Entity*> m_entity_bones;
         std::vector<Transform*> m_entity_transforms;
         AnimationStateManager anim_states;
+        ModelAnimation m_updated_anim;
+        /** @brief Time passed since the pose was last sampled */
+        float m_pending_time = 0;
+        int m_frames_since_update = 0;
+        /** @brief Frames between the last two samples, we interpolate
+         * between them over as many frames */
+        int m_span = 1;
+        /** @brief Frames interpolated since the last sample */
+        int m_frames_since_sample = 0;
+        /** @brief The pose was last sampled before we went off screen */
+        bool m_stale = false;
+
+        void write_pose(ModelAnimation anim){
+            m_updated_anim = anim;
+            m_model->pose(m_updated_anim, 0);
+            for (int i = 0; i < anim.boneCount; i++){
+                auto bone = anim.bones[i];
+                Transform* bone_transform = m_entity_transforms[i];
+                if (bone.parent == -1){
+                    bone_transform->position(vec3(anim.framePoses[0][i].translation));
+                } else {
+                    bone_transform->position(vec3(anim.framePoses[0][i].translation) - vec3(anim.framePoses[0][bone.parent].translation));
+                }
+            }
+        }
+
     public:
-        ModelAnimator(Entity* entity, std::string path, Model* model, std::string starting_animation = "TPose", float framerate = 60) : m_model(model){
-            m_anims = LoadModelAnimations(path.c_str(),&m_anim_count);
-            int bone_count = m_anims[0].boneCount;
-            for (int i = 0; i < m_anim_count; i++){
-                assert(bone_count == m_anims[i].boneCount);
-                anim_states.add_animation_state(m_anims[i],true,framerate);
+        // update only touches our own animation state, bone transforms and
+        // the pose of our model, skinning happens when it's drawn. The
+        // budget it spends is atomic
+        static constexpr bool parallel = true;
+        using writes = ComponentAccess<Transform, Model>;
+
+        ModelAnimator(Entity* entity, std::string path, Model* model, std::string starting_animation = "TPose", float framerate = 60) : m_model(model), anim_states(AnimationClipSet::load(path)){
+            const AnimationClipSet& clips = anim_states.clips();
+            for (int i = 0; i < clips.size(); i++){
+                anim_states.add_animation_state(&clips.clip(i),true,framerate);
             }
             anim_states.play_animation(starting_animation);
             ModelAnimation updated_anim = anim_states.update();
+            m_updated_anim = updated_anim;
 
             for (int i = 0; i < updated_anim.boneCount; i++){
                 auto bone = updated_anim.bones[i];
                 Entity* bone_entity;
                 if (bone.parent == -1){
                     bone_entity = entity->create_child(bone.name);
-                    bone_entity->get_component<Transform>()->position = vec3(updated_anim.framePoses[0][i].translation);
+                    bone_entity->get_component<Transform>()->position(vec3(updated_anim.framePoses[0][i].translation));
                 } else {
                     bone_entity = m_entity_bones[bone.parent]->create_child(bone.name);
-                    bone_entity->get_component<Transform>()->position = vec3(updated_anim.framePoses[0][i].translation) - vec3(updated_anim.framePoses[0][bone.parent].translation);
+                    bone_entity->get_component<Transform>()->position(vec3(updated_anim.framePoses[0][i].translation) - vec3(updated_anim.framePoses[0][bone.parent].translation));
                 }
 
                 m_entity_transforms.push_back(bone_entity->get_component<Transform>());
@@ -250,28 +383,43 @@ class ModelAnimator : public Component{
             return anim_states;
         }
 
-        ~ModelAnimator(){
-            UnloadModelAnimations(m_anims,m_anim_count);
-        }
-
         void init(){
-            m_render_model = m_model->render_model();
-            m_raylib_model = *m_render_model->model();
-            ModelAnimation updated_anim = anim_states.update();
-            UpdateModelAnimation(m_raylib_model, updated_anim, 0);
+            write_pose(anim_states.update(0.0f));
+            m_span = 1;
         }
 
+        /**
+         * @brief Sample as often as the model's size on screen last frame
+         * calls for (see `AnimationBudget::interval`), within the frame's
+         * budget, interpolating the frames in between. Off screen, only time
+         * moves on and the pose (and bones) are left as they were.
+         */
         void update(){
-            ModelAnimation updated_anim = anim_states.update();
-            UpdateModelAnimation(m_raylib_model, updated_anim, 0);
-            for (int i = 0; i < updated_anim.boneCount; i++){
-                auto bone = updated_anim.bones[i];
-                Transform* bone_transform = m_entity_transforms[i];
-                if (bone.parent == -1){
-                    bone_transform->position = vec3(updated_anim.framePoses[0][i].translation);
-                } else {
-                    bone_transform->position = vec3(updated_anim.framePoses[0][i].translation) - vec3(updated_anim.framePoses[0][bone.parent].translation);
-                }
+            m_pending_time += game_info.frame_time;
+            m_frames_since_update++;
+            float size = m_model->screen_size();
+            if (size <= 0){
+                anim_states.advance(m_pending_time);
+                m_pending_time = 0;
+                m_frames_since_update = 0;
+                m_stale = true;
+                return;
+            }
+            int interval = AnimationBudget::interval(size);
+            bool due = m_stale || (m_frames_since_update >= interval);
+            bool force = m_stale || (m_frames_since_update >= SPRF_ANIMATION_MAX_INTERVAL);
+            if (due && AnimationBudget::get().spend(anim_states.bones(), force)){
+                anim_states.update(m_pending_time);
+                // after a gap there's nothing worth interpolating from
+                m_span = m_stale ? 1 : m_frames_since_update;
+                m_pending_time = 0;
+                m_frames_since_update = 0;
+                m_frames_since_sample = 0;
+                m_stale = false;
+                write_pose(anim_states.interpolate(1.0f / m_span));
+            } else if (m_frames_since_sample + 1 < m_span){
+                m_frames_since_sample++;
+                write_pose(anim_states.interpolate((float)(m_frames_since_sample + 1) / m_span));
             }
         }
 
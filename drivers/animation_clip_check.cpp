@@ -0,0 +1,163 @@
+#include "engine/animation_clip.hpp"
+#include "raymath.h"
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// Headless check of compressed clips: sampling against the raw animation
+// they were made from, at and past the ends of the clip, and a blend tree
+// against blending the same poses by hand.
+
+static int failures = 0;
+
+static void check(bool ok, const char* what, float frame) {
+    if (!ok) {
+        printf("FAIL: %s at frame %g\n", what, frame);
+        failures++;
+    }
+}
+
+/**
+ * @brief A made up animation, every channel of every bone moving
+ * differently so keyframe reduction keeps most keys.
+ */
+static ModelAnimation make_animation(int bones, int frames, float phase) {
+    ModelAnimation anim = {};
+    anim.boneCount = bones;
+    anim.frameCount = frames;
+    anim.bones = (BoneInfo*)RL_CALLOC(bones, sizeof(BoneInfo));
+    anim.framePoses = (::Transform**)RL_CALLOC(frames, sizeof(::Transform*));
+    snprintf(anim.name, sizeof(anim.name), "check %g", phase);
+    for (int b = 0; b < bones; b++) {
+        snprintf(anim.bones[b].name, sizeof(anim.bones[b].name), "bone %d", b);
+        anim.bones[b].parent = b - 1;
+    }
+    for (int f = 0; f < frames; f++) {
+        anim.framePoses[f] =
+            (::Transform*)RL_CALLOC(bones, sizeof(::Transform));
+        for (int b = 0; b < bones; b++) {
+            float t = f * 0.7f + b + phase;
+            ::Transform& pose = anim.framePoses[f][b];
+            pose.translation = {sinf(t), cosf(t * 1.3f) * 2, t * 0.1f};
+            pose.rotation =
+                QuaternionFromEuler(sinf(t) * 0.5f, t * 0.3f, cosf(t) * 0.2f);
+            pose.scale = {1.0f + 0.1f * sinf(t), 1, 1};
+        }
+    }
+    return anim;
+}
+
+static void free_animation(ModelAnimation& anim) {
+    for (int f = 0; f < anim.frameCount; f++) {
+        RL_FREE(anim.framePoses[f]);
+    }
+    RL_FREE(anim.framePoses);
+    RL_FREE(anim.bones);
+}
+
+static float angle(Quaternion a, Quaternion b) {
+    float dot = fabsf(Vector4DotProduct(a, b));
+    return 2.0f * acosf(fminf(dot, 1.0f));
+}
+
+/**
+ * @brief Compare a clip sampled at `frame` to the raw animation
+ * interpolated there.
+ */
+static void check_sample(const SPRF::AnimationClip& clip,
+                         const ModelAnimation& anim, float frame,
+                         std::vector<uint32_t>* cursors) {
+    SPRF::BonePose pose;
+    clip.sample(frame, pose, cursors);
+    check(pose.bones() == anim.boneCount, "bone count", frame);
+    float clamped = fminf(fmaxf(frame, 0.0f), (float)(anim.frameCount - 1));
+    int k = std::min((int)clamped, anim.frameCount - 2);
+    float t = clamped - k;
+    for (int b = 0; b < anim.boneCount; b++) {
+        ::Transform x = anim.framePoses[k][b];
+        ::Transform y = anim.framePoses[k + 1][b];
+        ::Transform got = pose.get(b);
+        Vector3 translation = Vector3Lerp(x.translation, y.translation, t);
+        Quaternion rotation = QuaternionNlerp(x.rotation, y.rotation, t);
+        check(Vector3Distance(translation, got.translation) < 1e-2f,
+              "translation", frame);
+        check(angle(rotation, got.rotation) < 1e-2f, "rotation", frame);
+        check(fabsf(Vector3Length(Vector3Subtract(
+                  Vector3Lerp(x.scale, y.scale, t), got.scale))) < 1e-2f,
+              "scale", frame);
+    }
+}
+
+static bool same_pose(const SPRF::BonePose& a, const SPRF::BonePose& b) {
+    if (a.bones() != b.bones())
+        return false;
+    for (int i = 0; i < a.bones(); i++) {
+        ::Transform x = a.get(i);
+        ::Transform y = b.get(i);
+        if ((Vector3Distance(x.translation, y.translation) > 1e-5f) ||
+            (angle(x.rotation, y.rotation) > 1e-3f) ||
+            (Vector3Distance(x.scale, y.scale) > 1e-5f))
+            return false;
+    }
+    return true;
+}
+
+int main() {
+    const int bones = 5;
+    const int frames = 10;
+    ModelAnimation walk = make_animation(bones, frames, 0);
+    ModelAnimation run = make_animation(bones, frames, 2);
+    SPRF::AnimationClip walk_clip(walk, 1e-4f);
+    SPRF::AnimationClip run_clip(run, 1e-4f);
+    printf("%d bones, %d frames, %zu bytes\n", walk_clip.bones(),
+           walk_clip.frames(), walk_clip.bytes());
+
+    const float last = frames - 1;
+    for (float frame : {0.0f, 3.5f, last, last + 3.0f, -1.0f}) {
+        check_sample(walk_clip, walk, frame, NULL);
+    }
+    // playing forward with cursors, running off the end
+    std::vector<uint32_t> cursors;
+    for (float frame = 0; frame <= last + 1; frame += 0.25f) {
+        check_sample(walk_clip, walk, frame, &cursors);
+    }
+    // and looping back to the start
+    check_sample(walk_clip, walk, 0.5f, &cursors);
+
+    SPRF::BlendTree tree;
+    int walk_node = tree.add_clip(&walk_clip);
+    int run_node = tree.add_clip(&run_clip);
+    int idle_node = tree.add_clip(&walk_clip);
+    int moving = tree.add_blend({walk_node, run_node});
+    int root = tree.add_blend({moving, idle_node});
+    tree.frame(walk_node, 2.25f);
+    tree.frame(run_node, last);
+    tree.frame(idle_node, 0);
+    tree.weight(moving, 0, 0.25f);
+    tree.weight(moving, 1, 0.75f);
+    tree.weight(root, 0, 1);
+    tree.weight(root, 1, 0);
+
+    SPRF::BonePose a, b, expected;
+    walk_clip.sample(2.25f, a);
+    run_clip.sample(last, b);
+    SPRF::blend_poses(a, b, 0.75f, expected);
+    check(same_pose(tree.evaluate(root), expected), "blend tree", 2.25f);
+
+    // bring the idle child in, nested blends of the blended pose
+    tree.weight(root, 1, 1);
+    SPRF::BonePose idle, outer;
+    walk_clip.sample(0, idle);
+    SPRF::blend_poses(expected, idle, 0.5f, outer);
+    check(same_pose(tree.evaluate(root), outer), "nested blend tree", 0);
+
+    free_animation(walk);
+    free_animation(run);
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "engine/culling.hpp"
+#include "engine/renderer.hpp"
+#include "raymath.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Headless benchmark of the frustum culling kernel: a stress_test sized grid
+// of randomly rotated and scaled instances against a perspective camera in
+// the middle of it. First checks that the planes the renderer builds with
+// `ViewFrustrum` match the ones extracted from the camera's matrices.
+
+static double time_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+/**
+ * @brief A plane scaled so its normal has unit length.
+ */
+static Vector4 normalized_plane(const float* plane) {
+    float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] +
+                         plane[2] * plane[2]);
+    return {plane[0] / length, plane[1] / length, plane[2] / length,
+            plane[3] / length};
+}
+
+/**
+ * @brief Whether `ViewFrustrum` builds the same planes (in any order) as
+ * `CullPlanes::from_matrix` does from the view projection raylib uses for
+ * the same camera.
+ */
+static bool check_view_frustrum(float fovy) {
+    const float aspect = 16.0f / 9.0f;
+    raylib::Camera3D camera({1, 2, 3}, {2, 2.2f, 3.5f}, {0, 1, 0}, fovy,
+                            CAMERA_PERSPECTIVE);
+    SPRF::ViewFrustrum frustrum(camera, aspect);
+    Matrix view = MatrixLookAt(camera.position, camera.target, camera.up);
+    Matrix projection =
+        MatrixPerspective(fovy * DEG2RAD, aspect, RL_CULL_DISTANCE_NEAR,
+                          RL_CULL_DISTANCE_FAR);
+    SPRF::CullPlanes expected =
+        SPRF::CullPlanes::from_matrix(MatrixMultiply(view, projection));
+    // the far plane extracted from the matrix loses a lot of precision (the
+    // near plane is very close), so offsets are only compared to about 1%
+    for (int i = 0; i < 6; i++) {
+        Vector4 plane = normalized_plane(frustrum.cull_planes().planes[i]);
+        bool found = false;
+        for (int j = 0; j < 6; j++) {
+            Vector4 other = normalized_plane(expected.planes[j]);
+            if ((Vector3Distance({plane.x, plane.y, plane.z},
+                                 {other.x, other.y, other.z}) < 1e-3f) &&
+                (fabsf(plane.w - other.w) < 1e-2f * fmaxf(1, fabsf(other.w))))
+                found = true;
+        }
+        if (!found) {
+            printf("fovy %g: frustum plane %d (%g %g %g %g) doesn't match "
+                   "the camera's\n",
+                   fovy, i, plane.x, plane.y, plane.z, plane.w);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    for (float fovy : {45.0f, 59.0f, 60.0f, 75.0f, 80.0f}) {
+        if (!check_view_frustrum(fovy))
+            return 1;
+    }
+
+    int n = 125000;
+    int iterations = 100;
+    if (argc > 1)
+        n = std::stoi(argv[1]);
+    if (argc > 2)
+        iterations = std::stoi(argv[2]);
+
+    srand(1234);
+    std::vector<Matrix> instances(n);
+    for (int i = 0; i < n; i++) {
+        Vector3 position = {(float)(rand() % 100) - 50,
+                            (float)(rand() % 100) - 50,
+                            (float)(rand() % 100) - 50};
+        Vector3 rotation = {(float)rand() / RAND_MAX * 6.28f,
+                            (float)rand() / RAND_MAX * 6.28f,
+                            (float)rand() / RAND_MAX * 6.28f};
+        float scale = 0.5f + (float)rand() / RAND_MAX;
+        instances[i] = MatrixMultiply(
+            MatrixMultiply(MatrixScale(scale, scale, scale),
+                           MatrixRotateXYZ(rotation)),
+            MatrixTranslate(position.x, position.y, position.z));
+    }
+    std::vector<Matrix> visible(n);
+
+    BoundingBox bbox = {{-0.25f, -0.25f, -0.25f}, {0.25f, 0.25f, 0.25f}};
+    SPRF::CullBounds bounds(bbox);
+
+    Matrix view =
+        MatrixLookAt({0, 0, 0}, {1, 0.2f, 0.5f}, {0, 1, 0});
+    Matrix projection =
+        MatrixPerspective(45 * DEG2RAD, 16.0 / 9.0, 0.01, 1000.0);
+    SPRF::CullPlanes planes =
+        SPRF::CullPlanes::from_matrix(MatrixMultiply(view, projection));
+
+    size_t n_scalar = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        n_scalar = SPRF::cull_instances_scalar(planes, bounds, instances.data(),
+                                               n, visible.data());
+    }
+    double scalar_ms = time_ms(start) / iterations;
+
+    size_t n_simd = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        n_simd = SPRF::cull_instances(planes, bounds, instances.data(), n,
+                                      visible.data());
+    }
+    double simd_ms = time_ms(start) / iterations;
+
+    printf("%d instances, %zu visible\n", n, n_simd);
+    printf("scalar: %.3f ms (%.2f ns/instance)\n", scalar_ms,
+           scalar_ms * 1e6 / n);
+    printf("simd:   %.3f ms (%.2f ns/instance)\n", simd_ms, simd_ms * 1e6 / n);
+    if (n_scalar != n_simd) {
+        printf("mismatch: scalar found %zu visible\n", n_scalar);
+        return 1;
+    }
+    return 0;
+}
@@ -41,19 +41,22 @@ class PlayerComponent : public Component {
     }
 
     void update() {
-        m_transform->position = m_network_entity->position;
-        m_transform->rotation.y = m_network_entity->rotation.y;
+        m_transform->position(m_network_entity->position);
+        vec3 rotation = m_transform->rotation();
+        rotation.y = m_network_entity->rotation.y;
+        m_transform->rotation(rotation);
         //m_head_transform->rotation.x = m_network_entity->rotation.x;
+        auto& commands = this->entity()->scene()->commands();
         if (m_network_entity->active && (!m_enabled)) {
             for (auto& i : this->entity()->children()) {
                 TraceLog(LOG_INFO, "enabling");
-                i->enable();
+                commands.enable(i->handle());
             }
             m_enabled = true;
         } else if ((!m_network_entity->active) && (m_enabled)) {
             for (auto& i : this->entity()->children()) {
                 TraceLog(LOG_INFO, "disabling");
-                i->disable();
+                commands.disable(i->handle());
             }
             m_enabled = false;
         }
@@ -67,24 +70,32 @@ class PlayerComponent : public Component {
 
 void init_player(Entity* player) {
     TraceLog(LOG_INFO, "initializing player");
-    auto player_model = player->scene()->renderer()->create_render_model("assets/xbot_rigged3.glb");
+    // every player draws from the same models, in one instanced draw per
+    // mesh (each in its own pose, the player model is skinned on the GPU)
+    auto player_model = player->scene()->renderer()->shared_render_model("assets/xbot_rigged3.glb");
+    if (!player_model->skinned()){
+        player_model = player->scene()->renderer()->create_render_model("assets/xbot_rigged3.glb");
+    }
+    if (player_model->lods() == 1){
+        player_model->generate_lods();
+    }
 
     player->add_component<PlayerComponent>();
     auto player_model_entity = player->create_child();
     auto player_model_model = player_model_entity->add_component<Model>(player_model);
-    player_model_entity->get_component<Transform>()->scale = vec3(0.01,0.01,0.01) * PLAYER_HEIGHT;
-    player_model_entity->get_component<Transform>()->rotation = vec3(M_PI_2,0,0);
-    player_model_entity->get_component<Transform>()->position = vec3(0,-0.5,0);
+    player_model_entity->get_component<Transform>()->scale(vec3(0.01,0.01,0.01) * PLAYER_HEIGHT);
+    player_model_entity->get_component<Transform>()->rotation(vec3(M_PI_2,0,0));
+    player_model_entity->get_component<Transform>()->position(vec3(0,-0.5,0));
     auto animator = player_model_entity->add_component<ModelAnimator>(player_model_entity,"assets/xbot_rigged3.glb",player_model_model);
     animator->play_animation("idle");
 
-    auto gun_model = player->scene()->renderer()->create_render_model("assets/ak47.glb");
+    auto gun_model = player->scene()->renderer()->shared_render_model("assets/ak47.glb");
     auto gun_entity = player_model_entity->find_entity("mixamorig:RightHand")->create_child();
     gun_entity->add_component<Model>(gun_model);
     //gun_entity->add_component<Selectable>(true,true);
-    gun_entity->get_component<Transform>()->position = vec3(4,6,-18);
-    gun_entity->get_component<Transform>()->rotation = vec3(-M_PI_2,0,M_PI_2);
-    gun_entity->get_component<Transform>()->scale = vec3(20,20,20);
+    gun_entity->get_component<Transform>()->position(vec3(4,6,-18));
+    gun_entity->get_component<Transform>()->rotation(vec3(-M_PI_2,0,M_PI_2));
+    gun_entity->get_component<Transform>()->scale(vec3(20,20,20));
 }
 
 class LocalSceneServerCommands : public DevConsoleCommand {
@@ -134,9 +145,9 @@ class GameScene : public DefaultScene{
             auto hands_model_entity = hands_entity->create_child("hands_model");
             auto hands_model_component = hands_model_entity->add_component<Model>(hands_model);
             //hands_model_entity->add_component<Selectable>(true,true);
-            hands_entity->get_component<Transform>()->scale = vec3(0.01,0.01,0.01);
-            hands_entity->get_component<Transform>()->rotation = vec3(M_PI_2,-0.7,0);
-            hands_entity->get_component<Transform>()->position = vec3(-0.1,-1.7,0.2);
+            hands_entity->get_component<Transform>()->scale(vec3(0.01,0.01,0.01));
+            hands_entity->get_component<Transform>()->rotation(vec3(M_PI_2,-0.7,0));
+            hands_entity->get_component<Transform>()->position(vec3(-0.1,-1.7,0.2));
             hands_entity->add_component<Selectable>(true,true);
             auto model_animator = hands_model_entity->add_component<ModelAnimator>(hands_model_entity,"assets/xbot_hands.glb",hands_model_component);
             model_animator->play_animation("idle");
@@ -146,9 +157,9 @@ class GameScene : public DefaultScene{
             auto gun_entity2 = hands_model_entity->find_entity("mixamorig:RightHand")->create_child();
             gun_entity2->add_component<Model>(gun_model);
             gun_entity2->add_component<Selectable>(true,true);
-            gun_entity2->get_component<Transform>()->position = vec3(6,0,-18);
-            gun_entity2->get_component<Transform>()->rotation = vec3(-M_PI_2,0.1,0.8);
-            gun_entity2->get_component<Transform>()->scale = vec3(20,20,20);
+            gun_entity2->get_component<Transform>()->position(vec3(6,0,-18));
+            gun_entity2->get_component<Transform>()->rotation(vec3(-M_PI_2,0.1,0.8));
+            gun_entity2->get_component<Transform>()->scale(vec3(20,20,20));
 
             player->get_child(0)->add_component<MouseLook>();
             player->get_child(0)->add_component<SoundListener>();
@@ -60,8 +60,8 @@ class IKNode{
             rotation(rot);
             m_entity = solver.entity()->create_child();
             m_entity->add_component<Model>(solver.node_model());
-            m_entity->get_component<Transform>()->position = position();
-            m_entity->get_component<Transform>()->rotation = rotation();
+            m_entity->get_component<Transform>()->position(position());
+            m_entity->get_component<Transform>()->rotation(rotation());
             //m_raw->rotation_weight = 1.0f;
         }
         IKNode(IKSolver& solver, IKNode* parent, raylib::Vector3 pos = raylib::Vector3(0,0,0), raylib::Vector3 rot = raylib::Vector3(0,0,0)) : m_solver(solver), m_id(m_solver.next_id()), m_raw(m_solver.raw()->node->create_child(parent->raw(), m_id)){
@@ -69,14 +69,14 @@ class IKNode{
             rotation(rot);
             m_entity = parent->entity()->create_child();
             m_entity->add_component<Model>(solver.node_model());
-            m_entity->get_component<Transform>()->position = position();
-            m_entity->get_component<Transform>()->rotation = rotation();
+            m_entity->get_component<Transform>()->position(position());
+            m_entity->get_component<Transform>()->rotation(rotation());
             //m_raw->rotation_weight = 1.0f;
         }
 
         void update(){
-            m_entity->get_component<Transform>()->position = position();
-            m_entity->get_component<Transform>()->rotation = rotation();
+            m_entity->get_component<Transform>()->position(position());
+            m_entity->get_component<Transform>()->rotation(rotation());
             for (auto& i : m_children){
                 i->update();
             }
@@ -131,8 +131,8 @@ class IKEffector : public Component{
         }
 
         void init(){
-            position(this->entity()->get_component<Transform>()->position);
-            rotation(this->entity()->get_component<Transform>()->rotation);
+            position(this->entity()->get_component<Transform>()->position());
+            rotation(this->entity()->get_component<Transform>()->rotation());
         }
 
         raylib::Vector3 position(){
@@ -157,54 +157,55 @@ class IKEffector : public Component{
 
         void update(){
             if (m_movable){
+                Transform* transform = this->entity()->get_component<Transform>();
                 if (IsKeyDown(KEY_UP)){
                     if (IsKeyDown(KEY_P)){
-                        this->entity()->get_component<Transform>()->rotation.z += game_info.frame_time;
+                        transform->rotation(transform->rotation() + vec3(0, 0, game_info.frame_time));
                     }
                     else {
-                        this->entity()->get_component<Transform>()->position.z += game_info.frame_time;
+                        transform->position(transform->position() + vec3(0, 0, game_info.frame_time));
                     }
                     m_diffed = true;
                 }
                 if (IsKeyDown(KEY_DOWN)){
                     if (IsKeyDown(KEY_P)){
-                        this->entity()->get_component<Transform>()->rotation.z -= game_info.frame_time;
+                        transform->rotation(transform->rotation() - vec3(0, 0, game_info.frame_time));
                     }
                     else {
-                        this->entity()->get_component<Transform>()->position.z -= game_info.frame_time;
+                        transform->position(transform->position() - vec3(0, 0, game_info.frame_time));
                     }
                     m_diffed = true;
                 }
                 if (IsKeyDown(KEY_LEFT)){
                     if (IsKeyDown(KEY_P)){
-                        this->entity()->get_component<Transform>()->rotation.x -= game_info.frame_time;
+                        transform->rotation(transform->rotation() - vec3(game_info.frame_time, 0, 0));
                     }
                     else {
-                        this->entity()->get_component<Transform>()->position.x -= game_info.frame_time;
+                        transform->position(transform->position() - vec3(game_info.frame_time, 0, 0));
                     }
                     m_diffed = true;
                 }
                 if (IsKeyDown(KEY_RIGHT)){
                     if (IsKeyDown(KEY_P)){
-                        this->entity()->get_component<Transform>()->rotation.x += game_info.frame_time;
+                        transform->rotation(transform->rotation() + vec3(game_info.frame_time, 0, 0));
                     }
                     else {
-                        this->entity()->get_component<Transform>()->position.x += game_info.frame_time;
+                        transform->position(transform->position() + vec3(game_info.frame_time, 0, 0));
                     }
                     m_diffed = true;
                 }
                 if (IsKeyDown(KEY_M)){
-                    this->entity()->get_component<Transform>()->position.y -= game_info.frame_time;
+                    transform->position(transform->position() - vec3(0, game_info.frame_time, 0));
                     m_diffed = true;
                 }
                 if (IsKeyDown(KEY_N)){
-                    this->entity()->get_component<Transform>()->position.y += game_info.frame_time;
+                    transform->position(transform->position() + vec3(0, game_info.frame_time, 0));
                     m_diffed = true;
                 }
             }
 
-            position(this->entity()->get_component<Transform>()->position);
-            rotation(this->entity()->get_component<Transform>()->rotation);
+            position(this->entity()->get_component<Transform>()->position());
+            rotation(this->entity()->get_component<Transform>()->rotation());
         }
 
         bool diff(){
@@ -286,7 +287,7 @@ class IKComponent : public Component{
             m_effectors.push_back(effector);
             effector->add_component<IKEffector>(m_solver,right_hand,2,true);
             effector->add_component<Model>(m_solver.effector_model());
-            effector->get_component<Transform>()->position = raylib::Vector3(0,0,0).Transform(right_hand->entity()->global_transform());
+            effector->get_component<Transform>()->position(raylib::Vector3(0,0,0).Transform(right_hand->entity()->global_transform()));
 
             /*int effs[] = {6};
             for (int i = 0; i < sizeof(effs)/sizeof(int); i++){
@@ -294,7 +295,7 @@ class IKComponent : public Component{
                 m_effectors.push_back(effector);
                 effector->add_component<IKEffector>(m_solver,m_nodes[effs[i]],2,true);
                 effector->add_component<Model>(m_solver.effector_model());
-                effector->get_component<Transform>()->position = (raylib::Vector3(current_anim.framePoses[0][effs[i]].translation)) * 0.01;
+                effector->get_component<Transform>()->position((raylib::Vector3(current_anim.framePoses[0][effs[i]].translation)) * 0.01);
             }*/
 
             /*int effs2[] = {34};
@@ -303,7 +304,7 @@ class IKComponent : public Component{
                 m_effectors.push_back(effector);
                 effector->add_component<IKEffector>(m_solver,m_nodes[effs2[i]],1,false);
                 effector->add_component<Model>(m_solver.effector_model());
-                effector->get_component<Transform>()->position = (raylib::Vector3(current_anim.framePoses[0][effs2[i]].translation) - raylib::Vector3(current_anim.framePoses[0][0].translation)) * 0.01;
+                effector->get_component<Transform>()->position((raylib::Vector3(current_anim.framePoses[0][effs2[i]].translation) - raylib::Vector3(current_anim.framePoses[0][0].translation)) * 0.01);
             }*/
 
             //int effs3[] = {10};
@@ -312,7 +313,7 @@ class IKComponent : public Component{
             //    m_effectors.push_back(effector);
             //    effector->add_component<IKEffector>(m_solver,m_nodes[effs3[i]],2,true);
             //    effector->add_component<Model>(m_solver.effector_model());
-            //    effector->get_component<Transform>()->position = (raylib::Vector3(current_anim.framePoses[0][effs3[i]].translation)) * 0.01;
+            //    effector->get_component<Transform>()->position((raylib::Vector3(current_anim.framePoses[0][effs3[i]].translation)) * 0.01);
             //}
 
             ik.solver.set_tree(m_solver.raw(), m_root->raw());
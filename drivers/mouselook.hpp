@@ -38,15 +38,14 @@ class MouseLook : public Component {
             vec2(game_settings.float_values["m_yaw"],
                             game_settings.float_values["m_pitch"]) *
             game_settings.float_values["m_sensitivity"];
-        this->entity()->get_component<Transform>()->rotation.x += mouse_delta.y;
-        this->entity()->get_component<Transform>()->rotation.y -= mouse_delta.x;
-
-        this->entity()->get_component<Transform>()->rotation.y =
-            Wrap(this->entity()->get_component<Transform>()->rotation.y, 0,
-                 2 * M_PI);
-        this->entity()->get_component<Transform>()->rotation.x =
-            Clamp(this->entity()->get_component<Transform>()->rotation.x,
-                  -M_PI * 0.5f + 0.5, M_PI * 0.5f - 0.5);
+        Transform* transform = this->entity()->get_component<Transform>();
+        vec3 rotation = transform->rotation();
+        rotation.x += mouse_delta.y;
+        rotation.y -= mouse_delta.x;
+
+        rotation.y = Wrap(rotation.y, 0, 2 * M_PI);
+        rotation.x = Clamp(rotation.x, -M_PI * 0.5f + 0.5, M_PI * 0.5f - 0.5);
+        transform->rotation(rotation);
     }
 };
 
@@ -15,11 +15,10 @@ class TestScene : public DefaultScene {
         light->fov(70);
 
         auto origin = this->create_entity();
-        origin->get_component<Transform>()->position.y = 0.5;
-        // origin->get_component<Transform>()->position.z = 10;
+        origin->get_component<Transform>()->position(vec3(0, 0.5, 0));
+        // origin->get_component<Transform>()->position(vec3(0, 0.5, 10));
         auto camera = origin->create_child();
-        camera->get_component<Transform>()->position.z = -10;
-        camera->get_component<Transform>()->position.y = 0;
+        camera->get_component<Transform>()->position(vec3(0, 0, -10));
         camera->add_component<Camera>();
         camera->get_component<Camera>()->set_active();
 
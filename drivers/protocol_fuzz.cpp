@@ -0,0 +1,275 @@
+// GENERATED by gen_protocol.py from protocol.json, don't edit by
+// hand.
+//
+// Fuzzes the generated decoders: every packet is round tripped with
+// random values, every truncation of it, a trailing byte and the
+// wrong packet type are rejected, and corrupted and random packets
+// decode (or don't) without reading past the end. Build with
+// -fsanitize=address to catch overreads.
+//
+// Usage: protocol_fuzz [iterations] [seed]
+
+#include "networking/protocol.hpp"
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+/** @brief Most elements in a random array, to keep packets small */
+#define SPRF_FUZZ_MAX_ELEMENTS 8
+
+using namespace SPRF;
+
+static std::mt19937 rng(1234);
+static int failures = 0;
+
+static float random_float(float min, float max) {
+    return std::uniform_real_distribution<float>(min, max)(rng);
+}
+
+/**
+ * @brief A string of random bytes, sometimes exactly `max` long.
+ */
+static std::string random_string(size_t max) {
+    size_t size = (rng() % 8 == 0) ? max : rng() % (MIN(max, 32) + 1);
+    std::string out(size, ' ');
+    for (auto& c : out) {
+        c = (char)rng();
+    }
+    return out;
+}
+
+static void randomize(ping_msg& msg);
+static void randomize(ping_response_msg& msg);
+static void randomize(user_action_msg& msg);
+static void randomize(ball_state_msg& msg);
+static void randomize(player_state_msg& msg);
+static void randomize(game_state_msg& msg);
+static void randomize(ball_state_compact_msg& msg);
+static void randomize(player_state_compact_msg& msg);
+static void randomize(game_state_compact_msg& msg);
+static void randomize(game_event_msg& msg);
+static void randomize(game_events_msg& msg);
+static void randomize(handshake_msg& msg);
+
+static void randomize(ping_msg& msg) {
+    msg.ping = (enet_uint32)rng();
+}
+
+static void randomize(ping_response_msg& msg) {
+    msg.ping_return = (enet_uint32)rng();
+    msg.server_time = (enet_uint32)rng();
+}
+
+static void randomize(user_action_msg& msg) {
+    msg.ping = (enet_uint32)rng();
+    msg.forward = rng() & 1;
+    msg.backward = rng() & 1;
+    msg.left = rng() & 1;
+    msg.right = rng() & 1;
+    msg.jump = rng() & 1;
+    msg.rotation.x = random_float(-10.0f, 10.0f);
+    msg.rotation.y = random_float(-10.0f, 10.0f);
+    msg.rotation.z = random_float(-10.0f, 10.0f);
+}
+
+static void randomize(ball_state_msg& msg) {
+    msg.position.x = random_float(-1000.0f, 1000.0f);
+    msg.position.y = random_float(-1000.0f, 1000.0f);
+    msg.position.z = random_float(-1000.0f, 1000.0f);
+    msg.rotation.x = random_float(-10.0f, 10.0f);
+    msg.rotation.y = random_float(-10.0f, 10.0f);
+    msg.rotation.z = random_float(-10.0f, 10.0f);
+}
+
+static void randomize(player_state_msg& msg) {
+    msg.id = (enet_uint32)rng();
+    msg.position.x = random_float(-1000.0f, 1000.0f);
+    msg.position.y = random_float(-1000.0f, 1000.0f);
+    msg.position.z = random_float(-1000.0f, 1000.0f);
+    msg.velocity.x = random_float(-64.0f, 64.0f);
+    msg.velocity.y = random_float(-64.0f, 64.0f);
+    msg.velocity.z = random_float(-64.0f, 64.0f);
+    msg.rotation.x = random_float(-10.0f, 10.0f);
+    msg.rotation.y = random_float(-10.0f, 10.0f);
+    msg.rotation.z = random_float(-10.0f, 10.0f);
+    msg.health = random_float(0.0f, 255.0f);
+}
+
+static void randomize(game_state_msg& msg) {
+    msg.tick = (enet_uint32)rng();
+    msg.partial = rng() & 1;
+    randomize(msg.ball);
+    msg.players.resize(rng() % (MIN(255, SPRF_FUZZ_MAX_ELEMENTS) + 1));
+    for (auto& i : msg.players) {
+        randomize(i);
+    }
+}
+
+static void randomize(ball_state_compact_msg& msg) {
+    msg.position.x = random_float(-256.0f, 256.0f);
+    msg.position.y = random_float(-256.0f, 256.0f);
+    msg.position.z = random_float(-256.0f, 256.0f);
+    msg.rotation.x = random_float(-10.0f, 10.0f);
+    msg.rotation.y = random_float(-10.0f, 10.0f);
+    msg.rotation.z = random_float(-10.0f, 10.0f);
+}
+
+static void randomize(player_state_compact_msg& msg) {
+    msg.id = (enet_uint32)rng();
+    msg.position.x = random_float(-256.0f, 256.0f);
+    msg.position.y = random_float(-256.0f, 256.0f);
+    msg.position.z = random_float(-256.0f, 256.0f);
+    msg.velocity.x = random_float(-64.0f, 64.0f);
+    msg.velocity.y = random_float(-64.0f, 64.0f);
+    msg.velocity.z = random_float(-64.0f, 64.0f);
+    msg.pitch = random_float(-10.0f, 10.0f);
+    msg.yaw = random_float(-10.0f, 10.0f);
+}
+
+static void randomize(game_state_compact_msg& msg) {
+    msg.tick = (enet_uint32)rng();
+    msg.partial = rng() & 1;
+    randomize(msg.ball);
+    msg.players.resize(rng() % (MIN(255, SPRF_FUZZ_MAX_ELEMENTS) + 1));
+    for (auto& i : msg.players) {
+        randomize(i);
+    }
+}
+
+static void randomize(game_event_msg& msg) {
+    msg.type = (game_event_t)(rng() % GAME_EVENT_COUNT);
+    msg.source = (enet_uint32)rng();
+    msg.payload = random_string(256);
+}
+
+static void randomize(game_events_msg& msg) {
+    msg.tick = (enet_uint32)rng();
+    msg.events.resize(rng() % (MIN(4096, SPRF_FUZZ_MAX_ELEMENTS) + 1));
+    for (auto& i : msg.events) {
+        randomize(i);
+    }
+}
+
+static void randomize(handshake_msg& msg) {
+    msg.protocol_version = (enet_uint32)rng();
+    msg.id = (enet_uint32)rng();
+    msg.tickrate = (enet_uint32)rng();
+    msg.current_time = (enet_uint32)rng();
+    msg.ball_radius = random_float(-1000.0f, 1000.0f);
+}
+
+template <class T> static std::vector<enet_uint8> encode(const T& msg) {
+    PacketWriter out;
+    out.write_u8(T::packet_type);
+    msg.encode(out);
+    return std::vector<enet_uint8>(out.data(), out.data() + out.size());
+}
+
+/**
+ * @brief Decode the first `size` bytes, copied so that reading past them is
+ * reading past the end of an allocation.
+ */
+template <class T>
+static bool decode(const std::vector<enet_uint8>& bytes, size_t size,
+                   T& msg) {
+    enet_uint8* copy = new enet_uint8[size];
+    memcpy(copy, bytes.data(), size);
+    ENetPacket packet = {};
+    packet.data = copy;
+    packet.dataLength = size;
+    bool ok = decode_packet(&packet, msg);
+    delete[] copy;
+    return ok;
+}
+
+template <class T>
+static bool decode(const std::vector<enet_uint8>& bytes, T& msg) {
+    return decode(bytes, bytes.size(), msg);
+}
+
+static void fail(const char* name, const char* check, int iteration) {
+    printf("FAIL: %s: %s (iteration %d)\n", name, check, iteration);
+    failures++;
+}
+
+/**
+ * @brief Anything that decodes has to encode into something that decodes.
+ */
+template <class T>
+static void check_decoded(const char* name, const char* check,
+                          const std::vector<enet_uint8>& bytes,
+                          int iteration) {
+    T msg;
+    if (!decode(bytes, msg))
+        return;
+    T again;
+    if (!decode(encode(msg), again))
+        fail(name, check, iteration);
+}
+
+template <class T> static void fuzz(const char* name, int iterations) {
+    size_t total = 0;
+    for (int i = 0; i < iterations; i++) {
+        T msg;
+        randomize(msg);
+        std::vector<enet_uint8> bytes = encode(msg);
+        total += bytes.size();
+        T decoded;
+        if (!decode(bytes, decoded) || (encode(decoded) != bytes))
+            fail(name, "round trip", i);
+        for (size_t n = 0; n < bytes.size(); n++) {
+            T truncated;
+            if (decode(bytes, n, truncated))
+                fail(name, "truncated packet decoded", i);
+        }
+        std::vector<enet_uint8> padded = bytes;
+        padded.push_back((enet_uint8)rng());
+        T trailing;
+        if (decode(padded, trailing))
+            fail(name, "trailing byte decoded", i);
+        std::vector<enet_uint8> retyped = bytes;
+        retyped[0] = (T::packet_type + 1 + rng() % (PACKET_COUNT - 1)) %
+                     PACKET_COUNT;
+        T wrong;
+        if (decode(retyped, wrong))
+            fail(name, "wrong packet type decoded", i);
+
+        std::vector<enet_uint8> corrupted = bytes;
+        for (int j = 0; j < 4; j++) {
+            size_t at = 1 + rng() % (corrupted.size() - 1);
+            corrupted[at] ^= 1 << (rng() % 8);
+        }
+        check_decoded<T>(name, "corrupted packet", corrupted, i);
+        std::vector<enet_uint8> noise(1 + rng() % (2 * bytes.size()));
+        for (auto& b : noise) {
+            b = (enet_uint8)rng();
+        }
+        noise[0] = T::packet_type;
+        check_decoded<T>(name, "random packet", noise, i);
+    }
+    printf("%s: %d packets, %zu bytes on average\n", name, iterations,
+           iterations > 0 ? total / iterations : 0);
+}
+
+int main(int argc, char** argv) {
+    int iterations = 1000;
+    if (argc > 1)
+        iterations = std::stoi(argv[1]);
+    if (argc > 2)
+        rng.seed(std::stoul(argv[2]));
+    printf("protocol version %d\n", PROTOCOL_VERSION);
+    fuzz<ping_msg>("ping", iterations);
+    fuzz<ping_response_msg>("ping_response", iterations);
+    fuzz<user_action_msg>("user_action", iterations);
+    fuzz<game_state_msg>("game_state", iterations);
+    fuzz<game_state_compact_msg>("game_state_compact", iterations);
+    fuzz<game_events_msg>("game_events", iterations);
+    fuzz<handshake_msg>("handshake", iterations);
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
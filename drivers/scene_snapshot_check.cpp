@@ -0,0 +1,221 @@
+#include "engine/engine.hpp"
+#include "engine/scene_snapshot.hpp"
+#include "networking/map.hpp"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Checks scene snapshots round trip: a hand built hierarchy is saved and
+// loaded back (into a scene and under a parent) and compared entity by
+// entity, broken files are rejected, and a map loaded from its snapshot
+// matches the map built from scratch. Needs a GL context for the renderer,
+// so it opens a hidden window; run it from the build directory (assets).
+
+namespace SPRF {
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static bool same_vec3(vec3 a, vec3 b) {
+    return Vector3Distance(a, b) < 1e-6f;
+}
+
+/**
+ * @brief Whether two render models are the same resource, or were made the
+ * same way (for models that belong to different scenes).
+ */
+static bool same_render_model(RenderModel* a, RenderModel* b) {
+    if (a == b)
+        return true;
+    if ((!a) || (!b) || (a->clip() != b->clip()) ||
+        (a->model()->meshCount != b->model()->meshCount))
+        return false;
+    for (int i = 0; i < a->model()->meshCount; i++) {
+        if (a->model()->meshes[i].vertexCount !=
+            b->model()->meshes[i].vertexCount)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Compare two hierarchies: names, enabled flags, transforms and the
+ * components snapshots keep.
+ */
+static void compare(Entity* a, Entity* b, const std::string& path) {
+    std::string where = path + "/" + a->name();
+    check(a->name() == b->name(), where + ": name " + b->name());
+    check(a->enabled() == b->enabled(), where + ": enabled");
+    Transform* ta = a->get_component<Transform>();
+    Transform* tb = b->get_component<Transform>();
+    check(same_vec3(ta->position(), tb->position()), where + ": position");
+    check(same_vec3(ta->rotation(), tb->rotation()), where + ": rotation");
+    check(same_vec3(ta->scale(), tb->scale()), where + ": scale");
+    check(a->has_component<Model>() == b->has_component<Model>(),
+          where + ": Model");
+    if (a->has_component<Model>() && b->has_component<Model>()) {
+        Model* ma = a->get_component<Model>();
+        Model* mb = b->get_component<Model>();
+        check(ma->enabled() == mb->enabled(), where + ": Model enabled");
+        check(same_render_model(ma->render_model(), mb->render_model()),
+              where + ": Model render model");
+    }
+    check(a->n_children() == b->n_children(), where + ": children");
+    for (size_t i = 0; (i < a->n_children()) && (i < b->n_children()); i++) {
+        compare(a->get_child(i), b->get_child(i), where);
+    }
+}
+
+static void set_transform(Entity* entity, vec3 position, vec3 rotation,
+                          vec3 scale) {
+    Transform* transform = entity->get_component<Transform>();
+    transform->position(position);
+    transform->rotation(rotation);
+    transform->scale(scale);
+}
+
+static void check_round_trip(const std::string& filename) {
+    Scene original;
+    RenderModel* cube = original.renderer()->create_render_model(
+        raylib::Mesh::Cube(1, 2, 3));
+    RenderModel* sphere = original.renderer()->create_render_model(
+        raylib::Mesh::Sphere(1, 8, 8));
+
+    Entity* root = original.create_entity("root");
+    set_transform(root, vec3(1, 2, 3), vec3(0.1, 0.2, 0.3), vec3(1, 1, 2));
+    root->add_component<Model>(cube);
+    Entity* hidden = root->create_child("hidden");
+    set_transform(hidden, vec3(-1, 0, 5), vec3(0, 3, 0), vec3(0.5, 0.5, 0.5));
+    hidden->add_component<Model>(sphere)->disable();
+    hidden->disable();
+    Entity* empty = hidden->create_child("");
+    set_transform(empty, vec3(0, 0, -2), vec3(0, 0, 1), vec3(1, 1, 1));
+    Entity* shared = root->create_child("shared cube");
+    shared->add_component<Model>(cube);
+    Entity* other = original.create_entity("other root");
+    other->add_component<Model>(sphere);
+
+    std::vector<void*> resources;
+    std::vector<Entity*> roots = {root, other};
+    check(SceneSnapshot::save(filename, roots, resources, 42), "save");
+    check(resources.size() == 2, "two resources");
+    check(SceneSnapshot::matches(filename, 42), "matches its source");
+    check(!SceneSnapshot::matches(filename, 43), "matches another source");
+
+    Scene loaded;
+    std::vector<Entity*> loaded_roots =
+        SceneSnapshot::load(filename, &loaded, resources);
+    check(loaded_roots.size() == roots.size(), "root count");
+    for (size_t i = 0; (i < roots.size()) && (i < loaded_roots.size()); i++) {
+        compare(roots[i], loaded_roots[i], "");
+    }
+
+    Entity* parent = loaded.create_entity("parent");
+    std::vector<Entity*> children =
+        SceneSnapshot::load(filename, &loaded, resources, parent);
+    check((children.size() == roots.size()) &&
+              (parent->n_children() == roots.size()),
+          "load under a parent");
+    for (size_t i = 0; (i < roots.size()) && (i < children.size()); i++) {
+        check(children[i]->parent() == parent, "parent of loaded root");
+        compare(roots[i], children[i], "parent");
+    }
+}
+
+static std::string read_file(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>());
+}
+
+static void write_file(const std::string& filename, const std::string& data) {
+    std::ofstream file(filename, std::ios::binary);
+    file.write(data.data(), data.size());
+}
+
+static void check_broken(const std::string& filename) {
+    std::string data = read_file(filename);
+    std::string broken_name = filename + ".broken";
+    std::vector<void*> resources = {NULL, NULL};
+    Scene scene;
+
+    write_file(broken_name, data.substr(0, data.size() / 2));
+    check(!SceneSnapshot::matches(broken_name, 42), "truncated matches");
+    check(SceneSnapshot::load(broken_name, &scene, resources).empty(),
+          "truncated loads");
+
+    // the first entity claims a parent after it
+    std::string bad_parent = data;
+    SnapshotHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+    uint32_t parent = 5;
+    memcpy(&bad_parent[header.entities_offset], &parent, sizeof(parent));
+    write_file(broken_name, bad_parent);
+    check(SceneSnapshot::load(broken_name, &scene, resources).empty(),
+          "bad parent loads");
+
+    std::string bad_version = data;
+    uint32_t version = SCENE_SNAPSHOT_VERSION + 1;
+    memcpy(&bad_version[offsetof(SnapshotHeader, version)], &version,
+           sizeof(version));
+    write_file(broken_name, bad_version);
+    check(SceneSnapshot::load(broken_name, &scene, resources).empty(),
+          "other version loads");
+
+    check(scene.entities().empty(), "broken snapshots created entities");
+    remove(broken_name.c_str());
+}
+
+static void check_map(const std::string& filename) {
+    remove(filename.c_str());
+    auto map = simple_map();
+    Scene built;
+    map->load(&built, filename);
+    std::string baked = read_file(filename);
+    check(baked.size() > 0, "map snapshot baked");
+    Scene cached;
+    map->load(&cached, filename);
+    check(read_file(filename) == baked, "map snapshot rebaked");
+    Entity* a = built.find_entity("sprf_map");
+    Entity* b = cached.find_entity("sprf_map");
+    check(a && b, "sprf_map");
+    if (a && b)
+        compare(a, b, "");
+
+    // a changed map doesn't load the old snapshot
+    auto spawn = std::make_shared<MapPositionElement>("spawn");
+    spawn->add_instance(vec3(1, 2, 3), vec3(0, 0, 0));
+    map->add_element(spawn);
+    Scene changed;
+    map->load(&changed, filename);
+    Entity* c = changed.find_entity("sprf_map");
+    check(c && a && (c->n_children() == a->n_children() + 1),
+          "stale map snapshot loaded");
+    check(read_file(filename) != baked, "changed map rebaked");
+}
+
+} // namespace SPRF
+
+int main() {
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    raylib::Window window(64, 64, "scene_snapshot_check");
+    std::string filename = "scene_snapshot_check.snapshot";
+    SPRF::check_round_trip(filename);
+    SPRF::check_broken(filename);
+    remove(filename.c_str());
+    SPRF::check_map("scene_snapshot_check_map.snapshot");
+    remove("scene_snapshot_check_map.snapshot");
+    if (SPRF::failures) {
+        printf("%d checks failed\n", SPRF::failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
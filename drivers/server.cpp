@@ -36,6 +36,9 @@ int main(int argc, char** argv) {
             server.quit();
             break;
         }
+        if (command == "metrics") {
+            std::cout << server.metrics();
+        }
     }
 
     server.join();
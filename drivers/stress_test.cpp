@@ -36,7 +36,7 @@ class MyScene : public TestScene {
                     float z = k - (nz/2);
                     auto sphere = this->create_entity("sphere_" + std::to_string(count));
                     sphere->add_component<Model>(model);
-                    sphere->get_component<Transform>()->position = vec3(x,y,z);
+                    sphere->get_component<Transform>()->position(vec3(x,y,z));
                     count++;
                 }
             }
@@ -14,21 +14,22 @@ class Rotation : public Component {
     void init() { transform = this->entity()->get_component<Transform>(); }
     void update() {
         if (!IsKeyDown(KEY_Z)) {
-            transform->rotation.y -= GetMouseWheelMoveV().x * 0.2;
-            transform->rotation.x += GetMouseWheelMoveV().y * 0.2;
+            transform->rotation(transform->rotation() +
+                                vec3(GetMouseWheelMoveV().y * 0.2,
+                                     -GetMouseWheelMoveV().x * 0.2, 0));
         }
         float speed = m_speed;
         if (IsKeyDown(KEY_W)) {
-            transform->position.z += game_info.frame_time * speed;
+            transform->position(transform->position() + vec3(0, 0, game_info.frame_time * speed));
         }
         if (IsKeyDown(KEY_S)) {
-            transform->position.z -= game_info.frame_time * speed;
+            transform->position(transform->position() - vec3(0, 0, game_info.frame_time * speed));
         }
         if (IsKeyDown(KEY_A)) {
-            transform->position.x += game_info.frame_time * speed;
+            transform->position(transform->position() + vec3(game_info.frame_time * speed, 0, 0));
         }
         if (IsKeyDown(KEY_D)) {
-            transform->position.x -= game_info.frame_time * speed;
+            transform->position(transform->position() - vec3(game_info.frame_time * speed, 0, 0));
         }
         // if (!game_info.dev_console_active){
         //     DisableCursor();
@@ -42,11 +43,13 @@ class Zoom : public Component {
   public:
     void update() {
         if (IsKeyDown(KEY_Z)) {
-            this->entity()->get_component<Transform>()->position.z +=
-                GetMouseWheelMoveV().y;
-            if (this->entity()->get_component<Transform>()->position.z > -1) {
-                this->entity()->get_component<Transform>()->position.z = -1;
+            Transform* transform = this->entity()->get_component<Transform>();
+            vec3 position = transform->position();
+            position.z += GetMouseWheelMoveV().y;
+            if (position.z > -1) {
+                position.z = -1;
             }
+            transform->position(position);
         }
     }
 };
@@ -62,12 +65,11 @@ class TestScene : public DefaultScene {
 
         auto origin = this->create_entity();
         origin->add_component<Rotation>();
-        origin->get_component<Transform>()->position.y = 0.5;
-        // origin->get_component<Transform>()->position.z = 10;
+        origin->get_component<Transform>()->position(vec3(0, 0.5, 0));
+        // origin->get_component<Transform>()->position(vec3(0, 0.5, 10));
         auto camera = origin->create_child();
         camera->add_component<Zoom>();
-        camera->get_component<Transform>()->position.z = -10;
-        camera->get_component<Transform>()->position.y = 0;
+        camera->get_component<Transform>()->position(vec3(0, 0, -10));
         camera->add_component<Camera>();
         camera->get_component<Camera>()->set_active();
 
@@ -84,7 +86,7 @@ class TestScene : public DefaultScene {
         plane->clip(false);
         auto plane_entity = this->create_entity();
         plane_entity->add_component<Model>(plane);
-        // plane_entity->get_component<Transform>()->position.z = 10;
+        // plane_entity->get_component<Transform>()->position(vec3(0, 0, 10));
 
         auto cube =
             this->renderer()->create_render_model(Mesh::Cube(1, 1, 1));
@@ -95,35 +97,30 @@ class TestScene : public DefaultScene {
         // cube->add_texture("assets/prototype_texture/orange-cube.png");
 
         auto sphere1 = this->create_entity();
-        sphere1->get_component<Transform>()->position.y = 0.5;
-        sphere1->get_component<Transform>()->position.z = 0.5; // + (float)10;
-        sphere1->get_component<Transform>()->rotation.y = 0;
+        sphere1->get_component<Transform>()->position(
+            vec3(0, 0.5, 0.5)); // + (float)10;
         sphere1->add_component<Model>(sphere);
 
         auto sphere2 = this->create_entity();
-        sphere2->get_component<Transform>()->position.y = 0.5;
-        sphere2->get_component<Transform>()->position.z = 0.5 + (float)2;
-        sphere2->get_component<Transform>()->rotation.y = M_PI_2;
+        sphere2->get_component<Transform>()->position(
+            vec3(0, 0.5, 0.5 + (float)2));
+        sphere2->get_component<Transform>()->rotation(vec3(0, M_PI_2, 0));
         sphere2->add_component<Model>(sphere);
 
         for (int i = -(map_z_size / 2); i < (map_z_size / 2); i++) {
             for (int y = 0; y < 5; y++) {
                 auto cube_entity = this->create_entity();
-                cube_entity->get_component<Transform>()->position.y =
-                    0.5 + (float)y;
-                cube_entity->get_component<Transform>()->position.z =
-                    0.5 + (float)i;
-                cube_entity->get_component<Transform>()->position.x =
-                    0.5 + -((float)map_x_size) * 0.5;
+                cube_entity->get_component<Transform>()->position(
+                    vec3(0.5 + -((float)map_x_size) * 0.5,
+                         0.5 + (float)y,
+                         0.5 + (float)i));
                 cube_entity->add_component<Model>(cube);
 
                 auto cube_entity2 = this->create_entity();
-                cube_entity2->get_component<Transform>()->position.y =
-                    0.5 + (float)y;
-                cube_entity2->get_component<Transform>()->position.z =
-                    0.5 + (float)i;
-                cube_entity2->get_component<Transform>()->position.x =
-                    0.5 + ((float)map_x_size) * 0.5;
+                cube_entity2->get_component<Transform>()->position(
+                    vec3(0.5 + ((float)map_x_size) * 0.5,
+                         0.5 + (float)y,
+                         0.5 + (float)i));
                 cube_entity2->add_component<Model>(cube);
             }
         }
@@ -131,21 +128,17 @@ class TestScene : public DefaultScene {
         for (int i = -(map_x_size / 2) + 1; i < (map_x_size / 2); i++) {
             for (int y = 0; y < 5; y++) {
                 auto cube_entity = this->create_entity();
-                cube_entity->get_component<Transform>()->position.y =
-                    0.5 + (float)y;
-                cube_entity->get_component<Transform>()->position.x =
-                    0.5 + (float)i;
-                cube_entity->get_component<Transform>()->position.z =
-                    0.5 + -((float)map_z_size / 2);
+                cube_entity->get_component<Transform>()->position(
+                    vec3(0.5 + (float)i,
+                         0.5 + (float)y,
+                         0.5 + -((float)map_z_size / 2)));
                 cube_entity->add_component<Model>(cube);
 
                 auto cube_entity2 = this->create_entity();
-                cube_entity2->get_component<Transform>()->position.y =
-                    0.5 + (float)y;
-                cube_entity2->get_component<Transform>()->position.x =
-                    0.5 + (float)i;
-                cube_entity2->get_component<Transform>()->position.z =
-                    0.5 + ((float)map_z_size / 2) - 1.0;
+                cube_entity2->get_component<Transform>()->position(
+                    vec3(0.5 + (float)i,
+                         0.5 + (float)y,
+                         0.5 + ((float)map_z_size / 2) - 1.0));
                 cube_entity2->add_component<Model>(cube);
             }
         }
@@ -44,8 +44,9 @@ class Rotation : public Component {
             return;
         }
         if (!IsKeyDown(KEY_Z)) {
-            transform->rotation.y -= GetMouseWheelMoveV().x * 0.2;
-            transform->rotation.x += GetMouseWheelMoveV().y * 0.2;
+            transform->rotation(transform->rotation() +
+                                vec3(GetMouseWheelMoveV().y * 0.2,
+                                     -GetMouseWheelMoveV().x * 0.2, 0));
         }
         auto cam = *this->entity()->scene()->get_active_camera();
         auto forward =
@@ -57,10 +58,10 @@ class Rotation : public Component {
                                 forward, vec3(0, 1, 0), M_PI_2))
                 .Normalize();
 
-        transform->position +=
-            forward * game_info.frame_time * m_speed * (m_forward - m_backward);
-        transform->position +=
-            left * game_info.frame_time * m_speed * (m_left - m_right);
+        transform->position(
+            transform->position() +
+            forward * game_info.frame_time * m_speed * (m_forward - m_backward) +
+            left * game_info.frame_time * m_speed * (m_left - m_right));
 
         reset_inputs();
     }
@@ -70,11 +71,13 @@ class Zoom : public Component {
   public:
     void update() {
         if (IsKeyDown(KEY_Z)) {
-            this->entity()->get_component<Transform>()->position.z +=
-                GetMouseWheelMoveV().y;
-            if (this->entity()->get_component<Transform>()->position.z > -1) {
-                this->entity()->get_component<Transform>()->position.z = -1;
+            Transform* transform = this->entity()->get_component<Transform>();
+            vec3 position = transform->position();
+            position.z += GetMouseWheelMoveV().y;
+            if (position.z > -1) {
+                position.z = -1;
             }
+            transform->position(position);
         }
     }
 };
@@ -98,13 +101,12 @@ class TestScene : public DefaultScene {
 
         auto origin = this->create_entity("origin");
         origin->add_component<Rotation>(this->dev_console());
-        origin->get_component<Transform>()->position.y = 0.5;
+        origin->get_component<Transform>()->position(vec3(0, 0.5, 0));
         origin->add_component<Selectable>();
 
         auto camera = origin->create_child("camera");
         camera->add_component<Zoom>();
-        camera->get_component<Transform>()->position.z = -10;
-        camera->get_component<Transform>()->position.y = 0;
+        camera->get_component<Transform>()->position(vec3(0, 0, -10));
         camera->add_component<Camera>();
         camera->get_component<Camera>()->set_active();
         camera->add_component<Selectable>();
@@ -0,0 +1,679 @@
+"""Generates src/networking/protocol.hpp from src/networking/protocol.json,
+and drivers/protocol_fuzz.cpp to fuzz it.
+
+The schema lists the enums and messages that go over the wire. Every message
+becomes a `<name>_msg` struct with `encode`/`decode` methods built on
+PacketWriter/PacketReader (src/networking/packet_io.hpp), so all decoding is
+bounds checked and quantization lives in one place.
+
+Field types:
+    u8, u16, u32, f32     plain values
+    bool                  consecutive bools are packed into one byte
+    vec3                  3 x f32
+    string                u16 length + bytes, "max" bytes at most
+    array                 "count" (u8/u16) + elements of message "of",
+                          "max" elements at most. The struct gets a
+                          `max_<name>` constant; encoding more is a bug
+                          (asserted), senders split or trim to fit
+    <enum>                stored as the enum's "storage" type, range checked
+    <message>             nested message
+Quantization (f32 and vec3 only):
+    "quantize": "angle16"   wrapped to [-pi, pi) in 16 bits
+    "quantize": "fixed16"   clamped to ["min", "max"] in 16 bits
+
+Bump "version" whenever the wire format changes; clients and servers with
+different versions refuse to talk to each other.
+
+protocol_fuzz round trips every packet with random values, and checks that
+truncated, padded, corrupted and random packets are rejected or decoded
+without reading past the end (build it with -fsanitize=address to be sure).
+
+Usage: python3 gen_protocol.py
+"""
+
+import json
+import os
+
+os.chdir(os.path.dirname(os.path.abspath(__file__)))
+
+SCHEMA = "src/networking/protocol.json"
+OUTPUT = "src/networking/protocol.hpp"
+FUZZ_OUTPUT = "drivers/protocol_fuzz.cpp"
+
+INTS = {"u8": "enet_uint8", "u16": "enet_uint16", "u32": "enet_uint32"}
+COUNT_LIMITS = {"u8": 255, "u16": 65535}
+COLUMNS = 80
+
+
+def fmt_float(x):
+    return repr(float(x)) + "f"
+
+
+def enum_prefix(values):
+    prefix = os.path.commonprefix(values)
+    return prefix[: prefix.rfind("_") + 1]
+
+
+class Generator:
+    def __init__(self, schema):
+        self.schema = schema
+        self.enums = schema["enums"]
+        self.messages = schema["messages"]
+        self.lines = []
+
+    def emit(self, line=""):
+        self.lines.append(line)
+
+    def emit_wrapped(self, start, terms, sep, end):
+        """Emits `start + sep.join(terms) + end`, wrapped at COLUMNS."""
+        indent = " " * len(start)
+        line = start
+        for i, term in enumerate(terms):
+            piece = term + (sep if i < len(terms) - 1 else end)
+            if line != start and line != indent and (
+                len(line) + 1 + len(piece) > COLUMNS
+            ):
+                self.emit(line)
+                line = indent
+            elif line != start and line != indent:
+                line += " "
+            line += piece
+        self.emit(line)
+
+    def count_name(self, enum):
+        return enum_prefix(self.enums[enum]["values"]) + "COUNT"
+
+    def cpp_type(self, field):
+        t = field["type"]
+        if t in INTS:
+            return INTS[t]
+        if t == "f32":
+            return "float"
+        if t == "bool":
+            return "bool"
+        if t == "vec3":
+            return "vec3"
+        if t == "string":
+            return "std::string"
+        if t == "array":
+            return "std::vector<" + field["of"] + "_msg>"
+        if t in self.enums:
+            return t
+        if t in self.messages:
+            return t + "_msg"
+        raise ValueError("unknown type " + t)
+
+    def default(self, field):
+        t = field["type"]
+        if t in INTS:
+            return " = 0"
+        if t == "f32":
+            return " = 0"
+        if t == "bool":
+            return " = false"
+        if t == "vec3":
+            return " = vec3(0, 0, 0)"
+        if t in self.enums:
+            return " = (" + t + ")0"
+        return ""
+
+    def groups(self, fields):
+        """Splits fields into single fields and runs of bools."""
+        out = []
+        for field in fields:
+            if (
+                field["type"] == "bool"
+                and out
+                and isinstance(out[-1], list)
+                and len(out[-1]) < 8
+            ):
+                out[-1].append(field)
+            elif field["type"] == "bool":
+                out.append([field])
+            else:
+                out.append(field)
+        return out
+
+    def encode_scalar(self, field, value):
+        q = field.get("quantize")
+        if q == "angle16":
+            return "out.write_angle16(" + value + ");"
+        if q == "fixed16":
+            return (
+                "out.write_fixed16("
+                + value
+                + ", "
+                + fmt_float(field["min"])
+                + ", "
+                + fmt_float(field["max"])
+                + ");"
+            )
+        return "out.write_f32(" + value + ");"
+
+    def decode_scalar(self, field, target):
+        q = field.get("quantize")
+        if q == "angle16":
+            return "in.read_angle16(&" + target + ")"
+        if q == "fixed16":
+            return (
+                "in.read_fixed16(&"
+                + target
+                + ", "
+                + fmt_float(field["min"])
+                + ", "
+                + fmt_float(field["max"])
+                + ")"
+            )
+        return "in.read_f32(&" + target + ")"
+
+    def encode_field(self, field):
+        name = field["name"]
+        t = field["type"]
+        if t in INTS:
+            self.emit("        out.write_" + t + "(" + name + ");")
+        elif t == "f32":
+            self.emit("        " + self.encode_scalar(field, name))
+        elif t == "vec3":
+            if "quantize" in field:
+                for c in "xyz":
+                    self.emit(
+                        "        " + self.encode_scalar(field, name + "." + c)
+                    )
+            else:
+                self.emit("        out.write_vec3(" + name + ");")
+        elif t == "string":
+            m = str(field["max"])
+            self.emit("        if (" + name + ".size() > " + m + ") {")
+            self.emit(
+                "            out.write_string(" + name + ".substr(0, " + m + "));"
+            )
+            self.emit("        } else {")
+            self.emit("            out.write_string(" + name + ");")
+            self.emit("        }")
+        elif t == "array":
+            c = field["count"]
+            n = "n_" + name
+            self.emit(
+                "        assert("
+                + name
+                + ".size() <= max_"
+                + name
+                + ");"
+            )
+            self.emit(
+                "        "
+                + INTS[c]
+                + " "
+                + n
+                + " = MIN("
+                + name
+                + ".size(), (size_t)"
+                + str(field["max"])
+                + ");"
+            )
+            self.emit("        out.write_" + c + "(" + n + ");")
+            self.emit("        for (size_t i = 0; i < " + n + "; i++) {")
+            self.emit("            " + name + "[i].encode(out);")
+            self.emit("        }")
+        elif t in self.enums:
+            s = self.enums[t]["storage"]
+            self.emit(
+                "        out.write_" + s + "((" + INTS[s] + ")" + name + ");"
+            )
+        elif t in self.messages:
+            self.emit("        " + name + ".encode(out);")
+
+    def decode_field(self, field):
+        name = field["name"]
+        t = field["type"]
+        if t in INTS:
+            self.emit("        if (!in.read_" + t + "(&" + name + "))")
+            self.emit("            return false;")
+        elif t == "f32":
+            self.emit("        if (!" + self.decode_scalar(field, name) + ")")
+            self.emit("            return false;")
+        elif t == "vec3":
+            if "quantize" in field:
+                for c in "xyz":
+                    self.emit(
+                        "        if (!"
+                        + self.decode_scalar(field, name + "." + c)
+                        + ")"
+                    )
+                    self.emit("            return false;")
+            else:
+                self.emit("        if (!in.read_vec3(&" + name + "))")
+                self.emit("            return false;")
+        elif t == "string":
+            self.emit(
+                "        if (!in.read_string(&"
+                + name
+                + ", "
+                + str(field["max"])
+                + "))"
+            )
+            self.emit("            return false;")
+        elif t == "array":
+            c = field["count"]
+            n = "n_" + name
+            self.emit("        " + INTS[c] + " " + n + ";")
+            self.emit("        if (!in.read_" + c + "(&" + n + "))")
+            self.emit("            return false;")
+            if field["max"] < COUNT_LIMITS[c]:
+                self.emit("        if (" + n + " > " + str(field["max"]) + ")")
+                self.emit("            return false;")
+            self.emit("        " + name + ".resize(" + n + ");")
+            self.emit("        for (auto& i : " + name + ") {")
+            self.emit("            if (!i.decode(in))")
+            self.emit("                return false;")
+            self.emit("        }")
+        elif t in self.enums:
+            s = self.enums[t]["storage"]
+            raw = "raw_" + name
+            self.emit("        " + INTS[s] + " " + raw + ";")
+            self.emit("        if (!in.read_" + s + "(&" + raw + "))")
+            self.emit("            return false;")
+            self.emit("        if (" + raw + " >= " + self.count_name(t) + ")")
+            self.emit("            return false;")
+            self.emit("        " + name + " = (" + t + ")" + raw + ";")
+        elif t in self.messages:
+            self.emit("        if (!" + name + ".decode(in))")
+            self.emit("            return false;")
+
+    def gen_enum(self, name, enum):
+        values = enum["values"]
+        self.emit("enum " + name + " : " + INTS[enum["storage"]] + " {")
+        for i, v in enumerate(values):
+            self.emit("    " + v + (" = 0," if i == 0 else ","))
+        self.emit("    " + self.count_name(name))
+        self.emit("};")
+        self.emit()
+
+    def gen_message(self, name, msg):
+        self.emit("struct " + name + "_msg {")
+        if "packet" in msg:
+            self.emit(
+                "    static const packet_type_t packet_type = "
+                + msg["packet"]
+                + ";"
+            )
+            self.emit()
+        arrays = [f for f in msg["fields"] if f["type"] == "array"]
+        for field in arrays:
+            if field["max"] > COUNT_LIMITS[field["count"]]:
+                raise ValueError(
+                    name + "." + field["name"] + ": max doesn't fit the count"
+                )
+            self.emit(
+                "    /** @brief Most `"
+                + field["name"]
+                + "` one message can carry */"
+            )
+            self.emit(
+                "    static constexpr size_t max_"
+                + field["name"]
+                + " = "
+                + str(field["max"])
+                + ";"
+            )
+        if arrays:
+            self.emit()
+        for field in msg["fields"]:
+            self.emit(
+                "    "
+                + self.cpp_type(field)
+                + " "
+                + field["name"]
+                + self.default(field)
+                + ";"
+            )
+        self.emit()
+        self.emit("    void encode(PacketWriter& out) const {")
+        for group in self.groups(msg["fields"]):
+            if isinstance(group, list):
+                terms = [
+                    "(" + f["name"] + " << " + str(i) + ")"
+                    for i, f in enumerate(group)
+                ]
+                self.emit_wrapped("        out.write_u8(", terms, " |", ");")
+            else:
+                self.encode_field(group)
+        self.emit("    }")
+        self.emit()
+        self.emit("    bool decode(PacketReader& in) {")
+        for idx, group in enumerate(self.groups(msg["fields"])):
+            if isinstance(group, list):
+                bits = "bits_" + str(idx)
+                self.emit("        enet_uint8 " + bits + ";")
+                self.emit("        if (!in.read_u8(&" + bits + "))")
+                self.emit("            return false;")
+                for i, f in enumerate(group):
+                    self.emit(
+                        "        "
+                        + f["name"]
+                        + " = "
+                        + bits
+                        + " & (1 << "
+                        + str(i)
+                        + ");"
+                    )
+            else:
+                self.decode_field(group)
+        self.emit("        return true;")
+        self.emit("    }")
+        self.emit("};")
+        self.emit()
+
+    def generate(self):
+        self.emit("/** @file protocol.hpp")
+        self.emit(" *")
+        self.emit(" * GENERATED by gen_protocol.py from protocol.json, don't edit by")
+        self.emit(" * hand. Wire messages and their bounds checked encoders/decoders.")
+        self.emit(" *")
+        self.emit(" */")
+        self.emit()
+        self.emit("#ifndef _SPRF_NETWORKING_PROTOCOL_HPP_")
+        self.emit("#define _SPRF_NETWORKING_PROTOCOL_HPP_")
+        self.emit()
+        self.emit('#include "packet_io.hpp"')
+        self.emit("#include <cassert>")
+        self.emit("#include <enet/enet.h>")
+        self.emit("#include <string>")
+        self.emit("#include <vector>")
+        self.emit()
+        self.emit("/** @brief Peers with a different version can't talk to each other */")
+        self.emit("#define PROTOCOL_VERSION (" + str(self.schema["version"]) + ")")
+        self.emit()
+        self.emit("namespace SPRF {")
+        self.emit()
+        for name, enum in self.enums.items():
+            self.gen_enum(name, enum)
+        for name, msg in self.messages.items():
+            self.gen_message(name, msg)
+        self.emit(HELPERS)
+        self.emit("} // namespace SPRF")
+        self.emit()
+        self.emit("#endif // _SPRF_NETWORKING_PROTOCOL_HPP_")
+        return "\n".join(self.lines) + "\n"
+
+
+class FuzzGenerator(Generator):
+    """Generates a driver fuzzing the encoders/decoders `Generator` makes."""
+
+    def random_scalar(self, field):
+        q = field.get("quantize")
+        if q == "angle16":
+            return "random_float(-10.0f, 10.0f)"
+        if q == "fixed16":
+            return (
+                "random_float("
+                + fmt_float(field["min"])
+                + ", "
+                + fmt_float(field["max"])
+                + ")"
+            )
+        return "random_float(-1000.0f, 1000.0f)"
+
+    def randomize_field(self, field):
+        name = "msg." + field["name"]
+        t = field["type"]
+        if t in INTS:
+            self.emit("    " + name + " = (" + INTS[t] + ")rng();")
+        elif t == "f32":
+            self.emit("    " + name + " = " + self.random_scalar(field) + ";")
+        elif t == "bool":
+            self.emit("    " + name + " = rng() & 1;")
+        elif t == "vec3":
+            r = self.random_scalar(field)
+            for c in "xyz":
+                self.emit("    " + name + "." + c + " = " + r + ";")
+        elif t == "string":
+            self.emit(
+                "    " + name + " = random_string(" + str(field["max"]) + ");"
+            )
+        elif t == "array":
+            self.emit(
+                "    "
+                + name
+                + ".resize(rng() % (MIN("
+                + str(field["max"])
+                + ", SPRF_FUZZ_MAX_ELEMENTS) + 1));"
+            )
+            self.emit("    for (auto& i : " + name + ") {")
+            self.emit("        randomize(i);")
+            self.emit("    }")
+        elif t in self.enums:
+            self.emit(
+                "    "
+                + name
+                + " = ("
+                + t
+                + ")(rng() % "
+                + self.count_name(t)
+                + ");"
+            )
+        elif t in self.messages:
+            self.emit("    randomize(" + name + ");")
+
+    def generate(self):
+        self.emit("// GENERATED by gen_protocol.py from protocol.json, don't edit by")
+        self.emit("// hand.")
+        self.emit("//")
+        self.emit("// Fuzzes the generated decoders: every packet is round tripped with")
+        self.emit("// random values, every truncation of it, a trailing byte and the")
+        self.emit("// wrong packet type are rejected, and corrupted and random packets")
+        self.emit("// decode (or don't) without reading past the end. Build with")
+        self.emit("// -fsanitize=address to catch overreads.")
+        self.emit("//")
+        self.emit("// Usage: protocol_fuzz [iterations] [seed]")
+        self.emit()
+        self.emit('#include "networking/protocol.hpp"')
+        self.emit("#include <cstdio>")
+        self.emit("#include <random>")
+        self.emit("#include <string>")
+        self.emit("#include <vector>")
+        self.emit()
+        self.emit("/** @brief Most elements in a random array, to keep packets small */")
+        self.emit("#define SPRF_FUZZ_MAX_ELEMENTS 8")
+        self.emit()
+        self.emit("using namespace SPRF;")
+        self.emit()
+        self.emit(FUZZ_HELPERS)
+        for name in self.messages:
+            self.emit("static void randomize(" + name + "_msg& msg);")
+        self.emit()
+        for name, msg in self.messages.items():
+            self.emit("static void randomize(" + name + "_msg& msg) {")
+            for field in msg["fields"]:
+                self.randomize_field(field)
+            self.emit("}")
+            self.emit()
+        self.emit(FUZZ_CHECKS)
+        self.emit("int main(int argc, char** argv) {")
+        self.emit("    int iterations = 1000;")
+        self.emit("    if (argc > 1)")
+        self.emit("        iterations = std::stoi(argv[1]);")
+        self.emit("    if (argc > 2)")
+        self.emit("        rng.seed(std::stoul(argv[2]));")
+        self.emit('    printf("protocol version %d\\n", PROTOCOL_VERSION);')
+        for name, msg in self.messages.items():
+            if "packet" in msg:
+                self.emit(
+                    "    fuzz<" + name + '_msg>("' + name + '", iterations);'
+                )
+        self.emit("    if (failures > 0) {")
+        self.emit('        printf("%d checks failed\\n", failures);')
+        self.emit("        return 1;")
+        self.emit("    }")
+        self.emit('    printf("all checks passed\\n");')
+        self.emit("    return 0;")
+        self.emit("}")
+        return "\n".join(self.lines) + "\n"
+
+
+FUZZ_HELPERS = """static std::mt19937 rng(1234);
+static int failures = 0;
+
+static float random_float(float min, float max) {
+    return std::uniform_real_distribution<float>(min, max)(rng);
+}
+
+/**
+ * @brief A string of random bytes, sometimes exactly `max` long.
+ */
+static std::string random_string(size_t max) {
+    size_t size = (rng() % 8 == 0) ? max : rng() % (MIN(max, 32) + 1);
+    std::string out(size, ' ');
+    for (auto& c : out) {
+        c = (char)rng();
+    }
+    return out;
+}
+"""
+
+FUZZ_CHECKS = """template <class T> static std::vector<enet_uint8> encode(const T& msg) {
+    PacketWriter out;
+    out.write_u8(T::packet_type);
+    msg.encode(out);
+    return std::vector<enet_uint8>(out.data(), out.data() + out.size());
+}
+
+/**
+ * @brief Decode the first `size` bytes, copied so that reading past them is
+ * reading past the end of an allocation.
+ */
+template <class T>
+static bool decode(const std::vector<enet_uint8>& bytes, size_t size,
+                   T& msg) {
+    enet_uint8* copy = new enet_uint8[size];
+    memcpy(copy, bytes.data(), size);
+    ENetPacket packet = {};
+    packet.data = copy;
+    packet.dataLength = size;
+    bool ok = decode_packet(&packet, msg);
+    delete[] copy;
+    return ok;
+}
+
+template <class T>
+static bool decode(const std::vector<enet_uint8>& bytes, T& msg) {
+    return decode(bytes, bytes.size(), msg);
+}
+
+static void fail(const char* name, const char* check, int iteration) {
+    printf("FAIL: %s: %s (iteration %d)\\n", name, check, iteration);
+    failures++;
+}
+
+/**
+ * @brief Anything that decodes has to encode into something that decodes.
+ */
+template <class T>
+static void check_decoded(const char* name, const char* check,
+                          const std::vector<enet_uint8>& bytes,
+                          int iteration) {
+    T msg;
+    if (!decode(bytes, msg))
+        return;
+    T again;
+    if (!decode(encode(msg), again))
+        fail(name, check, iteration);
+}
+
+template <class T> static void fuzz(const char* name, int iterations) {
+    size_t total = 0;
+    for (int i = 0; i < iterations; i++) {
+        T msg;
+        randomize(msg);
+        std::vector<enet_uint8> bytes = encode(msg);
+        total += bytes.size();
+        T decoded;
+        if (!decode(bytes, decoded) || (encode(decoded) != bytes))
+            fail(name, "round trip", i);
+        for (size_t n = 0; n < bytes.size(); n++) {
+            T truncated;
+            if (decode(bytes, n, truncated))
+                fail(name, "truncated packet decoded", i);
+        }
+        std::vector<enet_uint8> padded = bytes;
+        padded.push_back((enet_uint8)rng());
+        T trailing;
+        if (decode(padded, trailing))
+            fail(name, "trailing byte decoded", i);
+        std::vector<enet_uint8> retyped = bytes;
+        retyped[0] = (T::packet_type + 1 + rng() % (PACKET_COUNT - 1)) %
+                     PACKET_COUNT;
+        T wrong;
+        if (decode(retyped, wrong))
+            fail(name, "wrong packet type decoded", i);
+
+        std::vector<enet_uint8> corrupted = bytes;
+        for (int j = 0; j < 4; j++) {
+            size_t at = 1 + rng() % (corrupted.size() - 1);
+            corrupted[at] ^= 1 << (rng() % 8);
+        }
+        check_decoded<T>(name, "corrupted packet", corrupted, i);
+        std::vector<enet_uint8> noise(1 + rng() % (2 * bytes.size()));
+        for (auto& b : noise) {
+            b = (enet_uint8)rng();
+        }
+        noise[0] = T::packet_type;
+        check_decoded<T>(name, "random packet", noise, i);
+    }
+    printf("%s: %d packets, %zu bytes on average\\n", name, iterations,
+           iterations > 0 ? total / iterations : 0);
+}
+"""
+
+
+HELPERS = """/**
+ * @brief Reads the packet type (the first byte of every packet).
+ *
+ * @return bool false if the packet is empty or the type is unknown.
+ */
+static inline bool peek_packet_type(const ENetPacket* packet,
+                                    packet_type_t* out) {
+    PacketReader in(packet);
+    enet_uint8 raw;
+    if (!in.read_u8(&raw) || (raw >= PACKET_COUNT))
+        return false;
+    *out = (packet_type_t)raw;
+    return true;
+}
+
+/**
+ * @brief Encodes a message (with its packet type) into an ENet packet.
+ */
+template <class T>
+static inline ENetPacket* encode_packet(const T& msg, enet_uint32 flags) {
+    PacketWriter out;
+    out.write_u8(T::packet_type);
+    msg.encode(out);
+    return out.packet(flags);
+}
+
+/**
+ * @brief Decodes a packet into `msg`.
+ *
+ * @return bool false if the packet has the wrong type, is truncated, has
+ * out of range values or trailing bytes.
+ */
+template <class T>
+static inline bool decode_packet(const ENetPacket* packet, T& msg) {
+    PacketReader in(packet);
+    enet_uint8 raw;
+    if (!in.read_u8(&raw) || (raw != T::packet_type))
+        return false;
+    return msg.decode(in) && in.done();
+}
+"""
+
+if __name__ == "__main__":
+    with open(SCHEMA) as f:
+        schema = json.load(f)
+    with open(OUTPUT, "w") as f:
+        f.write(Generator(schema).generate())
+    print("LOG: wrote " + OUTPUT)
+    with open(FUZZ_OUTPUT, "w") as f:
+        f.write(FuzzGenerator(schema).generate())
+    print("LOG: wrote " + FUZZ_OUTPUT)
@@ -162,14 +162,14 @@ class IMGuiManager : public Component {
         ImGui::Begin("Properties");
         if (Selectable::currently_selected) {
             Entity* entity = Selectable::currently_selected;
-            ImGui::Text("(%d) %s", entity->id(), entity->name().c_str());
+            ImGui::Text("(%u) %s", entity->id(), entity->name().c_str());
             // float pos[] =
             // {transform->position.x,transform->position.y,transform->position.z};
             ImGui::NewLine();
             entity->get_component<Transform>()->draw_editor();
             for (auto& i : entity->components()) {
                 ImGui::NewLine();
-                i.second->draw_editor();
+                i->draw_editor();
             }
         }
         ImGui::End();
@@ -179,6 +179,7 @@ class IMGuiManager : public Component {
         }
 
         ImGui::End();
+        Profiler::get().draw_imgui();
     }
 };
 
@@ -0,0 +1,103 @@
+#ifndef _SPRF_ANIMATION_BUDGET_HPP_
+#define _SPRF_ANIMATION_BUDGET_HPP_
+
+#include "base.hpp"
+#include <atomic>
+#include <cmath>
+
+/** @brief Bones all animators together may sample per frame by default */
+#define SPRF_ANIMATION_BUDGET 4096
+/** @brief Animations at least this big on screen (see
+ * `ViewFrustrum::screen_size`) are sampled every frame. Every halving of the
+ * size doubles the frames between samples */
+#define SPRF_ANIMATION_FULL_RATE_SIZE 0.2f
+/** @brief Most frames between two samples of an animation on screen, even
+ * when the budget is spent */
+#define SPRF_ANIMATION_MAX_INTERVAL 8
+
+namespace SPRF {
+
+/**
+ * @brief Caps how much animation is sampled per frame.
+ *
+ * Animators ask for a share of the budget (in bones) before sampling, with
+ * `spend`. Once it runs out, animators that aren't overdue wait for the next
+ * frame, keeping their last pose. `interval` tells animators how often
+ * they're worth sampling given how big they look, so small, distant ones
+ * sample less often in the first place.
+ *
+ * Shared by every scene. `end_frame` is called by `Game` once per frame.
+ * `spend` can be called from parallel component updates.
+ */
+class AnimationBudget {
+  private:
+    std::atomic<int> m_spent{0};
+    std::atomic<int> m_deferred{0};
+    int m_budget = SPRF_ANIMATION_BUDGET;
+
+  public:
+    static AnimationBudget& get() {
+        static AnimationBudget budget;
+        return budget;
+    }
+
+    /**
+     * @brief Frames between two samples for an animation this big on
+     * screen: 1 at `SPRF_ANIMATION_FULL_RATE_SIZE` and up, doubling every
+     * time the size halves, up to `SPRF_ANIMATION_MAX_INTERVAL`.
+     */
+    static int interval(float screen_size) {
+        int out = 1;
+        float size = SPRF_ANIMATION_FULL_RATE_SIZE;
+        while ((screen_size < size) && (out < SPRF_ANIMATION_MAX_INTERVAL)) {
+            size *= 0.5f;
+            out *= 2;
+        }
+        return out;
+    }
+
+    /**
+     * @brief Take `bones` from this frame's budget.
+     *
+     * @param force Take them even if that overspends the budget, for
+     * animators that can't wait any longer.
+     * @return bool Whether the animator may sample this frame.
+     */
+    bool spend(int bones, bool force = false) {
+        int spent = m_spent.load(std::memory_order_relaxed);
+        do {
+            if ((!force) && (spent + bones > m_budget)) {
+                m_deferred.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        } while (!m_spent.compare_exchange_weak(spent, spent + bones,
+                                                std::memory_order_relaxed));
+        return true;
+    }
+
+    /**
+     * @brief Start the next frame's budget, and report this frame's use in
+     * `game_info`.
+     */
+    void end_frame() {
+        game_info.sampled_bones = m_spent.exchange(0);
+        game_info.deferred_animations = m_deferred.exchange(0);
+    }
+
+    /**
+     * @brief Sets the bones sampled per frame.
+     */
+    int budget(int bones) {
+        m_budget = bones;
+        return m_budget;
+    }
+
+    /**
+     * @brief Gets the bones sampled per frame.
+     */
+    int budget() const { return m_budget; }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_ANIMATION_BUDGET_HPP_
@@ -0,0 +1,690 @@
+#ifndef _SPRF_ANIMATION_CLIP_HPP_
+#define _SPRF_ANIMATION_CLIP_HPP_
+
+#include "raylib.h"
+#include "raymath.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPRF_ANIMATION_SSE
+#include <emmintrin.h>
+#endif
+
+/** @brief Largest error keyframe reduction may add to a translation, as a
+ * fraction of the largest translation in the file */
+#define SPRF_CLIP_POSITION_ERROR 1e-4f
+/** @brief Largest error keyframe reduction may add to a rotation quaternion
+ * component (about half the angle, in radians) */
+#define SPRF_CLIP_ROTATION_ERROR 5e-4f
+/** @brief Largest error keyframe reduction may add to a scale */
+#define SPRF_CLIP_SCALE_ERROR 1e-3f
+
+namespace SPRF {
+
+/**
+ * @brief Components of a bone's pose, one row each in a `BonePose`.
+ */
+enum bone_channel_t {
+    BONE_TX,
+    BONE_TY,
+    BONE_TZ,
+    BONE_RX,
+    BONE_RY,
+    BONE_RZ,
+    BONE_RW,
+    BONE_SX,
+    BONE_SY,
+    BONE_SZ,
+    BONE_CHANNELS
+};
+
+/**
+ * @brief Local transforms of every bone of a skeleton, in structure of
+ * arrays form.
+ *
+ * Each channel is a row of `stride()` floats (the bone count rounded up to
+ * 4), so blending and normalizing work on four bones at a time. Bones past
+ * the end are kept at the identity.
+ */
+class BonePose {
+  private:
+    int m_bones = 0;
+    int m_stride = 0;
+    std::vector<float> m_data;
+
+  public:
+    BonePose() {}
+
+    BonePose(int bones) { resize(bones); }
+
+    /**
+     * @brief Resize to `bones` bones, all at the identity.
+     */
+    void resize(int bones) {
+        m_bones = bones;
+        m_stride = (bones + 3) & ~3;
+        m_data.assign(BONE_CHANNELS * m_stride, 0.0f);
+        std::fill_n(channel(BONE_RW), m_stride, 1.0f);
+        for (int c = BONE_SX; c <= BONE_SZ; c++) {
+            std::fill_n(channel(c), m_stride, 1.0f);
+        }
+    }
+
+    int bones() const { return m_bones; }
+
+    int stride() const { return m_stride; }
+
+    float* channel(int c) { return m_data.data() + c * m_stride; }
+
+    const float* channel(int c) const { return m_data.data() + c * m_stride; }
+
+    ::Transform get(int bone) const {
+        const float* d = m_data.data() + bone;
+        int s = m_stride;
+        return {{d[BONE_TX * s], d[BONE_TY * s], d[BONE_TZ * s]},
+                {d[BONE_RX * s], d[BONE_RY * s], d[BONE_RZ * s],
+                 d[BONE_RW * s]},
+                {d[BONE_SX * s], d[BONE_SY * s], d[BONE_SZ * s]}};
+    }
+
+    void set(int bone, const ::Transform& t) {
+        float values[BONE_CHANNELS] = {
+            t.translation.x, t.translation.y, t.translation.z,
+            t.rotation.x,    t.rotation.y,    t.rotation.z,
+            t.rotation.w,    t.scale.x,       t.scale.y,
+            t.scale.z};
+        for (int c = 0; c < BONE_CHANNELS; c++) {
+            channel(c)[bone] = values[c];
+        }
+    }
+
+    /**
+     * @brief Write the pose out as raylib transforms, e.g. for
+     * `ModelAnimation::framePoses`.
+     */
+    void to_transforms(::Transform* out) const {
+        for (int i = 0; i < m_bones; i++) {
+            out[i] = get(i);
+        }
+    }
+
+    /**
+     * @brief Make every rotation a unit quaternion.
+     */
+    void normalize_rotations() {
+        float* x = channel(BONE_RX);
+        float* y = channel(BONE_RY);
+        float* z = channel(BONE_RZ);
+        float* w = channel(BONE_RW);
+#ifdef SPRF_ANIMATION_SSE
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 tiny = _mm_set1_ps(1e-20f);
+        for (int i = 0; i < m_stride; i += 4) {
+            __m128 qx = _mm_loadu_ps(x + i);
+            __m128 qy = _mm_loadu_ps(y + i);
+            __m128 qz = _mm_loadu_ps(z + i);
+            __m128 qw = _mm_loadu_ps(w + i);
+            __m128 length2 = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)),
+                _mm_add_ps(_mm_mul_ps(qz, qz), _mm_mul_ps(qw, qw)));
+            __m128 inv =
+                _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(length2, tiny)));
+            _mm_storeu_ps(x + i, _mm_mul_ps(qx, inv));
+            _mm_storeu_ps(y + i, _mm_mul_ps(qy, inv));
+            _mm_storeu_ps(z + i, _mm_mul_ps(qz, inv));
+            _mm_storeu_ps(w + i, _mm_mul_ps(qw, inv));
+        }
+#else
+        for (int i = 0; i < m_stride; i++) {
+            float length2 =
+                x[i] * x[i] + y[i] * y[i] + z[i] * z[i] + w[i] * w[i];
+            float inv = 1.0f / sqrtf(fmaxf(length2, 1e-20f));
+            x[i] *= inv;
+            y[i] *= inv;
+            z[i] *= inv;
+            w[i] *= inv;
+        }
+#endif
+    }
+};
+
+/**
+ * @brief Weighted average of `n` poses of the same skeleton.
+ *
+ * Translations and scales are blended linearly, rotations are normalized
+ * after blending (nlerp), each flipped onto the same side as the first
+ * pose's so they take the shorter way round. `out` may be one of `poses`.
+ *
+ * @param weights One per pose, normalized here, so they needn't add up to 1.
+ */
+inline void blend_poses(const BonePose* const* poses, const float* weights,
+                        int n, BonePose& out) {
+    if (n == 0)
+        return;
+    float total = 0;
+    for (int p = 0; p < n; p++) {
+        total += weights[p];
+    }
+    float scale = total > 0 ? 1.0f / total : 0.0f;
+    const int stride = poses[0]->stride();
+    if (out.bones() != poses[0]->bones())
+        out.resize(poses[0]->bones());
+#ifdef SPRF_ANIMATION_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    for (int i = 0; i < stride; i += 4) {
+        __m128 sum[BONE_CHANNELS];
+        __m128 reference[4];
+        for (int c = 0; c < 4; c++) {
+            reference[c] = _mm_loadu_ps(poses[0]->channel(BONE_RX + c) + i);
+        }
+        for (int c = 0; c < BONE_CHANNELS; c++) {
+            sum[c] = zero;
+        }
+        for (int p = 0; p < n; p++) {
+            const BonePose& pose = *poses[p];
+            __m128 w = _mm_set1_ps(weights[p] * scale);
+            __m128 rotation[4];
+            __m128 dot = zero;
+            for (int c = 0; c < 4; c++) {
+                rotation[c] = _mm_loadu_ps(pose.channel(BONE_RX + c) + i);
+                dot = _mm_add_ps(dot, _mm_mul_ps(rotation[c], reference[c]));
+            }
+            __m128 w_rotation =
+                _mm_xor_ps(w, _mm_and_ps(_mm_cmplt_ps(dot, zero), sign));
+            for (int c = 0; c < 4; c++) {
+                sum[BONE_RX + c] = _mm_add_ps(
+                    sum[BONE_RX + c], _mm_mul_ps(rotation[c], w_rotation));
+            }
+            for (int c : {BONE_TX, BONE_TY, BONE_TZ, BONE_SX, BONE_SY,
+                          BONE_SZ}) {
+                sum[c] = _mm_add_ps(
+                    sum[c], _mm_mul_ps(_mm_loadu_ps(pose.channel(c) + i), w));
+            }
+        }
+        for (int c = 0; c < BONE_CHANNELS; c++) {
+            _mm_storeu_ps(out.channel(c) + i, sum[c]);
+        }
+    }
+#else
+    for (int i = 0; i < stride; i++) {
+        float sum[BONE_CHANNELS] = {};
+        for (int p = 0; p < n; p++) {
+            const BonePose& pose = *poses[p];
+            float w = weights[p] * scale;
+            float dot = 0;
+            for (int c = BONE_RX; c <= BONE_RW; c++) {
+                dot += pose.channel(c)[i] * poses[0]->channel(c)[i];
+            }
+            float w_rotation = dot < 0 ? -w : w;
+            for (int c = 0; c < BONE_CHANNELS; c++) {
+                bool rotation = (c >= BONE_RX) && (c <= BONE_RW);
+                sum[c] += pose.channel(c)[i] * (rotation ? w_rotation : w);
+            }
+        }
+        for (int c = 0; c < BONE_CHANNELS; c++) {
+            out.channel(c)[i] = sum[c];
+        }
+    }
+#endif
+    out.normalize_rotations();
+}
+
+/**
+ * @brief `a` blended towards `b` by `t`. `out` may be `a` or `b`.
+ */
+inline void blend_poses(const BonePose& a, const BonePose& b, float t,
+                        BonePose& out) {
+    const BonePose* poses[2] = {&a, &b};
+    float weights[2] = {1.0f - t, t};
+    blend_poses(poses, weights, 2, out);
+}
+
+/**
+ * @brief A skeletal animation, compressed.
+ *
+ * Every bone has a translation, rotation and scale track. Keyframe reduction
+ * drops every frame that linear interpolation between the frames kept
+ * around it reproduces (within `SPRF_CLIP_*_ERROR`), so a bone that doesn't
+ * move is a single key. Kept keys are quantized to 16 bits per component
+ * over the range of their track. That is 10 bytes per key against the 40
+ * of a raylib `Transform` per bone per frame.
+ */
+class AnimationClip {
+  private:
+    struct Track {
+        /** @brief Index of the first key in `m_key_frames` */
+        uint32_t first;
+        /** @brief Number of keys, at least 1 */
+        uint32_t count;
+        /** @brief Value of a quantized 0 */
+        float min[4];
+        /** @brief Value of a quantized step */
+        float step[4];
+    };
+
+    std::string m_name;
+    int m_bones = 0;
+    int m_frames = 0;
+    /** @brief Translation, rotation and scale track of each bone */
+    std::vector<Track> m_tracks;
+    /** @brief Frame of each key */
+    std::vector<uint16_t> m_key_frames;
+    /** @brief Four quantized components per key */
+    std::vector<uint16_t> m_keys;
+
+    /**
+     * @brief Largest difference between frames `(first, last)` of `values`
+     * and interpolating between `first` and `last`.
+     */
+    static float segment_error(const std::vector<Vector4>& values, int first,
+                               int last, bool rotation) {
+        float error = 0;
+        Vector4 a = values[first];
+        Vector4 b = values[last];
+        for (int m = first + 1; m < last; m++) {
+            float t = (m - first) / (float)(last - first);
+            Vector4 v = {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t,
+                         a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t};
+            if (rotation)
+                v = QuaternionNormalize(v);
+            const Vector4& expected = values[m];
+            error = fmaxf(error, fabsf(v.x - expected.x));
+            error = fmaxf(error, fabsf(v.y - expected.y));
+            error = fmaxf(error, fabsf(v.z - expected.z));
+            error = fmaxf(error, fabsf(v.w - expected.w));
+        }
+        return error;
+    }
+
+    /**
+     * @brief Frames of `values` that keyframe reduction keeps.
+     */
+    static std::vector<int> reduce(const std::vector<Vector4>& values,
+                                   float tolerance, bool rotation) {
+        std::vector<int> keep = {0};
+        int n = values.size();
+        bool constant = true;
+        for (int f = 1; (f < n) && constant; f++) {
+            constant = (fabsf(values[f].x - values[0].x) <= tolerance) &&
+                       (fabsf(values[f].y - values[0].y) <= tolerance) &&
+                       (fabsf(values[f].z - values[0].z) <= tolerance) &&
+                       (fabsf(values[f].w - values[0].w) <= tolerance);
+        }
+        if (constant)
+            return keep;
+        int first = 0;
+        while (first < n - 1) {
+            int last = first + 1;
+            while ((last + 1 < n) &&
+                   (segment_error(values, first, last + 1, rotation) <=
+                    tolerance)) {
+                last++;
+            }
+            keep.push_back(last);
+            first = last;
+        }
+        return keep;
+    }
+
+    void add_track(const std::vector<Vector4>& values, float tolerance,
+                   bool rotation) {
+        std::vector<int> keep = reduce(values, tolerance, rotation);
+        Track track;
+        track.first = m_key_frames.size();
+        track.count = keep.size();
+        float max[4];
+        for (int c = 0; c < 4; c++) {
+            track.min[c] = INFINITY;
+            max[c] = -INFINITY;
+        }
+        for (int f : keep) {
+            const float* v = &values[f].x;
+            for (int c = 0; c < 4; c++) {
+                track.min[c] = fminf(track.min[c], v[c]);
+                max[c] = fmaxf(max[c], v[c]);
+            }
+        }
+        for (int c = 0; c < 4; c++) {
+            track.step[c] = (max[c] - track.min[c]) / 65535.0f;
+        }
+        for (int f : keep) {
+            const float* v = &values[f].x;
+            m_key_frames.push_back(f);
+            for (int c = 0; c < 4; c++) {
+                float q = track.step[c] > 0
+                              ? (v[c] - track.min[c]) / track.step[c]
+                              : 0.0f;
+                m_keys.push_back(
+                    (uint16_t)fminf(fmaxf(roundf(q), 0.0f), 65535.0f));
+            }
+        }
+        m_tracks.push_back(track);
+    }
+
+    /**
+     * @brief Value of a track at a frame, in `out[0..3]`.
+     *
+     * @param cursor Key the track was last sampled at, updated. Playing
+     * forward, the next key is found without searching.
+     */
+    void sample_track(const Track& track, float frame, float* out,
+                      uint32_t& cursor) const {
+        uint32_t k = 0;
+        float t = 0;
+        if (track.count > 1) {
+            const uint16_t* frames = &m_key_frames[track.first];
+            k = cursor;
+            if ((k > track.count - 2) || (frames[k] > frame)) {
+                k = std::upper_bound(frames, frames + track.count, frame) -
+                    frames;
+                k = k == 0 ? 0 : k - 1;
+                // the last key only ends a span, at or past it t is 1
+                k = std::min(k, track.count - 2);
+            }
+            while ((k < track.count - 2) && (frames[k + 1] <= frame)) {
+                k++;
+            }
+            cursor = k;
+            t = (frame - frames[k]) / (float)(frames[k + 1] - frames[k]);
+            t = fminf(fmaxf(t, 0.0f), 1.0f);
+        }
+        const uint16_t* key = &m_keys[(track.first + k) * 4];
+#ifdef SPRF_ANIMATION_SSE
+        // both keys in one load, as 16 bit integers
+        __m128i raw = track.count > 1 ? _mm_loadu_si128((const __m128i*)key)
+                                      : _mm_loadl_epi64((const __m128i*)key);
+        __m128i zero = _mm_setzero_si128();
+        __m128 a = _mm_cvtepi32_ps(_mm_unpacklo_epi16(raw, zero));
+        __m128 b = _mm_cvtepi32_ps(_mm_unpackhi_epi16(raw, zero));
+        __m128 q = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(t)));
+        _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(track.min),
+                                      _mm_mul_ps(_mm_loadu_ps(track.step), q)));
+#else
+        const uint16_t* next = track.count > 1 ? key + 4 : key;
+        for (int c = 0; c < 4; c++) {
+            float q = key[c] + (next[c] - (float)key[c]) * t;
+            out[c] = track.min[c] + track.step[c] * q;
+        }
+#endif
+    }
+
+  public:
+    /**
+     * @brief Compress an animation.
+     *
+     * @param position_tolerance Largest error keyframe reduction may add to
+     * a translation.
+     */
+    AnimationClip(const ModelAnimation& anim, float position_tolerance)
+        : m_name(anim.name), m_bones(anim.boneCount),
+          m_frames(std::min(anim.frameCount, 65535)) {
+        std::vector<Vector4> values(m_frames);
+        for (int bone = 0; bone < m_bones; bone++) {
+            for (int f = 0; f < m_frames; f++) {
+                Vector3 t = anim.framePoses[f][bone].translation;
+                values[f] = {t.x, t.y, t.z, 0};
+            }
+            add_track(values, position_tolerance, false);
+            for (int f = 0; f < m_frames; f++) {
+                Quaternion q = anim.framePoses[f][bone].rotation;
+                // q and -q are the same rotation, keep neighbours on the same
+                // side so interpolating them takes the short way round
+                if ((f > 0) && (Vector4DotProduct(q, values[f - 1]) < 0))
+                    q = QuaternionScale(q, -1);
+                values[f] = q;
+            }
+            add_track(values, SPRF_CLIP_ROTATION_ERROR, true);
+            for (int f = 0; f < m_frames; f++) {
+                Vector3 s = anim.framePoses[f][bone].scale;
+                values[f] = {s.x, s.y, s.z, 0};
+            }
+            add_track(values, SPRF_CLIP_SCALE_ERROR, false);
+        }
+    }
+
+    const std::string& name() const { return m_name; }
+
+    int bones() const { return m_bones; }
+
+    int frames() const { return m_frames; }
+
+    /**
+     * @brief Memory taken by the clip's tracks and keys, in bytes.
+     */
+    size_t bytes() const {
+        return m_tracks.size() * sizeof(Track) +
+               m_key_frames.size() * sizeof(uint16_t) +
+               m_keys.size() * sizeof(uint16_t);
+    }
+
+    /**
+     * @brief Pose of every bone at a frame, interpolating between keys.
+     *
+     * @param frame Frame, clamped to `[0, frames() - 1]`.
+     * @param out Resized to `bones()` if it isn't already.
+     * @param cursors Key each track was last sampled at, kept by the caller
+     * from one call to the next. Without them every key is found by binary
+     * search.
+     */
+    void sample(float frame, BonePose& out,
+                std::vector<uint32_t>* cursors = NULL) const {
+        if (out.bones() != m_bones)
+            out.resize(m_bones);
+        uint32_t search[3];
+        if (cursors)
+            cursors->resize(m_tracks.size(), 0);
+        if (m_frames == 0)
+            return;
+        frame = fminf(fmaxf(frame, 0.0f), (float)(m_frames - 1));
+        float value[4];
+        float* channels[BONE_CHANNELS];
+        for (int c = 0; c < BONE_CHANNELS; c++) {
+            channels[c] = out.channel(c);
+        }
+        for (int bone = 0; bone < m_bones; bone++) {
+            const Track* tracks = &m_tracks[bone * 3];
+            uint32_t* cursor = search;
+            if (cursors) {
+                cursor = &(*cursors)[bone * 3];
+            } else {
+                search[0] = search[1] = search[2] = UINT32_MAX;
+            }
+            sample_track(tracks[0], frame, value, cursor[0]);
+            for (int c = 0; c < 3; c++) {
+                channels[BONE_TX + c][bone] = value[c];
+            }
+            sample_track(tracks[1], frame, value, cursor[1]);
+            for (int c = 0; c < 4; c++) {
+                channels[BONE_RX + c][bone] = value[c];
+            }
+            sample_track(tracks[2], frame, value, cursor[2]);
+            for (int c = 0; c < 3; c++) {
+                channels[BONE_SX + c][bone] = value[c];
+            }
+        }
+        out.normalize_rotations();
+    }
+};
+
+/**
+ * @brief Every animation in a model file, compressed, with the bone
+ * hierarchy they share.
+ *
+ * Loaded once per file with `load` and shared by everything animating with
+ * it; the raw animations are dropped as soon as they're compressed.
+ */
+class AnimationClipSet {
+  private:
+    std::vector<BoneInfo> m_bones;
+    std::vector<AnimationClip> m_clips;
+
+  public:
+    /**
+     * @brief The animations in a file, loading them unless something still
+     * holds them from an earlier call.
+     */
+    static std::shared_ptr<const AnimationClipSet>
+    load(const std::string& path) {
+        static std::unordered_map<std::string,
+                                  std::weak_ptr<const AnimationClipSet>>
+            loaded;
+        if (auto out = loaded[path].lock())
+            return out;
+        auto out = std::make_shared<AnimationClipSet>();
+        int count = 0;
+        ModelAnimation* anims = LoadModelAnimations(path.c_str(), &count);
+        if (count > 0) {
+            out->m_bones.assign(anims[0].bones,
+                                anims[0].bones + anims[0].boneCount);
+        }
+        float extent = 0;
+        size_t raw = 0;
+        for (int i = 0; i < count; i++) {
+            for (int f = 0; f < anims[i].frameCount; f++) {
+                for (int b = 0; b < anims[i].boneCount; b++) {
+                    Vector3 t = anims[i].framePoses[f][b].translation;
+                    extent = fmaxf(extent, fmaxf(fabsf(t.x),
+                                                 fmaxf(fabsf(t.y), fabsf(t.z))));
+                }
+            }
+        }
+        float tolerance = fmaxf(extent * SPRF_CLIP_POSITION_ERROR, 1e-6f);
+        size_t compressed = 0;
+        for (int i = 0; i < count; i++) {
+            if (anims[i].boneCount != (int)out->m_bones.size()) {
+                TraceLog(LOG_WARNING, "%s: animation %s has %d bones, not %d",
+                         path.c_str(), anims[i].name, anims[i].boneCount,
+                         (int)out->m_bones.size());
+                continue;
+            }
+            raw += sizeof(::Transform) * anims[i].boneCount *
+                   anims[i].frameCount;
+            out->m_clips.emplace_back(anims[i], tolerance);
+            compressed += out->m_clips.back().bytes();
+        }
+        if (count > 0)
+            UnloadModelAnimations(anims, count);
+        TraceLog(LOG_INFO, "%s: %d animations, %d KB (%d KB uncompressed)",
+                 path.c_str(), (int)out->m_clips.size(),
+                 (int)(compressed / 1024), (int)(raw / 1024));
+        loaded[path] = out;
+        return out;
+    }
+
+    /**
+     * @brief Bones of the skeleton, with parents (always before their
+     * children).
+     */
+    const std::vector<BoneInfo>& bones() const { return m_bones; }
+
+    int size() const { return m_clips.size(); }
+
+    const AnimationClip& clip(int i) const { return m_clips[i]; }
+};
+
+/**
+ * @brief Tree of clips blended together, e.g. running forwards and
+ * strafing, weighted by velocity.
+ *
+ * Leaves sample a clip at a frame, inner nodes blend any number of children
+ * (see `blend_poses`). Each node keeps its own pose, so evaluating the tree
+ * allocates nothing once it has been evaluated once.
+ */
+class BlendTree {
+  private:
+    struct Node {
+        const AnimationClip* clip;
+        float frame;
+        std::vector<int> children;
+        std::vector<float> weights;
+        BonePose pose;
+    };
+
+    std::vector<Node> m_nodes;
+    /** @brief Scratch for `evaluate` */
+    std::vector<const BonePose*> m_poses;
+    std::vector<float> m_weights;
+
+  public:
+    /**
+     * @brief Add a leaf sampling `clip` (which must outlive the tree).
+     *
+     * @return int The node.
+     */
+    int add_clip(const AnimationClip* clip) {
+        Node node;
+        node.clip = clip;
+        node.frame = 0;
+        m_nodes.push_back(std::move(node));
+        return m_nodes.size() - 1;
+    }
+
+    /**
+     * @brief Add a node blending `children`, weighted equally until told
+     * otherwise.
+     *
+     * @return int The node.
+     */
+    int add_blend(const std::vector<int>& children) {
+        Node node;
+        node.clip = NULL;
+        node.frame = 0;
+        node.children = children;
+        node.weights.assign(children.size(), 1.0f);
+        m_nodes.push_back(std::move(node));
+        return m_nodes.size() - 1;
+    }
+
+    /**
+     * @brief Set the frame a leaf samples its clip at.
+     */
+    void frame(int node, float frame) { m_nodes[node].frame = frame; }
+
+    /**
+     * @brief Set the weight of the `child`th child of a blend node.
+     */
+    void weight(int node, int child, float weight) {
+        m_nodes[node].weights[child] = weight;
+    }
+
+    /**
+     * @brief Pose of a node (and so of the subtree under it). Children with
+     * no weight aren't evaluated.
+     */
+    const BonePose& evaluate(int index) {
+        Node& node = m_nodes[index];
+        if (node.clip) {
+            node.clip->sample(node.frame, node.pose);
+            return node.pose;
+        }
+        // children first: evaluating them may grow the scratch vectors
+        for (size_t i = 0; i < node.children.size(); i++) {
+            if (node.weights[i] > 0)
+                evaluate(node.children[i]);
+        }
+        size_t base = m_poses.size();
+        for (size_t i = 0; i < node.children.size(); i++) {
+            if (node.weights[i] > 0) {
+                m_poses.push_back(&m_nodes[node.children[i]].pose);
+                m_weights.push_back(node.weights[i]);
+            }
+        }
+        int n = m_poses.size() - base;
+        if (n > 0)
+            blend_poses(&m_poses[base], &m_weights[base], n, node.pose);
+        m_poses.resize(base);
+        m_weights.resize(base);
+        return node.pose;
+    }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_ANIMATION_CLIP_HPP_
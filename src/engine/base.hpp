@@ -85,6 +85,11 @@ class GameInfo {
   public:
     int visible_meshes = 0;
     int hidden_meshes = 0;
+    int drawn_triangles = 0;
+    int draw_calls = 0;
+    int state_changes = 0;
+    int sampled_bones = 0;
+    int deferred_animations = 0;
     float frame_time = 0;
     vec2 monitor_size; // inches
     vec3 position;
@@ -95,6 +100,8 @@ class GameInfo {
     int ping;
     float recieve_delta;
     float send_delta;
+    float clock_offset = 0;
+    float clock_drift = 0;
     bool dev_console_active = false;
     // vec2 mouse_sense_ratio = vec2(0.0165, 0.022);
     int packet_queue_size = 0;
@@ -140,10 +147,18 @@ class GameInfo {
             draw_debug_var("send_delta", send_delta, 0, 100);
             draw_debug_var("recv_delta", recieve_delta, 0, 120);
             draw_debug_var("packet_queue_size", packet_queue_size, 0, 140);
+            draw_debug_var("clock_offset", clock_offset, 0, 160);
+            draw_debug_var("clock_drift", clock_drift, 0, 180);
             draw_debug_var("visible_meshes", visible_meshes, 0, 200);
             draw_debug_var("hidden_meshes", hidden_meshes, 0, 220);
             draw_debug_var("ball_pos", ball_position, 0, 240);
             draw_debug_var("ball_rot", ball_rotation, 0, 260);
+            draw_debug_var("drawn_triangles", drawn_triangles, 0, 280);
+            draw_debug_var("draw_calls", draw_calls, 0, 300);
+            draw_debug_var("state_changes", state_changes, 0, 320);
+            draw_debug_var("sampled_bones", sampled_bones, 0, 340);
+            draw_debug_var("deferred_animations", deferred_animations, 0,
+                           360);
         }
     }
 
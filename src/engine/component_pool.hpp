@@ -0,0 +1,332 @@
+#ifndef _SPRF_COMPONENT_POOL_HPP_
+#define _SPRF_COMPONENT_POOL_HPP_
+
+#include "base.hpp"
+#include "component_type.hpp"
+#include "profiler.hpp"
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/** @brief Number of components in each chunk of a `ComponentPool` */
+#define COMPONENT_POOL_CHUNK_SIZE (256)
+
+namespace SPRF {
+
+class Component;
+
+/**
+ * @brief The component hooks the scene runs every frame.
+ *
+ * Only the update phases can run on worker threads.
+ */
+enum component_phase_t {
+    PHASE_BEFORE_UPDATE,
+    PHASE_UPDATE,
+    PHASE_AFTER_UPDATE,
+    PHASE_DRAW3D,
+    PHASE_DRAW_DEBUG,
+    PHASE_BEFORE_DRAW2D,
+    PHASE_DRAW2D,
+    PHASE_AFTER_DRAW2D,
+    PHASE_COUNT
+};
+
+/**
+ * @brief Name of a phase, for the profiler.
+ */
+inline const char* component_phase_name(component_phase_t phase) {
+    static const char* names[PHASE_COUNT] = {
+        "before_update", "update",     "after_update", "draw3D",
+        "draw_debug",    "before_draw2D", "draw2D",    "after_draw2D"};
+    return names[phase];
+}
+
+/** @brief `T::reads` if it is declared, otherwise nothing */
+template <class T, class = void> struct component_reads {
+    static component_mask_t mask() { return 0; }
+};
+
+template <class T>
+struct component_reads<T, std::void_t<typename T::reads>> {
+    static component_mask_t mask() { return T::reads::mask(); }
+};
+
+/** @brief `T::writes` if it is declared, otherwise nothing */
+template <class T, class = void> struct component_writes {
+    static component_mask_t mask() { return 0; }
+};
+
+template <class T>
+struct component_writes<T, std::void_t<typename T::writes>> {
+    static component_mask_t mask() { return T::writes::mask(); }
+};
+
+/** @brief `T::parallel` if it is declared, otherwise false */
+template <class T, class = void>
+struct component_parallel : std::false_type {};
+
+template <class T>
+struct component_parallel<T, std::void_t<decltype(T::parallel)>>
+    : std::integral_constant<bool, T::parallel> {};
+
+/**
+ * @brief Whether `T` overrides a hook of `Base`.
+ *
+ * `&T::hook` has the type of the class that declares `hook`, so it only
+ * matches `&Base::hook` if nothing between `Base` and `T` overrides it.
+ */
+#define COMPONENT_OVERRIDES(T, Base, hook)                                     \
+    (!std::is_same<decltype(&T::hook), decltype(&Base::hook)>::value)
+
+/**
+ * @brief Type erased interface to a `ComponentPool`.
+ *
+ * The scene keeps one pool per component type and runs each phase pool by
+ * pool, so there is one virtual call per type per phase instead of one per
+ * component. Pools only subscribe to the phases their type overrides.
+ */
+class ComponentPoolBase {
+  public:
+    virtual ~ComponentPoolBase() {}
+    /**
+     * @brief Destroy a component allocated from this pool.
+     */
+    virtual void release(Component* component) = 0;
+    /** @brief Number of live components */
+    virtual size_t size() = 0;
+    /**
+     * @brief Whether the component type overrides the hook for `phase`.
+     */
+    virtual bool implements(component_phase_t phase) = 0;
+    /**
+     * @brief Note that a component's entity was enabled or disabled, or a
+     * component was added or released.
+     */
+    virtual void mark_dirty() = 0;
+    /**
+     * @brief Rebuild the list of active components if anything changed.
+     *
+     * Called on the main thread before each phase.
+     */
+    virtual void refresh() = 0;
+    /** @brief Number of active components, the range to iterate */
+    virtual size_t count() = 0;
+    /** @brief Whether the update phases may run on worker threads */
+    virtual bool parallel() = 0;
+    /** @brief Component types the update phases read */
+    virtual component_mask_t reads() = 0;
+    /** @brief Component types the update phases write */
+    virtual component_mask_t writes() = 0;
+    /**
+     * @brief Run a phase on active components [begin, end).
+     *
+     * Disjoint ranges of a parallel pool may run on different threads.
+     */
+    virtual void run(component_phase_t phase, size_t begin, size_t end) = 0;
+};
+
+/**
+ * @brief Contiguous storage for every component of type `T` in a scene.
+ *
+ * Components live in fixed size chunks that are never moved, so pointers to
+ * components stay valid for their whole lifetime (components keep pointers
+ * to each other). Released slots are reused by later allocations.
+ *
+ * Phases walk a dense list of the active components (live, and their
+ * entity and its ancestors are enabled) and call the hooks with a qualified
+ * `T::hook()` call: every component in the pool is exactly a `T`, so there is
+ * no need for virtual dispatch. The list is rebuilt, in slot order, before
+ * the next phase whenever something was enabled, disabled, added or
+ * released, so disabled subtrees cost nothing while they stay disabled.
+ *
+ * @tparam T Component type.
+ */
+template <class T> class ComponentPool : public ComponentPoolBase {
+  private:
+    struct Chunk {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type
+            slots[COMPONENT_POOL_CHUNK_SIZE];
+        bool alive[COMPONENT_POOL_CHUNK_SIZE] = {};
+    };
+
+    /** @brief Chunks are heap allocated separately so they never move */
+    std::vector<std::unique_ptr<Chunk>> m_chunks;
+    /** @brief Slots ever handed out (live or released) */
+    size_t m_high_water = 0;
+    /** @brief Number of live components */
+    size_t m_size = 0;
+    /** @brief Released slots, reused before growing */
+    std::vector<size_t> m_free;
+    /** @brief Slots of the active components, in slot order */
+    std::vector<size_t> m_active;
+    bool m_dirty = true;
+
+    T* slot(size_t idx) {
+        return reinterpret_cast<T*>(
+            &m_chunks[idx / COMPONENT_POOL_CHUNK_SIZE]
+                 ->slots[idx % COMPONENT_POOL_CHUNK_SIZE]);
+    }
+
+    bool& alive(size_t idx) {
+        return m_chunks[idx / COMPONENT_POOL_CHUNK_SIZE]
+            ->alive[idx % COMPONENT_POOL_CHUNK_SIZE];
+    }
+
+    /**
+     * @brief Calls `fn` on active components [begin, end).
+     *
+     * Liveness and the entity are checked again, in case something was
+     * released or disabled earlier in the same phase.
+     */
+    template <class F> void for_each_active(F fn, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            size_t idx = m_active[i];
+            if (!alive(idx))
+                continue;
+            T* component = slot(idx);
+            if (!component->entity()->active_in_hierarchy())
+                continue;
+            fn(component);
+        }
+    }
+
+    template <class Base = Component>
+    static bool overrides(component_phase_t phase) {
+        switch (phase) {
+        case PHASE_BEFORE_UPDATE:
+            return COMPONENT_OVERRIDES(T, Base, before_update);
+        case PHASE_UPDATE:
+            return COMPONENT_OVERRIDES(T, Base, update);
+        case PHASE_AFTER_UPDATE:
+            return COMPONENT_OVERRIDES(T, Base, after_update);
+        case PHASE_DRAW3D:
+            return COMPONENT_OVERRIDES(T, Base, draw3D);
+        case PHASE_DRAW_DEBUG:
+            return COMPONENT_OVERRIDES(T, Base, draw_debug);
+        case PHASE_BEFORE_DRAW2D:
+            return COMPONENT_OVERRIDES(T, Base, before_draw2D);
+        case PHASE_DRAW2D:
+            return COMPONENT_OVERRIDES(T, Base, draw2D);
+        case PHASE_AFTER_DRAW2D:
+            return COMPONENT_OVERRIDES(T, Base, after_draw2D);
+        default:
+            return false;
+        }
+    }
+
+  public:
+    ComponentPool() {}
+
+    ComponentPool(const ComponentPool&) = delete;
+    ComponentPool& operator=(const ComponentPool&) = delete;
+
+    ~ComponentPool() {
+        for (size_t i = 0; i < m_high_water; i++) {
+            if (alive(i))
+                slot(i)->~T();
+        }
+    }
+
+    /**
+     * @brief Construct a new component in the pool.
+     *
+     * @return T* Pointer to the component, valid until it is released.
+     */
+    template <typename... Args> T* create(Args&&... args) {
+        size_t idx;
+        if (m_free.size() > 0) {
+            idx = m_free.back();
+            m_free.pop_back();
+        } else {
+            idx = m_high_water++;
+            if ((idx / COMPONENT_POOL_CHUNK_SIZE) >= m_chunks.size())
+                m_chunks.push_back(std::make_unique<Chunk>());
+        }
+        T* out = new (slot(idx)) T(std::forward<Args>(args)...);
+        alive(idx) = true;
+        out->set_pool(this, idx);
+        m_size++;
+        m_dirty = true;
+        return out;
+    }
+
+    void release(Component* component) {
+        T* ptr = static_cast<T*>(component);
+        size_t idx = ptr->pool_slot();
+        assert(slot(idx) == ptr);
+        assert(alive(idx));
+        slot(idx)->~T();
+        alive(idx) = false;
+        m_free.push_back(idx);
+        m_size--;
+        m_dirty = true;
+    }
+
+    size_t size() { return m_size; }
+
+    bool implements(component_phase_t phase) { return overrides(phase); }
+
+    void mark_dirty() { m_dirty = true; }
+
+    void refresh() {
+        if (!m_dirty)
+            return;
+        m_active.clear();
+        for (size_t i = 0; i < m_high_water; i++) {
+            if (alive(i) && slot(i)->entity()->active_in_hierarchy())
+                m_active.push_back(i);
+        }
+        m_dirty = false;
+    }
+
+    size_t count() { return m_active.size(); }
+
+    bool parallel() { return component_parallel<T>::value; }
+
+    component_mask_t reads() { return component_reads<T>::mask(); }
+
+    component_mask_t writes() {
+        return component_writes<T>::mask() | ComponentType<T>::bit();
+    }
+
+    void run(component_phase_t phase, size_t begin, size_t end) {
+        PROFILE_SCOPE(type_name<T>());
+        switch (phase) {
+        case PHASE_BEFORE_UPDATE:
+            for_each_active([](T* i) { i->T::before_update(); }, begin, end);
+            break;
+        case PHASE_UPDATE:
+            for_each_active([](T* i) { i->T::update(); }, begin, end);
+            break;
+        case PHASE_AFTER_UPDATE:
+            for_each_active([](T* i) { i->T::after_update(); }, begin, end);
+            break;
+        case PHASE_DRAW3D:
+            for_each_active(
+                [](T* i) { i->T::draw3D(i->entity()->global_transform()); },
+                begin, end);
+            break;
+        case PHASE_DRAW_DEBUG:
+            for_each_active([](T* i) { i->T::draw_debug(); }, begin, end);
+            break;
+        case PHASE_BEFORE_DRAW2D:
+            for_each_active([](T* i) { i->T::before_draw2D(); }, begin, end);
+            break;
+        case PHASE_DRAW2D:
+            for_each_active([](T* i) { i->T::draw2D(); }, begin, end);
+            break;
+        case PHASE_AFTER_DRAW2D:
+            for_each_active([](T* i) { i->T::after_draw2D(); }, begin, end);
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_COMPONENT_POOL_HPP_
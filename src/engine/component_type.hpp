@@ -0,0 +1,82 @@
+#ifndef _SPRF_COMPONENT_TYPE_HPP_
+#define _SPRF_COMPONENT_TYPE_HPP_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/** @brief Most component types a program can use (bits in a
+ * `component_mask_t`) */
+#define MAX_COMPONENT_TYPES (64)
+
+namespace SPRF {
+
+/** @brief One bit per component type id */
+typedef uint64_t component_mask_t;
+
+/**
+ * @brief Number of set bits in `mask`.
+ */
+inline size_t popcount64(component_mask_t mask) {
+#ifdef _MSC_VER
+    return __popcnt64(mask);
+#else
+    return __builtin_popcountll(mask);
+#endif
+}
+
+/**
+ * @brief Hands out the next component type id.
+ */
+inline size_t next_component_type_id() {
+    static size_t counter = 0;
+    size_t out = counter++;
+    assert(out < MAX_COMPONENT_TYPES);
+    return out;
+}
+
+/**
+ * @brief Small dense id per component type.
+ *
+ * Ids are assigned once per type during static initialization, so looking
+ * one up is a plain load instead of hashing a `std::type_index`. Ids index
+ * the scene's component pools and the bits of an entity's component mask.
+ *
+ * @tparam T Component type.
+ */
+template <class T> struct ComponentType {
+    static const size_t id;
+
+    /** @brief Bit for `T` in a `component_mask_t` */
+    static component_mask_t bit() { return ((component_mask_t)1) << id; }
+};
+
+template <class T>
+const size_t ComponentType<T>::id = next_component_type_id();
+
+/**
+ * @brief List of component types a component reads or writes.
+ *
+ * Components that want their update phases to run on the worker threads
+ * declare
+ *
+ *     static constexpr bool parallel = true;
+ *     using reads = ComponentAccess<NetworkEntity>;
+ *     using writes = ComponentAccess<Transform>;
+ *
+ * and the scheduler only runs two component types at the same time if
+ * neither writes something the other touches. A type always counts as
+ * writing itself. `Transform` can be listed like any component type.
+ */
+template <class... Ts> struct ComponentAccess {
+    static component_mask_t mask() {
+        return (ComponentType<Ts>::bit() | ... | (component_mask_t)0);
+    }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_COMPONENT_TYPE_HPP_
@@ -0,0 +1,323 @@
+#ifndef _SPRF_CULLING_HPP_
+#define _SPRF_CULLING_HPP_
+
+#include "raylib.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPRF_CULLING_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace SPRF {
+
+/**
+ * @brief Local bounds of a mesh, as used by `cull_instances`.
+ */
+struct CullBounds {
+    /** @brief Center of the AABB */
+    float center[3];
+    /** @brief Half size of the AABB along each axis */
+    float extents[3];
+    /** @brief Radius of the bounding sphere around `center` */
+    float radius;
+
+    CullBounds() {}
+
+    CullBounds(BoundingBox bbox) {
+        center[0] = (bbox.min.x + bbox.max.x) * 0.5f;
+        center[1] = (bbox.min.y + bbox.max.y) * 0.5f;
+        center[2] = (bbox.min.z + bbox.max.z) * 0.5f;
+        extents[0] = fabsf(bbox.max.x - bbox.min.x) * 0.5f;
+        extents[1] = fabsf(bbox.max.y - bbox.min.y) * 0.5f;
+        extents[2] = fabsf(bbox.max.z - bbox.min.z) * 0.5f;
+        radius = sqrtf(extents[0] * extents[0] + extents[1] * extents[1] +
+                       extents[2] * extents[2]);
+    }
+};
+
+/**
+ * @brief Six planes `(x, y, z, d)`, with points where `x*px + y*py + z*pz + d
+ * >= 0` on the inside. The normals don't need to be normalized. Opposite
+ * planes come in pairs (0 and 1, 2 and 3, 4 and 5).
+ */
+struct CullPlanes {
+    float planes[6][4];
+
+    /**
+     * @brief The same frustum with every plane pushed `margin` outwards.
+     */
+    CullPlanes expanded(float margin) const {
+        CullPlanes out;
+        for (int i = 0; i < 6; i++) {
+            const float* p = planes[i];
+            float len = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+            float inv = (len > 0) ? (1.0f / len) : 0.0f;
+            out.planes[i][0] = p[0] * inv;
+            out.planes[i][1] = p[1] * inv;
+            out.planes[i][2] = p[2] * inv;
+            out.planes[i][3] = p[3] * inv + margin;
+        }
+        return out;
+    }
+
+    /**
+     * @brief The eight corners of the frustum, intersecting one plane of each
+     * opposite pair.
+     *
+     * @return false if some three planes don't meet in a point.
+     */
+    bool corners(Vector3 out[8]) const {
+        for (int i = 0; i < 8; i++) {
+            const float* a = planes[(i & 1)];
+            const float* b = planes[2 + ((i >> 1) & 1)];
+            const float* c = planes[4 + ((i >> 2) & 1)];
+            // n_a.x = -d_a etc, by Cramer's rule
+            float bc[3] = {b[1] * c[2] - b[2] * c[1], b[2] * c[0] - b[0] * c[2],
+                           b[0] * c[1] - b[1] * c[0]};
+            float ca[3] = {c[1] * a[2] - c[2] * a[1], c[2] * a[0] - c[0] * a[2],
+                           c[0] * a[1] - c[1] * a[0]};
+            float ab[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+                           a[0] * b[1] - a[1] * b[0]};
+            float det = a[0] * bc[0] + a[1] * bc[1] + a[2] * bc[2];
+            if (fabsf(det) < 1e-12f)
+                return false;
+            float inv = -1.0f / det;
+            out[i].x = (a[3] * bc[0] + b[3] * ca[0] + c[3] * ab[0]) * inv;
+            out[i].y = (a[3] * bc[1] + b[3] * ca[1] + c[3] * ab[1]) * inv;
+            out[i].z = (a[3] * bc[2] + b[3] * ca[2] + c[3] * ab[2]) * inv;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Whether all of `points` are inside the frustum (which, as it is
+     * convex, means their convex hull is).
+     */
+    bool contains(const Vector3* points, int n) const {
+        for (int i = 0; i < 6; i++) {
+            const float* p = planes[i];
+            for (int j = 0; j < n; j++) {
+                if (p[0] * points[j].x + p[1] * points[j].y +
+                        p[2] * points[j].z + p[3] <
+                    0)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Extract the frustum planes of a (raylib) view projection
+     * matrix.
+     */
+    static CullPlanes from_matrix(Matrix vp) {
+        float rows[4][4] = {{vp.m0, vp.m4, vp.m8, vp.m12},
+                            {vp.m1, vp.m5, vp.m9, vp.m13},
+                            {vp.m2, vp.m6, vp.m10, vp.m14},
+                            {vp.m3, vp.m7, vp.m11, vp.m15}};
+        CullPlanes out;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 4; j++) {
+                out.planes[i * 2][j] = rows[3][j] + rows[i][j];
+                out.planes[i * 2 + 1][j] = rows[3][j] - rows[i][j];
+            }
+        }
+        return out;
+    }
+};
+
+/**
+ * @brief Whether one instance of a mesh may be visible.
+ *
+ * The local AABB is transformed to a world space AABB (center through the
+ * matrix, extents through its absolute value) and rejected only if it is
+ * entirely behind one of the planes, so it never culls anything visible.
+ */
+inline bool cull_visible(const CullPlanes& planes, const CullBounds& bounds,
+                         const Matrix& m) {
+    const float* c = bounds.center;
+    const float* e = bounds.extents;
+    float cx = m.m0 * c[0] + m.m4 * c[1] + m.m8 * c[2] + m.m12;
+    float cy = m.m1 * c[0] + m.m5 * c[1] + m.m9 * c[2] + m.m13;
+    float cz = m.m2 * c[0] + m.m6 * c[1] + m.m10 * c[2] + m.m14;
+    float ex = fabsf(m.m0) * e[0] + fabsf(m.m4) * e[1] + fabsf(m.m8) * e[2];
+    float ey = fabsf(m.m1) * e[0] + fabsf(m.m5) * e[1] + fabsf(m.m9) * e[2];
+    float ez = fabsf(m.m2) * e[0] + fabsf(m.m6) * e[1] + fabsf(m.m10) * e[2];
+    for (int i = 0; i < 6; i++) {
+        const float* p = planes.planes[i];
+        float dist = p[0] * cx + p[1] * cy + p[2] * cz + p[3];
+        float radius = fabsf(p[0]) * ex + fabsf(p[1]) * ey + fabsf(p[2]) * ez;
+        if (dist + radius < 0)
+            return false;
+    }
+    return true;
+}
+
+enum cull_result_t { CULL_OUTSIDE, CULL_INTERSECTS, CULL_INSIDE };
+
+/**
+ * @brief Classify a world space AABB against the planes. Like
+ * `cull_visible`, `CULL_OUTSIDE` is only returned if the box is entirely
+ * behind one plane.
+ */
+inline cull_result_t cull_aabb(const CullPlanes& planes, const float min[3],
+                               const float max[3]) {
+    float c[3];
+    float e[3];
+    for (int i = 0; i < 3; i++) {
+        c[i] = (min[i] + max[i]) * 0.5f;
+        e[i] = (max[i] - min[i]) * 0.5f;
+    }
+    cull_result_t out = CULL_INSIDE;
+    for (int i = 0; i < 6; i++) {
+        const float* p = planes.planes[i];
+        float dist = p[0] * c[0] + p[1] * c[1] + p[2] * c[2] + p[3];
+        float radius =
+            fabsf(p[0]) * e[0] + fabsf(p[1]) * e[1] + fabsf(p[2]) * e[2];
+        if (dist + radius < 0)
+            return CULL_OUTSIDE;
+        if (dist - radius < 0)
+            out = CULL_INTERSECTS;
+    }
+    return out;
+}
+
+/**
+ * @brief Call `visit(i)` for every instance `i` of a mesh that may be
+ * visible, in order.
+ *
+ * Same test as `cull_visible`. With SSE, four instances are tested at a
+ * time: their matrices are transposed into structure of arrays form so each
+ * plane is three multiply-adds per component for all four.
+ *
+ * @param in Instance transforms.
+ * @param n Number of instances.
+ */
+template <class F>
+inline void cull_instances_each(const CullPlanes& planes,
+                                const CullBounds& bounds, const Matrix* in,
+                                size_t n, F&& visit) {
+    size_t i = 0;
+#ifdef SPRF_CULLING_SSE
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 c[3];
+    __m128 e[3];
+    for (int k = 0; k < 3; k++) {
+        c[k] = _mm_set1_ps(bounds.center[k]);
+        e[k] = _mm_set1_ps(bounds.extents[k]);
+    }
+    __m128 p[6][4];
+    __m128 p_abs[6][3];
+    for (int k = 0; k < 6; k++) {
+        for (int j = 0; j < 4; j++) {
+            p[k][j] = _mm_set1_ps(planes.planes[k][j]);
+        }
+        for (int j = 0; j < 3; j++) {
+            p_abs[k][j] = _mm_set1_ps(fabsf(planes.planes[k][j]));
+        }
+    }
+
+    for (; i + 4 <= n; i += 4) {
+        const float* m = (const float*)(in + i);
+        __m128 center[3];
+        __m128 extent[3];
+        for (int row = 0; row < 3; row++) {
+            // row `row` of each matrix is the `row`th output component
+            __m128 a = _mm_loadu_ps(m + row * 4);
+            __m128 b = _mm_loadu_ps(m + 16 + row * 4);
+            __m128 d = _mm_loadu_ps(m + 32 + row * 4);
+            __m128 f = _mm_loadu_ps(m + 48 + row * 4);
+            _MM_TRANSPOSE4_PS(a, b, d, f);
+            center[row] = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(a, c[0]), _mm_mul_ps(b, c[1])),
+                _mm_add_ps(_mm_mul_ps(d, c[2]), f));
+            extent[row] = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, a), e[0]),
+                           _mm_mul_ps(_mm_andnot_ps(sign, b), e[1])),
+                _mm_mul_ps(_mm_andnot_ps(sign, d), e[2]));
+        }
+        __m128 outside = zero;
+        for (int j = 0; j < 6; j++) {
+            __m128 dist = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(p[j][0], center[0]),
+                           _mm_mul_ps(p[j][1], center[1])),
+                _mm_add_ps(_mm_mul_ps(p[j][2], center[2]), p[j][3]));
+            __m128 radius = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(p_abs[j][0], extent[0]),
+                           _mm_mul_ps(p_abs[j][1], extent[1])),
+                _mm_mul_ps(p_abs[j][2], extent[2]));
+            outside =
+                _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, radius), zero));
+        }
+        int visible = (~_mm_movemask_ps(outside)) & 0xF;
+        for (int j = 0; j < 4; j++) {
+            if (visible & (1 << j))
+                visit(i + j);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (cull_visible(planes, bounds, in[i]))
+            visit(i);
+    }
+}
+
+/**
+ * @brief `cull_instances` without SIMD, one instance at a time.
+ */
+inline size_t cull_instances_scalar(const CullPlanes& planes,
+                                    const CullBounds& bounds, const Matrix* in,
+                                    size_t n, Matrix* out) {
+    size_t n_visible = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (cull_visible(planes, bounds, in[i]))
+            out[n_visible++] = in[i];
+    }
+    return n_visible;
+}
+
+/**
+ * @brief Copy the instances of a mesh that may be visible to `out` (see
+ * `cull_instances_each`).
+ *
+ * @param in Instance transforms.
+ * @param n Number of instances.
+ * @param out Room for `n` transforms.
+ * @return size_t Number of transforms written to `out`.
+ */
+inline size_t cull_instances(const CullPlanes& planes, const CullBounds& bounds,
+                             const Matrix* in, size_t n, Matrix* out) {
+    size_t n_visible = 0;
+    cull_instances_each(planes, bounds, in, n,
+                        [&](size_t i) { out[n_visible++] = in[i]; });
+    return n_visible;
+}
+
+/**
+ * @brief Mark the instances of a mesh that may be visible (see
+ * `cull_instances_each`), for drawing them where they are instead of
+ * copying them.
+ *
+ * @param visible Set to 1 for instances that may be visible, 0 for the
+ * rest. Room for `n`.
+ * @return size_t Number of instances marked visible.
+ */
+inline size_t cull_instances_mask(const CullPlanes& planes,
+                                  const CullBounds& bounds, const Matrix* in,
+                                  size_t n, uint8_t* visible) {
+    memset(visible, 0, n);
+    size_t n_visible = 0;
+    cull_instances_each(planes, bounds, in, n, [&](size_t i) {
+        visible[i] = 1;
+        n_visible++;
+    });
+    return n_visible;
+}
+
+} // namespace SPRF
+
+#endif // _SPRF_CULLING_HPP_
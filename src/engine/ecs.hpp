@@ -2,8 +2,14 @@
 #define _SPRB_ECS_HPP_
 
 #include "base.hpp"
+#include "component_pool.hpp"
+#include "component_type.hpp"
+#include "entity_commands.hpp"
+#include "entity_pool.hpp"
 #include "imgui/imgui.h"
 #include "imgui/rlImGui.h"
+#include "job_system.hpp"
+#include "name_table.hpp"
 //#include "raylib-cpp.hpp"
 #include "renderer.hpp"
 #include <cassert>
@@ -31,9 +37,22 @@ class Component : public Logger {
   private:
     /** @brief Pointer to the parent entity */
     Entity* m_entity = NULL;
+    /** @brief Pool the component was allocated from */
+    ComponentPoolBase* m_pool = NULL;
+    /** @brief Index of the component in `m_pool` */
+    size_t m_pool_slot = 0;
 
   public:
     Component() {}
+    /**
+     * @brief Set the pool the component lives in (see `ComponentPool`).
+     */
+    void set_pool(ComponentPoolBase* pool, size_t slot) {
+        m_pool = pool;
+        m_pool_slot = slot;
+    }
+    ComponentPoolBase* pool() { return m_pool; }
+    size_t pool_slot() { return m_pool_slot; }
     /**
      * @brief Get the parent entity of the component.
      * @return Pointer to the parent entity.
@@ -86,16 +105,43 @@ class Component : public Logger {
 
 /**
  * @brief Class representing a transform with position, rotation, and scale.
+ *
+ * The fields are only written through the setters, which mark the cached
+ * matrices dirty; they are rebuilt the next time they are asked for. Every
+ * rebuild bumps `version()`, which is what entities use to tell if their
+ * cached world matrix is stale.
  */
 class Transform : public Logger {
-  public:
+  private:
     /** @brief Position of the transform */
-    vec3 position;
+    vec3 m_position;
     /** @brief Rotation of the transform */
-    vec3 rotation;
+    vec3 m_rotation;
     /** @brief Scale of the transform */
-    vec3 scale;
+    vec3 m_scale;
+    mat4x4 m_local;
+    mat4x4 m_local_rotation;
+    /** @brief Bumped every time the cached matrices change */
+    uint32_t m_version = 0;
+    /** @brief Set by the setters, the cached matrices need rebuilding */
+    bool m_dirty = true;
+
+    /**
+     * @brief Rebuild the cached matrices if a setter was called.
+     */
+    void validate() {
+        if (!m_dirty)
+            return;
+        m_local_rotation = quat::FromEuler(m_rotation).ToMatrix();
+        auto mat_scale = mat4x4::Scale(m_scale.x, m_scale.y, m_scale.z);
+        auto mat_translation =
+            mat4x4::Translate(m_position.x, m_position.y, m_position.z);
+        m_local = mat_scale * m_local_rotation * mat_translation;
+        m_dirty = false;
+        m_version++;
+    }
 
+  public:
     /**
      * @brief Construct a new Transform object.
      * @param position_ Initial position.
@@ -105,43 +151,78 @@ class Transform : public Logger {
     Transform(vec3 position_ = vec3(0, 0, 0),
               vec3 rotation_ = vec3(0, 0, 0),
               vec3 scale_ = vec3(1, 1, 1))
-        : position(position_), rotation(rotation_), scale(scale_) {}
+        : m_position(position_), m_rotation(rotation_), m_scale(scale_) {}
+
+    vec3 position() const { return m_position; }
+
+    void position(vec3 position_) {
+        m_position = position_;
+        m_dirty = true;
+    }
+
+    vec3 rotation() const { return m_rotation; }
+
+    void rotation(vec3 rotation_) {
+        m_rotation = rotation_;
+        m_dirty = true;
+    }
+
+    vec3 scale() const { return m_scale; }
+
+    void scale(vec3 scale_) {
+        m_scale = scale_;
+        m_dirty = true;
+    }
 
     /**
      * @brief Get the transformation matrix.
      * @return Transformation matrix.
      */
     mat4x4 matrix() {
-        auto mat_scale = mat4x4::Scale(scale.x, scale.y, scale.z);
-        auto mat_rotation = quat::FromEuler(rotation).ToMatrix();
-        auto mat_translation =
-            mat4x4::Translate(position.x, position.y, position.z);
-        return mat_scale * mat_rotation * mat_translation;
+        validate();
+        return m_local;
     }
 
     mat4x4 rotation_matrix() {
-        return quat::FromEuler(rotation).ToMatrix();
+        validate();
+        return m_local_rotation;
+    }
+
+    /**
+     * @brief Changes every time `matrix()` does.
+     */
+    uint32_t version() {
+        validate();
+        return m_version;
     }
 
     void draw_editor() {
         ImGui::Text("Transform");
-        ImGui::InputFloat3("pos", (float*)&this->position);
-        ImGui::InputFloat3("rot", (float*)&this->rotation);
-        ImGui::InputFloat3("scale", (float*)&this->scale);
+        if (ImGui::InputFloat3("pos", (float*)&m_position))
+            m_dirty = true;
+        if (ImGui::InputFloat3("rot", (float*)&m_rotation))
+            m_dirty = true;
+        if (ImGui::InputFloat3("scale", (float*)&m_scale))
+            m_dirty = true;
     }
 };
 
-extern int id_counter;
-
 /**
  * @brief Class representing an entity in the scene.
  *
- * Entities are containers for components and manage their lifecycle.
+ * Entities are containers for components and manage their lifecycle. They
+ * are allocated from the scene's `EntityPool`, so create them with
+ * `Scene::create_entity` or `create_child` and destroy them with
+ * `Scene::destroy_entity`. Anything that outlives a frame should hold the
+ * entity's `handle()` rather than a pointer.
  */
 class Entity : public Logger {
   private:
-    /** @brief Components attached to the entity */
-    std::unordered_map<std::type_index, Component*> m_components;
+    /** @brief Bit `ComponentType<T>::id` is set if we have a `T` */
+    component_mask_t m_component_mask = 0;
+    /** @brief Components attached to the entity, packed in type id order.
+     * The slot of a type is the number of mask bits below its bit. */
+    std::vector<Component*> m_components;
     /** @brief Children entities */
     std::vector<Entity*> m_children;
     /** @brief Transform of the entity */
@@ -150,69 +231,104 @@ class Entity : public Logger {
     Scene* m_scene;
     /** @brief Pointer to the parent entity */
     Entity* m_parent = NULL;
-    int m_id;
+    /** @brief Our slot in the scene's entity pool */
+    EntityHandle m_handle;
     bool m_enabled;
-    std::string m_name = "";
+    /** @brief Enabled, and so are all of our ancestors */
+    bool m_active_in_hierarchy;
+
+    /** @brief Cached `global_transform()` */
+    mat4x4 m_world;
+    /** @brief Cached `global_rotation()` */
+    mat4x4 m_world_rotation;
+    /** @brief Bumped every time `m_world` changes */
+    uint32_t m_world_version = 0;
+    /** @brief `m_transform.version()` and the parent's `m_world_version` that
+     * `m_world` was built from */
+    uint32_t m_world_local_version = 0;
+    uint32_t m_world_parent_version = 0;
+    bool m_world_valid = false;
 
     /**
-     * @brief Add a child entity.
-     * @param child Pointer to the child entity.
+     * @brief Rebuild `m_world` from our parent's, which must already be up
+     * to date, if either our transform or the parent's world matrix changed.
      */
-    void add_child(Entity* child) { m_children.push_back(child); }
+    void update_world() {
+        uint32_t parent_version = m_parent ? m_parent->m_world_version : 0;
+        uint32_t local_version = m_transform.version();
+        if (m_world_valid && (local_version == m_world_local_version) &&
+            (parent_version == m_world_parent_version))
+            return;
+        if (m_parent) {
+            m_world = m_transform.matrix() * m_parent->m_world;
+            m_world_rotation =
+                m_transform.rotation_matrix() * m_parent->m_world_rotation;
+        } else {
+            m_world = m_transform.matrix();
+            m_world_rotation = m_transform.rotation_matrix();
+        }
+        m_world_local_version = local_version;
+        m_world_parent_version = parent_version;
+        m_world_valid = true;
+        m_world_version++;
+    }
 
     /**
-     * @brief Call draw3D on components.
-     * @param parent_transform Transformation matrix of the parent.
+     * @brief Rebuild `m_world` if our transform or any ancestor's changed.
+     *
+     * Walks up to the root, so it is only for lookups outside of
+     * `update_transforms` (when the scene's transforms aren't clean).
      */
-    void draw3D(mat4x4 parent_transform) {
-        if (!m_enabled)
-            return;
-        mat4x4 transform = m_transform.matrix() * parent_transform;
-        for (const auto& [key, value] : m_components) {
-            value->draw3D(transform);
-        }
-        for (auto i : m_children) {
-            i->draw3D(transform);
-        }
+    void validate_world() {
+        if (m_parent)
+            m_parent->validate_world();
+        update_world();
     }
 
-  public:
     /**
-     * @brief Call after_update on components.
+     * @brief `update_world` for this subtree, parents before children.
      */
-    void after_update() {
-        if (!m_enabled)
-            return;
-        for (const auto& [key, value] : m_components) {
-            value->after_update();
-        }
+    void update_subtree() {
+        update_world();
         for (auto i : m_children) {
-            i->after_update();
+            i->update_subtree();
         }
     }
+    std::string m_name = "";
+    /** @brief `m_name` interned in the scene's name table */
+    name_id_t m_name_id = NAME_ID_NONE;
 
     /**
-     * @brief Call before_update on components.
+     * @brief Recompute `m_active_in_hierarchy` for us and our children.
      */
-    void before_update() {
-        if (!m_enabled)
+    void update_active() {
+        bool active =
+            m_enabled && ((!m_parent) || m_parent->m_active_in_hierarchy);
+        if (active == m_active_in_hierarchy)
             return;
-        for (const auto& [key, value] : m_components) {
-            value->before_update();
+        m_active_in_hierarchy = active;
+        for (auto i : m_components) {
+            i->pool()->mark_dirty();
         }
         for (auto i : m_children) {
-            i->before_update();
+            i->update_active();
         }
     }
 
+    /**
+     * @brief Add a child entity.
+     * @param child Pointer to the child entity.
+     */
+    void add_child(Entity* child) { m_children.push_back(child); }
+
+  public:
     /**
      * @brief Construct a new Entity object.
      * @param scene Pointer to the scene.
      */
     Entity(Scene* scene, std::string name = "") : m_scene(scene), m_name(name) {
-        m_id = id_counter++;
         m_enabled = true;
-        TraceLog(LOG_INFO, "created entity %d", m_id);
+        m_active_in_hierarchy = true;
     };
 
     /**
@@ -222,25 +338,31 @@ class Entity : public Logger {
      */
     Entity(Scene* scene, Entity* parent, std::string name = "")
         : m_scene(scene), m_parent(parent), m_name(name) {
-        m_id = id_counter++;
         m_enabled = true;
-        TraceLog(LOG_INFO, "created entity %d", m_id);
+        m_active_in_hierarchy = parent->active_in_hierarchy();
     };
 
     /**
-     * @brief Destroy the Entity object and its components.
+     * @brief Called by the pool when the entity is allocated.
      */
-    ~Entity() {
-        TraceLog(LOG_INFO, "deleting entity %d", m_id);
-        for (const auto& [key, value] : m_components) {
-            delete value;
-        }
-        for (auto i : m_children) {
-            delete i;
-        }
+    void set_handle(EntityHandle handle) {
+        m_handle = handle;
+        TraceLog(LOG_INFO, "created entity %u", id());
     }
 
-    std::string& name() { return m_name; }
+    const std::string& name() { return m_name; }
+
+    /**
+     * @brief Rename the entity, keeping the scene's name index up to date.
+     */
+    void set_name(std::string name);
+
+    name_id_t name_id() { return m_name_id; }
+
+    /**
+     * @brief Called by the scene when the entity is added to its name index.
+     */
+    void set_name_id(name_id_t id) { m_name_id = id; }
 
     size_t n_children() { return m_children.size(); }
 
@@ -250,120 +372,77 @@ class Entity : public Logger {
         return m_children[idx];
     }
 
-    int id() { return m_id; }
+    /** @brief Handle to this entity, stays safe to resolve with
+     * `Scene::get_entity` after the entity is destroyed */
+    EntityHandle handle() { return m_handle; }
+
+    uint32_t id() { return m_handle.value; }
+
+    Entity* parent() { return m_parent; }
 
     std::vector<Entity*>& children() { return m_children; }
 
     /**
      * @brief Get the global transformation matrix.
+     *
+     * Cached, and only recomputed when this entity's or an ancestor's
+     * transform changed (see `Scene::update_transforms`).
+     *
      * @return Global transformation matrix.
      */
-    mat4x4 global_transform() {
-        if (!m_parent) {
-            return m_transform.matrix();
-        }
-        return m_transform.matrix() * m_parent->global_transform();
-    }
+    mat4x4 global_transform();
 
-    mat4x4 global_rotation() {
-        if (!m_parent) {
-            return m_transform.rotation_matrix();
-        }
-        return m_transform.rotation_matrix() * m_parent->global_rotation();
+    mat4x4 global_rotation();
+
+    /**
+     * @brief Counter that changes whenever `global_transform()` does, so
+     * callers can tell whether this entity moved since they last looked.
+     */
+    uint32_t world_version();
+
+    /**
+     * @brief Bring the cached world matrices of this subtree up to date,
+     * parents before children.
+     *
+     * Our ancestors are validated once, then every entity of the subtree is
+     * visited once, building on its parent's already updated matrix.
+     */
+    void update_transforms() {
+        if (m_parent)
+            m_parent->validate_world();
+        update_subtree();
     }
 
     void enable() {
-        TraceLog(LOG_INFO, "enabling entity %d", m_id);
+        TraceLog(LOG_INFO, "enabling entity %u", id());
         m_enabled = true;
+        update_active();
     }
 
     void disable() {
-        TraceLog(LOG_INFO, "disabling entity %d", m_id);
+        TraceLog(LOG_INFO, "disabling entity %u", id());
         m_enabled = false;
+        update_active();
     }
 
-    /**
-     * @brief Create a child entity.
-     * @return Pointer to the child entity.
-     */
-    Entity* create_child(std::string name = "entity") {
-        Entity* out = new Entity(m_scene, this, name);
-        add_child(out);
-        return out;
-    }
-
-    /**
-     * @brief Call update on components.
-     */
-    void update() {
-        if (!m_enabled)
-            return;
-        // before_update();
-        for (const auto& [key, value] : m_components) {
-            value->update();
-        }
-        for (auto i : m_children) {
-            i->update();
-        }
-        // after_update();
-    }
+    bool enabled() { return m_enabled; }
 
     /**
-     * @brief Call draw3D on components.
+     * @brief Whether the entity and all of its ancestors are enabled.
      */
-    void draw3D() {
-        if (!m_enabled)
-            return;
-        mat4x4 transform = m_transform.matrix();
-        for (const auto& [key, value] : m_components) {
-            value->draw3D(transform);
-        }
-        for (auto i : m_children) {
-            i->draw3D(transform);
-        }
-    }
+    bool active_in_hierarchy() { return m_active_in_hierarchy; }
 
     /**
-     * @brief Call draw2D on components.
+     * @brief Create a child entity.
+     * @return Pointer to the child entity.
      */
-    void draw2D() {
-        if (!m_enabled)
-            return;
-        for (const auto& [key, value] : m_components) {
-            value->draw2D();
-        }
-        for (auto i : m_children) {
-            i->draw2D();
-        }
-    }
-
-    void before_draw2D() {
-        if (!m_enabled)
-            return;
-        for (const auto& [key, value] : m_components) {
-            value->before_draw2D();
-        }
-        for (auto i : m_children) {
-            i->before_draw2D();
-        }
-    }
-
-    void after_draw2D() {
-        if (!m_enabled)
-            return;
-        for (const auto& [key, value] : m_components) {
-            value->after_draw2D();
-        }
-        for (auto i : m_children) {
-            i->after_draw2D();
-        }
-    }
+    Entity* create_child(std::string name = "entity");
 
     /**
      * @brief Call init on components.
      */
     void init() {
-        for (const auto& [key, value] : m_components) {
+        for (auto value : m_components) {
             value->init();
         }
         for (int i = 0; i < m_children.size(); i++) {
@@ -375,7 +454,7 @@ class Entity : public Logger {
      * @brief Call destroy on components.
      */
     void destroy() {
-        for (const auto& [key, value] : m_components) {
+        for (auto value : m_components) {
             value->destroy();
         }
         for (auto i : m_children) {
@@ -383,54 +462,41 @@ class Entity : public Logger {
         }
     }
 
-    /**
-     * @brief Call draw_debug on components.
-     */
-    void draw_debug() {
-        if (!m_enabled)
-            return;
-        for (const auto& [key, value] : m_components) {
-            value->draw_debug();
-        }
-        for (auto i : m_children) {
-            i->draw_debug();
-        }
-    }
-
     /**
      * @brief Get a component of the entity.
      * @tparam T Type of the component.
      * @return Pointer to the component.
      */
     template <class T> T* get_component() {
-        auto temp = m_components.find(std::type_index(typeid(T)));
-        assert((temp != m_components.end()));
-        return dynamic_cast<T*>(temp->second);
+        assert(has_component<T>());
+        return static_cast<T*>(m_components[component_slot<T>()]);
     }
 
     template <class T> bool has_component() {
-        auto temp = m_components.find(std::type_index(typeid(T)));
-        return (temp != m_components.end());
+        return (m_component_mask & ComponentType<T>::bit()) != 0;
     }
 
-    std::unordered_map<std::type_index, Component*>& components() {
-        return m_components;
+    /**
+     * @brief Index of `T` in `m_components` (where it is, or would be
+     * inserted).
+     */
+    template <class T> size_t component_slot() {
+        return popcount64(m_component_mask & (ComponentType<T>::bit() - 1));
     }
 
+    std::vector<Component*>& components() { return m_components; }
+
     /**
      * @brief Add a component to the entity.
+     *
+     * The component is allocated from the scene's pool for `T`.
+     *
      * @tparam T Type of the component.
      * @tparam Args Parameter pack for the component constructor.
      * @param args Arguments for the component constructor.
      * @return Pointer to the added component.
      */
-    template <class T, typename... Args> T* add_component(Args... args) {
-        auto temp = m_components.find(std::type_index(typeid(T)));
-        assert((temp == m_components.end()));
-        m_components[std::type_index(typeid(T))] = new T(args...);
-        m_components[std::type_index(typeid(T))]->set_parent(this);
-        return get_component<T>();
-    }
+    template <class T, typename... Args> T* add_component(Args... args);
 
     /**
      * @brief Get the scene the entity belongs to.
@@ -438,17 +504,53 @@ class Entity : public Logger {
      */
     Scene* scene() { return m_scene; }
 
-    Entity* find_entity(std::string entity_name) {
-        if (name() == entity_name) {
+    /**
+     * @brief Find an entity called `entity_name` in this subtree (including
+     * this entity).
+     *
+     * Looked up in the scene's name index. If several match, returns the one
+     * a depth first search would find first.
+     *
+     * @return Entity* The entity, or NULL if there is none.
+     */
+    Entity* find_entity(const std::string& entity_name);
+
+    /**
+     * @brief Find a descendant by path, e.g. `"hands/hands_model"`.
+     *
+     * Each `/` separated part names a direct child of the previous one,
+     * starting from this entity's children. Where siblings share a name each
+     * of them is tried in turn, so the path matches if any chain of names
+     * does; the first such chain in child order wins.
+     *
+     * @return Entity* The entity, or NULL if no chain matches.
+     */
+    Entity* find_path(const std::string& path);
+
+    /**
+     * @brief `find_path` for a path already split into name ids.
+     */
+    Entity* find_path(const name_id_t* ids, size_t n) {
+        if (n == 0)
             return this;
+        for (auto i : m_children) {
+            if (i->name_id() != ids[0])
+                continue;
+            if (Entity* out = i->find_path(ids + 1, n - 1))
+                return out;
         }
-        Entity* out = NULL;
-        for (auto& i : m_children) {
-            if ((out = i->find_entity(entity_name))) {
-                break;
-            }
+        return NULL;
+    }
+
+    /**
+     * @brief First direct child with name id `name`.
+     */
+    Entity* find_child(name_id_t name) {
+        for (auto i : m_children) {
+            if (i->name_id() == name)
+                return i;
         }
-        return out;
+        return NULL;
     }
 };
 
@@ -465,9 +567,28 @@ template <> Transform* Entity::get_component<Transform>();
  * rendering.
  */
 class Scene : public Logger {
+    friend class Entity;
+
   private:
-    /** @brief Entities in the scene */
+    /** @brief Root entities in the scene */
     std::vector<Entity*> m_entities;
+    /** @brief Storage for every entity in the scene, roots and children */
+    EntityPool<Entity> m_entity_pool;
+    /** @brief Every entity name used in the scene */
+    NameTable m_names;
+    /** @brief Entities by name id, in no particular order */
+    std::vector<std::vector<Entity*>> m_name_index;
+    /** @brief Hierarchy changes recorded during phases */
+    EntityCommands m_commands;
+
+    /** @brief One pool per component type, in the order the types were first
+     * added. Phases run pool by pool. */
+    std::vector<std::unique_ptr<ComponentPoolBase>> m_pools;
+    /** @brief Pools by `ComponentType<T>::id` (NULL until first used) */
+    ComponentPoolBase* m_pool_index[MAX_COMPONENT_TYPES] = {};
+    /** @brief Pools whose type overrides each phase's hook, in `m_pools`
+     * order. Phases only visit these. */
+    std::vector<ComponentPoolBase*> m_phase_pools[PHASE_COUNT];
 
     /** @brief Default camera in the scene */
     raylib::Camera3D m_default_camera;
@@ -482,25 +603,256 @@ class Scene : public Logger {
 
     bool m_should_close = false;
 
+    /** @brief Set while drawing, when transforms can't change and every
+     * entity's world matrix was just brought up to date */
+    bool m_transforms_clean = false;
+
+    /** @brief Worker threads for parallel components, started the first time
+     * one needs to run */
+    std::unique_ptr<JobSystem> m_jobs;
+
     /**
      * @brief Add an entity to the scene.
      * @param entity Pointer to the entity.
      */
     void add_entity(Entity* entity) { m_entities.push_back(entity); }
 
+    /**
+     * @brief Add `entity` to the name index under its current name.
+     */
+    void index_entity(Entity* entity) {
+        name_id_t id = m_names.intern(entity->name());
+        entity->set_name_id(id);
+        if (id >= m_name_index.size())
+            m_name_index.resize(id + 1);
+        m_name_index[id].push_back(entity);
+    }
+
+    /**
+     * @brief Remove `entity` from the name index.
+     */
+    void unindex_entity(Entity* entity) {
+        std::vector<Entity*>& entities = m_name_index[entity->name_id()];
+        for (size_t i = 0; i < entities.size(); i++) {
+            if (entities[i] == entity) {
+                entities[i] = entities.back();
+                entities.pop_back();
+                break;
+            }
+        }
+    }
+
+    /**
+     * @brief Whether a depth first search of the scene reaches `a` before
+     * `b`.
+     *
+     * Compares the root to entity paths, so only walks the two ancestor
+     * chains and the children of the node where they split.
+     */
+    bool visited_before(Entity* a, Entity* b) {
+        std::vector<Entity*> path_a;
+        std::vector<Entity*> path_b;
+        for (Entity* i = a; i; i = i->parent())
+            path_a.push_back(i);
+        for (Entity* i = b; i; i = i->parent())
+            path_b.push_back(i);
+        size_t len_a = path_a.size();
+        size_t len_b = path_b.size();
+        size_t depth = 0;
+        while ((depth < len_a) && (depth < len_b) &&
+               (path_a[len_a - 1 - depth] == path_b[len_b - 1 - depth]))
+            depth++;
+        // one is an ancestor of the other
+        if (depth == len_a)
+            return true;
+        if (depth == len_b)
+            return false;
+        Entity* split_a = path_a[len_a - 1 - depth];
+        Entity* split_b = path_b[len_b - 1 - depth];
+        std::vector<Entity*>& siblings =
+            split_a->parent() ? split_a->parent()->children() : m_entities;
+        for (auto i : siblings) {
+            if (i == split_a)
+                return true;
+            if (i == split_b)
+                return false;
+        }
+        return false;
+    }
+
+    /**
+     * @brief First entity (in depth first order) called `name` under
+     * `root`, or anywhere in the scene if `root` is NULL.
+     */
+    Entity* find_indexed(const std::string& name, Entity* root) {
+        name_id_t id = m_names.find(name);
+        if ((id == NAME_ID_NONE) || (id >= m_name_index.size()))
+            return NULL;
+        Entity* out = NULL;
+        for (auto i : m_name_index[id]) {
+            if (root) {
+                Entity* ancestor = i;
+                while (ancestor && (ancestor != root))
+                    ancestor = ancestor->parent();
+                if (!ancestor)
+                    continue;
+            }
+            if ((!out) || visited_before(i, out))
+                out = i;
+        }
+        return out;
+    }
+
+    /**
+     * @brief Return `entity`, its components and its subtree to the pools.
+     */
+    void free_entity(Entity* entity) {
+        for (auto i : entity->children()) {
+            free_entity(i);
+        }
+        for (auto i : entity->components()) {
+            i->pool()->release(i);
+        }
+        TraceLog(LOG_INFO, "deleting entity %u", entity->id());
+        unindex_entity(entity);
+        m_entity_pool.destroy(entity->handle());
+    }
+
     /**
      * @brief Update entity components.
      */
     void update() {
-        size_t len = m_entities.size();
-        for (size_t i = 0; i < len; i++) {
-            m_entities[i]->before_update();
+        run_phase(PHASE_BEFORE_UPDATE);
+        apply_commands();
+        run_phase(PHASE_UPDATE);
+        apply_commands();
+        run_phase(PHASE_AFTER_UPDATE);
+        apply_commands();
+    }
+
+    /**
+     * @brief Sync point: apply everything recorded in `m_commands`.
+     *
+     * Commands recorded by the callbacks of creates are applied too.
+     */
+    void apply_commands() {
+        PROFILE_SCOPE("apply_commands");
+        std::vector<EntityCommands::Command> commands;
+        while ((commands = m_commands.take()).size() > 0) {
+            for (auto& i : commands) {
+                Entity* target = get_entity(i.target);
+                switch (i.type) {
+                case ENTITY_COMMAND_CREATE: {
+                    if (i.target.valid() && !target)
+                        break;
+                    Entity* entity = target ? target->create_child(i.name)
+                                            : create_entity(i.name);
+                    if (i.callback)
+                        i.callback(entity);
+                    break;
+                }
+                case ENTITY_COMMAND_DESTROY:
+                    if (target)
+                        destroy_entity(target);
+                    break;
+                case ENTITY_COMMAND_ENABLE:
+                    if (target)
+                        target->enable();
+                    break;
+                case ENTITY_COMMAND_DISABLE:
+                    if (target)
+                        target->disable();
+                    break;
+                }
+            }
         }
-        for (size_t i = 0; i < len; i++) {
-            m_entities[i]->update();
+    }
+
+    /**
+     * @brief Run one update phase over every pool.
+     *
+     * Pools run in order. Consecutive parallel pools whose declared accesses
+     * don't conflict (see `ComponentAccess`) are grouped into a stage and
+     * split into chunk sized jobs for the worker threads; everything else
+     * runs on the main thread, so components that touch raylib/GL or the
+     * scene don't need to change.
+     */
+    void run_phase(component_phase_t phase) {
+        PROFILE_SCOPE(component_phase_name(phase));
+        std::vector<ComponentPoolBase*>& pools = m_phase_pools[phase];
+        // pools created mid update (new component types) are picked up next
+        // frame
+        size_t len = pools.size();
+        size_t i = 0;
+        while (i < len) {
+            if (!pools[i]->parallel()) {
+                pools[i]->refresh();
+                pools[i]->run(phase, 0, pools[i]->count());
+                i++;
+                continue;
+            }
+            component_mask_t reads = 0;
+            component_mask_t writes = 0;
+            size_t end = i;
+            while ((end < len) && pools[end]->parallel()) {
+                component_mask_t r = pools[end]->reads();
+                component_mask_t w = pools[end]->writes();
+                if ((w & (reads | writes)) || (r & writes))
+                    break;
+                reads |= r;
+                writes |= w;
+                end++;
+            }
+            run_stage(phase, i, end,
+                      (reads | writes) & ComponentType<Transform>::bit());
+            i = end;
+        }
+    }
+
+    /**
+     * @brief Run pools [begin, end) of `m_phase_pools[phase]` on the worker
+     * threads.
+     *
+     * World matrices are frozen for the stage so `global_transform` never
+     * updates caches shared between threads; they are brought up to date
+     * first if any pool in the stage touches `Transform`.
+     */
+    void run_stage(component_phase_t phase, size_t begin, size_t end,
+                   bool uses_transforms) {
+        if (!m_jobs)
+            m_jobs = std::make_unique<JobSystem>();
+        if (uses_transforms) {
+            update_transforms();
+            m_transforms_clean = true;
+        }
+        std::vector<JobSystem::job_t> jobs;
+        for (size_t i = begin; i < end; i++) {
+            ComponentPoolBase* pool = m_phase_pools[phase][i];
+            pool->refresh();
+            size_t count = pool->count();
+            for (size_t j = 0; j < count; j += COMPONENT_POOL_CHUNK_SIZE) {
+                size_t chunk_end = j + COMPONENT_POOL_CHUNK_SIZE;
+                if (chunk_end > count)
+                    chunk_end = count;
+                jobs.push_back([pool, phase, j, chunk_end]() {
+                    pool->run(phase, j, chunk_end);
+                });
+            }
         }
+        m_jobs->run(jobs);
+        m_transforms_clean = false;
+    }
+
+    /**
+     * @brief Run a phase over its pools on the main thread.
+     */
+    void run_main(component_phase_t phase) {
+        PROFILE_SCOPE(component_phase_name(phase));
+        std::vector<ComponentPoolBase*>& pools = m_phase_pools[phase];
+        size_t len = pools.size();
         for (size_t i = 0; i < len; i++) {
-            m_entities[i]->after_update();
+            pools[i]->refresh();
+            pools[i]->run(phase, 0, pools[i]->count());
         }
     }
 
@@ -508,20 +860,30 @@ class Scene : public Logger {
      * @brief Call draw3D on entity components.
      */
     void draw3D() {
-        for (auto i : m_entities) {
-            i->draw3D();
+        {
+            PROFILE_SCOPE("update_transforms");
+            update_transforms();
         }
+        m_transforms_clean = true;
+        run_main(PHASE_DRAW3D);
+        m_transforms_clean = false;
     }
 
     /**
-     * @brief Call draw3D on entity components.
+     * @brief Bring every entity's cached world matrix up to date in one top
+     * down pass.
      */
-    void draw_debug() {
+    void update_transforms() {
         for (auto i : m_entities) {
-            i->draw_debug();
+            i->update_transforms();
         }
     }
 
+    /**
+     * @brief Call draw_debug on entity components.
+     */
+    void draw_debug() { run_main(PHASE_DRAW_DEBUG); }
+
   public:
     /**
      * @brief Get the active camera of the scene.
@@ -536,14 +898,50 @@ class Scene : public Logger {
 
     template <typename... Args> Scene(Args... args) {}
 
+    /**
+     * @brief Bulk destroy everything in the scene.
+     *
+     * Components go first, pool by pool, then every entity in one pass over
+     * the entity pool, instead of unlinking the hierarchy one entity at a
+     * time.
+     */
     virtual ~Scene() {
-        for (auto i : m_entities) {
-            delete i;
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            m_phase_pools[i].clear();
+        }
+        for (int i = 0; i < MAX_COMPONENT_TYPES; i++) {
+            m_pool_index[i] = NULL;
+        }
+        m_pools.clear();
+        m_entities.clear();
+        m_name_index.clear();
+        m_entity_pool.clear();
+    }
+
+    /**
+     * @brief Get the pool that components of type `T` are allocated from.
+     */
+    template <class T> ComponentPool<T>* pool() {
+        ComponentPoolBase*& out = m_pool_index[ComponentType<T>::id];
+        if (!out) {
+            out = new ComponentPool<T>();
+            m_pools.push_back(std::unique_ptr<ComponentPoolBase>(out));
+            for (int i = 0; i < PHASE_COUNT; i++) {
+                if (out->implements((component_phase_t)i))
+                    m_phase_pools[i].push_back(out);
+            }
         }
+        return static_cast<ComponentPool<T>*>(out);
     }
 
     bool should_close() { return m_should_close; }
 
+    /**
+     * @brief Whether every cached world matrix is known to be up to date, so
+     * `Entity::global_transform` can skip checking its ancestors.
+     */
+    bool transforms_clean() { return m_transforms_clean; }
+
     void close() {
         TraceLog(LOG_INFO, "Closing scene...");
         m_should_close = true;
@@ -564,11 +962,47 @@ class Scene : public Logger {
      * @return Pointer to the created entity.
      */
     Entity* create_entity(std::string name = "entity") {
-        auto out = new Entity(this, name);
+        auto out = m_entity_pool.create(this, name);
+        index_entity(out);
         add_entity(out);
         return out;
     }
 
+    /**
+     * @brief Allocate a child of `parent`, use `Entity::create_child`.
+     */
+    Entity* create_child(Entity* parent, std::string name) {
+        auto out = m_entity_pool.create(this, parent, name);
+        index_entity(out);
+        return out;
+    }
+
+    /**
+     * @brief Resolve a handle.
+     * @return Entity* The entity, or NULL if it has been destroyed.
+     */
+    Entity* get_entity(EntityHandle handle) {
+        return m_entity_pool.get(handle);
+    }
+
+    /**
+     * @brief Destroy an entity, its components and all of its children.
+     *
+     * Handles to any of them stop resolving. Must not be called while the
+     * scene is running a phase, use `commands()` instead.
+     */
+    void destroy_entity(Entity* entity) {
+        std::vector<Entity*>& siblings =
+            entity->parent() ? entity->parent()->children() : m_entities;
+        for (size_t i = 0; i < siblings.size(); i++) {
+            if (siblings[i] == entity) {
+                siblings.erase(siblings.begin() + i);
+                break;
+            }
+        }
+        free_entity(entity);
+    }
+
     /**
      * @brief Initialize entity components.
      */
@@ -609,19 +1043,28 @@ class Scene : public Logger {
      * @param texture Render texture to draw to.
      */
     void draw(raylib::RenderTexture2D& texture) {
-        update();
+        {
+            PROFILE_SCOPE("update");
+            update();
+        }
 
         ClearBackground(BLACK);
 
         draw3D();
 
-        m_renderer.calculate_shadows(get_active_camera());
+        {
+            PROFILE_SCOPE("shadow pass");
+            m_renderer.calculate_shadows(get_active_camera());
+        }
 
         texture.BeginMode();
 
         get_active_camera()->BeginMode();
 
-        m_renderer.render(get_active_camera(), m_background_color);
+        {
+            PROFILE_SCOPE("render");
+            m_renderer.render(get_active_camera(), m_background_color);
+        }
 
         draw_debug();
 
@@ -636,29 +1079,129 @@ class Scene : public Logger {
      * @brief Call draw2D on entity components.
      */
     void draw2D() {
-        for (auto i : m_entities) {
-            i->before_draw2D();
-        }
-        for (auto i : m_entities) {
-            i->draw2D();
-        }
-        for (auto i : m_entities) {
-            i->after_draw2D();
-        }
+        run_main(PHASE_BEFORE_DRAW2D);
+        run_main(PHASE_DRAW2D);
+        run_main(PHASE_AFTER_DRAW2D);
+        apply_commands();
     }
 
+    /**
+     * @brief Buffer for creating, destroying, enabling and disabling
+     * entities from components while the scene is running.
+     */
+    EntityCommands& commands() { return m_commands; }
+
     std::vector<Entity*>& entities() { return m_entities; }
 
-    Entity* find_entity(std::string name) {
-        Entity* out = NULL;
-        for (auto& i : m_entities) {
-            if ((out = i->find_entity(name))) {
-                break;
-            }
+    /**
+     * @brief Find an entity by name anywhere in the scene.
+     *
+     * Looked up in the name index. If several match, returns the one a depth
+     * first search would find first.
+     *
+     * @return Entity* The entity, or NULL if there is none.
+     */
+    Entity* find_entity(const std::string& name) {
+        return find_indexed(name, NULL);
+    }
+
+    /**
+     * @brief Find an entity by path, e.g. `"player/camera/hands"`.
+     *
+     * The first `/` separated part names a root entity, each following part
+     * a direct child of the previous one. Every entity matching a part is
+     * tried, as in `Entity::find_path`.
+     *
+     * @return Entity* The entity, or NULL if no chain matches.
+     */
+    Entity* find_path(const std::string& path) {
+        std::vector<name_id_t> ids;
+        if (!path_ids(path, ids))
+            return NULL;
+        for (auto i : m_entities) {
+            if (i->name_id() != ids[0])
+                continue;
+            if (Entity* out = i->find_path(ids.data() + 1, ids.size() - 1))
+                return out;
+        }
+        return NULL;
+    }
+
+    /**
+     * @brief Split a `/` separated path into name ids.
+     *
+     * @return bool false if some part isn't the name of any entity.
+     */
+    bool path_ids(const std::string& path, std::vector<name_id_t>& ids) {
+        size_t begin = 0;
+        while (true) {
+            size_t end = path.find('/', begin);
+            name_id_t id = m_names.find(path.substr(begin, end - begin));
+            if (id == NAME_ID_NONE)
+                return false;
+            ids.push_back(id);
+            if (end == std::string::npos)
+                return true;
+            begin = end + 1;
         }
-        return out;
     }
+
+    /**
+     * @brief Every name used in the scene.
+     */
+    NameTable& names() { return m_names; }
 };
+
+inline Entity* Entity::create_child(std::string name) {
+    Entity* out = m_scene->create_child(this, name);
+    add_child(out);
+    return out;
+}
+
+inline void Entity::set_name(std::string name) {
+    m_scene->unindex_entity(this);
+    m_name = name;
+    m_scene->index_entity(this);
+}
+
+inline Entity* Entity::find_entity(const std::string& entity_name) {
+    return m_scene->find_indexed(entity_name, this);
+}
+
+inline Entity* Entity::find_path(const std::string& path) {
+    std::vector<name_id_t> ids;
+    if (!m_scene->path_ids(path, ids))
+        return NULL;
+    return find_path(ids.data(), ids.size());
+}
+
+inline mat4x4 Entity::global_transform() {
+    if (!m_scene->transforms_clean())
+        validate_world();
+    return m_world;
+}
+
+inline mat4x4 Entity::global_rotation() {
+    if (!m_scene->transforms_clean())
+        validate_world();
+    return m_world_rotation;
+}
+
+inline uint32_t Entity::world_version() {
+    if (!m_scene->transforms_clean())
+        validate_world();
+    return m_world_version;
+}
+
+template <class T, typename... Args> T* Entity::add_component(Args... args) {
+    assert(!has_component<T>());
+    T* out = m_scene->pool<T>()->create(args...);
+    out->set_parent(this);
+    m_components.insert(m_components.begin() + component_slot<T>(), out);
+    m_component_mask |= ComponentType<T>::bit();
+    return out;
+}
+
 } // namespace SPRF
 
 #endif //_SPRB_ECS_HPP_
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include <string>
 #include <vector>
 
+#include "animation_budget.hpp"
 #include "base.hpp"
 
 #include "camera.hpp"
@@ -150,10 +151,13 @@ class Game : public Logger {
         m_load_next = [this, args...]() {
             loading_screen.draw();
             log(LOG_INFO, "Loading scene %s", typeid(T).name());
+            double start = GetTime();
             m_current_scene->destroy();
             auto out = std::make_shared<T>(this, args...);
             m_current_scene = out;
             m_current_scene->init();
+            log(LOG_INFO, "Loaded scene %s in %g ms", typeid(T).name(),
+                (GetTime() - start) * 1000.0);
         };
         m_scene_to_load = true;
     }
@@ -169,6 +173,8 @@ class Game : public Logger {
                    20, GREEN);
         game_info.draw_debug();
         EndDrawing();
+        Profiler::get().end_frame();
+        AnimationBudget::get().end_frame();
         game_info.frame_time = GetFrameTime();
         if (m_scene_to_load) {
             m_current_scene->on_close();
@@ -474,6 +480,36 @@ class VolumeCommand : public DevConsoleCommand {
     }
 };
 
+class ProfCommand : public DevConsoleCommand {
+  public:
+    using DevConsoleCommand::DevConsoleCommand;
+    void handle(std::vector<std::string>& args) {
+        if (args.size() > 1)
+            return;
+        if (args.size() == 1) {
+            Profiler::get().enabled(args[0] == "1");
+        }
+        TraceLog(LOG_CONSOLE, "prof %d", Profiler::get().enabled());
+    }
+};
+
+class ProfTraceCommand : public DevConsoleCommand {
+  public:
+    using DevConsoleCommand::DevConsoleCommand;
+    void handle(std::vector<std::string>& args) {
+        if (args.size() != 2) {
+            TraceLog(LOG_CONSOLE, "usage: prof_trace <frames> <filename>");
+            return;
+        }
+        int frames = std::stoi(args[0]);
+        if (frames <= 0)
+            return;
+        Profiler::get().capture(frames, args[1]);
+        TraceLog(LOG_CONSOLE, "tracing %d frames to %s", frames,
+                 args[1].c_str());
+    }
+};
+
 class PassCommand : public DevConsoleCommand {
   public:
     using DevConsoleCommand::DevConsoleCommand;
@@ -497,6 +533,8 @@ class DefaultDevConsole : public DevConsole {
         add_command<DoCommand>("do");
         add_command<LambdaCommand>("lambda");
         add_command<PassCommand>("pass");
+        add_command<ProfCommand>("prof");
+        add_command<ProfTraceCommand>("prof_trace");
     }
 
     void init() { exec("autoexec.cfg"); }
@@ -0,0 +1,94 @@
+#ifndef _SPRF_ENTITY_COMMANDS_HPP_
+#define _SPRF_ENTITY_COMMANDS_HPP_
+
+#include "entity_pool.hpp"
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SPRF {
+
+class Entity;
+
+enum entity_command_t {
+    ENTITY_COMMAND_CREATE,
+    ENTITY_COMMAND_DESTROY,
+    ENTITY_COMMAND_ENABLE,
+    ENTITY_COMMAND_DISABLE
+};
+
+/**
+ * @brief Changes to the entity hierarchy recorded during a phase and applied
+ * by the scene afterwards.
+ *
+ * Creating, destroying, enabling or disabling entities while a phase is
+ * running changes the lists the phase is walking, and isn't safe at all from
+ * parallel components. Components record the change here instead and the
+ * scene applies everything, in order, at the next sync point (after each
+ * update phase and after drawing). Recording takes a lock, so any thread can
+ * record.
+ *
+ * Entities are referred to by handle, so a command on an entity that was
+ * destroyed in the meantime is dropped.
+ */
+class EntityCommands {
+  public:
+    typedef std::function<void(Entity*)> callback_t;
+
+    struct Command {
+        entity_command_t type;
+        /** @brief Entity to change, or the parent for creates (invalid to
+         * create a root entity) */
+        EntityHandle target;
+        std::string name;
+        /** @brief Called with the new entity for creates */
+        callback_t callback;
+    };
+
+  private:
+    std::mutex m_mutex;
+    std::vector<Command> m_commands;
+
+    void push(entity_command_t type, EntityHandle target,
+              std::string name = "", callback_t callback = callback_t()) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_commands.push_back({type, target, name, callback});
+    }
+
+  public:
+    /**
+     * @brief Create an entity at the next sync point.
+     *
+     * @param on_created Called with the entity once it exists, to add
+     * components and so on.
+     * @param parent Parent of the new entity, or an invalid handle for a
+     * root entity.
+     */
+    void create(std::string name, callback_t on_created,
+                EntityHandle parent = EntityHandle()) {
+        push(ENTITY_COMMAND_CREATE, parent, name, on_created);
+    }
+
+    /** @brief Destroy an entity and its subtree at the next sync point */
+    void destroy(EntityHandle entity) { push(ENTITY_COMMAND_DESTROY, entity); }
+
+    void enable(EntityHandle entity) { push(ENTITY_COMMAND_ENABLE, entity); }
+
+    void disable(EntityHandle entity) { push(ENTITY_COMMAND_DISABLE, entity); }
+
+    /**
+     * @brief Take every recorded command, leaving the buffer empty.
+     */
+    std::vector<Command> take() {
+        std::vector<Command> out;
+        std::lock_guard<std::mutex> guard(m_mutex);
+        out.swap(m_commands);
+        return out;
+    }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_ENTITY_COMMANDS_HPP_
@@ -0,0 +1,155 @@
+#ifndef _SPRF_ENTITY_POOL_HPP_
+#define _SPRF_ENTITY_POOL_HPP_
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/** @brief Bits of an `EntityHandle` used for the slot index */
+#define ENTITY_HANDLE_INDEX_BITS (20)
+/** @brief Bits of an `EntityHandle` used for the generation */
+#define ENTITY_HANDLE_GENERATION_BITS (32 - ENTITY_HANDLE_INDEX_BITS)
+/** @brief Number of entities in each chunk of an `EntityPool` */
+#define ENTITY_POOL_CHUNK_SIZE (256)
+
+namespace SPRF {
+
+/**
+ * @brief 32 bit reference to an entity that is safe to keep around.
+ *
+ * The low bits are the entity's slot in the scene's `EntityPool`, the high
+ * bits the generation of that slot. Destroying an entity bumps the
+ * generation, so old handles stop resolving (`Scene::get_entity` returns
+ * NULL) instead of pointing at whatever reuses the slot. Generations start
+ * at 1, so a zero handle is never valid.
+ */
+struct EntityHandle {
+    uint32_t value = 0;
+
+    EntityHandle() {}
+    EntityHandle(uint32_t index, uint32_t generation)
+        : value((generation << ENTITY_HANDLE_INDEX_BITS) | index) {}
+
+    uint32_t index() const {
+        return value & ((1u << ENTITY_HANDLE_INDEX_BITS) - 1);
+    }
+
+    uint32_t generation() const { return value >> ENTITY_HANDLE_INDEX_BITS; }
+
+    bool valid() const { return value != 0; }
+
+    bool operator==(const EntityHandle& other) const {
+        return value == other.value;
+    }
+
+    bool operator!=(const EntityHandle& other) const {
+        return value != other.value;
+    }
+};
+
+/**
+ * @brief Slab allocator for entities, addressed by `EntityHandle`.
+ *
+ * Entities live in fixed size chunks that never move. Destroyed slots are
+ * reused, with a new generation. `clear` destroys everything at once when a
+ * scene is unloaded.
+ *
+ * @tparam T Entity type, needs `set_handle(EntityHandle)`.
+ */
+template <class T> class EntityPool {
+  private:
+    struct Chunk {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type
+            slots[ENTITY_POOL_CHUNK_SIZE];
+    };
+
+    std::vector<std::unique_ptr<Chunk>> m_chunks;
+    /** @brief Current generation of each slot */
+    std::vector<uint32_t> m_generations;
+    std::vector<bool> m_alive;
+    /** @brief Destroyed slots, reused before growing */
+    std::vector<uint32_t> m_free;
+    size_t m_size = 0;
+
+    T* slot(uint32_t idx) {
+        return reinterpret_cast<T*>(&m_chunks[idx / ENTITY_POOL_CHUNK_SIZE]
+                                         ->slots[idx % ENTITY_POOL_CHUNK_SIZE]);
+    }
+
+  public:
+    EntityPool() {}
+
+    EntityPool(const EntityPool&) = delete;
+    EntityPool& operator=(const EntityPool&) = delete;
+
+    ~EntityPool() { clear(); }
+
+    /**
+     * @brief Construct a new entity in the pool.
+     */
+    template <typename... Args> T* create(Args&&... args) {
+        uint32_t idx;
+        if (m_free.size() > 0) {
+            idx = m_free.back();
+            m_free.pop_back();
+        } else {
+            idx = m_generations.size();
+            assert(idx < (1u << ENTITY_HANDLE_INDEX_BITS));
+            m_generations.push_back(1);
+            m_alive.push_back(false);
+            if ((idx / ENTITY_POOL_CHUNK_SIZE) >= m_chunks.size())
+                m_chunks.push_back(std::make_unique<Chunk>());
+        }
+        T* out = new (slot(idx)) T(std::forward<Args>(args)...);
+        m_alive[idx] = true;
+        out->set_handle(EntityHandle(idx, m_generations[idx]));
+        m_size++;
+        return out;
+    }
+
+    /**
+     * @brief The entity `handle` refers to, or NULL if it was destroyed.
+     */
+    T* get(EntityHandle handle) {
+        uint32_t idx = handle.index();
+        if ((idx >= m_generations.size()) || (!m_alive[idx]) ||
+            (m_generations[idx] != handle.generation()))
+            return NULL;
+        return slot(idx);
+    }
+
+    /**
+     * @brief Destroy an entity, invalidating its handles.
+     */
+    void destroy(EntityHandle handle) {
+        uint32_t idx = handle.index();
+        assert(get(handle) != NULL);
+        slot(idx)->~T();
+        m_alive[idx] = false;
+        m_generations[idx]++;
+        if (m_generations[idx] >= (1u << ENTITY_HANDLE_GENERATION_BITS))
+            m_generations[idx] = 1;
+        m_free.push_back(idx);
+        m_size--;
+    }
+
+    /**
+     * @brief Destroy every entity in the pool.
+     */
+    void clear() {
+        for (uint32_t i = 0; i < m_generations.size(); i++) {
+            if (m_alive[i])
+                destroy(EntityHandle(i, m_generations[i]));
+        }
+    }
+
+    size_t size() { return m_size; }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_ENTITY_POOL_HPP_
@@ -0,0 +1,238 @@
+#ifndef _SPRF_INSTANCE_BUFFER_HPP_
+#define _SPRF_INSTANCE_BUFFER_HPP_
+
+#include "raylib.h"
+#include "raymath.h"
+#include "rlgl.h"
+#include <vector>
+
+/** @brief Number of buffers `InstanceStream` cycles through, so we never
+ * write to a buffer the GPU may still be reading from */
+#define SPRF_INSTANCE_RING_SIZE 3
+/** @brief Smallest `InstanceBuffer` allocation, in instances */
+#define SPRF_INSTANCE_BUFFER_MIN 64
+/** @brief Most draws a mesh of a model is split into to draw its visible
+ * instances where they are in the model's `InstanceBuffer`, one per run of
+ * consecutive instances; past that they are copied to an `InstanceStream` */
+#define SPRF_INSTANCE_RANGES_MAX 8
+
+#ifndef MAX_MATERIAL_MAPS
+// as in raylib's config.h, which isn't installed with raylib.h
+#define MAX_MATERIAL_MAPS 12
+#endif
+
+namespace SPRF {
+
+/**
+ * @brief Instance transforms in a vertex buffer that stays on the GPU
+ * between draws.
+ *
+ * raylib's `DrawMeshInstanced` allocates, fills and deletes a buffer every
+ * call. Buffers here are only (re)written when the caller has new
+ * transforms, and drawn from with `draw_mesh_instanced`.
+ */
+class InstanceBuffer {
+  private:
+    unsigned int m_vbo = 0;
+    /** @brief Size of `m_vbo` in instances */
+    int m_capacity = 0;
+    /** @brief Transforms in the layout the shaders read */
+    std::vector<float16> m_staging;
+
+  public:
+    InstanceBuffer() {}
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    InstanceBuffer(InstanceBuffer&& other) noexcept
+        : m_vbo(other.m_vbo), m_capacity(other.m_capacity) {
+        other.m_vbo = 0;
+        other.m_capacity = 0;
+    }
+
+    ~InstanceBuffer() {
+        if (m_vbo)
+            rlUnloadVertexBuffer(m_vbo);
+    }
+
+    unsigned int id() const { return m_vbo; }
+
+    int capacity() const { return m_capacity; }
+
+    /**
+     * @brief Make room for `n` instances. Growing drops the contents, draws
+     * already issued from the old buffer are fine (GL keeps it alive until
+     * they're done).
+     *
+     * @return true if the buffer was reallocated.
+     */
+    bool reserve(int n) {
+        if (n <= m_capacity)
+            return false;
+        int capacity = m_capacity < SPRF_INSTANCE_BUFFER_MIN
+                           ? SPRF_INSTANCE_BUFFER_MIN
+                           : m_capacity;
+        while (capacity < n)
+            capacity *= 2;
+        if (m_vbo)
+            rlUnloadVertexBuffer(m_vbo);
+        m_vbo = rlLoadVertexBuffer(NULL, capacity * sizeof(float16), true);
+        m_capacity = capacity;
+        return true;
+    }
+
+    /**
+     * @brief Write transforms to instances `[first, first + n)`, which must
+     * fit (see `reserve`).
+     */
+    void upload(const Matrix* transforms, int n, int first = 0) {
+        if (n == 0)
+            return;
+        m_staging.resize(n);
+        for (int i = 0; i < n; i++) {
+            m_staging[i] = MatrixToFloatV(transforms[i]);
+        }
+        rlUpdateVertexBuffer(m_vbo, m_staging.data(), n * sizeof(float16),
+                             first * sizeof(float16));
+    }
+};
+
+/**
+ * @brief Ring of `InstanceBuffer`s for transforms that change every frame.
+ *
+ * Everything pushed in a frame is appended to one buffer, and the next frame
+ * moves on to the next buffer, so the driver never has to wait for the GPU
+ * to finish with a buffer before we overwrite it.
+ */
+class InstanceStream {
+  private:
+    InstanceBuffer m_buffers[SPRF_INSTANCE_RING_SIZE];
+    int m_current = 0;
+    /** @brief Instances pushed to the current buffer this frame */
+    int m_used = 0;
+
+  public:
+    /**
+     * @brief Start on the next buffer of the ring.
+     */
+    void next_frame() {
+        m_current = (m_current + 1) % SPRF_INSTANCE_RING_SIZE;
+        m_used = 0;
+    }
+
+    /**
+     * @brief Upload transforms for this frame.
+     *
+     * @param first Set to the index of the first uploaded instance in the
+     * returned buffer.
+     * @return Buffer to draw from.
+     */
+    const InstanceBuffer& push(const Matrix* transforms, int n, int& first) {
+        InstanceBuffer& buffer = m_buffers[m_current];
+        if (buffer.reserve(m_used + n)) {
+            // the old contents are gone, start over in the new buffer
+            m_used = 0;
+        }
+        first = m_used;
+        buffer.upload(transforms, n, first);
+        m_used += n;
+        return buffer;
+    }
+};
+
+/**
+ * @brief `DrawMeshInstanced`, but drawing instances `[first, first + n)` of
+ * an `InstanceBuffer` instead of uploading transforms.
+ *
+ * Needs vertex array objects (always there with the GL 3.3 the engine's
+ * shaders are written for).
+ */
+inline void draw_mesh_instanced(Mesh mesh, Material material,
+                                const InstanceBuffer& buffer, int first,
+                                int n) {
+    if (n == 0)
+        return;
+    rlEnableShader(material.shader.id);
+
+    if (material.shader.locs[SHADER_LOC_COLOR_DIFFUSE] != -1) {
+        Color color = material.maps[MATERIAL_MAP_DIFFUSE].color;
+        float values[4] = {color.r / 255.0f, color.g / 255.0f,
+                           color.b / 255.0f, color.a / 255.0f};
+        rlSetUniform(material.shader.locs[SHADER_LOC_COLOR_DIFFUSE], values,
+                     SHADER_UNIFORM_VEC4, 1);
+    }
+    if (material.shader.locs[SHADER_LOC_COLOR_SPECULAR] != -1) {
+        Color color = material.maps[MATERIAL_MAP_SPECULAR].color;
+        float values[4] = {color.r / 255.0f, color.g / 255.0f,
+                           color.b / 255.0f, color.a / 255.0f};
+        rlSetUniform(material.shader.locs[SHADER_LOC_COLOR_SPECULAR], values,
+                     SHADER_UNIFORM_VEC4, 1);
+    }
+
+    Matrix view = rlGetMatrixModelview();
+    Matrix projection = rlGetMatrixProjection();
+    if (material.shader.locs[SHADER_LOC_MATRIX_VIEW] != -1)
+        rlSetUniformMatrix(material.shader.locs[SHADER_LOC_MATRIX_VIEW], view);
+    if (material.shader.locs[SHADER_LOC_MATRIX_PROJECTION] != -1)
+        rlSetUniformMatrix(material.shader.locs[SHADER_LOC_MATRIX_PROJECTION],
+                           projection);
+    if (material.shader.locs[SHADER_LOC_MATRIX_NORMAL] != -1)
+        rlSetUniformMatrix(material.shader.locs[SHADER_LOC_MATRIX_NORMAL],
+                           MatrixIdentity());
+    Matrix model_view = MatrixMultiply(rlGetMatrixTransform(), view);
+    rlSetUniformMatrix(material.shader.locs[SHADER_LOC_MATRIX_MVP],
+                       MatrixMultiply(model_view, projection));
+
+    if (!rlEnableVertexArray(mesh.vaoId)) {
+        TraceLog(LOG_WARNING, "draw_mesh_instanced needs vertex arrays");
+        rlDisableShader();
+        return;
+    }
+    rlEnableVertexBuffer(buffer.id());
+    int location = material.shader.locs[SHADER_LOC_MATRIX_MODEL];
+    for (int i = 0; i < 4; i++) {
+        rlEnableVertexAttribute(location + i);
+        rlSetVertexAttribute(location + i, 4, RL_FLOAT, 0, sizeof(float16),
+                             first * sizeof(float16) + i * sizeof(Vector4));
+        rlSetVertexAttributeDivisor(location + i, 1);
+    }
+    rlDisableVertexBuffer();
+
+    for (int i = 0; i < MAX_MATERIAL_MAPS; i++) {
+        if (material.maps[i].texture.id > 0) {
+            rlActiveTextureSlot(i);
+            if ((i == MATERIAL_MAP_IRRADIANCE) ||
+                (i == MATERIAL_MAP_PREFILTER) || (i == MATERIAL_MAP_CUBEMAP))
+                rlEnableTextureCubemap(material.maps[i].texture.id);
+            else
+                rlEnableTexture(material.maps[i].texture.id);
+            rlSetUniform(material.shader.locs[SHADER_LOC_MAP_DIFFUSE + i], &i,
+                         SHADER_UNIFORM_INT, 1);
+        }
+    }
+
+    if (mesh.indices != NULL)
+        rlDrawVertexArrayElementsInstanced(0, mesh.triangleCount * 3, 0, n);
+    else
+        rlDrawVertexArrayInstanced(0, mesh.vertexCount, n);
+
+    for (int i = 0; i < MAX_MATERIAL_MAPS; i++) {
+        if (material.maps[i].texture.id > 0) {
+            rlActiveTextureSlot(i);
+            if ((i == MATERIAL_MAP_IRRADIANCE) ||
+                (i == MATERIAL_MAP_PREFILTER) || (i == MATERIAL_MAP_CUBEMAP))
+                rlDisableTextureCubemap();
+            else
+                rlDisableTexture();
+        }
+    }
+    rlDisableVertexArray();
+    rlDisableVertexBuffer();
+    rlDisableVertexBufferElement();
+    rlDisableShader();
+}
+
+} // namespace SPRF
+
+#endif // _SPRF_INSTANCE_BUFFER_HPP_
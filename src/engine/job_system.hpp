@@ -0,0 +1,169 @@
+#ifndef _SPRF_JOB_SYSTEM_HPP_
+#define _SPRF_JOB_SYSTEM_HPP_
+
+#include "base.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SPRF {
+
+/**
+ * @brief Pool of worker threads with per worker job queues and work
+ * stealing.
+ *
+ * Jobs are spread round robin over the worker queues. A worker runs jobs
+ * from the back of its own queue and, when that is empty, steals from the
+ * front of the others, so uneven jobs still keep every worker busy. The
+ * thread that submitted a batch helps run it while it waits.
+ */
+class JobSystem : public Logger {
+  public:
+    typedef std::function<void()> job_t;
+
+  private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<job_t> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    /** @brief Jobs submitted but not picked up yet. Counted before the job
+     * is queued, so a worker taking it can never bring it below zero */
+    std::atomic<size_t> m_queued{0};
+    std::atomic<size_t> m_next_queue{0};
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake;
+    bool m_quit = false;
+
+    bool pop(size_t idx, job_t& out) {
+        Queue& queue = *m_queues[idx];
+        std::lock_guard<std::mutex> guard(queue.mutex);
+        if (queue.jobs.empty())
+            return false;
+        out = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+        return true;
+    }
+
+    bool steal(size_t thief, job_t& out) {
+        for (size_t i = 1; i <= m_queues.size(); i++) {
+            Queue& queue = *m_queues[(thief + i) % m_queues.size()];
+            std::lock_guard<std::mutex> guard(queue.mutex);
+            if (queue.jobs.empty())
+                continue;
+            out = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Run one job, from queue `idx` if possible.
+     *
+     * @return bool false if there was nothing to run.
+     */
+    bool run_one(size_t idx) {
+        job_t job;
+        if (!(pop(idx, job) || steal(idx, job)))
+            return false;
+        m_queued--;
+        job();
+        return true;
+    }
+
+    void worker(size_t idx) {
+        while (true) {
+            if (run_one(idx))
+                continue;
+            std::unique_lock<std::mutex> lock(m_wake_mutex);
+            m_wake.wait(lock, [this]() { return m_quit || (m_queued > 0); });
+            if (m_quit)
+                return;
+        }
+    }
+
+  public:
+    /**
+     * @param n_threads Number of worker threads, defaults to one less than
+     * the number of cores (the main thread is the other one).
+     */
+    JobSystem(size_t n_threads = 0) {
+        if (n_threads == 0) {
+            size_t cores = std::thread::hardware_concurrency();
+            n_threads = cores > 1 ? cores - 1 : 1;
+        }
+        for (size_t i = 0; i < n_threads; i++) {
+            m_queues.push_back(std::make_unique<Queue>());
+        }
+        for (size_t i = 0; i < n_threads; i++) {
+            m_threads.push_back(std::thread(&JobSystem::worker, this, i));
+        }
+        log(LOG_INFO, "started %lu worker threads", n_threads);
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> guard(m_wake_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        for (auto& i : m_threads) {
+            i.join();
+        }
+    }
+
+    size_t n_threads() { return m_threads.size(); }
+
+    /**
+     * @brief Queue a job on one of the workers.
+     */
+    void submit(job_t job) {
+        size_t idx = m_next_queue++ % m_queues.size();
+        {
+            std::lock_guard<std::mutex> guard(m_wake_mutex);
+            m_queued++;
+        }
+        {
+            std::lock_guard<std::mutex> guard(m_queues[idx]->mutex);
+            m_queues[idx]->jobs.push_back(std::move(job));
+        }
+        m_wake.notify_one();
+    }
+
+    /**
+     * @brief Run every job in `jobs` and return once they have all finished.
+     *
+     * The calling thread runs jobs too while it waits.
+     */
+    void run(std::vector<job_t>& jobs) {
+        if (jobs.size() == 0)
+            return;
+        auto remaining = std::make_shared<std::atomic<size_t>>(jobs.size());
+        for (auto& i : jobs) {
+            job_t job = std::move(i);
+            submit([job, remaining]() {
+                job();
+                (*remaining)--;
+            });
+        }
+        while (*remaining > 0) {
+            if (!run_one(m_next_queue % m_queues.size()))
+                std::this_thread::yield();
+        }
+    }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_JOB_SYSTEM_HPP_
@@ -5,6 +5,7 @@
 #include "ecs.hpp"
 //#include "raylib-cpp.hpp"
 #include "renderer.hpp"
+#include "scene_snapshot.hpp"
 #include <memory>
 
 namespace SPRF {
@@ -13,22 +14,104 @@ class Model : public Component {
   private:
     RenderModel* m_model;
     bool m_enabled = true;
+    /** @brief `entity()->world_version()` when we were last drawn */
+    uint32_t m_last_world_version = 0;
+    /** @brief `m_model->frame()` when we were last drawn */
+    uint32_t m_last_frame = 0;
+    bool m_drawn = false;
+    /** @brief Our instance slot in `m_model` */
+    uint32_t m_slot = 0;
+    /** @brief Whether `pose` was called */
+    bool m_posed = false;
+    /** @brief Whether `pose` was called since we were last drawn */
+    bool m_pose_changed = false;
+    /** @brief Animation to draw in (see `pose`) */
+    ModelAnimation m_pose_anim;
+    /** @brief Frame of `m_pose_anim` to draw in */
+    int m_pose_frame = 0;
 
   public:
     Model(RenderModel* model) : m_model(model) {}
 
     void draw3D(mat4x4 parent_transform) {
-        if (m_enabled)
-            m_model->add_instance(parent_transform);
+        if (!m_enabled)
+            return;
+        uint32_t version = entity()->world_version();
+        uint32_t frame = m_model->frame();
+        bool acquired = (!m_drawn) || (frame != m_last_frame + 1);
+        if (acquired) {
+            // skipped a frame, so the slot was released
+            m_slot = m_model->acquire_slot(parent_transform);
+        } else if (version != m_last_world_version) {
+            m_model->update_slot(m_slot, parent_transform);
+        } else {
+            m_model->touch_slot(m_slot);
+        }
+        // a slot keeps its pose, until it's acquired again
+        if (m_posed && (m_pose_changed || acquired))
+            m_model->pose_slot(m_slot, m_pose_anim, m_pose_frame);
+        m_pose_changed = false;
+        m_last_world_version = version;
+        m_last_frame = frame;
+        m_drawn = true;
+    }
+
+    /**
+     * @brief Draw in a frame of an animation from now on, e.g. set from
+     * `update` by an animator. Call it again whenever the animation's poses
+     * change.
+     *
+     * Only this instance is posed if the model is skinned on the GPU (see
+     * `RenderModel::pose_slot`). `anim` must stay valid while we're drawn.
+     */
+    void pose(ModelAnimation anim, int frame) {
+        m_pose_anim = anim;
+        m_pose_frame = frame;
+        m_posed = true;
+        m_pose_changed = true;
+    }
+
+    /**
+     * @brief How big we looked from the camera last frame (see
+     * `RenderModel::slot_screen_size`): 0 if we weren't in view or are
+     * disabled, `INFINITY` if that's unknown.
+     */
+    float screen_size() {
+        if (!m_enabled)
+            return 0;
+        if (!m_drawn)
+            return INFINITY;
+        return m_model->slot_screen_size(m_slot);
     }
 
     void enable() { m_enabled = true; }
 
     void disable() { m_enabled = false; }
 
+    bool enabled() { return m_enabled; }
+
     RenderModel* render_model() { return m_model; }
+
+    void save(SnapshotWriter& out) {
+        out.write<uint32_t>(out.resource(m_model));
+        out.write<uint8_t>(m_enabled);
+    }
+
+    static void load(Entity* entity, SnapshotReader& in) {
+        auto model = in.resource<RenderModel>(in.read<uint32_t>());
+        bool enabled = in.read<uint8_t>();
+        if (!in.ok())
+            return;
+        auto out = entity->add_component<Model>(model);
+        if (!enabled)
+            out->disable();
+    }
 };
 
+/** @brief Registers `Model` with `SnapshotRegistry` */
+inline const bool model_snapshot_registered =
+    SnapshotRegistry::get().add<Model>("Model");
+
 } // namespace SPRF
 
 #endif // _SPRF_MODEL_HPP_
\ No newline at end of file
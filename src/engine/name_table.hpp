@@ -0,0 +1,62 @@
+#ifndef _SPRF_NAME_TABLE_HPP_
+#define _SPRF_NAME_TABLE_HPP_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SPRF {
+
+/** @brief Interned string, see `NameTable` */
+typedef uint32_t name_id_t;
+
+/** @brief Returned by `NameTable::find` for strings that were never
+ * interned */
+#define NAME_ID_NONE ((SPRF::name_id_t)-1)
+
+/**
+ * @brief Interns strings into small dense ids.
+ *
+ * Equal strings always get the same id, so comparing names is an integer
+ * compare and ids can index arrays directly. Ids are never freed.
+ */
+class NameTable {
+  private:
+    std::unordered_map<std::string, name_id_t> m_ids;
+    std::vector<std::string> m_names;
+
+  public:
+    /**
+     * @brief Id of `name`, interning it if this is the first time we see it.
+     */
+    name_id_t intern(const std::string& name) {
+        auto it = m_ids.find(name);
+        if (it != m_ids.end())
+            return it->second;
+        name_id_t out = m_names.size();
+        m_names.push_back(name);
+        m_ids[name] = out;
+        return out;
+    }
+
+    /**
+     * @brief Id of `name`, without interning it.
+     * @return name_id_t The id, or `NAME_ID_NONE` if `name` was never
+     * interned (so nothing can be called that).
+     */
+    name_id_t find(const std::string& name) const {
+        auto it = m_ids.find(name);
+        if (it == m_ids.end())
+            return NAME_ID_NONE;
+        return it->second;
+    }
+
+    const std::string& str(name_id_t id) const { return m_names[id]; }
+
+    size_t size() const { return m_names.size(); }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_NAME_TABLE_HPP_
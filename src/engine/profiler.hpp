@@ -0,0 +1,378 @@
+#ifndef _SPRF_PROFILER_HPP_
+#define _SPRF_PROFILER_HPP_
+
+#include "base.hpp"
+#include "imgui/imgui.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+#ifdef __GNUG__
+#include <cxxabi.h>
+#include <cstdlib>
+#endif
+
+/** @brief Events each thread can record between two `end_frame` calls */
+#define PROFILER_BUFFER_SIZE (1 << 14)
+/** @brief Most threads that can record events */
+#define PROFILER_MAX_THREADS (64)
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+/**
+ * @brief Time the rest of the enclosing block. `name` must outlive the
+ * profiler (a string literal, or see `type_name`).
+ */
+#define PROFILE_SCOPE(name)                                                    \
+    SPRF::ProfileScope PROFILE_CONCAT(_profile_scope_, __LINE__)(name)
+
+namespace SPRF {
+
+/**
+ * @brief Readable name of `T`, for profiler labels.
+ */
+template <class T> const char* type_name() {
+    static const std::string name = []() {
+        std::string out = typeid(T).name();
+#ifdef __GNUG__
+        int status = 0;
+        char* demangled =
+            abi::__cxa_demangle(out.c_str(), NULL, NULL, &status);
+        if (status == 0)
+            out = demangled;
+        free(demangled);
+#endif
+        size_t pos = out.find("SPRF::");
+        if (pos != std::string::npos)
+            out.erase(pos, 6);
+        return out;
+    }();
+    return name.c_str();
+}
+
+/**
+ * @brief One timed scope.
+ */
+struct ProfileEvent {
+    const char* name;
+    /** @brief Nanoseconds since the profiler started */
+    uint64_t start;
+    uint64_t end;
+    /** @brief Number of enclosing scopes on the same thread */
+    uint32_t depth;
+    /** @brief Index of the thread that recorded the event */
+    uint32_t thread;
+};
+
+/**
+ * @brief Events recorded by one thread.
+ *
+ * Only the owning thread writes; it publishes events by bumping `written`.
+ * The profiler reads them from the main thread in `end_frame`, when the
+ * worker threads are idle, so recording never takes a lock.
+ */
+struct ProfilerThreadBuffer {
+    ProfileEvent events[PROFILER_BUFFER_SIZE];
+    std::atomic<uint64_t> written{0};
+    /** @brief Events up to here were collected (main thread only) */
+    uint64_t read = 0;
+    /** @brief Open scopes (owning thread only) */
+    uint32_t depth = 0;
+    uint32_t thread = 0;
+};
+
+/**
+ * @brief CPU frame profiler.
+ *
+ * Scopes (see `PROFILE_SCOPE`) around scene phases, component types and
+ * renderer stages record into per thread buffers. Once per frame
+ * `end_frame` collects them, keeps the last frame for the ImGui view and a
+ * running average per label, and appends them to a Chrome trace capture if
+ * one is running (open the file in chrome://tracing or Perfetto).
+ *
+ * Disabled by default; a disabled scope is a single relaxed load.
+ */
+class Profiler {
+  private:
+    struct Stat {
+        /** @brief Total time in the last frame, in ms */
+        double last = 0;
+        /** @brief Moving average of `last` */
+        double average = 0;
+        int calls = 0;
+    };
+
+    std::atomic<bool> m_enabled{false};
+    std::chrono::steady_clock::time_point m_epoch =
+        std::chrono::steady_clock::now();
+
+    std::mutex m_threads_mutex;
+    std::unique_ptr<ProfilerThreadBuffer> m_threads[PROFILER_MAX_THREADS];
+    std::atomic<uint32_t> m_n_threads{0};
+
+    uint64_t m_frame_start = 0;
+    uint64_t m_last_frame_start = 0;
+    uint64_t m_last_frame_end = 0;
+    std::vector<ProfileEvent> m_last_frame;
+    std::unordered_map<std::string, Stat> m_stats;
+
+    std::vector<ProfileEvent> m_capture;
+    int m_capture_frames = 0;
+    std::string m_capture_file;
+
+    ProfilerThreadBuffer* register_thread() {
+        std::lock_guard<std::mutex> guard(m_threads_mutex);
+        uint32_t idx = m_n_threads;
+        if (idx >= PROFILER_MAX_THREADS)
+            return NULL;
+        m_threads[idx] = std::make_unique<ProfilerThreadBuffer>();
+        m_threads[idx]->thread = idx;
+        m_n_threads = idx + 1;
+        return m_threads[idx].get();
+    }
+
+    static void write_escaped(FILE* fp, const char* str) {
+        for (; *str; str++) {
+            if ((*str == '"') || (*str == '\\'))
+                fputc('\\', fp);
+            if ((unsigned char)*str >= 0x20)
+                fputc(*str, fp);
+        }
+    }
+
+    bool write_chrome_trace() {
+        FILE* fp = fopen(m_capture_file.c_str(), "w");
+        if (!fp)
+            return false;
+        fprintf(fp, "{\"traceEvents\":[\n");
+        for (size_t i = 0; i < m_capture.size(); i++) {
+            const ProfileEvent& event = m_capture[i];
+            fprintf(fp, "{\"name\":\"");
+            write_escaped(fp, event.name);
+            fprintf(fp,
+                    "\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,"
+                    "\"dur\":%.3f}%s\n",
+                    event.thread, event.start * 1e-3,
+                    (event.end - event.start) * 1e-3,
+                    (i + 1 < m_capture.size()) ? "," : "");
+        }
+        fprintf(fp, "]}\n");
+        return fclose(fp) == 0;
+    }
+
+  public:
+    static Profiler& get() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    bool enabled() { return m_enabled.load(std::memory_order_relaxed); }
+
+    void enabled(bool v) { m_enabled = v; }
+
+    /** @brief Nanoseconds since the profiler started */
+    uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - m_epoch)
+            .count();
+    }
+
+    /**
+     * @brief The calling thread's buffer, NULL if there are too many
+     * threads.
+     */
+    ProfilerThreadBuffer* thread_buffer() {
+        static thread_local ProfilerThreadBuffer* buffer = register_thread();
+        return buffer;
+    }
+
+    /**
+     * @brief Collect the events recorded since the last call.
+     *
+     * Call once per frame on the main thread, outside of any scope.
+     */
+    void end_frame() {
+        uint64_t frame_end = now();
+        m_last_frame.clear();
+        uint32_t n_threads = m_n_threads;
+        for (uint32_t i = 0; i < n_threads; i++) {
+            ProfilerThreadBuffer& buffer = *m_threads[i];
+            uint64_t written = buffer.written.load(std::memory_order_acquire);
+            // drop whatever was overwritten
+            if ((written - buffer.read) > PROFILER_BUFFER_SIZE)
+                buffer.read = written - PROFILER_BUFFER_SIZE;
+            for (; buffer.read < written; buffer.read++) {
+                m_last_frame.push_back(
+                    buffer.events[buffer.read % PROFILER_BUFFER_SIZE]);
+            }
+        }
+
+        for (auto& i : m_stats) {
+            i.second.last = 0;
+            i.second.calls = 0;
+        }
+        for (auto& i : m_last_frame) {
+            Stat& stat = m_stats[i.name];
+            stat.last += (i.end - i.start) * 1e-6;
+            stat.calls++;
+        }
+        for (auto& i : m_stats) {
+            i.second.average = 0.95 * i.second.average + 0.05 * i.second.last;
+        }
+
+        if (m_capture_frames > 0) {
+            m_capture.insert(m_capture.end(), m_last_frame.begin(),
+                             m_last_frame.end());
+            m_capture_frames--;
+            if (m_capture_frames == 0) {
+                if (write_chrome_trace())
+                    TraceLog(LOG_INFO, "wrote profiler trace to %s",
+                             m_capture_file.c_str());
+                else
+                    TraceLog(LOG_ERROR, "couldn't write profiler trace to %s",
+                             m_capture_file.c_str());
+                m_capture.clear();
+            }
+        }
+
+        m_last_frame_start = m_frame_start;
+        m_last_frame_end = frame_end;
+        m_frame_start = frame_end;
+    }
+
+    /**
+     * @brief Record the next `frames` frames and write them to `filename`
+     * as a Chrome trace. Enables the profiler.
+     */
+    void capture(int frames, std::string filename) {
+        m_capture.clear();
+        m_capture_frames = frames;
+        m_capture_file = filename;
+        m_enabled = true;
+    }
+
+    /**
+     * @brief Draw the last frame as a flame graph (one lane per thread) and
+     * the time per label, in an ImGui window.
+     */
+    void draw_imgui() {
+        ImGui::Begin("Profiler");
+        bool enabled = this->enabled();
+        if (ImGui::Checkbox("enabled", &enabled))
+            this->enabled(enabled);
+        double frame_ms = (m_last_frame_end - m_last_frame_start) * 1e-6;
+        ImGui::Text("frame %.3f ms", frame_ms);
+
+        const float row_height = ImGui::GetTextLineHeightWithSpacing();
+        ImDrawList* draw_list = ImGui::GetWindowDrawList();
+        float width = ImGui::GetContentRegionAvail().x;
+        double scale = (frame_ms > 0) ? width / (frame_ms * 1e6) : 0;
+        uint32_t n_threads = m_n_threads;
+        for (uint32_t thread = 0; thread < n_threads; thread++) {
+            uint32_t max_depth = 0;
+            bool any = false;
+            for (auto& i : m_last_frame) {
+                if (i.thread != thread)
+                    continue;
+                any = true;
+                max_depth = std::max(max_depth, i.depth);
+            }
+            if (!any)
+                continue;
+            ImGui::Text("thread %u", thread);
+            ImVec2 origin = ImGui::GetCursorScreenPos();
+            ImGui::Dummy(ImVec2(width, row_height * (max_depth + 1)));
+            for (auto& i : m_last_frame) {
+                if ((i.thread != thread) || (i.start < m_last_frame_start))
+                    continue;
+                ImVec2 min(origin.x + (i.start - m_last_frame_start) * scale,
+                           origin.y + i.depth * row_height);
+                ImVec2 max(origin.x + (i.end - m_last_frame_start) * scale,
+                           min.y + row_height - 1);
+                if (max.x - min.x < 1)
+                    max.x = min.x + 1;
+                ImU32 color = ImColor::HSV(
+                    (std::hash<std::string>()(i.name) % 256) / 255.0f, 0.5f,
+                    0.7f);
+                draw_list->AddRectFilled(min, max, color);
+                draw_list->PushClipRect(min, max, true);
+                draw_list->AddText(min, IM_COL32_WHITE, i.name);
+                draw_list->PopClipRect();
+                if (ImGui::IsMouseHoveringRect(min, max))
+                    ImGui::SetTooltip("%s: %.3f ms", i.name,
+                                      (i.end - i.start) * 1e-6);
+            }
+        }
+
+        std::vector<std::pair<std::string, Stat>> stats(m_stats.begin(),
+                                                        m_stats.end());
+        std::sort(stats.begin(), stats.end(), [](auto& a, auto& b) {
+            return a.second.average > b.second.average;
+        });
+        if (ImGui::BeginTable("profiler_stats", 3)) {
+            ImGui::TableSetupColumn("scope");
+            ImGui::TableSetupColumn("avg ms");
+            ImGui::TableSetupColumn("calls");
+            ImGui::TableHeadersRow();
+            for (auto& i : stats) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(i.first.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", i.second.average);
+                ImGui::TableNextColumn();
+                ImGui::Text("%d", i.second.calls);
+            }
+            ImGui::EndTable();
+        }
+        ImGui::End();
+    }
+};
+
+/**
+ * @brief Records the time between its construction and destruction, see
+ * `PROFILE_SCOPE`.
+ */
+class ProfileScope {
+  private:
+    ProfilerThreadBuffer* m_buffer = NULL;
+    const char* m_name;
+    uint64_t m_start;
+
+  public:
+    ProfileScope(const char* name) : m_name(name) {
+        Profiler& profiler = Profiler::get();
+        if (!profiler.enabled())
+            return;
+        m_buffer = profiler.thread_buffer();
+        if (!m_buffer)
+            return;
+        m_buffer->depth++;
+        m_start = profiler.now();
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    ~ProfileScope() {
+        if (!m_buffer)
+            return;
+        uint64_t end = Profiler::get().now();
+        m_buffer->depth--;
+        uint64_t idx = m_buffer->written.load(std::memory_order_relaxed);
+        m_buffer->events[idx % PROFILER_BUFFER_SIZE] = {
+            m_name, m_start, end, m_buffer->depth, m_buffer->thread};
+        m_buffer->written.store(idx + 1, std::memory_order_release);
+    }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_PROFILER_HPP_
@@ -0,0 +1,374 @@
+#ifndef _SPRF_RENDER_QUEUE_HPP_
+#define _SPRF_RENDER_QUEUE_HPP_
+
+#include "base.hpp"
+#include "instance_buffer.hpp"
+#include "profiler.hpp"
+#include "raylib.h"
+#include "raymath.h"
+#include "rlgl.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/** @brief Bits of a sort key holding the distance from the camera */
+#define SPRF_RENDER_QUEUE_DEPTH_BITS 24
+/** @brief Distance from the camera that maps to the largest depth in a sort
+ * key (anything further sorts as if it was here) */
+#define SPRF_RENDER_QUEUE_DEPTH_RANGE RL_CULL_DISTANCE_FAR
+
+namespace SPRF {
+
+enum render_pass_t { RENDER_PASS_OPAQUE = 0, RENDER_PASS_TRANSPARENT = 1 };
+
+/**
+ * @brief Instanced draws collected over a frame, sorted and then submitted
+ * with as few state changes as possible.
+ *
+ * Every draw gets a 64 bit sort key. Opaque draws sort by shader, then
+ * texture, then mesh, then front to back, so draws that share state end up
+ * next to each other and what's left is drawn nearest first (cheap early
+ * depth rejects). Transparent draws come after all opaque ones and sort back
+ * to front first, so they blend in the right order. Ids are truncated to fit
+ * the key, which can only make the order less than ideal: `submit` compares
+ * the real state before changing it.
+ *
+ * Instances pushed with `reserve_instances` are uploaded together, once,
+ * when the queue is submitted.
+ */
+class RenderQueue {
+  private:
+    struct Item {
+        uint64_t key;
+        ::Mesh mesh;
+        /** @brief Shader and maps to draw with */
+        ::Material material;
+        /** @brief Diffuse color, instead of the material's (which is shared
+         * by every draw of the model) */
+        Color diffuse;
+        /** @brief Buffer to draw instances from, NULL for this frame's
+         * instances (`reserve_instances`) */
+        const InstanceBuffer* buffer;
+        int first;
+        int n;
+    };
+
+    struct SortEntry {
+        uint64_t key;
+        uint32_t item;
+    };
+
+    std::vector<Item> m_items;
+    /** @brief Instances for this frame, uploaded by `submit` */
+    std::vector<Matrix> m_instances;
+    size_t m_n_instances = 0;
+    std::vector<SortEntry> m_sorted;
+    std::vector<SortEntry> m_scratch;
+    Vector3 m_camera_position = {0, 0, 0};
+
+    /**
+     * @brief Sort `m_sorted` by key: least significant byte first, one
+     * counting pass per byte, skipping bytes that are the same for every
+     * item.
+     */
+    void radix_sort() {
+        size_t n = m_sorted.size();
+        m_scratch.resize(n);
+        SortEntry* in = m_sorted.data();
+        SortEntry* out = m_scratch.data();
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t count[256] = {0};
+            for (size_t i = 0; i < n; i++) {
+                count[(in[i].key >> shift) & 0xFF]++;
+            }
+            if (count[(in[0].key >> shift) & 0xFF] == n)
+                continue;
+            size_t offset = 0;
+            for (int b = 0; b < 256; b++) {
+                size_t c = count[b];
+                count[b] = offset;
+                offset += c;
+            }
+            for (size_t i = 0; i < n; i++) {
+                out[count[(in[i].key >> shift) & 0xFF]++] = in[i];
+            }
+            std::swap(in, out);
+        }
+        if (in != m_sorted.data())
+            memcpy(m_sorted.data(), in, sizeof(SortEntry) * n);
+    }
+
+  public:
+    /**
+     * @brief Build a sort key.
+     *
+     * @param pass `RENDER_PASS_OPAQUE` or `RENDER_PASS_TRANSPARENT`.
+     * @param shader Shader id.
+     * @param texture Diffuse texture id.
+     * @param mesh Vertex array id of the mesh.
+     * @param depth Distance from the camera, see `depth`.
+     */
+    static uint64_t sort_key(render_pass_t pass, unsigned int shader,
+                             unsigned int texture, unsigned int mesh,
+                             uint32_t depth) {
+        uint64_t state = (((uint64_t)shader & 0x3FF) << 28) |
+                         (((uint64_t)texture & 0xFFF) << 16) |
+                         ((uint64_t)mesh & 0xFFFF);
+        if (pass == RENDER_PASS_TRANSPARENT) {
+            uint64_t far_first =
+                (~depth) & ((1u << SPRF_RENDER_QUEUE_DEPTH_BITS) - 1);
+            return (1ull << 62) | (far_first << 38) | state;
+        }
+        return (state << SPRF_RENDER_QUEUE_DEPTH_BITS) | depth;
+    }
+
+    /**
+     * @brief Start a frame seen from `camera_position`, dropping anything
+     * left from the last one.
+     */
+    void begin(Vector3 camera_position) {
+        m_camera_position = camera_position;
+        m_items.clear();
+        m_n_instances = 0;
+    }
+
+    /**
+     * @brief Distance of a point from the camera, quantized for a sort key.
+     */
+    uint32_t depth(Vector3 position) const {
+        float d = Vector3Distance(position, m_camera_position) /
+                  SPRF_RENDER_QUEUE_DEPTH_RANGE;
+        d = Clamp(d, 0.0f, 1.0f);
+        return (uint32_t)(d * ((1u << SPRF_RENDER_QUEUE_DEPTH_BITS) - 1));
+    }
+
+    /**
+     * @brief Room for `n` instances at the end of this frame's instances,
+     * valid until the next call. Keep them with `commit_instances`.
+     */
+    Matrix* reserve_instances(size_t n) {
+        if (m_instances.size() < m_n_instances + n)
+            m_instances.resize(m_n_instances + n);
+        return m_instances.data() + m_n_instances;
+    }
+
+    /**
+     * @brief Keep the first `n` instances written to the last
+     * `reserve_instances`.
+     *
+     * @return int Index of the first of them, to draw them with `push`.
+     */
+    int commit_instances(size_t n) {
+        int first = m_n_instances;
+        m_n_instances += n;
+        return first;
+    }
+
+    /**
+     * @brief Queue a draw of instances `[first, first + n)`.
+     *
+     * @param material Material to draw with, with the shader set.
+     * @param diffuse Diffuse color to draw with (the material's, tinted).
+     * Drawn as transparent if it is.
+     * @param buffer Buffer the instances are in, NULL for this frame's
+     * instances.
+     * @param depth Distance from the camera (see `depth`).
+     */
+    void push(::Mesh mesh, ::Material material, Color diffuse,
+              const InstanceBuffer* buffer, int first, int n,
+              uint32_t depth) {
+        if (n == 0)
+            return;
+        render_pass_t pass =
+            (diffuse.a < 255) ? RENDER_PASS_TRANSPARENT : RENDER_PASS_OPAQUE;
+        Item item;
+        item.key = sort_key(pass, material.shader.id,
+                            material.maps[MATERIAL_MAP_DIFFUSE].texture.id,
+                            mesh.vaoId, depth);
+        item.mesh = mesh;
+        item.material = material;
+        item.diffuse = diffuse;
+        item.buffer = buffer;
+        item.first = first;
+        item.n = n;
+        m_items.push_back(item);
+    }
+
+    size_t size() const { return m_items.size(); }
+
+    /**
+     * @brief Upload this frame's instances, then draw everything queued in
+     * key order, only changing the shader, uniforms, textures, vertex array
+     * and instance attributes when they differ from the last draw.
+     *
+     * Needs vertex array objects, like `draw_mesh_instanced`.
+     *
+     * @param stream Where to upload this frame's instances.
+     */
+    void submit(InstanceStream& stream) {
+        PROFILE_SCOPE("submit");
+        const InstanceBuffer* frame_buffer = NULL;
+        int frame_first = 0;
+        if (m_n_instances > 0) {
+            frame_buffer =
+                &stream.push(m_instances.data(), m_n_instances, frame_first);
+        }
+        {
+            PROFILE_SCOPE("sort");
+            m_sorted.resize(m_items.size());
+            for (size_t i = 0; i < m_items.size(); i++) {
+                m_sorted[i] = {m_items[i].key, (uint32_t)i};
+            }
+            if (!m_sorted.empty())
+                radix_sort();
+        }
+
+        Matrix view = rlGetMatrixModelview();
+        Matrix projection = rlGetMatrixProjection();
+        Matrix mvp = MatrixMultiply(
+            MatrixMultiply(rlGetMatrixTransform(), view), projection);
+
+        unsigned int shader = 0;
+        Color diffuse = {0, 0, 0, 0};
+        Color specular = {0, 0, 0, 0};
+        bool colors_set = false;
+        bool samplers[MAX_MATERIAL_MAPS] = {};
+        unsigned int textures[MAX_MATERIAL_MAPS] = {};
+        unsigned int vao = 0;
+        // instance attributes the bound vertex array was last set up for
+        const InstanceBuffer* attrib_buffer = NULL;
+        int attrib_first = -1;
+        int attrib_location = -1;
+
+        for (auto& entry : m_sorted) {
+            const Item& item = m_items[entry.item];
+            const ::Material& material = item.material;
+            const Shader& s = material.shader;
+            const InstanceBuffer* buffer = item.buffer;
+            int first = item.first;
+            if (!buffer) {
+                buffer = frame_buffer;
+                first += frame_first;
+            }
+
+            if (s.id != shader) {
+                rlEnableShader(s.id);
+                shader = s.id;
+                game_info.state_changes++;
+                if (s.locs[SHADER_LOC_MATRIX_VIEW] != -1)
+                    rlSetUniformMatrix(s.locs[SHADER_LOC_MATRIX_VIEW], view);
+                if (s.locs[SHADER_LOC_MATRIX_PROJECTION] != -1)
+                    rlSetUniformMatrix(s.locs[SHADER_LOC_MATRIX_PROJECTION],
+                                       projection);
+                if (s.locs[SHADER_LOC_MATRIX_NORMAL] != -1)
+                    rlSetUniformMatrix(s.locs[SHADER_LOC_MATRIX_NORMAL],
+                                       MatrixIdentity());
+                rlSetUniformMatrix(s.locs[SHADER_LOC_MATRIX_MVP], mvp);
+                memset(samplers, 0, sizeof(samplers));
+                colors_set = false;
+                attrib_location = -1;
+            }
+
+            Color color = item.diffuse;
+            if ((s.locs[SHADER_LOC_COLOR_DIFFUSE] != -1) &&
+                ((!colors_set) ||
+                 (memcmp(&color, &diffuse, sizeof(Color)) != 0))) {
+                float values[4] = {color.r / 255.0f, color.g / 255.0f,
+                                   color.b / 255.0f, color.a / 255.0f};
+                rlSetUniform(s.locs[SHADER_LOC_COLOR_DIFFUSE], values,
+                             SHADER_UNIFORM_VEC4, 1);
+                diffuse = color;
+            }
+            color = material.maps[MATERIAL_MAP_SPECULAR].color;
+            if ((s.locs[SHADER_LOC_COLOR_SPECULAR] != -1) &&
+                ((!colors_set) ||
+                 (memcmp(&color, &specular, sizeof(Color)) != 0))) {
+                float values[4] = {color.r / 255.0f, color.g / 255.0f,
+                                   color.b / 255.0f, color.a / 255.0f};
+                rlSetUniform(s.locs[SHADER_LOC_COLOR_SPECULAR], values,
+                             SHADER_UNIFORM_VEC4, 1);
+                specular = color;
+            }
+            colors_set = true;
+
+            for (int i = 0; i < MAX_MATERIAL_MAPS; i++) {
+                unsigned int id = material.maps[i].texture.id;
+                if (id == 0)
+                    continue;
+                if (id != textures[i]) {
+                    rlActiveTextureSlot(i);
+                    if ((i == MATERIAL_MAP_IRRADIANCE) ||
+                        (i == MATERIAL_MAP_PREFILTER) ||
+                        (i == MATERIAL_MAP_CUBEMAP))
+                        rlEnableTextureCubemap(id);
+                    else
+                        rlEnableTexture(id);
+                    textures[i] = id;
+                    game_info.state_changes++;
+                }
+                if (!samplers[i]) {
+                    rlSetUniform(s.locs[SHADER_LOC_MAP_DIFFUSE + i], &i,
+                                 SHADER_UNIFORM_INT, 1);
+                    samplers[i] = true;
+                }
+            }
+
+            if (item.mesh.vaoId != vao) {
+                if (!rlEnableVertexArray(item.mesh.vaoId)) {
+                    TraceLog(LOG_WARNING,
+                             "RenderQueue::submit needs vertex arrays");
+                    continue;
+                }
+                vao = item.mesh.vaoId;
+                attrib_buffer = NULL;
+                game_info.state_changes++;
+            }
+            int location = s.locs[SHADER_LOC_MATRIX_MODEL];
+            if ((buffer != attrib_buffer) || (first != attrib_first) ||
+                (location != attrib_location)) {
+                rlEnableVertexBuffer(buffer->id());
+                for (int i = 0; i < 4; i++) {
+                    rlEnableVertexAttribute(location + i);
+                    rlSetVertexAttribute(location + i, 4, RL_FLOAT, 0,
+                                         sizeof(float16),
+                                         first * sizeof(float16) +
+                                             i * sizeof(Vector4));
+                    rlSetVertexAttributeDivisor(location + i, 1);
+                }
+                rlDisableVertexBuffer();
+                attrib_buffer = buffer;
+                attrib_first = first;
+                attrib_location = location;
+            }
+
+            if (item.mesh.indices != NULL)
+                rlDrawVertexArrayElementsInstanced(
+                    0, item.mesh.triangleCount * 3, 0, item.n);
+            else
+                rlDrawVertexArrayInstanced(0, item.mesh.vertexCount, item.n);
+            game_info.draw_calls++;
+        }
+
+        for (int i = 0; i < MAX_MATERIAL_MAPS; i++) {
+            if (textures[i] == 0)
+                continue;
+            rlActiveTextureSlot(i);
+            if ((i == MATERIAL_MAP_IRRADIANCE) ||
+                (i == MATERIAL_MAP_PREFILTER) || (i == MATERIAL_MAP_CUBEMAP))
+                rlDisableTextureCubemap();
+            else
+                rlDisableTexture();
+        }
+        rlDisableVertexArray();
+        rlDisableVertexBuffer();
+        rlDisableVertexBufferElement();
+        rlDisableShader();
+
+        m_items.clear();
+        m_n_instances = 0;
+    }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_RENDER_QUEUE_HPP_
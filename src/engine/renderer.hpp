@@ -2,10 +2,17 @@
 #define _SPRF_RENDERER_HPP_
 
 #include "base.hpp"
+#include "culling.hpp"
+#include "instance_buffer.hpp"
+#include "profiler.hpp"
 //#include "raylib-cpp.hpp"
+#include "render_queue.hpp"
 #include "shader_sources.hpp"
 #include "shaders.hpp"
 #include "shadow_map_texture.hpp"
+#include "simplify.hpp"
+#include "skinning.hpp"
+#include "static_bvh.hpp"
 #include <iostream>
 #include <memory>
 #include <vector>
@@ -40,6 +47,10 @@ class ViewFrustrum {
     raylib::Camera3D& m_camera;
     /** @brief Planes defining the view frustum */
     Plane m_planes[6];
+    /** @brief `m_planes` in the form `cull_instances` takes */
+    CullPlanes m_cull_planes;
+    /** @brief Aspect ratio of the view */
+    float m_aspect;
 
     /**
      * @brief Get the display height.
@@ -61,7 +72,7 @@ class ViewFrustrum {
      * @brief Get the aspect ratio.
      * @return Aspect ratio.
      */
-    float aspect() { return display_width() / display_height(); }
+    float aspect() { return m_aspect; }
 
     /**
      * @brief Get the field of view.
@@ -98,24 +109,31 @@ class ViewFrustrum {
     }
 
     /**
-     * @brief Get the camera up vector.
-     * @return Camera up vector.
+     * @brief Get the camera right vector.
+     * @return Camera right vector.
      */
-    vec3 cam_up() { return m_camera.up; }
+    vec3 cam_right() {
+        return cam_front().CrossProduct(m_camera.up).Normalize();
+    }
 
     /**
-     * @brief Get the camera right vector.
-     * @return Camera right vector.
+     * @brief Get the camera up vector, square to the front and right ones
+     * (`m_camera.up` is only the world up when the camera pitches).
+     * @return Camera up vector.
      */
-    vec3 cam_right() { return cam_front().CrossProduct(cam_up()); }
+    vec3 cam_up() { return cam_right().CrossProduct(cam_front()); }
 
   public:
     /**
      * @brief Construct a new ViewFrustrum object.
      * @param camera Reference to the camera.
+     * @param aspect_ Aspect ratio of the view, 0 for the window's.
      */
-    ViewFrustrum(raylib::Camera3D& camera) : m_camera(camera) {
-        float halfVSide = z_far() * tanf(fov_y() * 0.5f);
+    ViewFrustrum(raylib::Camera3D& camera, float aspect_ = 0)
+        : m_camera(camera), m_aspect(aspect_) {
+        if (m_aspect <= 0)
+            m_aspect = display_width() / display_height();
+        float halfVSide = z_far() * tanf(fov_y() * DEG2RAD * 0.5f);
         float halfHSide = halfVSide * aspect();
         auto front = cam_front();
         auto frontMultFar = front * z_far();
@@ -136,6 +154,34 @@ class ViewFrustrum {
         m_planes[5].normal =
             (frontMultFar + cam_up() * halfVSide).CrossProduct(cam_right());
         m_planes[5].point = cam_position();
+
+        for (int i = 0; i < 6; i++) {
+            vec3 normal = m_planes[i].normal;
+            m_cull_planes.planes[i][0] = normal.x;
+            m_cull_planes.planes[i][1] = normal.y;
+            m_cull_planes.planes[i][2] = normal.z;
+            m_cull_planes.planes[i][3] = -normal.DotProduct(m_planes[i].point);
+        }
+    }
+
+    const CullPlanes& cull_planes() { return m_cull_planes; }
+
+    /**
+     * @brief How big a sphere looks from the camera.
+     *
+     * @param center Center of the sphere.
+     * @param radius Radius of the sphere.
+     * @return float Diameter of the sphere on screen, as a fraction of the
+     * screen height (about, it doesn't account for perspective distortion
+     * away from the center of the screen).
+     */
+    float screen_size(Vector3 center, float radius) {
+        if (m_camera.projection == CAMERA_ORTHOGRAPHIC)
+            return (2.0f * radius) / m_camera.fovy;
+        float distance = Vector3Distance(center, m_camera.position);
+        if (distance <= radius)
+            return INFINITY;
+        return radius / (distance * tanf(fov_y() * DEG2RAD * 0.5f));
     }
 
     /**
@@ -258,6 +304,9 @@ struct BBoxCorners {
     }
 };
 
+static_assert(sizeof(mat4x4) == sizeof(Matrix),
+              "instances are culled as plain raylib matrices");
+
 /**
  * @brief Class representing a model to be rendered.
  *
@@ -266,6 +315,21 @@ struct BBoxCorners {
  */
 class RenderModel : public Logger {
   private:
+    /**
+     * @brief A level of detail: the meshes of the model, simplified.
+     */
+    struct Lod {
+        /** @brief One mesh per mesh of the model */
+        ::Mesh* meshes;
+        /** @brief Drawn for instances smaller than this on screen (see
+         * `ViewFrustrum::screen_size`) */
+        float screen_size;
+        /** @brief `m_pose_version` the meshes were last posed for */
+        uint32_t posed;
+        /** @brief Number of instances drawn at this level this frame */
+        int n_instances;
+    };
+
     /** @brief Pointer to the model */
     raylib::Model* m_model;
     /** @brief Pointer to texture */
@@ -273,31 +337,471 @@ class RenderModel : public Logger {
     bool m_texture_loaded = false;
     /** @brief Bounding boxes of meshes of the model */
     BBoxCorners* m_bounding_boxes = NULL;
+    /** @brief Bounds of meshes of the model for frustum culling */
+    CullBounds* m_cull_bounds = NULL;
+    /** @brief Bounds of the whole model, for picking levels of detail */
+    CullBounds m_model_bounds;
+    /** @brief Levels of detail, most detailed first. The first is the model
+     * itself, the others are owned */
+    std::vector<Lod> m_lods;
+    /** @brief Level of detail shadows are drawn with */
+    int m_shadow_lod = 0;
+    /** @brief Animation the meshes should be in (see `pose`) */
+    ModelAnimation m_pose_anim;
+    /** @brief Frame of `m_pose_anim` the meshes should be in */
+    int m_pose_frame = 0;
+    /** @brief Bumped by `pose` */
+    uint32_t m_pose_version = 0;
+    /** @brief Whether the meshes are skinned in the vertex shader, each
+     * instance in its own pose (see `pose_slot`) */
+    bool m_skinned = false;
+    /** @brief Bone id and weight buffers of every level of detail */
+    std::vector<unsigned int> m_bone_vbos;
+    /** @brief Bone matrices of each slot, `boneCount` per slot */
+    std::vector<Matrix> m_palettes;
+    /** @brief Whether each slot was posed since it was acquired */
+    std::vector<uint8_t> m_slot_posed;
     /** @brief Transformation matrix of the model */
     mat4x4 m_model_transform;
     /** @brief Number of instances allocated */
     int m_instances_allocated = 0;
     /** @brief Number of instances of the model */
     int m_n_instances = 0;
-    /** @brief Instances of the model */
+    /** @brief Instances of the model, packed (see `acquire_slot`) */
     mat4x4* m_instances = NULL;
-    /** @brief Number of visible instances of the model */
-    int m_n_visible_instances = 0;
-    /** @brief Visible instances of the model */
+    /** @brief Frame each of `m_instances` was last drawn in */
+    uint32_t* m_instance_frame = NULL;
+    /** @brief Slot each of `m_instances` belongs to */
+    uint32_t* m_instance_slot = NULL;
+    /** @brief Index in `m_instances` of each slot */
+    std::vector<uint32_t> m_slot_index;
+    /** @brief Slots released by `sweep` */
+    std::vector<uint32_t> m_free_slots;
+    /** @brief Whether `sweep` ran this frame */
+    bool m_swept = false;
+    /** @brief Room for every instance, for culling shadow casters into */
     Matrix* m_visible_instances = NULL;
+    /** @brief Size on screen of each of `m_instances` in this frame's camera
+     * pass, 0 if it was culled (see `measure`) */
+    float* m_instance_size = NULL;
+    /** @brief `m_instance_size` of each slot, kept for the next frame */
+    std::vector<float> m_slot_size;
+    /** @brief Frame each slot's `m_slot_size` was measured in */
+    std::vector<uint32_t> m_slot_measured;
+    /** @brief Level of detail each of `m_instances` is drawn at this frame
+     * (see `select_lods`) */
+    uint8_t* m_instance_lod = NULL;
+    /** @brief Whether each of `m_instances` passed the culling of the mesh
+     * being queued (see `queue_visible`) */
+    uint8_t* m_instance_visible = NULL;
+    /** @brief `m_instances`, kept on the GPU. Only instances that were
+     * added, moved or repacked are written (see `upload_instances`) */
+    InstanceBuffer m_instance_buffer;
+    /** @brief Indices in `m_instances` to write to `m_instance_buffer` */
+    std::vector<uint32_t> m_dirty_instances;
+    /** @brief Whether each of `m_instances` is in `m_dirty_instances` */
+    uint8_t* m_instance_dirty = NULL;
+    /** @brief Runs of visible instances, for `queue_visible` */
+    std::vector<InstanceRange> m_visible_ranges;
 
     Color m_tint = Color::White();
 
     bool m_clip = true;
 
+    /** @brief Bumped by `clear_instances`, so once per frame */
+    uint32_t m_frame = 0;
+    /** @brief An instance was added, moved or dropped this frame */
+    bool m_instances_moved = false;
+    /** @brief The meshes themselves changed this frame (see `mark_changed`) */
+    bool m_meshes_changed = false;
+    /** @brief Bumped once in every frame the instances changed */
+    uint32_t m_instances_version = 0;
+    /** @brief Whether `m_instances_version` was bumped this frame */
+    bool m_instances_version_bumped = false;
+    /** @brief Instances of each mesh that passed the shadow culling of each
+     * shadow map (light and cascade), kept on the GPU while neither the
+     * shadow map nor the instances move */
+    std::vector<InstanceBuffer>
+        m_shadow_casters[MAX_LIGHTS * SPRF_SHADOW_CASCADES];
+    /** @brief Number of instances in each of `m_shadow_casters` */
+    std::vector<int> m_n_shadow_casters[MAX_LIGHTS * SPRF_SHADOW_CASCADES];
+    /** @brief Static instances that passed the shadow culling of each shadow
+     * map */
+    std::vector<InstanceRange>
+        m_static_shadow_casters[MAX_LIGHTS * SPRF_SHADOW_CASCADES];
+    /** @brief Frustum `m_shadow_casters` were culled against */
+    CullPlanes m_shadow_casters_planes[MAX_LIGHTS * SPRF_SHADOW_CASCADES];
+    /** @brief `m_instances_version` `m_shadow_casters` were culled from */
+    uint32_t m_shadow_casters_version[MAX_LIGHTS * SPRF_SHADOW_CASCADES];
+    /** @brief Whether `m_shadow_casters` is filled in for each shadow map */
+    bool m_shadow_casters_valid[MAX_LIGHTS * SPRF_SHADOW_CASCADES] = {};
+    /** @brief Instances that never move */
+    StaticBVH m_static;
+    /** @brief `m_static.instances()`, uploaded once after they are added */
+    InstanceBuffer m_static_buffer;
+    /** @brief Static instances were added or removed this frame */
+    bool m_static_changed = false;
+
     /**
      * @brief Reallocate memory for instances.
+     *
+     * @param previous Number of instances allocated before.
      */
-    void realloc_instances() {
+    void realloc_instances(int previous) {
         m_instances = (mat4x4*)realloc(
             m_instances, sizeof(mat4x4) * m_instances_allocated);
+        m_instance_frame = (uint32_t*)realloc(
+            m_instance_frame, sizeof(uint32_t) * m_instances_allocated);
+        m_instance_slot = (uint32_t*)realloc(
+            m_instance_slot, sizeof(uint32_t) * m_instances_allocated);
         m_visible_instances = (Matrix*)realloc(
             m_visible_instances, sizeof(Matrix) * m_instances_allocated);
+        m_instance_size = (float*)realloc(
+            m_instance_size, sizeof(float) * m_instances_allocated);
+        m_instance_lod = (uint8_t*)realloc(m_instance_lod,
+                                           m_instances_allocated);
+        m_instance_visible = (uint8_t*)realloc(m_instance_visible,
+                                               m_instances_allocated);
+        m_instance_dirty = (uint8_t*)realloc(m_instance_dirty,
+                                             m_instances_allocated);
+        memset(m_instance_dirty + previous, 0,
+               m_instances_allocated - previous);
+    }
+
+    /**
+     * @brief Write instance `index` to `m_instance_buffer` before it is next
+     * drawn from.
+     */
+    void mark_dirty(int index) {
+        if (m_instance_dirty[index])
+            return;
+        m_instance_dirty[index] = 1;
+        m_dirty_instances.push_back(index);
+    }
+
+    /**
+     * @brief Write the instances that changed since the last upload to
+     * `m_instance_buffer`, a run of consecutive ones at a time. Growing the
+     * buffer drops its contents, so everything is written then.
+     */
+    void upload_instances() {
+        bool all = m_instance_buffer.reserve(m_n_instances) ||
+                   (m_dirty_instances.size() * 2 > (size_t)m_n_instances);
+        for (auto i : m_dirty_instances) {
+            m_instance_dirty[i] = 0;
+        }
+        if (all) {
+            PROFILE_SCOPE("upload instances");
+            m_instance_buffer.upload(m_instances, m_n_instances);
+            m_dirty_instances.clear();
+            return;
+        }
+        if (m_dirty_instances.empty())
+            return;
+        PROFILE_SCOPE("upload instances");
+        std::sort(m_dirty_instances.begin(), m_dirty_instances.end());
+        size_t i = 0;
+        size_t len = m_dirty_instances.size();
+        while ((i < len) && (m_dirty_instances[i] < (uint32_t)m_n_instances)) {
+            uint32_t first = m_dirty_instances[i];
+            uint32_t count = 1;
+            while ((i + count < len) &&
+                   (m_dirty_instances[i + count] == first + count) &&
+                   (first + count < (uint32_t)m_n_instances)) {
+                count++;
+            }
+            m_instance_buffer.upload(m_instances + first, count, first);
+            i += count;
+        }
+        m_dirty_instances.clear();
+    }
+
+    /**
+     * @brief Drop instances that weren't drawn this frame, moving the last
+     * instance into each hole so `m_instances` stays packed.
+     */
+    void sweep() {
+        if (m_swept)
+            return;
+        m_swept = true;
+        int i = 0;
+        while (i < m_n_instances) {
+            if (m_instance_frame[i] == m_frame) {
+                i++;
+                continue;
+            }
+            uint32_t slot = m_instance_slot[i];
+            int last = m_n_instances - 1;
+            m_instances[i] = m_instances[last];
+            m_instance_frame[i] = m_instance_frame[last];
+            m_instance_slot[i] = m_instance_slot[last];
+            m_slot_index[m_instance_slot[i]] = i;
+            m_free_slots.push_back(slot);
+            m_n_instances--;
+            m_instances_moved = true;
+            mark_dirty(i);
+        }
+    }
+
+    /**
+     * @brief Get the instances ready to draw: drop stale ones and upload the
+     * static instances if they changed.
+     */
+    void prepare() {
+        sweep();
+        if (m_static.update(m_cull_bounds, m_model->meshCount)) {
+            m_static_buffer.reserve(m_static.size());
+            m_static_buffer.upload(m_static.instances(), m_static.size());
+        }
+    }
+
+    /**
+     * @brief Bring a level of detail's meshes to the pose set by `pose`. Only
+     * levels that are drawn are posed.
+     */
+    void pose_lod(int lod) {
+        Lod& level = m_lods[lod];
+        if (m_skinned || (level.posed == m_pose_version))
+            return;
+        PROFILE_SCOPE("pose");
+        ::Model model = *m_model;
+        model.meshes = level.meshes;
+        UpdateModelAnimation(model, m_pose_anim, m_pose_frame);
+        level.posed = m_pose_version;
+    }
+
+    /**
+     * @brief Work out how big each instance looks from the camera, 0 if the
+     * whole model is outside the frustum, into `m_instance_size` (and
+     * `m_slot_size`, for `slot_screen_size`).
+     */
+    void measure(ViewFrustrum& frustrum) {
+        if (m_slot_size.size() < m_slot_index.size()) {
+            m_slot_size.resize(m_slot_index.size(), INFINITY);
+            m_slot_measured.resize(m_slot_index.size(), m_frame - 1);
+        }
+        const float* c = m_model_bounds.center;
+        for (int j = 0; j < m_n_instances; j++) {
+            const Matrix& m = m_instances[j];
+            float size = 0;
+            if (cull_visible(frustrum.cull_planes(), m_model_bounds, m)) {
+                Vector3 center = {
+                    m.m0 * c[0] + m.m4 * c[1] + m.m8 * c[2] + m.m12,
+                    m.m1 * c[0] + m.m5 * c[1] + m.m9 * c[2] + m.m13,
+                    m.m2 * c[0] + m.m6 * c[1] + m.m10 * c[2] + m.m14};
+                float scale = sqrtf(
+                    fmaxf(fmaxf(m.m0 * m.m0 + m.m1 * m.m1 + m.m2 * m.m2,
+                                m.m4 * m.m4 + m.m5 * m.m5 + m.m6 * m.m6),
+                          m.m8 * m.m8 + m.m9 * m.m9 + m.m10 * m.m10));
+                size = frustrum.screen_size(center,
+                                            m_model_bounds.radius * scale);
+            }
+            m_instance_size[j] = size;
+            uint32_t slot = m_instance_slot[j];
+            m_slot_size[slot] = size;
+            m_slot_measured[slot] = m_frame;
+        }
+    }
+
+    /**
+     * @brief Sort the instances into the levels of detail by how big they
+     * look from the camera (see `measure`), into `m_instance_lod`.
+     */
+    void select_lods() {
+        for (auto& level : m_lods) {
+            level.n_instances = 0;
+        }
+        for (int j = 0; j < m_n_instances; j++) {
+            float size = m_instance_size[j];
+            size_t lod = 0;
+            while ((lod + 1 < m_lods.size()) &&
+                   (size < m_lods[lod + 1].screen_size)) {
+                lod++;
+            }
+            m_instance_lod[j] = lod;
+            m_lods[lod].n_instances++;
+        }
+    }
+
+    /**
+     * @brief Give the meshes of a level of detail their bone attributes, if
+     * the model is skinned on the GPU.
+     *
+     * @return false if the model is, but the meshes aren't skinned.
+     */
+    bool upload_skin(::Mesh* meshes) {
+        if (!m_skinned)
+            return true;
+        for (int i = 0; i < m_model->meshCount; i++) {
+            if (!upload_bone_attributes(meshes[i], m_bone_vbos))
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Add a level of detail, keeping it sorted.
+     *
+     * @param meshes One (uploaded) mesh per mesh of the model, owned by the
+     * model from now on.
+     */
+    void insert_lod(::Mesh* meshes, float screen_size) {
+        Lod level;
+        level.meshes = meshes;
+        level.screen_size = screen_size;
+        // pose it the first time it's drawn
+        level.posed = m_pose_version - 1;
+        level.n_instances = 0;
+        auto it = m_lods.begin() + 1;
+        while ((it != m_lods.end()) && (it->screen_size > screen_size)) {
+            it++;
+        }
+        m_lods.insert(it, std::move(level));
+    }
+
+    static Vector3 translation(const Matrix& m) {
+        return {m.m12, m.m13, m.m14};
+    }
+
+    /**
+     * @brief Diffuse color of a mesh, tinted.
+     */
+    Color tinted(int i) {
+        ::Material material = m_model->materials[m_model->meshMaterial[i]];
+        Color color = material.maps[MATERIAL_MAP_DIFFUSE].color;
+
+        Color colorTint = Color::White();
+        colorTint.r = (unsigned char)(((int)color.r*(int)m_tint.r)/255);
+        colorTint.g = (unsigned char)(((int)color.g*(int)m_tint.g)/255);
+        colorTint.b = (unsigned char)(((int)color.b*(int)m_tint.b)/255);
+        colorTint.a = (unsigned char)(((int)color.a*(int)m_tint.a)/255);
+        return colorTint;
+    }
+
+    /**
+     * @brief Draw instances of one mesh of the model, tinted, with a shader.
+     */
+    void draw_mesh(int i, Shader shader, const InstanceBuffer& buffer,
+                   int first, int n, int lod = 0) {
+        if (n == 0)
+            return;
+        ::Mesh mesh = m_lods[lod].meshes[i];
+        ::Material material = m_model->materials[m_model->meshMaterial[i]];
+
+        Color color = material.maps[MATERIAL_MAP_DIFFUSE].color;
+        material.maps[MATERIAL_MAP_DIFFUSE].color = tinted(i);
+        material.shader = shader;
+        {
+            PROFILE_SCOPE("draw instanced");
+            draw_mesh_instanced(mesh, material, buffer, first, n);
+        }
+        material.maps[MATERIAL_MAP_DIFFUSE].color = color;
+    }
+
+    /**
+     * @brief Queue one mesh of the model for the instances marked in
+     * `m_instance_visible`, the ones at level of detail `lod` (or all of
+     * them, drawn at the first level, if `lod` is -1).
+     *
+     * Opaque instances are drawn straight from `m_instance_buffer`, one draw
+     * per run of consecutive instances at the depth of its nearest, as long
+     * as that takes at most `SPRF_INSTANCE_RANGES_MAX` draws. Visible
+     * instances scattered further than that are copied to the queue's
+     * instances for this frame and drawn together instead. Transparent ones
+     * are drawn one at a time (the queue sorts them back to front, so they
+     * blend in the right order with everything else that's transparent),
+     * always from `m_instance_buffer`.
+     */
+    void queue_visible(RenderQueue& queue, int i, Shader shader, int lod) {
+        ::Mesh mesh = m_lods[std::max(lod, 0)].meshes[i];
+        ::Material material = m_model->materials[m_model->meshMaterial[i]];
+        material.shader = shader;
+        Color diffuse = tinted(i);
+        bool transparent = diffuse.a < 255;
+        uint32_t range_depth[SPRF_INSTANCE_RANGES_MAX];
+        uint32_t nearest = UINT32_MAX;
+        bool scattered = false;
+        int n_visible = 0;
+        m_visible_ranges.clear();
+        for (int j = 0; j < m_n_instances; j++) {
+            if ((!m_instance_visible[j]) ||
+                ((lod >= 0) && (m_instance_lod[j] != lod)))
+                continue;
+            n_visible++;
+            uint32_t depth = queue.depth(translation(m_instances[j]));
+            if (transparent) {
+                queue.push(mesh, material, diffuse, &m_instance_buffer, j, 1,
+                           depth);
+                continue;
+            }
+            nearest = std::min(nearest, depth);
+            if (scattered)
+                continue;
+            size_t n_ranges = m_visible_ranges.size();
+            if ((n_ranges > 0) &&
+                (m_visible_ranges.back().first +
+                     m_visible_ranges.back().count ==
+                 (uint32_t)j)) {
+                m_visible_ranges.back().count++;
+                range_depth[n_ranges - 1] =
+                    std::min(range_depth[n_ranges - 1], depth);
+                continue;
+            }
+            if (n_ranges == SPRF_INSTANCE_RANGES_MAX) {
+                scattered = true;
+                continue;
+            }
+            m_visible_ranges.push_back({(uint32_t)j, 1});
+            range_depth[n_ranges] = depth;
+        }
+        game_info.drawn_triangles += mesh.triangleCount * n_visible;
+        if (transparent || (n_visible == 0))
+            return;
+        if (scattered) {
+            Matrix* visible = queue.reserve_instances(n_visible);
+            int n = 0;
+            for (int j = 0; j < m_n_instances; j++) {
+                if (m_instance_visible[j] &&
+                    ((lod < 0) || (m_instance_lod[j] == lod)))
+                    visible[n++] = m_instances[j];
+            }
+            int first = queue.commit_instances(n);
+            queue.push(mesh, material, diffuse, NULL, first, n, nearest);
+            return;
+        }
+        for (size_t r = 0; r < m_visible_ranges.size(); r++) {
+            queue.push(mesh, material, diffuse, &m_instance_buffer,
+                       m_visible_ranges[r].first, m_visible_ranges[r].count,
+                       range_depth[r]);
+        }
+    }
+
+    /**
+     * @brief Queue ranges of the static instances for one mesh.
+     */
+    void queue_static(RenderQueue& queue, int i, Shader shader,
+                      const std::vector<InstanceRange>& ranges) {
+        ::Mesh mesh = m_lods[0].meshes[i];
+        ::Material material = m_model->materials[m_model->meshMaterial[i]];
+        material.shader = shader;
+        Color diffuse = tinted(i);
+        const Matrix* instances = m_static.instances();
+        for (auto& range : ranges) {
+            game_info.drawn_triangles += mesh.triangleCount * range.count;
+            queue.push(mesh, material, diffuse, &m_static_buffer, range.first,
+                       range.count,
+                       queue.depth(translation(instances[range.first])));
+        }
+    }
+
+    /**
+     * @brief Draw ranges of the static instances for one mesh.
+     */
+    void draw_static(int i, Shader shader,
+                     const std::vector<InstanceRange>& ranges) {
+        for (auto& range : ranges) {
+            draw_mesh(i, shader, m_static_buffer, range.first, range.count);
+        }
     }
 
   public:
@@ -317,17 +821,62 @@ class RenderModel : public Logger {
             m_bounding_boxes[i] =
                 (BBoxCorners(GetMeshBoundingBox(m_model->meshes[i])));
         }
+        m_cull_bounds =
+            (CullBounds*)malloc(sizeof(CullBounds) * m_model->meshCount);
+        // like GetModelBoundingBox, but without the model's transform (which
+        // is part of every instance)
+        BoundingBox model_bbox = {{0, 0, 0}, {0, 0, 0}};
+        for (int i = 0; i < m_model->meshCount; i++) {
+            BoundingBox bbox = GetMeshBoundingBox(m_model->meshes[i]);
+            m_cull_bounds[i] = CullBounds(bbox);
+            if (i == 0) {
+                model_bbox = bbox;
+                continue;
+            }
+            model_bbox.min = Vector3Min(model_bbox.min, bbox.min);
+            model_bbox.max = Vector3Max(model_bbox.max, bbox.max);
+        }
+        m_model_bounds = CullBounds(model_bbox);
+        m_lods.push_back(Lod());
+        m_lods[0].meshes = m_model->meshes;
+        m_lods[0].screen_size = INFINITY;
+        m_lods[0].posed = 0;
+        m_lods[0].n_instances = 0;
         m_instances_allocated = 50;
-        realloc_instances();
+        realloc_instances(0);
+        m_skinned = (m_model->boneCount > 0) && (m_model->meshCount > 0);
+        for (int i = 0; i < m_model->meshCount; i++) {
+            m_skinned = m_skinned && (m_model->meshes[i].boneIds != NULL) &&
+                        (m_model->meshes[i].boneWeights != NULL) &&
+                        (m_model->meshes[i].vaoId > 0);
+        }
+        if (m_skinned)
+            upload_skin(m_model->meshes);
     }
 
     ~RenderModel() {
+        for (size_t i = 1; i < m_lods.size(); i++) {
+            for (int j = 0; j < m_model->meshCount; j++) {
+                UnloadMesh(m_lods[i].meshes[j]);
+            }
+            delete[] m_lods[i].meshes;
+        }
+        for (auto vbo : m_bone_vbos) {
+            rlUnloadVertexBuffer(vbo);
+        }
         delete m_model;
         if (m_texture_loaded)
             UnloadTexture(m_texture);
         free(m_bounding_boxes);
+        free(m_cull_bounds);
         free(m_instances);
+        free(m_instance_frame);
+        free(m_instance_slot);
         free(m_visible_instances);
+        free(m_instance_size);
+        free(m_instance_lod);
+        free(m_instance_visible);
+        free(m_instance_dirty);
     }
 
     void add_texture(std::string path,
@@ -364,22 +913,361 @@ class RenderModel : public Logger {
     bool clip() { return m_clip; }
 
     /**
-     * @brief Clear all instances of the model.
+     * @brief Add levels of detail made by simplifying the model's meshes
+     * (see `simplify_mesh`).
+     *
+     * Instances are drawn at the least detailed level whose `screen_size`
+     * they are below, judged by the bounding sphere of the whole model so
+     * all meshes of an instance switch together.
+     *
+     * @param levels Number of levels to add.
+     * @param ratio Fraction of the triangles each level keeps of the level
+     * before.
+     * @param screen_size Size on screen (see `ViewFrustrum::screen_size`)
+     * below which the first added level is drawn, halving for every level
+     * after that.
+     * @return int Number of levels added, fewer than `levels` if the meshes
+     * don't simplify any further.
      */
-    void clear_instances() { m_n_instances = 0; }
+    int generate_lods(int levels = 3, float ratio = 0.5f,
+                      float screen_size = 0.25f) {
+        int added = 0;
+        float keep = 1;
+        for (int l = 0; l < levels; l++) {
+            keep *= ratio;
+            ::Mesh* meshes = new ::Mesh[m_model->meshCount];
+            int triangles = 0;
+            int previous = 0;
+            bool ok = true;
+            for (int i = 0; i < m_model->meshCount; i++) {
+                meshes[i] = simplify_mesh(m_model->meshes[i], keep);
+                ok = ok && (meshes[i].vertexCount > 0);
+                triangles += meshes[i].triangleCount;
+                previous += m_lods.back().meshes[i].triangleCount;
+            }
+            // a level that barely simplified isn't worth switching to
+            if ((!ok) || (triangles > previous * 0.9f)) {
+                for (int i = 0; i < m_model->meshCount; i++) {
+                    UnloadMesh(meshes[i]);
+                }
+                delete[] meshes;
+                break;
+            }
+            for (int i = 0; i < m_model->meshCount; i++) {
+                UploadMesh(&meshes[i], meshes[i].animVertices != NULL);
+            }
+            // without bone attributes the level would draw in the bind pose
+            if (!upload_skin(meshes)) {
+                log(LOG_WARNING,
+                    "level of detail %d lost its skin, dropping it",
+                    (int)m_lods.size());
+                for (int i = 0; i < m_model->meshCount; i++) {
+                    UnloadMesh(meshes[i]);
+                }
+                delete[] meshes;
+                break;
+            }
+            log(LOG_INFO, "level of detail %d: %d triangles (from %d)",
+                (int)m_lods.size(), triangles, previous);
+            insert_lod(meshes, screen_size);
+            screen_size *= 0.5f;
+            added++;
+        }
+        return added;
+    }
 
     /**
-     * @brief Add an instance of the model.
+     * @brief Add a level of detail made offline.
+     *
+     * @param path Model file with the same meshes as this model (in the same
+     * order), simplified. Only its meshes are used.
+     * @param screen_size Size on screen (see `ViewFrustrum::screen_size`)
+     * below which the level is drawn.
+     * @return bool Whether the level was added.
+     */
+    bool add_lod(std::string path, float screen_size) {
+        ::Model model = LoadModel(path.c_str());
+        if (model.meshCount != m_model->meshCount) {
+            log(LOG_ERROR, "%s has %d meshes, expected %d", path.c_str(),
+                model.meshCount, m_model->meshCount);
+            UnloadModel(model);
+            return false;
+        }
+        ::Mesh* meshes = new ::Mesh[model.meshCount];
+        for (int i = 0; i < model.meshCount; i++) {
+            meshes[i] = model.meshes[i];
+        }
+        // keep the meshes, drop the rest
+        model.meshCount = 0;
+        UnloadModel(model);
+        if (!upload_skin(meshes)) {
+            log(LOG_ERROR, "%s isn't skinned", path.c_str());
+            for (int i = 0; i < m_model->meshCount; i++) {
+                UnloadMesh(meshes[i]);
+            }
+            delete[] meshes;
+            return false;
+        }
+        insert_lod(meshes, screen_size);
+        return true;
+    }
+
+    /**
+     * @brief Number of levels of detail, including the model itself.
+     */
+    int lods() const { return m_lods.size(); }
+
+    /**
+     * @brief Sets the level of detail shadows are drawn with (clamped to the
+     * levels there are).
+     */
+    int shadow_lod(int lod) {
+        m_shadow_lod = lod;
+        mark_changed();
+        return m_shadow_lod;
+    }
+
+    /**
+     * @brief Gets the level of detail shadows are drawn with.
+     */
+    int shadow_lod() { return m_shadow_lod; }
+
+    /**
+     * @brief Pose the meshes (every level of detail) for an animation.
+     *
+     * Replaces `UpdateModelAnimation` on `model()`: skinning is deferred
+     * until a level is drawn, so only levels in use pay for it. `anim` must
+     * stay valid until the model is drawn. A model skinned on the GPU poses
+     * every slot instead (see `pose_slot`).
+     */
+    void pose(ModelAnimation anim, int frame) {
+        if (m_skinned) {
+            for (uint32_t slot = 0; slot < m_slot_index.size(); slot++) {
+                pose_slot(slot, anim, frame);
+            }
+            return;
+        }
+        m_pose_anim = anim;
+        m_pose_frame = frame;
+        m_pose_version++;
+        mark_changed();
+    }
+
+    /**
+     * @brief Pose one instance for an animation.
+     *
+     * If the model is skinned on the GPU, this only computes the slot's
+     * bone matrices: instances in different poses are still drawn together.
+     * Otherwise it falls back to `pose`, which poses the meshes, and so
+     * every instance.
+     *
+     * @param slot Slot of the instance (see `acquire_slot`), drawn this
+     * frame. Acquiring the slot again resets it to the bind pose.
+     */
+    void pose_slot(uint32_t slot, ModelAnimation anim, int frame) {
+        if (!m_skinned) {
+            pose(anim, frame);
+            return;
+        }
+        if ((anim.frameCount <= 0) || (anim.framePoses == NULL))
+            return;
+        frame = frame % anim.frameCount;
+        int n_bones = m_model->boneCount;
+        if (m_slot_posed.size() <= slot) {
+            m_slot_posed.resize(slot + 1, 0);
+            m_palettes.resize(m_slot_posed.size() * n_bones, MatrixIdentity());
+        }
+        Matrix* palette = &m_palettes[slot * n_bones];
+        for (int i = 0; i < std::min(n_bones, anim.boneCount); i++) {
+            palette[i] =
+                bone_matrix(m_model->bindPose[i], anim.framePoses[frame][i]);
+        }
+        m_slot_posed[slot] = 1;
+        mark_changed();
+    }
+
+    /**
+     * @brief Whether the meshes are skinned in the vertex shader, i.e. the
+     * model has bones and `pose_slot` poses instances separately.
+     */
+    bool skinned() const { return m_skinned; }
+
+    /**
+     * @brief Add this frame's bone matrices of every posed instance to
+     * `bones`.
+     *
+     * The shaders find an instance's bone matrices through the otherwise
+     * unused bottom row of its transform: `m3` holds the index of its first
+     * matrix + 1, or 0 for the bind pose. Instances whose index moved count
+     * as moved, so shadow casters holding the old one are culled again.
+     */
+    void upload_palettes(BoneTexture& bones) {
+        if (!m_skinned)
+            return;
+        sweep();
+        int n_bones = m_model->boneCount;
+        for (int j = 0; j < m_n_instances; j++) {
+            uint32_t slot = m_instance_slot[j];
+            float palette = 0;
+            if ((slot < m_slot_posed.size()) && m_slot_posed[slot])
+                palette = bones.add(&m_palettes[slot * n_bones], n_bones) + 1;
+            if (m_instances[j].m3 != palette) {
+                m_instances[j].m3 = palette;
+                m_instances_moved = true;
+                mark_dirty(j);
+            }
+        }
+    }
+
+    /**
+     * @brief End the frame. Instances that aren't drawn (`touch_slot` etc.)
+     * next frame are dropped before it is rendered.
+     */
+    void clear_instances() {
+        // make sure this frame's changes count even if nobody asked
+        instances_version();
+        m_instances_moved = false;
+        m_meshes_changed = false;
+        m_static_changed = false;
+        m_swept = false;
+        m_instances_version_bumped = false;
+        m_frame++;
+    }
+
+    /**
+     * @brief Number of times `clear_instances` was called, i.e. the frame
+     * instances are being added for.
+     */
+    uint32_t frame() const { return m_frame; }
+
+    /**
+     * @brief Add an instance that stays in the same slot from frame to
+     * frame.
+     *
+     * The slot holds the instance as long as it is drawn every frame, with
+     * `update_slot` if it moved or `touch_slot` if it didn't (which costs
+     * nothing but a store). A frame it isn't drawn in releases the slot.
      *
      * @param instance Transformation matrix of the instance.
+     * @return uint32_t The slot.
      */
-    void add_instance(mat4x4 instance) {
+    uint32_t acquire_slot(mat4x4 instance) {
         if (m_n_instances == m_instances_allocated) {
             m_instances_allocated *= 2;
-            realloc_instances();
+            realloc_instances(m_n_instances);
         }
+        uint32_t slot;
+        if (m_free_slots.empty()) {
+            slot = m_slot_index.size();
+            m_slot_index.push_back(0);
+        } else {
+            slot = m_free_slots.back();
+            m_free_slots.pop_back();
+        }
+        m_slot_index[slot] = m_n_instances;
+        if (slot < m_slot_posed.size())
+            m_slot_posed[slot] = 0;
         m_instances[m_n_instances] = m_model_transform * instance;
+        m_instance_frame[m_n_instances] = m_frame;
+        m_instance_slot[m_n_instances] = slot;
+        mark_dirty(m_n_instances);
         m_n_instances++;
+        m_instances_moved = true;
+        return slot;
+    }
+
+    /**
+     * @brief Draw the instance in a slot this frame, somewhere new.
+     */
+    void update_slot(uint32_t slot, mat4x4 instance) {
+        uint32_t index = m_slot_index[slot];
+        m_instances[index] = m_model_transform * instance;
+        m_instance_frame[index] = m_frame;
+        m_instances_moved = true;
+        mark_dirty(index);
+    }
+
+    /**
+     * @brief Draw the instance in a slot this frame, where it was last frame.
+     */
+    void touch_slot(uint32_t slot) {
+        m_instance_frame[m_slot_index[slot]] = m_frame;
+    }
+
+    /**
+     * @brief How big the instance in a slot looked from the camera last
+     * frame (see `ViewFrustrum::screen_size`).
+     *
+     * @return float 0 if it was outside the frustum, `INFINITY` if it
+     * wasn't measured (not drawn last frame, or the model isn't frustum
+     * culled).
+     */
+    float slot_screen_size(uint32_t slot) const {
+        if ((slot >= m_slot_measured.size()) ||
+            (m_slot_measured[slot] + 1 != m_frame))
+            return INFINITY;
+        return m_slot_size[slot];
+    }
+
+    /**
+     * @brief Add an instance for this frame only.
+     *
+     * @param instance Transformation matrix of the instance.
+     */
+    void add_instance(mat4x4 instance) { acquire_slot(instance); }
+
+    /**
+     * @brief Tell the renderer the mesh data changed this frame (e.g. CPU
+     * skinning), so shadows need redrawing even if no instance moved.
+     */
+    void mark_changed() { m_meshes_changed = true; }
+
+    /**
+     * @brief Whether the instances differ from last frame.
+     */
+    bool instances_changed() {
+        sweep();
+        return m_instances_moved || m_static_changed;
+    }
+
+    /**
+     * @brief Changes whenever the instances do, unlike `instances_changed`
+     * it can be compared across frames.
+     */
+    uint32_t instances_version() {
+        if (instances_changed() && (!m_instances_version_bumped)) {
+            m_instances_version++;
+            m_instances_version_bumped = true;
+        }
+        return m_instances_version;
+    }
+
+    /**
+     * @brief Whether anything about this model's shadows changed since last
+     * frame.
+     */
+    bool changed() { return instances_changed() || m_meshes_changed; }
+
+    /**
+     * @brief Add an instance that never moves, e.g. map geometry.
+     *
+     * Static instances aren't cleared every frame. They go in a `StaticBVH`
+     * that is culled a subtree at a time and uploaded to the GPU once, on top
+     * of the other instances.
+     *
+     * @param instance Transformation matrix of the instance.
+     */
+    void add_static_instance(mat4x4 instance) {
+        m_static.add(m_model_transform * instance);
+        m_static_changed = true;
+    }
+
+    /**
+     * @brief Remove all static instances.
+     */
+    void clear_static_instances() {
+        m_static.clear();
+        m_static_changed = true;
     }
 
     /**
@@ -390,43 +1278,34 @@ class RenderModel : public Logger {
      * original shader.
      *
      * @param shader Shader to be used for drawing.
+     * @param queue Queue to add the draws to.
      */
-    void draw(Shader shader, mat4x4 vp) {
-        Shader old_shader = m_model->materials[0].shader;
+    void draw(Shader shader, mat4x4 vp, RenderQueue& queue) {
+        prepare();
+        upload_instances();
+        pose_lod(0);
+        std::vector<InstanceRange> all_static;
+        if (m_static.size() > 0)
+            all_static.push_back({0, (uint32_t)m_static.size()});
         for (int i = 0; i < m_model->meshCount; i++) {
 
             BBoxCorners bbox = m_bounding_boxes[i];
-            m_n_visible_instances = 0;
-
-            mat4x4* instance_ptr = m_instances;
-            for (int j = 0; j < m_n_instances; j++) {
-                mat4x4 transform = *instance_ptr++;
-                if (bbox.visible(transform * vp)) {
-                    game_info.visible_meshes++;
-                    m_visible_instances[m_n_visible_instances] = transform;
-                    m_n_visible_instances++;
-                } else {
-                    game_info.hidden_meshes++;
+            {
+                PROFILE_SCOPE("cull");
+                for (int j = 0; j < m_n_instances; j++) {
+                    // m3 may hold a bone palette (see `upload_palettes`)
+                    mat4x4 model = m_instances[j];
+                    model.m3 = 0;
+                    m_instance_visible[j] = bbox.visible(model * vp);
+                    if (m_instance_visible[j]) {
+                        game_info.visible_meshes++;
+                    } else {
+                        game_info.hidden_meshes++;
+                    }
                 }
             }
-
-            MeshUnmanaged mesh = m_model->meshes[i];
-            ::Material material = m_model->materials[m_model->meshMaterial[i]];
-
-            Color color = material.maps[MATERIAL_MAP_DIFFUSE].color;
-
-            Color colorTint = Color::White();
-            colorTint.r = (unsigned char)(((int)color.r*(int)m_tint.r)/255);
-            colorTint.g = (unsigned char)(((int)color.g*(int)m_tint.g)/255);
-            colorTint.b = (unsigned char)(((int)color.b*(int)m_tint.b)/255);
-            colorTint.a = (unsigned char)(((int)color.a*(int)m_tint.a)/255);
-
-            material.maps[MATERIAL_MAP_DIFFUSE].color = colorTint;
-            material.shader = shader;
-            DrawMeshInstanced(mesh, material, m_visible_instances,
-                              m_n_visible_instances);
-            material.shader = old_shader;
-            material.maps[MATERIAL_MAP_DIFFUSE].color = color;
+            queue_visible(queue, i, shader, -1);
+            queue_static(queue, i, shader, all_static);
         }
     }
 
@@ -435,63 +1314,152 @@ class RenderModel : public Logger {
      *
      * This method temporarily sets the shader of the model's materials to the
      * provided shader, draws all instances of the model, and then restores the
-     * original shader.
+     * original shader. Each instance is drawn at the level of detail its size
+     * on screen calls for (see `generate_lods`); static instances are always
+     * drawn in full detail. Instances are drawn from the model's instance
+     * buffer, which is only written where slots were acquired, moved or
+     * repacked (see `queue_visible`).
      *
      * @param shader Shader to be used for drawing.
      * @param vp View-projection matrix.
      * @param frustrum View frustum.
+     * @param queue Queue to add the draws to.
      */
-    void draw(Shader shader, mat4x4 vp, ViewFrustrum& frustrum) {
+    void draw(Shader shader, mat4x4 vp, ViewFrustrum& frustrum,
+              RenderQueue& queue) {
         if (!m_clip) {
-            draw(shader, vp);
+            draw(shader, vp, queue);
             return;
         }
-        Shader old_shader = m_model->materials[0].shader;
-        for (int i = 0; i < m_model->meshCount; i++) {
-
-            BBoxCorners bbox = m_bounding_boxes[i];
-            m_n_visible_instances = 0;
+        prepare();
+        const std::vector<InstanceRange>* static_visible = NULL;
+        int n_static_visible = 0;
+        if (m_static.size() > 0) {
+            PROFILE_SCOPE("cull static");
+            static_visible = &m_static.visible(frustrum.cull_planes());
+            for (auto& range : *static_visible) {
+                n_static_visible += range.count;
+            }
+        }
+        {
+            PROFILE_SCOPE("select lods");
+            measure(frustrum);
+            if (m_lods.size() > 1)
+                select_lods();
+        }
+        upload_instances();
+        bool by_lod = m_lods.size() > 1;
+        if (by_lod) {
+            for (size_t lod = 0; lod < m_lods.size(); lod++) {
+                if (m_lods[lod].n_instances > 0)
+                    pose_lod(lod);
+            }
+        } else if (m_n_instances > 0) {
+            pose_lod(0);
+        }
+        for (int i = 0; (i < m_model->meshCount) && (m_n_instances > 0); i++) {
+            int n_visible;
+            {
+                PROFILE_SCOPE("cull");
+                n_visible = cull_instances_mask(
+                    frustrum.cull_planes(), m_cull_bounds[i], m_instances,
+                    m_n_instances, m_instance_visible);
+            }
+            game_info.visible_meshes += n_visible;
+            game_info.hidden_meshes += m_n_instances - n_visible;
+            if (n_visible == 0)
+                continue;
+            if (!by_lod) {
+                queue_visible(queue, i, shader, -1);
+                continue;
+            }
+            for (size_t lod = 0; lod < m_lods.size(); lod++) {
+                if (m_lods[lod].n_instances > 0)
+                    queue_visible(queue, i, shader, lod);
+            }
+        }
+        if (static_visible) {
+            pose_lod(0);
+            for (int i = 0; i < m_model->meshCount; i++) {
+                game_info.visible_meshes += n_static_visible;
+                game_info.hidden_meshes += m_static.size() - n_static_visible;
+                queue_static(queue, i, shader, *static_visible);
+            }
+        }
+    }
 
-            mat4x4* instance_ptr = m_instances;
-            for (int j = 0; j < m_n_instances; j++) {
-                mat4x4 transform = *instance_ptr++;
-                if (bbox.visible(transform, frustrum)) {
-                    game_info.visible_meshes++;
-                    m_visible_instances[m_n_visible_instances] = transform;
-                    m_n_visible_instances++;
-                } else {
-                    game_info.hidden_meshes++;
+    /**
+     * @brief Draw the model into a shadow map.
+     *
+     * Instances are culled against the shadow map's (orthographic) frustum.
+     * The instances that pass are kept on the GPU per shadow map and reused
+     * as long as the frustum and the instances stay put, so static casters
+     * are only culled (and uploaded) again when something moves. Instances
+     * that aren't static are drawn at `shadow_lod`.
+     *
+     * @param shader Shadow shader.
+     * @param map Index of the shadow map, `light id * SPRF_SHADOW_CASCADES +
+     * cascade`.
+     * @param planes Frustum planes of the shadow map.
+     */
+    void draw_shadow(Shader shader, int map, const CullPlanes& planes) {
+        assert((map >= 0) && (map < MAX_LIGHTS * SPRF_SHADOW_CASCADES));
+        prepare();
+        auto& casters = m_shadow_casters[map];
+        auto& n_casters = m_n_shadow_casters[map];
+        auto& static_casters = m_static_shadow_casters[map];
+        uint32_t version = instances_version();
+        if ((!m_shadow_casters_valid[map]) ||
+            (m_shadow_casters_version[map] != version) ||
+            (memcmp(&m_shadow_casters_planes[map], &planes,
+                    sizeof(CullPlanes)) != 0)) {
+            PROFILE_SCOPE("cull");
+            casters.resize(m_model->meshCount);
+            n_casters.resize(m_model->meshCount);
+            for (int i = 0; i < m_model->meshCount; i++) {
+                const Matrix* visible = m_instances;
+                int n_visible = m_n_instances;
+                if (m_clip) {
+                    n_visible = cull_instances(planes, m_cull_bounds[i],
+                                               m_instances, m_n_instances,
+                                               m_visible_instances);
+                    visible = m_visible_instances;
                 }
+                casters[i].reserve(n_visible);
+                casters[i].upload(visible, n_visible);
+                n_casters[i] = n_visible;
             }
-
-
-
-            MeshUnmanaged mesh = m_model->meshes[i];
-            ::Material material = m_model->materials[m_model->meshMaterial[i]];
-
-            Color color = material.maps[MATERIAL_MAP_DIFFUSE].color;
-
-            Color colorTint = Color::White();
-            colorTint.r = (unsigned char)(((int)color.r*(int)m_tint.r)/255);
-            colorTint.g = (unsigned char)(((int)color.g*(int)m_tint.g)/255);
-            colorTint.b = (unsigned char)(((int)color.b*(int)m_tint.b)/255);
-            colorTint.a = (unsigned char)(((int)color.a*(int)m_tint.a)/255);
-
-            material.maps[MATERIAL_MAP_DIFFUSE].color = colorTint;
-
-            material.shader = shader;
-            DrawMeshInstanced(mesh, material, m_visible_instances,
-                              m_n_visible_instances);
-            material.shader = old_shader;
-            //TraceLog(LOG_INFO,"drawing here");
-            material.maps[MATERIAL_MAP_DIFFUSE].color = color;
+            static_casters.clear();
+            if (m_clip) {
+                m_static.cull(planes, static_casters);
+            } else if (m_static.size() > 0) {
+                static_casters.push_back({0, (uint32_t)m_static.size()});
+            }
+            m_shadow_casters_planes[map] = planes;
+            m_shadow_casters_version[map] = version;
+            m_shadow_casters_valid[map] = true;
+        }
+        int lod = std::min(std::max(m_shadow_lod, 0), (int)m_lods.size() - 1);
+        for (int n : n_casters) {
+            if (n > 0) {
+                pose_lod(lod);
+                break;
+            }
+        }
+        if (!static_casters.empty())
+            pose_lod(0);
+        for (int i = 0; i < m_model->meshCount; i++) {
+            draw_mesh(i, shader, casters[i], 0, n_casters[i], lod);
+            draw_static(i, shader, static_casters);
         }
     }
 
     /**
      * @brief Draw the model with its default shader.
      */
-    void draw(mat4x4 vp) { draw(m_model->materials[0].shader, vp); }
+    void draw(mat4x4 vp, RenderQueue& queue) {
+        draw(m_model->materials[0].shader, vp, queue);
+    }
 
     raylib::Model* model() { return m_model; }
 };
@@ -507,10 +1475,24 @@ class Renderer : public Logger {
   private:
     /** @brief List of render models */
     std::vector<RenderModel*> m_render_models;
+    /** @brief Render models handed out by `shared_render_model`, by path */
+    std::unordered_map<std::string, RenderModel*> m_shared_models;
     /** @brief Shader used for rendering */
     raylib::Shader m_shader;
     /** @brief Shader used for rendering shadows */
     raylib::Shader m_shadow_shader;
+    /** @brief Instances uploaded for this frame's camera pass */
+    InstanceStream m_instance_stream;
+    /** @brief Draws of this frame's camera pass */
+    RenderQueue m_queue;
+    /** @brief Bone matrices of this frame's skinned instances */
+    BoneTexture m_bones;
+    /** @brief Whether `m_bones` was uploaded for this frame */
+    bool m_bones_uploaded = false;
+    /** @brief Bumped every shadow pass */
+    uint32_t m_shadow_frame = 0;
+    /** @brief Bumped every shadow pass in which any caster changed */
+    uint32_t m_casters_version = 0;
     /** @brief Skybox shader */
     raylib::Shader m_skybox_shader;
     /** @brief Camera position uniform */
@@ -542,14 +1524,30 @@ class Renderer : public Logger {
         rlEnableDepthMask();
     }
 
+    /**
+     * @brief Upload the bone matrices of every skinned instance, once per
+     * frame, before anything is drawn.
+     */
+    void upload_bones() {
+        if (m_bones_uploaded)
+            return;
+        PROFILE_SCOPE("upload bones");
+        m_bones.begin();
+        for (auto& i : m_render_models) {
+            i->upload_palettes(m_bones);
+        }
+        m_bones.upload();
+        m_bones_uploaded = true;
+    }
+
   public:
     /**
      * @brief Construct a new Renderer object.
      *
      * @param ka Ambient light coefficient.
-     * @param shadow_scale Shadow map resolution.
+     * @param shadow_scale Shadow map resolution, per cascade.
      */
-    Renderer(float ka = 0.2, int shadow_scale = 4096)
+    Renderer(float ka = 0.2, int shadow_scale = 1024)
         : m_shader(raylib::Shader::LoadFromMemory(lights_vs, lights_fs)),
           m_shadow_shader(raylib::Shader::LoadFromMemory(lights_vs, base_fs)),
           m_skybox_shader(raylib::Shader::LoadFromMemory(skybox_vs, skybox_fs)),
@@ -566,6 +1564,12 @@ class Renderer : public Logger {
             GetShaderLocation(m_shadow_shader, "mvp");
         m_shadow_shader.locs[SHADER_LOC_MATRIX_MODEL] =
             GetShaderLocationAttrib(m_shadow_shader, "instanceTransform");
+        int bone_unit = SPRF_BONE_TEXTURE_UNIT;
+        SetShaderValue(m_shader, GetShaderLocation(m_shader, "boneMatrices"),
+                       &bone_unit, SHADER_UNIFORM_INT);
+        SetShaderValue(m_shadow_shader,
+                       GetShaderLocation(m_shadow_shader, "boneMatrices"),
+                       &bone_unit, SHADER_UNIFORM_INT);
     }
 
     ~Renderer() {
@@ -589,6 +1593,26 @@ class Renderer : public Logger {
         return m_render_models[m_render_models.size() - 1];
     }
 
+    /**
+     * @brief Get the render model loaded from a file, creating it the first
+     * time.
+     *
+     * Everything drawn with the model shares it, so all of its instances go
+     * in the same instanced draws. Skinned models keep a pose per instance
+     * (see `RenderModel::pose_slot`), so they can be shared as long as
+     * `RenderModel::skinned` holds.
+     *
+     * @param path Model file.
+     * @return Pointer to the render model.
+     */
+    RenderModel* shared_render_model(std::string path) {
+        if (KEY_EXISTS(m_shared_models, path))
+            return m_shared_models[path];
+        RenderModel* out = create_render_model(path);
+        m_shared_models[path] = out;
+        return out;
+    }
+
     /**
      * @brief Get the shader used by the renderer.
      *
@@ -613,31 +1637,58 @@ class Renderer : public Logger {
     /**
      * @brief Calculate shadows for all lights.
      *
-     * This method iterates over all lights, and for each enabled light, it sets
-     * up shadow mapping by rendering the scene from the light's perspective to
-     * a shadow map.
+     * This method iterates over all lights, and for each enabled light, it
+     * fits the light's shadow cascades to the camera and renders the ones
+     * that are due from the light's perspective. Casters are culled against
+     * each cascade's frustum, and a cascade rendered from the same place with
+     * the same casters keeps its shadow map instead of rendering again.
      */
     void calculate_shadows(raylib::Camera* camera) {
-        int slot_start = 15 - MAX_LIGHTS;
+        int slot_start = 16 - MAX_LIGHTS * SPRF_SHADOW_CASCADES;
         assert(m_lights.size() <= MAX_LIGHTS);
+        upload_bones();
+        for (auto& i : m_render_models) {
+            if (i->changed()) {
+                m_casters_version++;
+                break;
+            }
+        }
+        m_shadow_frame++;
+        float aspect = IsWindowFullscreen()
+                           ? GetRenderWidth() / (float)GetRenderHeight()
+                           : GetScreenWidth() / (float)GetScreenHeight();
         for (auto& light : m_lights) {
             if (!light->enabled())
                 continue;
-            light->BeginShadowMode(camera);
-            ClearBackground(BLACK);
-
-            for (auto& i : m_render_models) {
-                i->draw(m_shadow_shader, light->light_cam(camera).GetMatrix());
+            light->fit_cascades(camera, aspect);
+            for (int c = 0; c < SPRF_SHADOW_CASCADES; c++) {
+                // a cascade that isn't due keeps its last map, seen from
+                // where it was rendered
+                if (!light->cascade_due(c, m_shadow_frame, m_casters_version))
+                    continue;
+                CullPlanes planes =
+                    CullPlanes::from_matrix(light->cascade_view_proj(c));
+                light->BeginShadowMode(c);
+                ClearBackground(BLACK);
+
+                for (auto& i : m_render_models) {
+                    i->draw_shadow(m_shadow_shader,
+                                   light->id() * SPRF_SHADOW_CASCADES + c,
+                                   planes);
+                }
+                light->EndShadowMode(c, m_shadow_frame, m_casters_version);
             }
-            light->EndShadowMode(slot_start);
+            light->bind_shadow_maps(slot_start);
         }
     }
 
     /**
      * @brief Render the scene from the perspective of a camera.
      *
-     * This method sets the camera position uniform, begins the camera mode,
-     * renders all models, clears their instances, and ends the camera mode.
+     * This method sets the camera position uniform, queues the draws of all
+     * models and clears their instances, then submits the queue (opaque
+     * draws sorted by state and front to back, then transparent ones back to
+     * front).
      *
      * @param camera Camera used to render the scene.
      */
@@ -654,21 +1705,20 @@ class Renderer : public Logger {
         ClearBackground(background_color);
         game_info.visible_meshes = 0;
         game_info.hidden_meshes = 0;
+        game_info.drawn_triangles = 0;
+        game_info.draw_calls = 0;
+        game_info.state_changes = 0;
         draw_skybox(camera->GetPosition());
+        upload_bones();
+        m_queue.begin(camera->GetPosition());
         for (auto& i : m_render_models) {
-            if (i->tint().a != 255)
-                continue;
-            i->draw(m_shader, camera->GetMatrix(), frustrum);
-            // i->draw(m_shader, cam.GetMatrix());
-            i->clear_instances();
-        }
-        for (auto& i : m_render_models) {
-            if (i->tint().a == 255)
-                continue;
-            i->draw(m_shader, camera->GetMatrix(), frustrum);
+            i->draw(m_shader, camera->GetMatrix(), frustrum, m_queue);
             // i->draw(m_shader, cam.GetMatrix());
             i->clear_instances();
         }
+        m_queue.submit(m_instance_stream);
+        m_instance_stream.next_frame();
+        m_bones_uploaded = false;
         // DrawGrid(100, 1);
         // cam.EndMode();
         //  camera->EndMode();
@@ -0,0 +1,600 @@
+#ifndef _SPRF_SCENE_SNAPSHOT_HPP_
+#define _SPRF_SCENE_SNAPSHOT_HPP_
+
+#include "base.hpp"
+#include "ecs.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/** @brief First bytes of a scene snapshot file */
+#define SCENE_SNAPSHOT_MAGIC (0x53525053) // "SPRS"
+/** @brief Bump whenever the layout of a snapshot changes */
+#define SCENE_SNAPSHOT_VERSION (2)
+/** @brief `SnapshotEntity::parent` of root entities */
+#define SCENE_SNAPSHOT_NO_PARENT ((uint32_t)-1)
+
+namespace SPRF {
+
+/**
+ * @brief Start of a snapshot file.
+ *
+ * Every offset is in bytes from the start of the file, so the file can be
+ * used straight from wherever it is mapped.
+ */
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    /** @brief Whatever the snapshot was made from, as a hash the caller
+     * picks (see `SceneSnapshot::matches`) */
+    uint32_t source;
+    uint32_t n_entities;
+    uint32_t n_components;
+    /** @brief `SnapshotEntity[n_entities]` */
+    uint32_t entities_offset;
+    /** @brief `SnapshotComponent[n_components]` */
+    uint32_t components_offset;
+    /** @brief Component parameters */
+    uint32_t data_offset;
+    uint32_t data_size;
+    /** @brief Entity names, not null terminated */
+    uint32_t strings_offset;
+    uint32_t strings_size;
+};
+
+/**
+ * @brief One entity. Entities are stored depth first, so a parent always
+ * comes before its children.
+ */
+struct SnapshotEntity {
+    /** @brief Index of the parent, or `SCENE_SNAPSHOT_NO_PARENT` */
+    uint32_t parent;
+    /** @brief Name, as an offset into the string section */
+    uint32_t name_offset;
+    uint32_t name_size;
+    /** @brief The entity's components are
+     * [first_component, first_component + n_components) */
+    uint32_t first_component;
+    uint32_t n_components;
+    uint32_t enabled;
+    float position[3];
+    float rotation[3];
+    float scale[3];
+};
+
+/**
+ * @brief One component's parameters.
+ */
+struct SnapshotComponent {
+    /** @brief `snapshot_hash` of the name the type was registered with */
+    uint32_t type;
+    /** @brief Parameters, as an offset into the data section */
+    uint32_t data_offset;
+    uint32_t data_size;
+};
+
+static_assert(sizeof(SnapshotHeader) == 44, "snapshot layout changed");
+static_assert(sizeof(SnapshotEntity) == 60, "snapshot layout changed");
+static_assert(sizeof(SnapshotComponent) == 12, "snapshot layout changed");
+
+/**
+ * @brief 32 bit FNV-1a, used to store component type names.
+ */
+inline uint32_t snapshot_hash(const std::string& str) {
+    uint32_t out = 2166136261u;
+    for (char i : str) {
+        out ^= (uint8_t)i;
+        out *= 16777619u;
+    }
+    return out;
+}
+
+/**
+ * @brief Appends a component's parameters to a snapshot.
+ *
+ * Resources (render models, textures...) can't be written to the file, so
+ * components store an index into a table of resource pointers that the
+ * caller keeps and passes back when loading.
+ */
+class SnapshotWriter {
+  private:
+    std::string& m_data;
+    std::vector<void*>& m_resources;
+
+  public:
+    SnapshotWriter(std::string& data, std::vector<void*>& resources)
+        : m_data(data), m_resources(resources) {}
+
+    template <class T> void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "only plain data can be written to a snapshot");
+        m_data.append((const char*)&value, sizeof(T));
+    }
+
+    void write_string(const std::string& str) {
+        write<uint32_t>(str.size());
+        m_data.append(str);
+    }
+
+    /**
+     * @brief Index of `ptr` in the resource table, adding it if needed.
+     */
+    uint32_t resource(void* ptr) {
+        for (size_t i = 0; i < m_resources.size(); i++) {
+            if (m_resources[i] == ptr)
+                return i;
+        }
+        m_resources.push_back(ptr);
+        return m_resources.size() - 1;
+    }
+};
+
+/**
+ * @brief Reads a component's parameters back out of a snapshot.
+ *
+ * Reads past the end of the parameters return zeros and clear `ok()`
+ * instead of reading out of bounds.
+ */
+class SnapshotReader {
+  private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+    const std::vector<void*>& m_resources;
+    bool m_ok = true;
+
+  public:
+    SnapshotReader(const uint8_t* data, size_t size,
+                   const std::vector<void*>& resources)
+        : m_data(data), m_size(size), m_resources(resources) {}
+
+    template <class T> T read() {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "only plain data can be read from a snapshot");
+        T out;
+        if ((m_size - m_pos) < sizeof(T)) {
+            m_ok = false;
+            memset(&out, 0, sizeof(T));
+            return out;
+        }
+        memcpy(&out, m_data + m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return out;
+    }
+
+    std::string read_string() {
+        uint32_t size = read<uint32_t>();
+        if ((m_size - m_pos) < size) {
+            m_ok = false;
+            return "";
+        }
+        std::string out((const char*)m_data + m_pos, size);
+        m_pos += size;
+        return out;
+    }
+
+    /**
+     * @brief Resource `idx` of the table passed to `SceneSnapshot::load`.
+     * @return R* The resource, or NULL if `idx` is out of range.
+     */
+    template <class R> R* resource(uint32_t idx) {
+        if (idx >= m_resources.size()) {
+            m_ok = false;
+            return NULL;
+        }
+        return (R*)m_resources[idx];
+    }
+
+    bool ok() { return m_ok; }
+};
+
+/**
+ * @brief Component types that can be written to snapshots.
+ *
+ * A component type opts in by implementing
+ *
+ *     void save(SnapshotWriter& out);
+ *     static void load(Entity* entity, SnapshotReader& in);
+ *
+ * (`load` adds the component to `entity`) and registering itself under a
+ * name that stays the same between builds:
+ *
+ *     SnapshotRegistry::get().add<Model>("Model");
+ *
+ * Components of unregistered types are left out of snapshots.
+ */
+class SnapshotRegistry {
+  public:
+    typedef std::function<void(Component*, SnapshotWriter&)> save_t;
+    typedef std::function<void(Entity*, SnapshotReader&)> load_t;
+
+  private:
+    struct Entry {
+        uint32_t type;
+        save_t save;
+        load_t load;
+    };
+
+    std::unordered_map<std::type_index, Entry> m_by_type;
+    std::unordered_map<uint32_t, Entry> m_by_hash;
+
+  public:
+    static SnapshotRegistry& get() {
+        static SnapshotRegistry registry;
+        return registry;
+    }
+
+    template <class T> bool add(const std::string& name) {
+        Entry entry;
+        entry.type = snapshot_hash(name);
+        entry.save = [](Component* component, SnapshotWriter& out) {
+            static_cast<T*>(component)->save(out);
+        };
+        entry.load = [](Entity* entity, SnapshotReader& in) {
+            T::load(entity, in);
+        };
+        assert(!KEY_EXISTS(m_by_hash, entry.type));
+        m_by_type[std::type_index(typeid(T))] = entry;
+        m_by_hash[entry.type] = entry;
+        return true;
+    }
+
+    const Entry* find(Component* component) {
+        auto it = m_by_type.find(std::type_index(typeid(*component)));
+        if (it == m_by_type.end())
+            return NULL;
+        return &it->second;
+    }
+
+    const Entry* find(uint32_t type) {
+        auto it = m_by_hash.find(type);
+        if (it == m_by_hash.end())
+            return NULL;
+        return &it->second;
+    }
+};
+
+/**
+ * @brief Read only view of a whole file.
+ *
+ * Memory maps the file where `mmap` is available, so loading a snapshot
+ * doesn't copy it and only touches the pages it reads. Elsewhere the file is
+ * read into a buffer.
+ */
+class SnapshotFile {
+  private:
+    const uint8_t* m_data = NULL;
+    size_t m_size = 0;
+    std::vector<uint8_t> m_buffer;
+    bool m_mapped = false;
+
+  public:
+    SnapshotFile(const std::string& filename) {
+#ifndef _WIN32
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if ((fstat(fd, &st) == 0) && (st.st_size > 0)) {
+            void* ptr =
+                mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                m_data = (const uint8_t*)ptr;
+                m_size = st.st_size;
+                m_mapped = true;
+            }
+        }
+        close(fd);
+#else
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        if (!file.good())
+            return;
+        m_buffer.resize(file.tellg());
+        file.seekg(0);
+        file.read((char*)m_buffer.data(), m_buffer.size());
+        if (!file.good())
+            return;
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+#endif
+    }
+
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    ~SnapshotFile() {
+#ifndef _WIN32
+        if (m_mapped)
+            munmap((void*)m_data, m_size);
+#endif
+    }
+
+    bool good() { return m_data != NULL; }
+
+    const uint8_t* data() { return m_data; }
+
+    size_t size() { return m_size; }
+};
+
+/**
+ * @brief Binary snapshots of entity hierarchies.
+ *
+ * A snapshot holds entity names, the hierarchy, transforms, enabled flags
+ * and the parameters of registered components (see `SnapshotRegistry`) in
+ * flat arrays. Loading maps the file, checks the offsets once and then
+ * creates entities and components straight into the scene's pools without
+ * any parsing beyond what components do for their own parameters.
+ *
+ * Snapshots are meant as a cache of scenes or maps built by code or from
+ * JSON (see `Map::load`): the caller saves a hash of what it built the
+ * entities from, and only loads the snapshot while `matches` says that is
+ * still the same. They are only readable by builds with the same endianness
+ * and `SCENE_SNAPSHOT_VERSION`.
+ */
+class SceneSnapshot {
+  private:
+    static void write_entity(Entity* entity, uint32_t parent,
+                             std::vector<SnapshotEntity>& entities,
+                             std::vector<SnapshotComponent>& components,
+                             std::string& data, std::string& strings,
+                             std::vector<void*>& resources) {
+        SnapshotEntity out;
+        memset(&out, 0, sizeof(out));
+        out.parent = parent;
+        out.name_offset = strings.size();
+        out.name_size = entity->name().size();
+        strings += entity->name();
+        out.first_component = components.size();
+        out.enabled = entity->enabled();
+        Transform* transform = entity->get_component<Transform>();
+        vec3 position = transform->position();
+        vec3 rotation = transform->rotation();
+        vec3 scale = transform->scale();
+        memcpy(out.position, &position, sizeof(out.position));
+        memcpy(out.rotation, &rotation, sizeof(out.rotation));
+        memcpy(out.scale, &scale, sizeof(out.scale));
+        SnapshotWriter writer(data, resources);
+        for (auto i : entity->components()) {
+            auto entry = SnapshotRegistry::get().find(i);
+            if (!entry)
+                continue;
+            SnapshotComponent component;
+            component.type = entry->type;
+            component.data_offset = data.size();
+            entry->save(i, writer);
+            component.data_size = data.size() - component.data_offset;
+            components.push_back(component);
+        }
+        out.n_components = components.size() - out.first_component;
+        uint32_t idx = entities.size();
+        entities.push_back(out);
+        for (auto i : entity->children()) {
+            write_entity(i, idx, entities, components, data, strings,
+                         resources);
+        }
+    }
+
+    static bool in_bounds(size_t offset, size_t size, size_t total) {
+        return (offset <= total) && (size <= (total - offset));
+    }
+
+    /**
+     * @brief Check every offset in the snapshot before using any of them.
+     */
+    static bool validate(const uint8_t* file, size_t file_size) {
+        if (file_size < sizeof(SnapshotHeader))
+            return false;
+        SnapshotHeader header;
+        memcpy(&header, file, sizeof(header));
+        if ((header.magic != SCENE_SNAPSHOT_MAGIC) ||
+            (header.version != SCENE_SNAPSHOT_VERSION))
+            return false;
+        if ((header.entities_offset % alignof(SnapshotEntity)) ||
+            (header.components_offset % alignof(SnapshotComponent)))
+            return false;
+        if (!(in_bounds(header.entities_offset,
+                        (size_t)header.n_entities * sizeof(SnapshotEntity),
+                        file_size) &&
+              in_bounds(header.components_offset,
+                        (size_t)header.n_components *
+                            sizeof(SnapshotComponent),
+                        file_size) &&
+              in_bounds(header.data_offset, header.data_size, file_size) &&
+              in_bounds(header.strings_offset, header.strings_size,
+                        file_size)))
+            return false;
+        auto entities =
+            (const SnapshotEntity*)(file + header.entities_offset);
+        auto components =
+            (const SnapshotComponent*)(file + header.components_offset);
+        for (uint32_t i = 0; i < header.n_entities; i++) {
+            const SnapshotEntity& entity = entities[i];
+            if ((entity.parent != SCENE_SNAPSHOT_NO_PARENT) &&
+                (entity.parent >= i))
+                return false;
+            if (!in_bounds(entity.name_offset, entity.name_size,
+                           header.strings_size))
+                return false;
+            if (!in_bounds(entity.first_component, entity.n_components,
+                           header.n_components))
+                return false;
+        }
+        for (uint32_t i = 0; i < header.n_components; i++) {
+            if (!in_bounds(components[i].data_offset, components[i].data_size,
+                           header.data_size))
+                return false;
+        }
+        return true;
+    }
+
+  public:
+    /**
+     * @brief Whether `filename` is a valid snapshot made from `source`.
+     * Missing or stale files aren't errors, so nothing is logged.
+     */
+    static bool matches(const std::string& filename, uint32_t source) {
+        SnapshotFile file(filename);
+        if ((!file.good()) || (!validate(file.data(), file.size())))
+            return false;
+        SnapshotHeader header;
+        memcpy(&header, file.data(), sizeof(header));
+        return header.source == source;
+    }
+
+    /**
+     * @brief Write `roots` and everything under them to a snapshot.
+     *
+     * @param resources Filled with the resources components referred to, in
+     * the order `load` needs them back. Resources already in it keep their
+     * index, so callers that create them in a fixed order can pass them in
+     * up front.
+     * @param source Hash of what the entities were made from.
+     * @return bool false if the file couldn't be written.
+     */
+    static bool save(const std::string& filename,
+                     const std::vector<Entity*>& roots,
+                     std::vector<void*>& resources, uint32_t source = 0) {
+        std::vector<SnapshotEntity> entities;
+        std::vector<SnapshotComponent> components;
+        std::string data;
+        std::string strings;
+        for (auto i : roots) {
+            write_entity(i, SCENE_SNAPSHOT_NO_PARENT, entities, components,
+                         data, strings, resources);
+        }
+
+        SnapshotHeader header;
+        header.magic = SCENE_SNAPSHOT_MAGIC;
+        header.version = SCENE_SNAPSHOT_VERSION;
+        header.source = source;
+        header.n_entities = entities.size();
+        header.n_components = components.size();
+        header.entities_offset = sizeof(SnapshotHeader);
+        header.components_offset =
+            header.entities_offset + entities.size() * sizeof(SnapshotEntity);
+        header.data_offset = header.components_offset +
+                             components.size() * sizeof(SnapshotComponent);
+        header.data_size = data.size();
+        header.strings_offset = header.data_offset + header.data_size;
+        header.strings_size = strings.size();
+
+        std::ofstream file(filename, std::ios::binary);
+        if (!file.good())
+            return false;
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)entities.data(),
+                   entities.size() * sizeof(SnapshotEntity));
+        file.write((const char*)components.data(),
+                   components.size() * sizeof(SnapshotComponent));
+        file.write(data.data(), data.size());
+        file.write(strings.data(), strings.size());
+        TraceLog(LOG_INFO, "saved %u entities to snapshot %s",
+                 header.n_entities, filename.c_str());
+        return file.good();
+    }
+
+    /**
+     * @brief Write every entity in `scene` to a snapshot.
+     */
+    static bool save(const std::string& filename, Scene* scene,
+                     std::vector<void*>& resources, uint32_t source = 0) {
+        return save(filename, scene->entities(), resources, source);
+    }
+
+    /**
+     * @brief Create the entities in a snapshot.
+     *
+     * Components are created but not initialized, like entities created by
+     * code in a scene's constructor.
+     *
+     * @param resources The table `save` filled in, with the same resources
+     * (or equivalent ones for this scene).
+     * @param parent Entity to add the snapshot's roots to, or NULL to add
+     * them to the scene.
+     * @return std::vector<Entity*> The root entities created, empty if the
+     * file is missing or invalid.
+     */
+    static std::vector<Entity*> load(const std::string& filename, Scene* scene,
+                                     const std::vector<void*>& resources,
+                                     Entity* parent = NULL) {
+        std::vector<Entity*> roots;
+        SnapshotFile file(filename);
+        if (!file.good()) {
+            TraceLog(LOG_ERROR, "couldn't open snapshot %s", filename.c_str());
+            return roots;
+        }
+        if (!validate(file.data(), file.size())) {
+            TraceLog(LOG_ERROR, "snapshot %s is invalid", filename.c_str());
+            return roots;
+        }
+        const uint8_t* base = file.data();
+        SnapshotHeader header;
+        memcpy(&header, base, sizeof(header));
+        auto entities = (const SnapshotEntity*)(base + header.entities_offset);
+        auto components =
+            (const SnapshotComponent*)(base + header.components_offset);
+        const uint8_t* data = base + header.data_offset;
+        const char* strings = (const char*)(base + header.strings_offset);
+
+        std::vector<Entity*> created(header.n_entities);
+        for (uint32_t i = 0; i < header.n_entities; i++) {
+            const SnapshotEntity& in = entities[i];
+            std::string name(strings + in.name_offset, in.name_size);
+            Entity* entity;
+            if (in.parent != SCENE_SNAPSHOT_NO_PARENT) {
+                entity = created[in.parent]->create_child(name);
+            } else {
+                entity = parent ? parent->create_child(name)
+                                : scene->create_entity(name);
+                roots.push_back(entity);
+            }
+            created[i] = entity;
+            Transform* transform = entity->get_component<Transform>();
+            transform->position(
+                vec3(in.position[0], in.position[1], in.position[2]));
+            transform->rotation(
+                vec3(in.rotation[0], in.rotation[1], in.rotation[2]));
+            transform->scale(vec3(in.scale[0], in.scale[1], in.scale[2]));
+            for (uint32_t j = 0; j < in.n_components; j++) {
+                const SnapshotComponent& component =
+                    components[in.first_component + j];
+                auto entry = SnapshotRegistry::get().find(component.type);
+                if (!entry) {
+                    TraceLog(LOG_WARNING,
+                             "snapshot %s: unknown component type %08x",
+                             filename.c_str(), component.type);
+                    continue;
+                }
+                SnapshotReader reader(data + component.data_offset,
+                                      component.data_size, resources);
+                entry->load(entity, reader);
+                if (!reader.ok())
+                    TraceLog(LOG_WARNING,
+                             "snapshot %s: bad parameters for component "
+                             "type %08x",
+                             filename.c_str(), component.type);
+            }
+            if (!in.enabled)
+                entity->disable();
+        }
+        TraceLog(LOG_INFO, "loaded %u entities from snapshot %s",
+                 header.n_entities, filename.c_str());
+        return roots;
+    }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_SCENE_SNAPSHOT_HPP_
@@ -35,6 +35,8 @@ uniform int shadowMapRes;
 out vec4 finalColor;
 
 #define MAX_LIGHTS 2
+// one shadow map per cascade, nearest first (SPRF_SHADOW_CASCADES)
+#define CASCADES 3
 
 struct Light {
     int enabled;
@@ -46,10 +48,10 @@ struct Light {
     vec3 L;
     float p;
     float intensity;
-    sampler2D shadowMap;
+    sampler2D shadowMap[CASCADES];
 };
 
-uniform mat4 light_vp[MAX_LIGHTS];
+uniform mat4 light_vp[MAX_LIGHTS*CASCADES];
 uniform Light lights[MAX_LIGHTS];
 
 vec3 diffuse(vec3 cM, vec3 cL, vec3 N, vec3 L){
@@ -60,7 +62,50 @@ vec3 specular(vec3 cL, vec3 N, vec3 H, float p){
     return cL*pow(max(0,dot(N,H)),p);
 }
 
-vec3 calculate_light(Light light, mat4 vp, vec3 cM, vec3 N, vec3 V){
+vec3 shadow_coords(mat4 vp){
+    vec4 fragPosLightSpace = vp * vec4(fragPosition, 1);
+    fragPosLightSpace.xyz /= fragPosLightSpace.w; // Perform the perspective division
+    return (fragPosLightSpace.xyz + 1.0f) / 2.0f; // Transform from [-1, 1] range to [0, 1] range
+}
+
+// whether the cascade covers coords, with room for the PCF kernel
+bool in_cascade(vec3 coords){
+    float margin = 3.0f / float(shadowMapRes);
+    return all(greaterThan(coords.xy, vec2(margin))) &&
+           all(lessThan(coords.xy, vec2(1.0f - margin))) &&
+           coords.z < 1.0f;
+}
+
+float shadow_amount(sampler2D shadowMap, vec3 coords, float bias){
+    vec2 sampleCoords = coords.xy;
+    float curDepth = coords.z;
+
+    int shadowCounter = 0;
+    int sample_factor = 2;
+    int numSamples = (sample_factor*2+1);//*(sample_factor*2+1);
+    numSamples = numSamples*numSamples;
+
+    // PCF (percentage-closer filtering) algorithm:
+    // Instead of testing if just one point is closer to the current point,
+    // we test the surrounding points as well.
+    // This blurs shadow edges, hiding aliasing artifacts.
+    vec2 texelSize = vec2(1.0f / float(shadowMapRes));
+    for (int x = -sample_factor; x <= sample_factor; x++)
+    {
+        for (int y = -sample_factor; y <= sample_factor; y++)
+        {
+            float sampleDepth = texture(shadowMap, sampleCoords + texelSize * vec2(x, y)).r;
+            if (curDepth - bias > sampleDepth)
+            {
+                shadowCounter++;
+            }
+        }
+    }
+
+    return float(shadowCounter)/float(numSamples);
+}
+
+vec3 calculate_light(Light light, int index, vec3 cM, vec3 N, vec3 V){
     vec3 H = normalize(V + light.L);
     vec3 cL = light.cL;
     vec3 L = light.L;
@@ -68,26 +113,29 @@ vec3 calculate_light(Light light, mat4 vp, vec3 cM, vec3 N, vec3 V){
     float ks = light.ks;
     float p = light.p;
     vec3 temp = kd * diffuse(cM,cL,N,L) + ks * specular(cL,N,H,p);
-    vec4 fragPosLightSpace = vp * vec4(fragPosition, 1);
-    fragPosLightSpace.xyz /= fragPosLightSpace.w;
-    fragPosLightSpace.xyz = (fragPosLightSpace.xyz + 1.0f) / 2.0f;
-    vec2 sampleCoords = fragPosLightSpace.xy;
-    float curDepth = fragPosLightSpace.z;
+
     float bias = max(0.0002 * (1.0 - dot(N, L)), 0.00002) + 0.00001;
-    int shadowCounter = 0;int sample_factor = 2;
-    int numSamples = (sample_factor*2+1);
-    numSamples = numSamples*numSamples;
-    vec2 texelSize = vec2(1.0f / float(shadowMapRes));
-    for (int x = -sample_factor; x <= sample_factor; x++){
-        for (int y = -sample_factor; y <= sample_factor; y++){
-            float sampleDepth = texture(light.shadowMap, sampleCoords + texelSize * vec2(x, y)).r;
-            if (curDepth - bias > sampleDepth){
-                shadowCounter++;
+
+    // use the nearest cascade that covers us (samplers can only be indexed
+    // with constants, hence one branch per cascade)
+    float shadow = 0.0f;
+    vec3 coords = shadow_coords(light_vp[index*CASCADES]);
+    if (in_cascade(coords)){
+        shadow = shadow_amount(light.shadowMap[0], coords, bias);
+    } else {
+        coords = shadow_coords(light_vp[index*CASCADES+1]);
+        if (in_cascade(coords)){
+            shadow = shadow_amount(light.shadowMap[1], coords, bias);
+        } else {
+            coords = shadow_coords(light_vp[index*CASCADES+2]);
+            if (in_cascade(coords)){
+                shadow = shadow_amount(light.shadowMap[2], coords, bias);
             }
         }
     }
-    float shadow = float(shadowCounter)/float(numSamples);
+
     temp = mix(vec4(temp,1), vec4(0, 0, 0, 1), shadow).xyz;
+
     return temp;
 }
 
@@ -98,7 +146,7 @@ void main(){
     vec3 out_col = cM * ka;
     for (int i = 0; i < MAX_LIGHTS; i++){
         if (lights[i].enabled == 1){
-            out_col += calculate_light(lights[i],light_vp[i],cM,N,V);
+            out_col += calculate_light(lights[i],i,cM,N,V);
         }
     }
     finalColor = vec4(out_col.x,out_col.y,out_col.z,base_color.w);
@@ -152,23 +200,52 @@ in vec2 vertexTexCoord;
 in vec3 vertexNormal;
 in vec4 vertexColor;
 in mat4 instanceTransform;
+layout(location = 14) in vec4 vertexBoneIds;
+layout(location = 15) in vec4 vertexBoneWeights;
 
 uniform mat4 mvp;
 uniform mat4 matNormal;
+uniform sampler2D boneMatrices;
 
 out vec3 fragPosition;
 out vec2 fragTexCoord;
 out vec4 fragColor;
 out vec3 fragNormal;
 
+mat4 bone_matrix(int index){
+    int texel = index * 4;
+    int width = textureSize(boneMatrices, 0).x;
+    ivec2 at = ivec2(texel % width, texel / width);
+    return mat4(texelFetch(boneMatrices, at, 0),
+                texelFetch(boneMatrices, at + ivec2(1, 0), 0),
+                texelFetch(boneMatrices, at + ivec2(2, 0), 0),
+                texelFetch(boneMatrices, at + ivec2(3, 0), 0));
+}
+
 void main(){
-    fragPosition = vec3(instanceTransform*vec4(vertexPosition, 1.0));
+    mat4 model = instanceTransform;
+    // first bone matrix of the instance's palette + 1, 0 if it isn't
+    // skinned (see RenderModel::upload_palettes)
+    int palette = int(model[0][3] + 0.5) - 1;
+    model[0][3] = 0.0;
+    vec4 position = vec4(vertexPosition, 1.0);
+    vec3 normal = vertexNormal;
+    if (palette >= 0){
+        mat4 skin = mat4(0.0);
+        for (int i = 0; i < 4; i++){
+            skin += vertexBoneWeights[i] *
+                    bone_matrix(palette + int(vertexBoneIds[i]));
+        }
+        position = skin * position;
+        normal = mat3(skin) * normal;
+    }
+    fragPosition = vec3(model*position);
     fragTexCoord = vertexTexCoord;
     fragColor = vertexColor;
-    mat4 rot = instanceTransform;
+    mat4 rot = model;
     rot[3] = vec4(0,0,0,1);
-    fragNormal = normalize(vec3(rot*matNormal*vec4(vertexNormal, 1.0)));
-    gl_Position = mvp*instanceTransform*vec4(vertexPosition, 1.0);
+    fragNormal = normalize(vec3(rot*matNormal*vec4(normal, 1.0)));
+    gl_Position = mvp*model*position;
 }
 
 )";
\ No newline at end of file
@@ -2,10 +2,20 @@
 #define _SPRF_SHADERS_HPP_
 
 #define MAX_LIGHTS 2
+/** @brief Shadow cascades per light (`CASCADES` in lights.fs) */
+#define SPRF_SHADOW_CASCADES 3
+/** @brief Depth covered by each cascade's orthographic projection, centered
+ * on the cascade. Matches the old single shadow map so the shader's depth
+ * bias keeps its scale */
+#define SPRF_SHADOW_DEPTH_RANGE 1000.0f
+/** @brief Blend between uniform (0) and logarithmic (1) cascade splits */
+#define SPRF_SHADOW_SPLIT_LAMBDA 0.5f
 
 #include "base.hpp"
 //#include "raylib-cpp.hpp"
 #include "shadow_map_texture.hpp"
+#include <cmath>
+#include <cstring>
 #include <string>
 
 namespace SPRF {
@@ -285,11 +295,6 @@ class Light : public Logger {
     ShaderUniform<vec3> m_pos;
     /** @brief Uniform variable for light direction */
     ShaderUniform<vec3> m_L;
-    /** @brief View matrix for light */
-    mat4x4 m_light_view;
-    /** @brief Projection matrix for light */
-    mat4x4 m_light_proj;
-
     /** @brief Scale of the light */
     float m_scale;
     /** @brief Field of view for the light */
@@ -297,15 +302,34 @@ class Light : public Logger {
 
     vec3 m_target = vec3(0, 0, 0);
 
-    /** @brief Location of the shadow map in the shader */
-    int m_shadow_mapLoc;
-    /** @brief Location of the light view-projection matrix in the shader */
-    int m_light_vpLoc;
-
-    /** @brief Shadow map texture */
-    RenderTexture2D m_shadow_map;
-    /** @brief Light view-projection matrix */
-    // mat4x4 m_light_vp;
+    /**
+     * @brief One shadow map, covering a slice of the camera's view.
+     */
+    struct Cascade {
+        RenderTexture2D shadow_map;
+        /** @brief Location of the shadow map in the shader */
+        int shadow_map_loc;
+        /** @brief Location of the light view-projection in the shader */
+        int light_vp_loc;
+        /** @brief Light view-projection fitted to the camera this frame */
+        mat4x4 fitted_vp;
+        /** @brief Light view-projection `shadow_map` was rendered with */
+        mat4x4 light_vp;
+        bool valid = false;
+        /** @brief Caster version (see `Renderer`) `shadow_map` has */
+        uint32_t casters_version = 0;
+        /** @brief Shadow frame `shadow_map` was rendered in */
+        uint32_t frame = 0;
+        /** @brief Re-render at most every `interval` shadow frames */
+        int interval = 1;
+    };
+
+    /** @brief Cascades, nearest first */
+    Cascade m_cascades[SPRF_SHADOW_CASCADES];
+    /** @brief Resolution of each cascade's shadow map */
+    int m_shadow_map_res;
+    /** @brief How far from the camera shadows reach */
+    float m_shadow_distance = 60.0f;
 
   public:
     /**
@@ -333,12 +357,20 @@ class Light : public Logger {
                 m_shader),
           m_L("lights[" + std::to_string(m_id) + "].L",
               vec3(1, 1, 1).Normalize(), m_shader),
-          m_scale(scale), m_fov(fov),
-          m_shadow_mapLoc(shader.GetLocation("lights[" + std::to_string(m_id) +
-                                             "].shadowMap")),
-          m_light_vpLoc(
-              shader.GetLocation("light_vp[" + std::to_string(m_id) + "]")),
-          m_shadow_map(LoadShadowmapRenderTexture(shadowMapRes, shadowMapRes)) {
+          m_scale(scale), m_fov(fov), m_shadow_map_res(shadowMapRes) {
+        for (int i = 0; i < SPRF_SHADOW_CASCADES; i++) {
+            Cascade& cascade = m_cascades[i];
+            cascade.shadow_map =
+                LoadShadowmapRenderTexture(shadowMapRes, shadowMapRes);
+            cascade.shadow_map_loc = shader.GetLocation(
+                "lights[" + std::to_string(m_id) + "].shadowMap[" +
+                std::to_string(i) + "]");
+            cascade.light_vp_loc = shader.GetLocation(
+                "light_vp[" +
+                std::to_string(m_id * SPRF_SHADOW_CASCADES + i) + "]");
+            // far cascades cover more and change less
+            cascade.interval = 1 << i;
+        }
         light_count++;
         assert(id() < MAX_LIGHTS);
     }
@@ -507,7 +539,11 @@ class Light : public Logger {
     /**
      * @brief Destroy the Light object.
      */
-    ~Light() { UnloadShadowmapRenderTexture(m_shadow_map); }
+    ~Light() {
+        for (auto& i : m_cascades) {
+            UnloadShadowmapRenderTexture(i.shadow_map);
+        }
+    }
 
     vec3 target() const { return m_target; }
 
@@ -519,6 +555,9 @@ class Light : public Logger {
     /**
      * @brief Get the camera representation of the light.
      *
+     * Shadows don't use this any more, they follow the camera (see
+     * `fit_cascades`).
+     *
      * @return Camera representation of the light.
      */
     raylib::Camera3D light_cam(raylib::Camera* camera) const {
@@ -533,32 +572,183 @@ class Light : public Logger {
     }
 
     /**
-     * @brief Begin shadow map rendering mode.
+     * @brief How far from the camera shadows reach.
+     */
+    float shadow_distance() const { return m_shadow_distance; }
+
+    float shadow_distance(float distance) {
+        m_shadow_distance = distance;
+        return m_shadow_distance;
+    }
+
+    /**
+     * @brief Re-render cascade `i` at most every `interval` frames (by default
+     * 1, 2 and 4 frames from near to far).
+     */
+    int cascade_interval(int i, int interval) {
+        assert((i >= 0) && (i < SPRF_SHADOW_CASCADES) && (interval > 0));
+        m_cascades[i].interval = interval;
+        return interval;
+    }
+
+    int cascade_interval(int i) const { return m_cascades[i].interval; }
+
+    /**
+     * @brief Far end of each cascade's slice of the view, a blend of
+     * logarithmic and uniform splits up to `shadow_distance()`.
+     */
+    void cascade_splits(float near, float splits[SPRF_SHADOW_CASCADES]) const {
+        float far = m_shadow_distance;
+        for (int i = 0; i < SPRF_SHADOW_CASCADES; i++) {
+            float t = (i + 1) / (float)SPRF_SHADOW_CASCADES;
+            float log_split = near * powf(far / near, t);
+            float uniform_split = near + (far - near) * t;
+            splits[i] = SPRF_SHADOW_SPLIT_LAMBDA * log_split +
+                        (1.0f - SPRF_SHADOW_SPLIT_LAMBDA) * uniform_split;
+        }
+    }
+
+    /**
+     * @brief Fit every cascade to its slice of the camera's view.
+     *
+     * Each slice is wrapped in a sphere, so a cascade's size doesn't change
+     * as the camera turns, and its center is snapped to whole shadow map
+     * texels in light space, so it doesn't shimmer as the camera moves.
+     *
+     * @param camera Perspective camera being rendered.
+     * @param aspect Aspect ratio of the camera's view.
+     */
+    void fit_cascades(raylib::Camera* camera, float aspect) {
+        vec3 position = camera->position;
+        vec3 forward = (vec3(camera->target) - position).Normalize();
+        vec3 right = forward.CrossProduct(camera->up).Normalize();
+        vec3 up = right.CrossProduct(forward);
+        float tan_y = tanf(camera->fovy * 0.5f * DEG2RAD);
+        float tan_x = tan_y * aspect;
+
+        vec3 light_up = vec3(0, 1, 0);
+        if (fabsf(L().DotProduct(light_up)) > 0.99f)
+            light_up = vec3(0, 0, 1);
+        // light space rotation, for snapping
+        mat4x4 light_rotation = MatrixLookAt(vec3(0, 0, 0), -L(), light_up);
+        mat4x4 light_rotation_inv = MatrixInvert(light_rotation);
+
+        float near = rlGetCullDistanceNear();
+        float splits[SPRF_SHADOW_CASCADES];
+        cascade_splits(near, splits);
+        for (int i = 0; i < SPRF_SHADOW_CASCADES; i++) {
+            float slice_near = (i == 0) ? near : splits[i - 1];
+            float slice_far = splits[i];
+            vec3 corners[8];
+            vec3 center = vec3(0, 0, 0);
+            for (int j = 0; j < 8; j++) {
+                float depth = (j & 4) ? slice_far : slice_near;
+                float x = ((j & 1) ? 1.0f : -1.0f) * tan_x * depth;
+                float y = ((j & 2) ? 1.0f : -1.0f) * tan_y * depth;
+                corners[j] = position + forward * depth + right * x + up * y;
+                center = center + corners[j] * 0.125f;
+            }
+            float radius = 0;
+            for (int j = 0; j < 8; j++) {
+                radius = fmaxf(radius, (corners[j] - center).Length());
+            }
+            // quantize so the size (and texel size) doesn't creep
+            radius = ceilf(radius * 16.0f) / 16.0f;
+
+            float texel = (2.0f * radius) / m_shadow_map_res;
+            vec3 light_center = Vector3Transform(center, light_rotation);
+            light_center.x = floorf(light_center.x / texel) * texel;
+            light_center.y = floorf(light_center.y / texel) * texel;
+            center = Vector3Transform(light_center, light_rotation_inv);
+
+            float half_depth = SPRF_SHADOW_DEPTH_RANGE * 0.5f;
+            mat4x4 view =
+                MatrixLookAt(center + L() * half_depth, center, light_up);
+            mat4x4 proj = MatrixOrtho(-radius, radius, -radius, radius, 0,
+                                      SPRF_SHADOW_DEPTH_RANGE);
+            m_cascades[i].fitted_vp = view * proj;
+        }
+    }
+
+    /**
+     * @brief Light view-projection of cascade `i` from the last
+     * `fit_cascades`.
+     */
+    mat4x4 cascade_view_proj(int i) const { return m_cascades[i].fitted_vp; }
+
+    /**
+     * @brief Whether cascade `i` should be rendered this shadow frame.
+     *
+     * It is if it was never rendered, or its interval is up and either the
+     * cascade moved or the casters changed since it was rendered.
+     *
+     * @param frame Counter bumped every shadow pass.
+     * @param casters_version Counter bumped whenever any caster changed.
+     */
+    bool cascade_due(int i, uint32_t frame, uint32_t casters_version) const {
+        const Cascade& cascade = m_cascades[i];
+        if (!cascade.valid)
+            return true;
+        if ((frame - cascade.frame) < (uint32_t)cascade.interval)
+            return false;
+        return (cascade.casters_version != casters_version) ||
+               (memcmp(&cascade.fitted_vp, &cascade.light_vp,
+                       sizeof(mat4x4)) != 0);
+    }
+
+    /**
+     * @brief Begin rendering cascade `i` with its fitted view-projection.
      */
-    void BeginShadowMode(raylib::Camera* camera) {
-        BeginTextureMode(m_shadow_map);
+    void BeginShadowMode(int i) {
+        Cascade& cascade = m_cascades[i];
+        BeginTextureMode(cascade.shadow_map);
         ClearBackground(WHITE);
-        BeginMode3D(light_cam(camera));
-        m_light_view = rlGetMatrixModelview();
-        m_light_proj = rlGetMatrixProjection();
+        // BeginMode3D, with the whole view-projection as the view and an
+        // identity projection (draws only ever use their product)
+        rlDrawRenderBatchActive();
+        rlMatrixMode(RL_PROJECTION);
+        rlPushMatrix();
+        rlLoadIdentity();
+        rlMatrixMode(RL_MODELVIEW);
+        rlLoadIdentity();
+        rlMultMatrixf(MatrixToFloat(cascade.fitted_vp));
+        rlEnableDepthTest();
     }
 
     /**
-     * @brief End shadow map rendering mode and update the shader with the
-     * shadow map texture.
+     * @brief End rendering cascade `i`.
      *
-     * @param slot_start Starting texture slot for the shadow map.
+     * @param frame Counter bumped every shadow pass.
+     * @param casters_version Counter bumped whenever any caster changed.
      */
-    void EndShadowMode(int slot_start) {
+    void EndShadowMode(int i, uint32_t frame, uint32_t casters_version) {
         EndMode3D();
         EndTextureMode();
-        mat4x4 light_view_proj = m_light_view * m_light_proj;
-        SetShaderValueMatrix(m_shader, m_light_vpLoc, light_view_proj);
+        Cascade& cascade = m_cascades[i];
+        cascade.light_vp = cascade.fitted_vp;
+        cascade.valid = true;
+        cascade.frame = frame;
+        cascade.casters_version = casters_version;
+    }
+
+    /**
+     * @brief Point the shader at the shadow maps as they were last rendered.
+     *
+     * @param slot_start Starting texture slot for the shadow maps.
+     */
+    void bind_shadow_maps(int slot_start) {
         rlEnableShader(m_shader.id);
-        int slot = slot_start + id();
-        rlActiveTextureSlot(slot);
-        rlEnableTexture(m_shadow_map.depth.id);
-        rlSetUniform(m_shadow_mapLoc, &slot, SHADER_UNIFORM_INT, 1);
+        for (int i = 0; i < SPRF_SHADOW_CASCADES; i++) {
+            Cascade& cascade = m_cascades[i];
+            SetShaderValueMatrix(m_shader, cascade.light_vp_loc,
+                                 cascade.light_vp);
+            rlEnableShader(m_shader.id);
+            int slot = slot_start + id() * SPRF_SHADOW_CASCADES + i;
+            rlActiveTextureSlot(slot);
+            rlEnableTexture(cascade.shadow_map.depth.id);
+            rlSetUniform(cascade.shadow_map_loc, &slot, SHADER_UNIFORM_INT,
+                         1);
+        }
     }
 };
 
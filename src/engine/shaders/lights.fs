@@ -19,6 +19,8 @@ uniform int shadowMapRes;
 out vec4 finalColor;
 
 #define MAX_LIGHTS 2
+// one shadow map per cascade, nearest first (SPRF_SHADOW_CASCADES)
+#define CASCADES 3
 
 struct Light {
     int enabled;
@@ -30,10 +32,10 @@ struct Light {
     vec3 L;
     float p;
     float intensity;
-    sampler2D shadowMap;
+    sampler2D shadowMap[CASCADES];
 };
 
-uniform mat4 light_vp[MAX_LIGHTS];
+uniform mat4 light_vp[MAX_LIGHTS*CASCADES];
 
 uniform Light lights[MAX_LIGHTS];
 
@@ -45,22 +47,23 @@ vec3 specular(vec3 cL, vec3 N, vec3 H, float p){
     return cL*pow(max(0,dot(N,H)),p);
 }
 
-vec3 calculate_light(Light light, mat4 vp, vec3 cM, vec3 N, vec3 V){
-    vec3 H = normalize(V + light.L);
-    vec3 cL = light.cL;
-    vec3 L = light.L;
-    float kd = light.kd;
-    float ks = light.ks;
-    float p = light.p;
-    vec3 temp = kd * diffuse(cM,cL,N,L) + ks * specular(cL,N,H,p);
-
+vec3 shadow_coords(mat4 vp){
     vec4 fragPosLightSpace = vp * vec4(fragPosition, 1);
     fragPosLightSpace.xyz /= fragPosLightSpace.w; // Perform the perspective division
-    fragPosLightSpace.xyz = (fragPosLightSpace.xyz + 1.0f) / 2.0f; // Transform from [-1, 1] range to [0, 1] range
-    vec2 sampleCoords = fragPosLightSpace.xy;
-    float curDepth = fragPosLightSpace.z;
+    return (fragPosLightSpace.xyz + 1.0f) / 2.0f; // Transform from [-1, 1] range to [0, 1] range
+}
 
-    float bias = max(0.0002 * (1.0 - dot(N, L)), 0.00002) + 0.00001;
+// whether the cascade covers coords, with room for the PCF kernel
+bool in_cascade(vec3 coords){
+    float margin = 3.0f / float(shadowMapRes);
+    return all(greaterThan(coords.xy, vec2(margin))) &&
+           all(lessThan(coords.xy, vec2(1.0f - margin))) &&
+           coords.z < 1.0f;
+}
+
+float shadow_amount(sampler2D shadowMap, vec3 coords, float bias){
+    vec2 sampleCoords = coords.xy;
+    float curDepth = coords.z;
 
     int shadowCounter = 0;
     int sample_factor = 2;
@@ -76,7 +79,7 @@ vec3 calculate_light(Light light, mat4 vp, vec3 cM, vec3 N, vec3 V){
     {
         for (int y = -sample_factor; y <= sample_factor; y++)
         {
-            float sampleDepth = texture(light.shadowMap, sampleCoords + texelSize * vec2(x, y)).r;
+            float sampleDepth = texture(shadowMap, sampleCoords + texelSize * vec2(x, y)).r;
             if (curDepth - bias > sampleDepth)
             {
                 shadowCounter++;
@@ -84,7 +87,37 @@ vec3 calculate_light(Light light, mat4 vp, vec3 cM, vec3 N, vec3 V){
         }
     }
 
-    float shadow = float(shadowCounter)/float(numSamples);
+    return float(shadowCounter)/float(numSamples);
+}
+
+vec3 calculate_light(Light light, int index, vec3 cM, vec3 N, vec3 V){
+    vec3 H = normalize(V + light.L);
+    vec3 cL = light.cL;
+    vec3 L = light.L;
+    float kd = light.kd;
+    float ks = light.ks;
+    float p = light.p;
+    vec3 temp = kd * diffuse(cM,cL,N,L) + ks * specular(cL,N,H,p);
+
+    float bias = max(0.0002 * (1.0 - dot(N, L)), 0.00002) + 0.00001;
+
+    // use the nearest cascade that covers us (samplers can only be indexed
+    // with constants, hence one branch per cascade)
+    float shadow = 0.0f;
+    vec3 coords = shadow_coords(light_vp[index*CASCADES]);
+    if (in_cascade(coords)){
+        shadow = shadow_amount(light.shadowMap[0], coords, bias);
+    } else {
+        coords = shadow_coords(light_vp[index*CASCADES+1]);
+        if (in_cascade(coords)){
+            shadow = shadow_amount(light.shadowMap[1], coords, bias);
+        } else {
+            coords = shadow_coords(light_vp[index*CASCADES+2]);
+            if (in_cascade(coords)){
+                shadow = shadow_amount(light.shadowMap[2], coords, bias);
+            }
+        }
+    }
 
     temp = mix(vec4(temp,1), vec4(0, 0, 0, 1), shadow).xyz;
 
@@ -102,7 +135,7 @@ void main()
 
     for (int i = 0; i < MAX_LIGHTS; i++){
         if (lights[i].enabled == 1){
-            out_col += calculate_light(lights[i],light_vp[i],cM,N,V);
+            out_col += calculate_light(lights[i],i,cM,N,V);
         }
     }
 
@@ -11,11 +11,16 @@ in vec3 vertexNormal;
 in vec4 vertexColor;
 
 in mat4 instanceTransform;
+// skinning, bound by upload_bone_attributes
+layout(location = 14) in vec4 vertexBoneIds;
+layout(location = 15) in vec4 vertexBoneWeights;
 
 // Input uniform values
 uniform mat4 mvp;
 //uniform mat4 matModel;
 uniform mat4 matNormal;
+// palettes of bone matrices, 4 texels each (see BoneTexture)
+uniform sampler2D boneMatrices;
 
 // Output vertex attributes (to fragment shader)
 out vec3 fragPosition;
@@ -25,16 +30,44 @@ out vec3 fragNormal;
 
 // NOTE: Add here your custom variables
 
+mat4 bone_matrix(int index)
+{
+    int texel = index * 4;
+    int width = textureSize(boneMatrices, 0).x;
+    ivec2 at = ivec2(texel % width, texel / width);
+    return mat4(texelFetch(boneMatrices, at, 0),
+                texelFetch(boneMatrices, at + ivec2(1, 0), 0),
+                texelFetch(boneMatrices, at + ivec2(2, 0), 0),
+                texelFetch(boneMatrices, at + ivec2(3, 0), 0));
+}
+
 void main()
 {
+    mat4 model = instanceTransform;
+    // first bone matrix of the instance's palette + 1, 0 if it isn't
+    // skinned (see RenderModel::upload_palettes)
+    int palette = int(model[0][3] + 0.5) - 1;
+    model[0][3] = 0.0;
+    vec4 position = vec4(vertexPosition, 1.0);
+    vec3 normal = vertexNormal;
+    if (palette >= 0)
+    {
+        mat4 skin = mat4(0.0);
+        for (int i = 0; i < 4; i++)
+        {
+            skin += vertexBoneWeights[i]*bone_matrix(palette + int(vertexBoneIds[i]));
+        }
+        position = skin*position;
+        normal = mat3(skin)*normal;
+    }
     // Send vertex attributes to fragment shader
-    fragPosition = vec3(instanceTransform*vec4(vertexPosition, 1.0));
+    fragPosition = vec3(model*position);
     fragTexCoord = vertexTexCoord;
     fragColor = vertexColor;
-    mat4 rot = instanceTransform; rot[3] = vec4(0,0,0,1); ;//rot[0][3] = 0; rot[1][3] = 0; rot[2][3] = 0; rot[3][3] = 1;
-    fragNormal = normalize(vec3(rot*matNormal*vec4(vertexNormal, 1.0)));
+    mat4 rot = model; rot[3] = vec4(0,0,0,1); ;//rot[0][3] = 0; rot[1][3] = 0; rot[2][3] = 0; rot[3][3] = 1;
+    fragNormal = normalize(vec3(rot*matNormal*vec4(normal, 1.0)));
     // Calculate final vertex position, note that we multiply mvp by instanceTransform
-    gl_Position = mvp*instanceTransform*vec4(vertexPosition, 1.0);
+    gl_Position = mvp*model*position;
     // Send vertex attributes to fragment shader
     //fragPosition = vec3(matModel*vec4(vertexPosition, 1.0));
     //fragTexCoord = vertexTexCoord;
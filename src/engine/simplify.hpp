@@ -0,0 +1,454 @@
+#ifndef _SPRF_SIMPLIFY_HPP_
+#define _SPRF_SIMPLIFY_HPP_
+
+#include "raylib.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** @brief Smallest cosine of the angle a triangle's normal may turn by in a
+ * single collapse of `simplify_mesh`, any further and the collapse counts as
+ * a flip */
+#define SPRF_SIMPLIFY_MIN_NORMAL_DOT 0.25f
+
+namespace SPRF {
+
+/**
+ * @brief Garland-Heckbert error quadric: the (area weighted) sum of squared
+ * distances to a set of planes.
+ */
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0;
+    double b2 = 0, bc = 0, bd = 0;
+    double c2 = 0, cd = 0;
+    double d2 = 0;
+    /** @brief Total weight of the planes */
+    double w = 0;
+
+    Quadric() {}
+
+    /**
+     * @brief Quadric of the plane `a*x + b*y + c*z + d = 0` (with a unit
+     * normal), weighted by `weight`.
+     */
+    Quadric(double a, double b, double c, double d, double weight)
+        : a2(a * a * weight), ab(a * b * weight), ac(a * c * weight),
+          ad(a * d * weight), b2(b * b * weight), bc(b * c * weight),
+          bd(b * d * weight), c2(c * c * weight), cd(c * d * weight),
+          d2(d * d * weight), w(weight) {}
+
+    Quadric& operator+=(const Quadric& o) {
+        a2 += o.a2;
+        ab += o.ab;
+        ac += o.ac;
+        ad += o.ad;
+        b2 += o.b2;
+        bc += o.bc;
+        bd += o.bd;
+        c2 += o.c2;
+        cd += o.cd;
+        d2 += o.d2;
+        w += o.w;
+        return *this;
+    }
+
+    /**
+     * @brief Weighted sum of squared distances from `p` to the planes.
+     */
+    double eval(const float* p) const {
+        double x = p[0], y = p[1], z = p[2];
+        return a2 * x * x + b2 * y * y + c2 * z * z +
+               2 * (ab * x * y + ac * x * z + bc * y * z) +
+               2 * (ad * x + bd * y + cd * z) + d2;
+    }
+};
+
+namespace detail {
+
+/**
+ * @brief Every attribute of vertex `v` as bytes, so identical vertices can
+ * be found with a hash map.
+ */
+inline std::string simplify_vertex_key(const ::Mesh& mesh, int v) {
+    std::string key((const char*)(mesh.vertices + v * 3), sizeof(float) * 3);
+    if (mesh.texcoords)
+        key.append((const char*)(mesh.texcoords + v * 2), sizeof(float) * 2);
+    if (mesh.texcoords2)
+        key.append((const char*)(mesh.texcoords2 + v * 2), sizeof(float) * 2);
+    if (mesh.normals)
+        key.append((const char*)(mesh.normals + v * 3), sizeof(float) * 3);
+    if (mesh.tangents)
+        key.append((const char*)(mesh.tangents + v * 4), sizeof(float) * 4);
+    if (mesh.colors)
+        key.append((const char*)(mesh.colors + v * 4), 4);
+    if (mesh.boneIds)
+        key.append((const char*)(mesh.boneIds + v * 4), 4);
+    if (mesh.boneWeights)
+        key.append((const char*)(mesh.boneWeights + v * 4), sizeof(float) * 4);
+    return key;
+}
+
+inline void simplify_normal(const float* a, const float* b, const float* c,
+                            double* out) {
+    double e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    double e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    out[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    out[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    out[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+template <typename T>
+inline T* simplify_copy(const T* in, const std::vector<uint32_t>& vertices,
+                        int components) {
+    if (!in)
+        return NULL;
+    T* out = (T*)MemAlloc(sizeof(T) * components * vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        memcpy(out + i * components, in + vertices[i] * components,
+               sizeof(T) * components);
+    }
+    return out;
+}
+
+} // namespace detail
+
+/**
+ * @brief Simplify a mesh by collapsing edges, cheapest first by quadric
+ * error, until it has `ratio` of its triangles or every collapse left would
+ * move the surface further than `max_error`.
+ *
+ * Collapses are half-edge collapses (one end of the edge moves onto the
+ * other), so every vertex of the result is a vertex of the input: attributes
+ * (uvs, normals, bone weights) carry over untouched and the result stays
+ * inside the input's bounding box. Vertices on attribute seams and on open
+ * borders never move, so seams don't tear and borders don't shrink. Collapses
+ * that would flip a triangle or make the surface non-manifold are skipped.
+ *
+ * The input is left untouched and may be indexed or not. Skinned meshes keep
+ * their bone ids and weights and get their own animated vertex buffers.
+ *
+ * @param mesh Mesh to simplify (only the CPU side is read).
+ * @param ratio Fraction of the triangles to keep.
+ * @param max_error Largest error allowed, as a fraction of the size of the
+ * mesh.
+ * @return Mesh A new mesh, not uploaded, or an empty mesh (`vertexCount ==
+ * 0`) if the result needs more vertices than 16 bit indices can address.
+ */
+inline ::Mesh simplify_mesh(const ::Mesh& mesh, float ratio,
+                          float max_error = 0.05f) {
+    ::Mesh out = {0};
+    if ((mesh.vertices == NULL) || (mesh.triangleCount == 0))
+        return out;
+
+    // weld identical vertices ("wedges"), and wedges at the same position
+    std::vector<uint32_t> wedge_vertex;
+    std::vector<uint32_t> wedge_pos;
+    std::vector<uint32_t> vertex_wedge(mesh.vertexCount);
+    std::vector<const float*> pos_xyz;
+    {
+        std::unordered_map<std::string, uint32_t> wedges;
+        std::unordered_map<std::string, uint32_t> positions;
+        for (int v = 0; v < mesh.vertexCount; v++) {
+            auto found = wedges.emplace(detail::simplify_vertex_key(mesh, v),
+                                        (uint32_t)wedge_vertex.size());
+            vertex_wedge[v] = found.first->second;
+            if (!found.second)
+                continue;
+            wedge_vertex.push_back(v);
+            auto pos = positions.emplace(
+                std::string((const char*)(mesh.vertices + v * 3),
+                            sizeof(float) * 3),
+                (uint32_t)pos_xyz.size());
+            if (pos.second)
+                pos_xyz.push_back(mesh.vertices + v * 3);
+            wedge_pos.push_back(pos.first->second);
+        }
+    }
+    size_t n_pos = pos_xyz.size();
+
+    // triangles as wedges, dropping any that are degenerate to begin with
+    std::vector<uint32_t> tris;
+    tris.reserve(mesh.triangleCount * 3);
+    for (int t = 0; t < mesh.triangleCount; t++) {
+        uint32_t w[3];
+        for (int k = 0; k < 3; k++) {
+            int v = mesh.indices ? mesh.indices[t * 3 + k] : t * 3 + k;
+            w[k] = vertex_wedge[v];
+        }
+        if ((wedge_pos[w[0]] == wedge_pos[w[1]]) ||
+            (wedge_pos[w[1]] == wedge_pos[w[2]]) ||
+            (wedge_pos[w[2]] == wedge_pos[w[0]]))
+            continue;
+        tris.insert(tris.end(), w, w + 3);
+    }
+
+    // positions with more than one wedge are on a seam, and positions on an
+    // open or non-manifold edge are on a border: neither may move
+    std::vector<uint32_t> pos_wedge(n_pos, UINT32_MAX);
+    std::vector<bool> locked(n_pos, false);
+    for (uint32_t w = 0; w < wedge_pos.size(); w++) {
+        uint32_t p = wedge_pos[w];
+        if (pos_wedge[p] != UINT32_MAX)
+            locked[p] = true;
+        pos_wedge[p] = w;
+    }
+    {
+        std::unordered_map<uint64_t, int> edges;
+        for (size_t t = 0; t < tris.size(); t += 3) {
+            for (int k = 0; k < 3; k++) {
+                uint64_t a = wedge_pos[tris[t + k]];
+                uint64_t b = wedge_pos[tris[t + (k + 1) % 3]];
+                edges[(std::min(a, b) << 32) | std::max(a, b)]++;
+            }
+        }
+        for (auto& edge : edges) {
+            if (edge.second == 2)
+                continue;
+            locked[edge.first >> 32] = true;
+            locked[edge.first & 0xFFFFFFFF] = true;
+        }
+    }
+
+    float min[3] = {INFINITY, INFINITY, INFINITY};
+    float max[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (const float* p : pos_xyz) {
+        for (int k = 0; k < 3; k++) {
+            min[k] = fminf(min[k], p[k]);
+            max[k] = fmaxf(max[k], p[k]);
+        }
+    }
+    double size = sqrt((max[0] - min[0]) * (max[0] - min[0]) +
+                       (max[1] - min[1]) * (max[1] - min[1]) +
+                       (max[2] - min[2]) * (max[2] - min[2]));
+    double error_limit = (max_error * size) * (max_error * size);
+
+    std::vector<Quadric> quadrics(n_pos);
+    for (size_t t = 0; t < tris.size(); t += 3) {
+        const float* p[3];
+        for (int k = 0; k < 3; k++)
+            p[k] = pos_xyz[wedge_pos[tris[t + k]]];
+        double n[3];
+        detail::simplify_normal(p[0], p[1], p[2], n);
+        double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (len == 0)
+            continue;
+        n[0] /= len;
+        n[1] /= len;
+        n[2] /= len;
+        double d = -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]);
+        Quadric q(n[0], n[1], n[2], d, len * 0.5);
+        for (int k = 0; k < 3; k++)
+            quadrics[wedge_pos[tris[t + k]]] += q;
+    }
+
+    struct Collapse {
+        uint32_t from;
+        uint32_t to;
+        double cost;
+    };
+
+    size_t target = (size_t)(ratio * (tris.size() / 3)) * 3;
+    std::vector<uint32_t> adj_start(n_pos + 1);
+    std::vector<uint32_t> adj;
+    std::vector<Collapse> collapses;
+    std::vector<bool> touched(n_pos);
+    std::vector<bool> removed;
+    std::vector<uint32_t> ring;
+    std::vector<uint32_t> to_ring;
+    while (tris.size() > target) {
+        // triangles around each position
+        std::fill(adj_start.begin(), adj_start.end(), 0);
+        for (uint32_t w : tris)
+            adj_start[wedge_pos[w] + 1]++;
+        for (size_t p = 0; p < n_pos; p++)
+            adj_start[p + 1] += adj_start[p];
+        adj.resize(tris.size());
+        {
+            std::vector<uint32_t> fill(adj_start.begin(), adj_start.end() - 1);
+            for (size_t i = 0; i < tris.size(); i++)
+                adj[fill[wedge_pos[tris[i]]]++] = i / 3;
+        }
+
+        // every edge, in both directions, that may collapse
+        collapses.clear();
+        for (size_t t = 0; t < tris.size(); t += 3) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t from = wedge_pos[tris[t + k]];
+                uint32_t to = wedge_pos[tris[t + (k + 1) % 3]];
+                if (locked[from])
+                    continue;
+                Quadric q = quadrics[from];
+                q += quadrics[to];
+                double cost = q.w > 0 ? q.eval(pos_xyz[to]) / q.w : 0;
+                if (cost > error_limit)
+                    continue;
+                collapses.push_back({from, to, cost});
+            }
+        }
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse& a, const Collapse& b) {
+                      return a.cost < b.cost;
+                  });
+        // two triangles go per collapse: don't let this pass go any further
+        // up the list than it needs to
+        size_t needed = (tris.size() - target) / 6 + 1;
+        double pass_limit =
+            collapses[std::min(needed, collapses.size()) - 1].cost;
+
+        std::fill(touched.begin(), touched.end(), false);
+        removed.assign(tris.size() / 3, false);
+        size_t n_removed = 0;
+        for (auto& c : collapses) {
+            if (c.cost > pass_limit)
+                break;
+            if (tris.size() - n_removed * 3 <= target)
+                break;
+            if (touched[c.from] || touched[c.to])
+                continue;
+            uint32_t* from_tris = adj.data() + adj_start[c.from];
+            uint32_t n_from_tris = adj_start[c.from + 1] - adj_start[c.from];
+
+            // link condition: the ends may only share the neighbours
+            // opposite the edge, or the collapse pinches the surface
+            ring.clear();
+            int shared_tris = 0;
+            uint32_t to_wedge = UINT32_MAX;
+            for (uint32_t i = 0; i < n_from_tris; i++) {
+                uint32_t t = from_tris[i] * 3;
+                bool has_to = false;
+                for (int k = 0; k < 3; k++) {
+                    uint32_t p = wedge_pos[tris[t + k]];
+                    if (p == c.to) {
+                        has_to = true;
+                        to_wedge = tris[t + k];
+                    } else if (p != c.from) {
+                        ring.push_back(p);
+                    }
+                }
+                shared_tris += has_to;
+            }
+            std::sort(ring.begin(), ring.end());
+            ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+            to_ring.clear();
+            for (uint32_t i = adj_start[c.to]; i < adj_start[c.to + 1]; i++) {
+                for (int k = 0; k < 3; k++)
+                    to_ring.push_back(wedge_pos[tris[adj[i] * 3 + k]]);
+            }
+            std::sort(to_ring.begin(), to_ring.end());
+            to_ring.erase(std::unique(to_ring.begin(), to_ring.end()),
+                          to_ring.end());
+            int shared = 0;
+            for (uint32_t p : ring) {
+                shared += std::binary_search(to_ring.begin(), to_ring.end(), p);
+            }
+            if ((shared_tris != 2) || (shared != 2))
+                continue;
+
+            // no triangle may flip (or turn too far)
+            bool flips = false;
+            for (uint32_t i = 0; (i < n_from_tris) && (!flips); i++) {
+                uint32_t t = from_tris[i] * 3;
+                const float* p[3];
+                const float* q[3];
+                bool has_to = false;
+                for (int k = 0; k < 3; k++) {
+                    uint32_t pos = wedge_pos[tris[t + k]];
+                    has_to |= (pos == c.to);
+                    p[k] = pos_xyz[pos];
+                    q[k] = (pos == c.from) ? pos_xyz[c.to] : p[k];
+                }
+                if (has_to)
+                    continue;
+                double n0[3];
+                double n1[3];
+                detail::simplify_normal(p[0], p[1], p[2], n0);
+                detail::simplify_normal(q[0], q[1], q[2], n1);
+                double dot = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+                double l0 = sqrt(n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]);
+                double l1 = sqrt(n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]);
+                flips = dot <= SPRF_SIMPLIFY_MIN_NORMAL_DOT * l0 * l1;
+            }
+            if (flips)
+                continue;
+
+            uint32_t from_wedge = pos_wedge[c.from];
+            for (uint32_t i = 0; i < n_from_tris; i++) {
+                uint32_t t = from_tris[i];
+                bool has_to = false;
+                for (int k = 0; k < 3; k++)
+                    has_to |= (wedge_pos[tris[t * 3 + k]] == c.to);
+                if (has_to) {
+                    removed[t] = true;
+                    n_removed++;
+                    continue;
+                }
+                for (int k = 0; k < 3; k++) {
+                    if (tris[t * 3 + k] == from_wedge)
+                        tris[t * 3 + k] = to_wedge;
+                }
+            }
+            quadrics[c.to] += quadrics[c.from];
+            touched[c.from] = true;
+            touched[c.to] = true;
+            for (uint32_t p : ring)
+                touched[p] = true;
+        }
+        if (n_removed == 0)
+            break;
+        size_t kept = 0;
+        for (size_t t = 0; t < removed.size(); t++) {
+            if (removed[t])
+                continue;
+            memmove(&tris[kept * 3], &tris[t * 3], sizeof(uint32_t) * 3);
+            kept++;
+        }
+        tris.resize(kept * 3);
+    }
+
+    // gather the wedges still in use
+    std::vector<uint32_t> new_index(wedge_vertex.size(), UINT32_MAX);
+    std::vector<uint32_t> vertices;
+    for (uint32_t& w : tris) {
+        if (new_index[w] == UINT32_MAX) {
+            new_index[w] = vertices.size();
+            vertices.push_back(wedge_vertex[w]);
+        }
+        w = new_index[w];
+    }
+    if (vertices.size() > 0xFFFF) {
+        TraceLog(LOG_WARNING,
+                 "simplify_mesh: %d vertices don't fit 16 bit indices",
+                 (int)vertices.size());
+        return out;
+    }
+
+    out.vertexCount = vertices.size();
+    out.triangleCount = tris.size() / 3;
+    out.vertices = detail::simplify_copy(mesh.vertices, vertices, 3);
+    out.texcoords = detail::simplify_copy(mesh.texcoords, vertices, 2);
+    out.texcoords2 = detail::simplify_copy(mesh.texcoords2, vertices, 2);
+    out.normals = detail::simplify_copy(mesh.normals, vertices, 3);
+    out.tangents = detail::simplify_copy(mesh.tangents, vertices, 4);
+    out.colors = detail::simplify_copy(mesh.colors, vertices, 4);
+    out.boneIds = detail::simplify_copy(mesh.boneIds, vertices, 4);
+    out.boneWeights = detail::simplify_copy(mesh.boneWeights, vertices, 4);
+    if (mesh.animVertices)
+        out.animVertices = detail::simplify_copy(mesh.vertices, vertices, 3);
+    if (mesh.animNormals)
+        out.animNormals = detail::simplify_copy(mesh.normals, vertices, 3);
+    out.indices =
+        (unsigned short*)MemAlloc(sizeof(unsigned short) * tris.size());
+    for (size_t i = 0; i < tris.size(); i++)
+        out.indices[i] = tris[i];
+    return out;
+}
+
+} // namespace SPRF
+
+#endif // _SPRF_SIMPLIFY_HPP_
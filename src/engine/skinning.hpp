@@ -0,0 +1,154 @@
+#ifndef _SPRF_SKINNING_HPP_
+#define _SPRF_SKINNING_HPP_
+
+#include "raylib.h"
+#include "raymath.h"
+#include "rlgl.h"
+#include <vector>
+
+/** @brief Vertex attribute location of bone ids (see `lights_vs`) */
+#define SPRF_BONE_IDS_LOCATION 14
+/** @brief Vertex attribute location of bone weights (see `lights_vs`) */
+#define SPRF_BONE_WEIGHTS_LOCATION 15
+/** @brief Texture unit the bone matrices are bound to, past the material
+ * maps and shadow maps */
+#define SPRF_BONE_TEXTURE_UNIT 16
+/** @brief Width of the bone matrix texture, in texels (4 per matrix) */
+#define SPRF_BONE_TEXTURE_WIDTH 1024
+
+namespace SPRF {
+
+/**
+ * @brief Matrix taking a vertex from the bind pose of a bone to its pose in
+ * an animation, the same transformation `UpdateModelAnimation` applies on the
+ * CPU.
+ */
+inline Matrix bone_matrix(const ::Transform& bind, const ::Transform& pose) {
+    Quaternion rotation =
+        QuaternionMultiply(pose.rotation, QuaternionInvert(bind.rotation));
+    Matrix out = MatrixTranslate(-bind.translation.x, -bind.translation.y,
+                                 -bind.translation.z);
+    out = MatrixMultiply(out,
+                         MatrixScale(pose.scale.x, pose.scale.y, pose.scale.z));
+    out = MatrixMultiply(out, QuaternionToMatrix(rotation));
+    return MatrixMultiply(out,
+                          MatrixTranslate(pose.translation.x,
+                                          pose.translation.y,
+                                          pose.translation.z));
+}
+
+/**
+ * @brief Add a mesh's bone ids and weights to its vertex array, which
+ * `UploadMesh` leaves out.
+ *
+ * @param vbos The two buffers created are appended here, to be unloaded
+ * with the mesh.
+ * @return false if the mesh isn't skinned (or not uploaded).
+ */
+inline bool upload_bone_attributes(const ::Mesh& mesh,
+                                   std::vector<unsigned int>& vbos) {
+    if ((mesh.boneIds == NULL) || (mesh.boneWeights == NULL) ||
+        (mesh.vaoId == 0))
+        return false;
+    rlEnableVertexArray(mesh.vaoId);
+    unsigned int ids = rlLoadVertexBuffer(
+        mesh.boneIds, mesh.vertexCount * 4 * sizeof(unsigned char), false);
+    rlSetVertexAttribute(SPRF_BONE_IDS_LOCATION, 4, RL_UNSIGNED_BYTE, false, 0,
+                         0);
+    rlEnableVertexAttribute(SPRF_BONE_IDS_LOCATION);
+    unsigned int weights = rlLoadVertexBuffer(
+        mesh.boneWeights, mesh.vertexCount * 4 * sizeof(float), false);
+    rlSetVertexAttribute(SPRF_BONE_WEIGHTS_LOCATION, 4, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(SPRF_BONE_WEIGHTS_LOCATION);
+    rlDisableVertexArray();
+    rlDisableVertexBuffer();
+    vbos.push_back(ids);
+    vbos.push_back(weights);
+    return true;
+}
+
+/**
+ * @brief Bone matrices of every skinned instance drawn this frame, in a
+ * float texture the vertex shader fetches them from.
+ *
+ * Each instance's palette is appended with `add`, and the offset it lands
+ * at goes in the instance's transform (see `RenderModel::upload_palettes`),
+ * so instances of a skinned model in different poses still draw in one
+ * instanced call. The texture is rewritten once per frame with `upload`.
+ */
+class BoneTexture {
+  private:
+    unsigned int m_texture = 0;
+    /** @brief Rows of `m_texture` */
+    int m_height = 0;
+    /** @brief This frame's matrices, in the layout the shader reads */
+    std::vector<float16> m_staging;
+
+  public:
+    BoneTexture() {}
+
+    BoneTexture(const BoneTexture&) = delete;
+    BoneTexture& operator=(const BoneTexture&) = delete;
+
+    ~BoneTexture() {
+        if (m_texture)
+            rlUnloadTexture(m_texture);
+    }
+
+    /**
+     * @brief Start a frame's palettes.
+     */
+    void begin() { m_staging.clear(); }
+
+    /**
+     * @brief Append a palette.
+     *
+     * @return int Index of its first matrix.
+     */
+    int add(const Matrix* bones, int n) {
+        int offset = m_staging.size();
+        for (int i = 0; i < n; i++) {
+            m_staging.push_back(MatrixToFloatV(bones[i]));
+        }
+        return offset;
+    }
+
+    /**
+     * @brief Number of matrices added this frame.
+     */
+    int size() const { return m_staging.size(); }
+
+    /**
+     * @brief Write this frame's palettes to the texture, growing it if they
+     * don't fit, and bind it to `SPRF_BONE_TEXTURE_UNIT`.
+     */
+    void upload() {
+        if (m_staging.empty())
+            return;
+        const int per_row = SPRF_BONE_TEXTURE_WIDTH / 4;
+        int rows = (m_staging.size() + per_row - 1) / per_row;
+        if (rows > m_height) {
+            int height = m_height < 1 ? 1 : m_height;
+            while (height < rows)
+                height *= 2;
+            if (m_texture)
+                rlUnloadTexture(m_texture);
+            m_texture = rlLoadTexture(NULL, SPRF_BONE_TEXTURE_WIDTH, height,
+                                      RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32A32,
+                                      1);
+            m_height = height;
+        }
+        // whole rows only
+        m_staging.resize(rows * per_row);
+        rlUpdateTexture(m_texture, 0, 0, SPRF_BONE_TEXTURE_WIDTH, rows,
+                        RL_PIXELFORMAT_UNCOMPRESSED_R32G32B32A32,
+                        m_staging.data());
+        rlActiveTextureSlot(SPRF_BONE_TEXTURE_UNIT);
+        rlEnableTexture(m_texture);
+        rlActiveTextureSlot(0);
+    }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_SKINNING_HPP_
@@ -0,0 +1,266 @@
+#ifndef _SPRF_STATIC_BVH_HPP_
+#define _SPRF_STATIC_BVH_HPP_
+
+#include "culling.hpp"
+#include "raylib.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+/** @brief Most instances in a leaf of a `StaticBVH` */
+#define SPRF_STATIC_BVH_LEAF_SIZE 16
+/** @brief How far (world units) the frustum a `StaticBVH` caches its visible
+ * instances for is grown, i.e. how far the camera can wander before they are
+ * culled again */
+#define SPRF_STATIC_CULL_MARGIN 2.0f
+
+namespace SPRF {
+
+/**
+ * @brief `count` instances starting at `first`.
+ */
+struct InstanceRange {
+    uint32_t first;
+    uint32_t count;
+};
+
+/**
+ * @brief Bounding volume hierarchy over instances of a model that never move
+ * (map geometry).
+ *
+ * Built once after the instances are added, by splitting at the median
+ * along the longest axis. Instances are stored in tree order, so every node
+ * covers a contiguous range of them: a node entirely outside the frustum is
+ * skipped and one entirely inside is taken whole without testing a single
+ * instance. Culling hands back ranges of instances rather than copies, so
+ * they can be drawn from a buffer uploaded once (see `RenderModel`).
+ *
+ * `visible` also remembers its result for a slightly larger frustum and
+ * hands it back as long as the camera's frustum stays inside that, so a
+ * still (or barely moving) camera doesn't cull static geometry at all.
+ */
+class StaticBVH {
+  private:
+    struct Node {
+        float min[3];
+        float max[3];
+        /** @brief Range of `m_instances` under this node */
+        uint32_t first;
+        uint32_t count;
+        /** @brief Index of the second child, the first child is the next
+         * node. 0 for leaves */
+        uint32_t right;
+    };
+
+    struct Item {
+        float min[3];
+        float max[3];
+        float centroid[3];
+        uint32_t index;
+    };
+
+    std::vector<Matrix> m_instances;
+    std::vector<Node> m_nodes;
+    bool m_dirty = false;
+
+    /** @brief Cached result of `visible` */
+    std::vector<InstanceRange> m_visible;
+    /** @brief Frustum `m_visible` was culled against */
+    CullPlanes m_visible_planes;
+    bool m_visible_valid = false;
+
+    uint32_t build_node(std::vector<Item>& items, uint32_t first,
+                        uint32_t count) {
+        uint32_t index = m_nodes.size();
+        m_nodes.push_back(Node());
+        Node node;
+        node.first = first;
+        node.count = count;
+        node.right = 0;
+        float c_min[3];
+        float c_max[3];
+        for (int k = 0; k < 3; k++) {
+            node.min[k] = c_min[k] = INFINITY;
+            node.max[k] = c_max[k] = -INFINITY;
+        }
+        for (uint32_t i = first; i < first + count; i++) {
+            for (int k = 0; k < 3; k++) {
+                node.min[k] = fminf(node.min[k], items[i].min[k]);
+                node.max[k] = fmaxf(node.max[k], items[i].max[k]);
+                c_min[k] = fminf(c_min[k], items[i].centroid[k]);
+                c_max[k] = fmaxf(c_max[k], items[i].centroid[k]);
+            }
+        }
+        if (count > SPRF_STATIC_BVH_LEAF_SIZE) {
+            int axis = 0;
+            for (int k = 1; k < 3; k++) {
+                if ((c_max[k] - c_min[k]) > (c_max[axis] - c_min[axis]))
+                    axis = k;
+            }
+            uint32_t half = count / 2;
+            std::nth_element(items.begin() + first,
+                             items.begin() + first + half,
+                             items.begin() + first + count,
+                             [axis](const Item& a, const Item& b) {
+                                 return a.centroid[axis] < b.centroid[axis];
+                             });
+            build_node(items, first, half);
+            node.right = build_node(items, first + half, count - half);
+        }
+        m_nodes[index] = node;
+        return index;
+    }
+
+    void build(const CullBounds* bounds, int n_bounds) {
+        std::vector<Item> items(m_instances.size());
+        for (size_t i = 0; i < m_instances.size(); i++) {
+            const Matrix& m = m_instances[i];
+            Item& item = items[i];
+            item.index = i;
+            for (int k = 0; k < 3; k++) {
+                item.min[k] = INFINITY;
+                item.max[k] = -INFINITY;
+            }
+            // world space AABB of every mesh, as in `cull_visible`
+            for (int j = 0; j < n_bounds; j++) {
+                const float* c = bounds[j].center;
+                const float* e = bounds[j].extents;
+                float center[3] = {
+                    m.m0 * c[0] + m.m4 * c[1] + m.m8 * c[2] + m.m12,
+                    m.m1 * c[0] + m.m5 * c[1] + m.m9 * c[2] + m.m13,
+                    m.m2 * c[0] + m.m6 * c[1] + m.m10 * c[2] + m.m14};
+                float extent[3] = {
+                    fabsf(m.m0) * e[0] + fabsf(m.m4) * e[1] +
+                        fabsf(m.m8) * e[2],
+                    fabsf(m.m1) * e[0] + fabsf(m.m5) * e[1] +
+                        fabsf(m.m9) * e[2],
+                    fabsf(m.m2) * e[0] + fabsf(m.m6) * e[1] +
+                        fabsf(m.m10) * e[2]};
+                for (int k = 0; k < 3; k++) {
+                    item.min[k] = fminf(item.min[k], center[k] - extent[k]);
+                    item.max[k] = fmaxf(item.max[k], center[k] + extent[k]);
+                }
+            }
+            for (int k = 0; k < 3; k++) {
+                item.centroid[k] = (item.min[k] + item.max[k]) * 0.5f;
+            }
+        }
+        m_nodes.clear();
+        if (!items.empty())
+            build_node(items, 0, items.size());
+        std::vector<Matrix> ordered(m_instances.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            ordered[i] = m_instances[items[i].index];
+        }
+        m_instances.swap(ordered);
+        m_dirty = false;
+    }
+
+    /**
+     * @brief Append a range to `out`, merging it with the last one if they
+     * touch.
+     */
+    static void push_range(std::vector<InstanceRange>& out, uint32_t first,
+                           uint32_t count) {
+        if ((!out.empty()) && (out.back().first + out.back().count == first)) {
+            out.back().count += count;
+            return;
+        }
+        out.push_back({first, count});
+    }
+
+  public:
+    /**
+     * @brief Add an instance. The tree is rebuilt on the next `update`.
+     */
+    void add(Matrix instance) {
+        m_instances.push_back(instance);
+        m_dirty = true;
+        m_visible_valid = false;
+    }
+
+    void clear() {
+        m_instances.clear();
+        m_nodes.clear();
+        m_dirty = false;
+        m_visible_valid = false;
+    }
+
+    size_t size() const { return m_instances.size(); }
+
+    /**
+     * @brief All instances, in tree order (once `update` was called).
+     */
+    const Matrix* instances() const { return m_instances.data(); }
+
+    /**
+     * @brief Rebuild the tree if instances were added since the last build.
+     *
+     * @param bounds Local bounds of each mesh of the model.
+     * @param n_bounds Number of meshes.
+     * @return true if it was rebuilt, i.e. `instances()` changed order.
+     */
+    bool update(const CullBounds* bounds, int n_bounds) {
+        if (!m_dirty)
+            return false;
+        build(bounds, n_bounds);
+        return true;
+    }
+
+    /**
+     * @brief Append the ranges of `instances()` that may be visible to
+     * `out`, in order.
+     *
+     * Leaves on the edge of the frustum are appended whole rather than
+     * split, so the ranges can be drawn straight from a buffer holding
+     * `instances()`.
+     */
+    void cull(const CullPlanes& planes, std::vector<InstanceRange>& out) const {
+        assert(!m_dirty);
+        if (m_nodes.empty())
+            return;
+        uint32_t stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            uint32_t index = stack[--top];
+            const Node& node = m_nodes[index];
+            cull_result_t result = cull_aabb(planes, node.min, node.max);
+            if (result == CULL_OUTSIDE)
+                continue;
+            if ((result == CULL_INSIDE) || (node.right == 0)) {
+                push_range(out, node.first, node.count);
+            } else {
+                stack[top++] = node.right;
+                stack[top++] = index + 1;
+            }
+        }
+    }
+
+    /**
+     * @brief Ranges of `instances()` that may be visible, reusing the last
+     * result if it still covers the frustum.
+     */
+    const std::vector<InstanceRange>& visible(const CullPlanes& planes) {
+        Vector3 corners[8];
+        bool bounded = planes.corners(corners);
+        if (m_visible_valid && bounded &&
+            m_visible_planes.contains(corners, 8))
+            return m_visible;
+        m_visible.clear();
+        if (bounded) {
+            m_visible_planes = planes.expanded(SPRF_STATIC_CULL_MARGIN);
+            cull(m_visible_planes, m_visible);
+            m_visible_valid = true;
+        } else {
+            cull(planes, m_visible);
+            m_visible_valid = false;
+        }
+        return m_visible;
+    }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_STATIC_BVH_HPP_
@@ -8,9 +8,11 @@
 #ifndef _SPRF_NETWORKING_CLIENT_HPP_
 #define _SPRF_NETWORKING_CLIENT_HPP_
 
+#include "clock_sync.hpp"
 #include "engine/engine.hpp"
 #include "packet.hpp"
 #include "physics/player_stats.hpp"
+#include <algorithm>
 #include <enet/enet.h>
 #include <functional>
 #include <list>
@@ -117,6 +119,21 @@ template <> class UpdateVariable<bool> : public DevConsoleCommand {
     }
 };
 
+class Client;
+
+/**
+ * @brief `say <message>`: sends a chat message to every player.
+ */
+class SayCommand : public DevConsoleCommand {
+  private:
+    Client* m_client;
+
+  public:
+    SayCommand(DevConsole& console, Client* client)
+        : DevConsoleCommand(console), m_client(client) {}
+    void handle(std::vector<std::string>& args);
+};
+
 /** NOTE: No fake ping for sends!!! Only recieves... Please fix! */
 class Client : public Component {
   private:
@@ -145,11 +162,33 @@ class Client : public Component {
     SmoothedVariable m_send_delta;
     SmoothedVariable m_ping;
 
+    /** @brief Estimate of the server simulation clock */
+    ClockSync m_clock;
+    /** @brief Tickrate of the server simulation (from the handshake) */
+    enet_uint32 m_server_tickrate = 100;
+    /** @brief Newest snapshot tick recieved, older snapshots are dropped */
+    enet_uint32 m_last_tick = 0;
+    bool m_recieved_snapshot = false;
+    /** @brief Tick each player was last in a snapshot, so players left out
+     * of partial snapshots can be carried forward for a while */
+    std::unordered_map<enet_uint32, enet_uint32> m_last_seen;
+
     // float m_interp = 2;
     game_state_packet m_last_game_state;
     std::mutex m_queue_mutex;
     std::list<game_state_packet> m_game_state_queue;
-    std::unordered_map<enet_uint32, Entity*> m_entities;
+    /** @brief Entities of the other players, by player id */
+    std::unordered_map<enet_uint32, EntityHandle> m_entities;
+
+    /** @brief Protects `m_events` and `m_outgoing_events` */
+    std::mutex m_event_mutex;
+    /** @brief Events recieved on the network thread, dispatched in `update` */
+    std::queue<game_event> m_events;
+    /** @brief Events to send to the server on the next network tick */
+    std::vector<game_event> m_outgoing_events;
+    /** @brief Handlers for each event type, called on the main thread */
+    std::vector<std::function<void(game_event&)>>
+        m_event_handlers[GAME_EVENT_COUNT];
 
     enet_uint32 m_id = -1;
 
@@ -164,7 +203,7 @@ class Client : public Component {
     std::queue<ENetEvent> m_fake_ping_down_packets;
 
     float m_ball_radius = 0;
-    Entity* m_ball_entity = NULL;
+    EntityHandle m_ball_entity;
 
     void reset_inputs() {
         m_forward = false;
@@ -181,7 +220,14 @@ class Client : public Component {
     int connect() {
         game->loading_screen.draw(0, "Creating ENet host...");
 
-        m_client = enet_host_create(NULL, 1, 1, 0, 0);
+        // advertised to the server as our incoming bandwidth, it sizes our
+        // snapshots to fit (0 is unlimited)
+        if (!KEY_EXISTS(game_settings.int_values, "cl_rate")) {
+            game_settings.int_values["cl_rate"] = 0;
+        }
+        enet_uint32 rate = std::max(game_settings.int_values["cl_rate"], 0);
+        TraceLog(LOG_INFO, "cl_rate %u", rate);
+        m_client = enet_host_create(NULL, 1, N_CHANNELS, rate, 0);
         if (!m_client) {
             TraceLog(LOG_ERROR, "An error occurred while trying to create an "
                                 "ENet client host!");
@@ -197,7 +243,8 @@ class Client : public Component {
         game->loading_screen.draw(0.2, "Creating peer...");
 
         TraceLog(LOG_INFO, "Creating Peer");
-        m_peer = enet_host_connect(m_client, &m_address, 1, 0);
+        m_peer = enet_host_connect(m_client, &m_address, N_CHANNELS,
+                                   PROTOCOL_VERSION);
         if (m_peer == NULL) {
             TraceLog(LOG_ERROR,
                      "No available peers for initiating an ENet connection!");
@@ -232,24 +279,49 @@ class Client : public Component {
 
         game->loading_screen.draw(0.8, "Waiting for handshake...");
         bool handshake_succeeded = false;
-        for (int i = 0; i < 10; i++) {
-            if (enet_host_service(m_client, &event, 500) > 0 &&
-                event.type == ENET_EVENT_TYPE_RECEIVE) {
-                HandshakePacket* handshake =
-                    (HandshakePacket*)event.packet->data;
+        // snapshots can arrive before the handshake, so wait on time rather
+        // than on the number of packets
+        enet_uint32 handshake_start = enet_time_get();
+        while ((!handshake_succeeded) &&
+               ((enet_time_get() - handshake_start) < 5000)) {
+            if (enet_host_service(m_client, &event, 500) <= 0)
+                continue;
+            if (event.type == ENET_EVENT_TYPE_DISCONNECT) {
+                if (event.data == DISCONNECT_PROTOCOL_MISMATCH) {
+                    TraceLog(LOG_ERROR,
+                             "Server rejected protocol version %d",
+                             PROTOCOL_VERSION);
+                }
+                return 0;
+            }
+            if (event.type != ENET_EVENT_TYPE_RECEIVE)
+                continue;
+            HandshakePacket handshake;
+            bool is_handshake = handshake.deserialize(event.packet);
+            enet_packet_destroy(event.packet);
+            if (is_handshake &&
+                (handshake.protocol_version != PROTOCOL_VERSION)) {
+                TraceLog(LOG_ERROR,
+                         "Server has protocol version %u, expected %d",
+                         handshake.protocol_version, PROTOCOL_VERSION);
+                enet_peer_reset(m_peer);
+                return 0;
+            }
+            if (is_handshake) {
                 TraceLog(LOG_INFO,
                          "I am player %u, server tickrate = %u, current_time = "
-                         "%u, ball_radius = %g",
-                         handshake->id, handshake->tickrate,
-                         handshake->current_time, handshake->ball_radius);
-                enet_time_set(handshake->current_time);
-                m_id = handshake->id;
-                m_ball_radius = handshake->ball_radius;
-                enet_packet_destroy(event.packet);
+                         "%u, ball_radius = %g, protocol = %u",
+                         handshake.id, handshake.tickrate,
+                         handshake.current_time, handshake.ball_radius,
+                         handshake.protocol_version);
+                m_clock.reset(handshake.current_time, enet_time_get());
+                m_server_tickrate = handshake.tickrate;
+                m_id = handshake.id;
+                m_ball_radius = handshake.ball_radius;
                 handshake_succeeded = true;
-                break;
             }
-            game->loading_screen.draw(0.8 + 0.02 * (float)i,
+            float waited = enet_time_get() - handshake_start;
+            game->loading_screen.draw(0.8 + 0.2 * waited / 5000.0f,
                                       "Waiting for handshake...");
         }
         if (!handshake_succeeded) {
@@ -325,36 +397,104 @@ class Client : public Component {
         }
         user_action_packet send_packet(
             m_forward, m_backward, m_left, m_right, m_jump,
-            this->entity()->get_child(0)->get_component<Transform>()->rotation);
+            this->entity()->get_child(0)->get_component<Transform>()->rotation());
         ENetPacket* packet = send_packet.serialize();
-        if (enet_peer_send(m_peer, 0, packet) != 0) {
+        if (enet_peer_send(m_peer, CHANNEL_SNAPSHOT, packet) != 0) {
             enet_packet_destroy(packet);
             TraceLog(LOG_ERROR, "Packet send failed?");
         }
+        send_events();
         enet_host_flush(m_client);
         reset_inputs();
     }
 
+    /**
+     * @brief Sends everything queued by `send_event` as reliable packets
+     * (one unless there are more than a packet can carry).
+     *
+     * Called from the network thread (ENet hosts aren't thread safe).
+     */
+    void send_events() {
+        std::vector<game_event> events;
+        {
+            std::lock_guard<std::mutex> guard(m_event_mutex);
+            if (m_outgoing_events.size() == 0)
+                return;
+            events.swap(m_outgoing_events);
+        }
+        for (auto& batch : game_event_packet::batches(0, events)) {
+            ENetPacket* packet = batch.serialize();
+            if (enet_peer_send(m_peer, CHANNEL_EVENT, packet) != 0) {
+                enet_packet_destroy(packet);
+                TraceLog(LOG_ERROR, "Event send failed?");
+            }
+        }
+    }
+
     void handle_recieve(ENetEvent* event) {
+        packet_type_t type;
+        if (!peek_packet_type(event->packet, &type)) {
+            TraceLog(LOG_WARNING, "dropping packet with unknown type");
+            return;
+        }
+        // events are reliable, so ENet has already acked them and faking loss
+        // here would just lose them for good
+        if (type == PACKET_GAME_EVENT) {
+            game_event_packet events;
+            if (!events.deserialize(event->packet)) {
+                TraceLog(LOG_WARNING, "dropping malformed event packet");
+                return;
+            }
+            std::lock_guard<std::mutex> guard(m_event_mutex);
+            for (auto& i : events.events) {
+                m_events.push(i);
+            }
+            return;
+        }
+
         if (m_fake_packet_down_loss) {
             if (randrange(0, 1) <= m_fake_packet_down_loss_amount)
                 return;
         }
 
-        packet_header header = *(packet_header*)(event->packet->data);
-        if (header.packet_type == PACKET_PING_RESPONSE) {
-            ping_response_packet tmp(event->packet->data,
-                                     event->packet->dataLength);
-            m_ping.update(enet_time_get() - tmp.ping_return);
+        if (type == PACKET_PING_RESPONSE) {
+            ping_response_packet tmp;
+            if (!tmp.deserialize(event->packet)) {
+                TraceLog(LOG_WARNING, "dropping malformed ping response");
+                return;
+            }
+            enet_uint32 now = enet_time_get();
+            m_ping.update(now - tmp.ping_return);
+            m_clock.add_sample(tmp.ping_return, tmp.server_time, now);
             return;
         }
-        if (header.packet_type == PACKET_GAME_STATE) {
+        if ((type == PACKET_GAME_STATE) ||
+            (type == PACKET_GAME_STATE_COMPACT)) {
+            game_state_packet game_state_update;
+            if (!game_state_update.deserialize(event->packet)) {
+                TraceLog(LOG_WARNING, "dropping malformed snapshot");
+                return;
+            }
             m_recv_delta.update(enet_time_get() - m_last_recieve);
             game_info.recieve_delta = m_recv_delta.get();
             m_last_recieve = enet_time_get();
-            game_state_packet game_state_update(event->packet->data,
-                                                event->packet->dataLength);
-            game_state_update.timestamp = enet_time_get();
+            // snapshots are unsequenced, so drop anything older than what we
+            // already have
+            if (m_recieved_snapshot && (game_state_update.tick <= m_last_tick))
+                return;
+            m_recieved_snapshot = true;
+            m_last_tick = game_state_update.tick;
+            if (!game_state_update.partial)
+                m_last_seen.clear();
+            for (auto& i : game_state_update.states) {
+                m_last_seen[i.id] = game_state_update.tick;
+            }
+            if (game_state_update.partial) {
+                carry_forward(game_state_update);
+            }
+            game_state_update.timestamp =
+                (enet_uint32)(((double)game_state_update.tick * 1000.0) /
+                              (double)m_server_tickrate);
             m_last_game_state = game_state_update;
 
             std::lock_guard<std::mutex> guard(m_queue_mutex);
@@ -362,6 +502,31 @@ class Client : public Component {
         }
     }
 
+    /**
+     * @brief Fills in players left out of a partial snapshot with their last
+     * known state.
+     *
+     * Players that haven't been in a snapshot for a second are dropped, so
+     * players that left don't stick around forever while we are short on
+     * bandwidth.
+     */
+    void carry_forward(game_state_packet& game_state_update) {
+        for (auto& i : m_last_game_state.states) {
+            enet_uint32 last_seen = m_last_seen[i.id];
+            if ((game_state_update.tick - last_seen) > m_server_tickrate)
+                continue;
+            bool found = false;
+            for (auto& j : game_state_update.states) {
+                if (j.id == i.id) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found)
+                game_state_update.states.push_back(i);
+        }
+    }
+
     void recv_packet() {
         if (m_fake_ping) {
             if (m_fake_ping_down_packets.size() > m_fake_ping_amount) {
@@ -467,10 +632,65 @@ class Client : public Component {
         dev_console->add_command<UpdateInput>("+left", &m_left);
         dev_console->add_command<UpdateInput>("+right", &m_right);
         dev_console->add_command<UpdateInput>("+jump", &m_jump);
-        enet_time_set(0);
+        dev_console->add_command<SayCommand>("say", this);
+        add_event_handler(GAME_EVENT_CHAT, [this](game_event& event) {
+            if (event.source == GAME_EVENT_SERVER) {
+                TraceLog(LOG_CONSOLE, "[server] %s", event.payload.c_str());
+            } else if (event.source == m_id) {
+                TraceLog(LOG_CONSOLE, "[you] %s", event.payload.c_str());
+            } else {
+                TraceLog(LOG_CONSOLE, "[player %u] %s", event.source,
+                         event.payload.c_str());
+            }
+        });
+        add_event_handler(GAME_EVENT_GOAL, [](game_event& event) {
+            TraceLog(LOG_CONSOLE, "GOAL! %s", event.payload.c_str());
+        });
+        add_event_handler(GAME_EVENT_RESET, [](game_event& event) {
+            TraceLog(LOG_CONSOLE, "game reset");
+        });
         m_client_thread = std::thread(&Client::run_client, this);
     }
 
+    /**
+     * @brief Register a handler for an event type.
+     *
+     * Handlers run on the main thread during `update`, in the order the
+     * server emitted the events.
+     */
+    void add_event_handler(game_event_t type,
+                           std::function<void(game_event&)> handler) {
+        m_event_handlers[type].push_back(handler);
+    }
+
+    /**
+     * @brief Queue an event for the server (only chat is accepted).
+     *
+     * Locks `m_event_mutex`.
+     */
+    void send_event(game_event_t type, std::string payload) {
+        std::lock_guard<std::mutex> guard(m_event_mutex);
+        m_outgoing_events.push_back(game_event(type, m_id, payload));
+    }
+
+    /**
+     * @brief Run the handlers of every event recieved since the last call.
+     */
+    void dispatch_events() {
+        std::queue<game_event> events;
+        {
+            std::lock_guard<std::mutex> guard(m_event_mutex);
+            events.swap(m_events);
+        }
+        while (!events.empty()) {
+            auto& event = events.front();
+            for (auto& handler : m_event_handlers[event.type]) {
+                handler(event);
+            }
+            events.pop();
+        }
+    }
+
     void close() {
         if (!m_connected)
             return;
@@ -501,13 +721,15 @@ class Client : public Component {
             this->entity()->scene()->renderer()->create_render_model(
                 Mesh::Cube(m_ball_radius, m_ball_radius,
                                    m_ball_radius));
+        ball_model->generate_lods();
         ball_model->tint(Color(255, 255, 255, 100));
         ball_cube_model->tint(Color(0, 0, 0, 255));
-        m_ball_entity = this->entity()->scene()->create_entity();
-        m_ball_entity->add_component<Model>(ball_model);
-        auto child_comp = m_ball_entity->create_child();
+        auto ball_entity = this->entity()->scene()->create_entity();
+        ball_entity->add_component<Model>(ball_model);
+        auto child_comp = ball_entity->create_child();
         child_comp->add_component<Model>(ball_cube_model);
-        m_ball_entity->init();
+        ball_entity->init();
+        m_ball_entity = ball_entity->handle();
     }
 
     // bool id_exists(std::unordered_map<enet_uint32, player_state_data>& data,
@@ -548,10 +770,12 @@ class Client : public Component {
     }
 
     game_state_packet interpolate_game_states() {
-        enet_uint32 client_time =
-            enet_time_get() -
+        double render_time =
+            m_clock.server_time(enet_time_get()) -
             m_recv_delta.get() *
                 game_settings.float_values["cl_interp"]; // m_interp;
+        enet_uint32 client_time =
+            (render_time > 0) ? (enet_uint32)render_time : 0;
         std::lock_guard<std::mutex> guard(m_queue_mutex);
         game_info.packet_queue_size = m_game_state_queue.size();
         if (m_game_state_queue.size() == 0) {
@@ -628,37 +852,66 @@ class Client : public Component {
         //    m_ball_entity->init();
         //}
 
-        for (auto& i : m_entities) {
-            i.second->get_component<NetworkEntity>()->active = false;
+        dispatch_events();
+
+        Scene* scene = this->entity()->scene();
+
+        for (auto it = m_entities.begin(); it != m_entities.end();) {
+            Entity* entity = scene->get_entity(it->second);
+            if (!entity) {
+                it = m_entities.erase(it);
+                continue;
+            }
+            entity->get_component<NetworkEntity>()->active = false;
+            it++;
         }
         auto interped = interpolate_game_states();
 
-        auto ball_transform = m_ball_entity->get_component<Transform>();
+        if (Entity* ball = scene->get_entity(m_ball_entity)) {
+            auto ball_transform = ball->get_component<Transform>();
 
-        ball_transform->position = interped.ball_state.position();
-        ball_transform->rotation = interped.ball_state.rotation();
+            ball_transform->position(interped.ball_state.position());
+            ball_transform->rotation(interped.ball_state.rotation());
 
-        game_info.ball_position = ball_transform->position;
-        game_info.ball_rotation = ball_transform->rotation;
+            game_info.ball_position = ball_transform->position();
+            game_info.ball_rotation = ball_transform->rotation();
+        }
 
         for (auto& i : interped.states) {
             if (i.id == m_id) {
-                this->entity()->get_component<Transform>()->position =
-                    i.position() + vec3(0, PLAYER_HEIGHT * 0.5, 0);
+                this->entity()->get_component<Transform>()->position(
+                    i.position() + vec3(0, PLAYER_HEIGHT * 0.5, 0));
                 game_info.position = i.position();
                 game_info.velocity = i.velocity();
                 continue;
             }
             if (!KEY_EXISTS(m_entities, i.id)) {
                 TraceLog(LOG_INFO, "creating new player with id %d", i.id);
-                auto entity = this->entity()->scene()->create_entity();
-                entity->add_component<NetworkEntity>();
-                m_init_player(entity);
-                entity->init();
-                assert(!KEY_EXISTS(m_entities, i.id));
-                m_entities[i.id] = entity;
+                // invalid until the scene creates the entity after this
+                // phase, so the id isn't queued twice
+                m_entities[i.id] = EntityHandle();
+                enet_uint32 id = i.id;
+                vec3 position = i.position();
+                vec3 rotation = i.rotation();
+                vec3 velocity = i.velocity();
+                scene->commands().create("entity", [this, id, position,
+                                                    rotation,
+                                                    velocity](Entity* entity) {
+                    auto net_data = entity->add_component<NetworkEntity>();
+                    net_data->position = position;
+                    net_data->rotation = rotation;
+                    net_data->velocity = velocity;
+                    net_data->active = true;
+                    m_init_player(entity);
+                    entity->init();
+                    m_entities[id] = entity->handle();
+                });
+                continue;
             }
-            auto net_data = m_entities[i.id]->get_component<NetworkEntity>();
+            Entity* entity = scene->get_entity(m_entities[i.id]);
+            if (!entity)
+                continue;
+            auto net_data = entity->get_component<NetworkEntity>();
             net_data->position = i.position();
             net_data->rotation = i.rotation();
             net_data->velocity = i.velocity();
@@ -667,8 +920,10 @@ class Client : public Component {
 
         // store information in game info
         game_info.ping = m_ping.get();
+        game_info.clock_offset = m_clock.offset();
+        game_info.clock_drift = m_clock.drift();
         game_info.rotation =
-            this->entity()->get_child(0)->get_component<Transform>()->rotation;
+            this->entity()->get_child(0)->get_component<Transform>()->rotation();
     }
 
     void draw2D() {
@@ -698,6 +953,16 @@ class Client : public Component {
     void destroy() {}
 };
 
+inline void SayCommand::handle(std::vector<std::string>& args) {
+    if (args.size() == 0)
+        return;
+    std::string message = args[0];
+    for (size_t i = 1; i < args.size(); i++) {
+        message += " " + args[i];
+    }
+    m_client->send_event(GAME_EVENT_CHAT, message);
+}
+
 } // namespace SPRF
 
 #endif // _SPRF_NETWORKING_CLIENT_HPP_
\ No newline at end of file
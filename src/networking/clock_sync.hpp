@@ -0,0 +1,255 @@
+/** @file clock_sync.hpp
+ *
+ * NTP style clock synchronization between the client and the server
+ * simulation. Every ping round trip gives a sample of the offset between the
+ * local enet clock and the server's simulation clock. The samples are filtered
+ * by round trip time (the fastest round trips have the least asymmetric
+ * delay) to get the offset, and a linear fit over the filtered offsets of the
+ * last half minute gives the drift of the server clock. The estimate is slewed
+ * rather than stepped so that interpolation never sees time jump around.
+ *
+ */
+
+#ifndef _SPRF_NETWORKING_CLOCK_SYNC_HPP_
+#define _SPRF_NETWORKING_CLOCK_SYNC_HPP_
+
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+/** @brief Number of round trips kept for the offset estimate */
+#define CLOCK_SYNC_WINDOW (64)
+/** @brief Errors bigger than this (in ms) are stepped instead of slewed */
+#define CLOCK_SYNC_STEP_MS (250.0)
+/** @brief Fraction of the error corrected per sample when slewing */
+#define CLOCK_SYNC_SLEW (0.1)
+/** @brief Largest drift we believe in (ms of server time per local ms) */
+#define CLOCK_SYNC_MAX_DRIFT (0.05)
+/** @brief How often (in ms) the filtered offset is recorded for drift */
+#define CLOCK_SYNC_DRIFT_INTERVAL (1000.0)
+/** @brief Number of filtered offsets kept for the drift fit */
+#define CLOCK_SYNC_HISTORY (30)
+
+namespace SPRF {
+
+/**
+ * @brief Estimates the server simulation clock from ping round trips.
+ *
+ * All times are in milliseconds. `add_sample` is called from the networking
+ * thread and `server_time` from the main thread, so both lock `m_mutex`.
+ */
+class ClockSync {
+  private:
+    struct Sample {
+        /** @brief Local time halfway through the round trip */
+        double local;
+        /** @brief server_time - local */
+        double offset;
+        /** @brief Round trip time */
+        double rtt;
+    };
+
+    std::mutex m_mutex;
+    size_t m_window;
+    std::vector<Sample> m_samples;
+    int m_next = 0;
+    /** @brief Filtered offsets over a longer period, for the drift fit */
+    std::vector<Sample> m_history;
+    int m_history_last = 0;
+
+    /** @brief Offset at `m_reference` */
+    double m_offset = 0;
+    /** @brief Drift of the server clock relative to the local clock */
+    double m_drift = 0;
+    /** @brief Local time that `m_offset` refers to */
+    double m_reference = 0;
+    /** @brief Smallest round trip in the current window */
+    double m_rtt = 0;
+    /** @brief Last value returned by `server_time`, to keep it monotonic */
+    double m_last = 0;
+    bool m_synced = false;
+
+    double estimate(double local_time) {
+        return local_time + m_offset + m_drift * (local_time - m_reference);
+    }
+
+    /**
+     * @brief Estimates the offset at `local_time` from the samples with the
+     * lowest round trip times.
+     *
+     * @param local_time Local time the resulting offset should refer to.
+     * @return double Estimated offset at `local_time`.
+     */
+    double filtered_offset(double local_time) {
+        double min_rtt = INFINITY;
+        for (auto& i : m_samples) {
+            min_rtt = fmin(min_rtt, i.rtt);
+        }
+        m_rtt = min_rtt;
+        // anything much slower than the fastest round trip probably queued
+        // somewhere on one leg, so its offset is skewed
+        double tolerance = fmax(2.0, min_rtt * 0.5);
+
+        double n = 0, sum = 0;
+        for (auto& i : m_samples) {
+            if (i.rtt > min_rtt + tolerance)
+                continue;
+            n += 1;
+            sum += i.offset + m_drift * (local_time - i.local);
+        }
+        return sum / n;
+    }
+
+    /**
+     * @brief Fits the drift to the history of filtered offsets.
+     *
+     * The sample window is far too short to see drift through the jitter, so
+     * the filtered offset is recorded every `CLOCK_SYNC_DRIFT_INTERVAL` ms and
+     * the drift is the slope of a least squares fit over those.
+     */
+    void update_drift(double local_time, double offset) {
+        if ((m_history.size() > 0) &&
+            ((local_time - m_history[m_history_last].local) <
+             CLOCK_SYNC_DRIFT_INTERVAL))
+            return;
+        Sample point;
+        point.local = local_time;
+        point.offset = offset;
+        point.rtt = m_rtt;
+        if (m_history.size() < CLOCK_SYNC_HISTORY) {
+            m_history.push_back(point);
+            m_history_last = m_history.size() - 1;
+        } else {
+            m_history_last = (m_history_last + 1) % m_history.size();
+            m_history[m_history_last] = point;
+        }
+        if (m_history.size() < 4)
+            return;
+
+        double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (auto& i : m_history) {
+            double x = i.local - local_time;
+            n += 1;
+            sx += x;
+            sy += i.offset;
+            sxx += x * x;
+            sxy += x * i.offset;
+        }
+        double denom = n * sxx - sx * sx;
+        if (fabs(denom) < 1e-9)
+            return;
+        double drift = (n * sxy - sx * sy) / denom;
+        m_drift =
+            fmax(-CLOCK_SYNC_MAX_DRIFT, fmin(CLOCK_SYNC_MAX_DRIFT, drift));
+    }
+
+  public:
+    ClockSync(size_t window = CLOCK_SYNC_WINDOW) : m_window(window) {
+        m_samples.reserve(m_window);
+    }
+
+    /**
+     * @brief Coarse initial sync (e.g. from the handshake), ignoring latency.
+     *
+     * @param server_time Server time sent by the server.
+     * @param local_time Local time the server time was received at.
+     */
+    void reset(double server_time, double local_time) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_samples.clear();
+        m_next = 0;
+        m_history.clear();
+        m_history_last = 0;
+        m_offset = server_time - local_time;
+        m_drift = 0;
+        m_reference = local_time;
+        m_rtt = 0;
+        m_last = 0;
+        m_synced = false;
+    }
+
+    /**
+     * @brief Add a ping round trip.
+     *
+     * @param send_time Local time the ping was sent.
+     * @param server_time Server time when the server answered the ping.
+     * @param recieve_time Local time the answer arrived.
+     */
+    void add_sample(double send_time, double server_time,
+                    double recieve_time) {
+        double rtt = recieve_time - send_time;
+        if (rtt < 0)
+            return;
+        Sample sample;
+        sample.local = (send_time + recieve_time) * 0.5;
+        sample.offset = server_time - sample.local;
+        sample.rtt = rtt;
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (m_samples.size() < m_window) {
+            m_samples.push_back(sample);
+        } else {
+            m_samples[m_next] = sample;
+            m_next = (m_next + 1) % m_samples.size();
+        }
+
+        double new_offset = filtered_offset(recieve_time);
+        update_drift(recieve_time, new_offset);
+
+        double error = (recieve_time + new_offset) - estimate(recieve_time);
+        if ((!m_synced) || (fabs(error) > CLOCK_SYNC_STEP_MS)) {
+            m_offset = new_offset;
+            m_synced = true;
+        } else {
+            m_offset = (estimate(recieve_time) - recieve_time) +
+                       error * CLOCK_SYNC_SLEW;
+        }
+        m_reference = recieve_time;
+    }
+
+    /**
+     * @brief Estimated server time at a local time.
+     *
+     * Never goes backwards between calls, so interpolation is monotonic even
+     * while the estimate is being corrected.
+     *
+     * @param local_time Local (enet) time.
+     * @return double Estimated server time.
+     */
+    double server_time(double local_time) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        double out = estimate(local_time);
+        if (out < m_last)
+            return m_last;
+        m_last = out;
+        return out;
+    }
+
+    /** @brief Current offset (server - local) in ms */
+    double offset() {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_offset;
+    }
+
+    /** @brief Current drift estimate (ms per ms) */
+    double drift() {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_drift;
+    }
+
+    /** @brief Fastest round trip in the current window */
+    double rtt() {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_rtt;
+    }
+
+    /** @brief Whether at least one round trip has been measured */
+    bool synced() {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_synced;
+    }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_NETWORKING_CLOCK_SYNC_HPP_
@@ -3,6 +3,11 @@
  *
  * To add a map element: implement MapElement, and add the element to Map::Read.
  *
+ * Maps are loaded in two steps: every element creates its resources (render
+ * models, lights...), then its entities under `sprf_map`. The entities are
+ * baked into a scene snapshot the first time a map file is loaded into the
+ * game, and later loads create them from the snapshot instead.
+ *
  */
 
 
@@ -12,6 +17,7 @@
 #include "custom_mesh.hpp"
 #include "editor/editor_tools.hpp"
 #include "engine/engine.hpp"
+#include "engine/scene_snapshot.hpp"
 #include "raylib-cpp.hpp"
 #include <fstream>
 #include <iostream>
@@ -21,6 +27,10 @@
 #include <vector>
 using json = nlohmann::json;
 
+/** @brief Bump whenever elements change what entities they create, so old
+ * map snapshots get rebaked */
+#define SPRF_MAP_SNAPSHOT_VERSION 1
+
 namespace SPRF {
 
 /** @struct MapElementInstance
@@ -75,9 +85,16 @@ class MapElement {
         }
     }
 
-    // load into the scene. try to keep everything organized -> make child of sprf_map etc..
+    // load everything that isn't an entity into the scene (render models,
+    // lights...). render models the entities use go in resources, always in
+    // the same order, so a snapshot of the entities can refer to them.
     // editor flag is set when loading into the editor instead of game.
-    virtual void load(Scene* scene, bool editor) = 0;
+    virtual void load_resources(Scene* scene, bool editor,
+                                std::vector<void*>& resources) = 0;
+
+    // create the entities, as children of map (sprf_map). not called when
+    // the entities come from a snapshot.
+    virtual void load_entities(Entity* map, bool editor) {}
 
     // load into physics world -> without needing to specify positions for any reason
     virtual void load(dWorldID world, dSpaceID space) = 0;
@@ -99,6 +116,7 @@ class MapCubeElement : public MapElement {
     float m_height;
     float m_length;
     std::string m_texture_path;
+    RenderModel* m_model = NULL;
 
   public:
     MapCubeElement(float width, float height, float length,
@@ -106,28 +124,40 @@ class MapCubeElement : public MapElement {
         : m_width(width), m_height(height), m_length(length),
           m_texture_path(texture_path) {}
 
-    void load(Scene* scene, bool editor) {
-        auto model = scene->renderer()->create_render_model(
+    void load_resources(Scene* scene, bool editor,
+                        std::vector<void*>& resources) {
+        m_model = scene->renderer()->create_render_model(
             Mesh::Cube(m_width, m_height, m_length));
         if (m_texture_path != "")
-            model->add_texture(m_texture_path);
+            m_model->add_texture(m_texture_path);
         //if (editor){
         //    TraceLog(LOG_INFO,"transparent cube");
         //    model->tint(Color(255,255,255,155));
         //}
-        auto map_entity = scene->find_entity("sprf_map");
-        assert(map_entity);
-        auto parent = map_entity->create_child("map_cube_element_" +
-                                               std::to_string(fresh_id()));
+        resources.push_back(m_model);
+        if (!editor) {
+            // cubes never move in game, so skip the per instance entities
+            // and put them straight in the model's static BVH. sprf_map and
+            // the element's entity are always at the origin.
+            for (auto& i : this->instances()) {
+                Transform transform(i.position, i.rotation, i.scale);
+                m_model->add_static_instance(transform.matrix());
+            }
+        }
+    }
+
+    void load_entities(Entity* map, bool editor) {
+        auto parent =
+            map->create_child("map_cube_element_" + std::to_string(fresh_id()));
+        if (!editor)
+            return;
         for (auto& i : this->instances()) {
             auto entity = parent->create_child();
-            entity->add_component<Model>(model);
-            entity->get_component<Transform>()->position = i.position;
-            entity->get_component<Transform>()->rotation = i.rotation;
-            entity->get_component<Transform>()->scale = i.scale;
-            if (editor){
-                entity->add_component<Selectable>(true, true);
-            }
+            entity->add_component<Model>(m_model);
+            entity->get_component<Transform>()->position(i.position);
+            entity->get_component<Transform>()->rotation(i.rotation);
+            entity->get_component<Transform>()->scale(i.scale);
+            entity->add_component<Selectable>(true, true);
         }
     }
 
@@ -184,6 +214,7 @@ class MapPlaneElement : public MapElement {
     std::string m_texture_path;
     int m_resX;
     int m_resY;
+    RenderModel* m_model = NULL;
 
   public:
     MapPlaneElement(float x_size, float y_size, std::string texture_path = "",
@@ -191,21 +222,24 @@ class MapPlaneElement : public MapElement {
         : m_x_size(x_size), m_y_size(y_size), m_texture_path(texture_path),
           m_resX(resX), m_resY(resY) {}
 
-    void load(Scene* scene, bool editor) {
-        auto plane = scene->renderer()->create_render_model(
+    void load_resources(Scene* scene, bool editor,
+                        std::vector<void*>& resources) {
+        m_model = scene->renderer()->create_render_model(
             WrappedMesh(m_x_size, m_y_size, m_resX, m_resY));
-        plane->clip(false);
+        m_model->clip(false);
         if (m_texture_path != "")
-            plane->add_texture(m_texture_path);
-        auto map_entity = scene->find_entity("sprf_map");
-        assert(map_entity);
-        auto parent = map_entity->create_child("map_plane_element" +
-                                               std::to_string(fresh_id()));
+            m_model->add_texture(m_texture_path);
+        resources.push_back(m_model);
+    }
+
+    void load_entities(Entity* map, bool editor) {
+        auto parent =
+            map->create_child("map_plane_element" + std::to_string(fresh_id()));
         for (auto& i : this->instances()) {
             auto entity = parent->create_child();
-            entity->add_component<Model>(plane);
-            entity->get_component<Transform>()->position = i.position;
-            entity->get_component<Transform>()->rotation = i.rotation;
+            entity->add_component<Model>(m_model);
+            entity->get_component<Transform>()->position(i.position);
+            entity->get_component<Transform>()->rotation(i.rotation);
             if (editor){
                 entity->add_component<Selectable>(true, true);
             }
@@ -255,16 +289,16 @@ class MapPositionElement : public MapElement {
 
     void load(dWorldID world, dSpaceID space) {}
 
-    void load(Scene* scene, bool editor) {
-        auto map_entity = scene->find_entity("sprf_map");
-        assert(map_entity);
-        auto parent =
-            map_entity->create_child("map_position_element_" + m_name + "_" +
-                                     std::to_string(fresh_id()));
+    void load_resources(Scene* scene, bool editor,
+                        std::vector<void*>& resources) {}
+
+    void load_entities(Entity* map, bool editor) {
+        auto parent = map->create_child("map_position_element_" + m_name +
+                                        "_" + std::to_string(fresh_id()));
         for (auto& i : this->instances()) {
             auto entity = parent->create_child("position");
-            entity->get_component<Transform>()->position = i.position;
-            entity->get_component<Transform>()->rotation = i.rotation;
+            entity->get_component<Transform>()->position(i.position);
+            entity->get_component<Transform>()->rotation(i.rotation);
             if (editor){
                 entity->add_component<Selectable>(true, true);
             }
@@ -308,7 +342,8 @@ class MapLightElement : public MapElement {
         m_fov = params["fov"];
     }
 
-    void load(Scene* scene, bool editor) {
+    void load_resources(Scene* scene, bool editor,
+                        std::vector<void*>& resources) {
         auto light = scene->renderer()->add_light();
         light->L(m_L);
         light->target(m_target);
@@ -336,7 +371,8 @@ class MapSkyboxElement : public MapElement {
 
   public:
     MapSkyboxElement(std::string path) : m_path(path) {}
-    void load(Scene* scene, bool editor) {
+    void load_resources(Scene* scene, bool editor,
+                        std::vector<void*>& resources) {
         scene->renderer()->load_skybox(m_path);
         scene->renderer()->enable_skybox();
     }
@@ -355,6 +391,32 @@ class MapSkyboxElement : public MapElement {
 class Map {
   private:
     std::vector<std::shared_ptr<MapElement>> m_elements;
+    /** @brief File the map was read from, if any */
+    std::string m_filename;
+
+    void load(Scene* scene, bool editor, const std::string& snapshot) {
+        MapElement::reset_ids();
+        std::vector<void*> resources;
+        for (auto i : m_elements) {
+            i->load_resources(scene, editor, resources);
+        }
+        uint32_t source = 0;
+        if (snapshot != "") {
+            source = snapshot_hash(std::to_string(SPRF_MAP_SNAPSHOT_VERSION) +
+                                   serialize().dump());
+            if (SceneSnapshot::matches(snapshot, source) &&
+                (SceneSnapshot::load(snapshot, scene, resources).size() > 0))
+                return;
+        }
+        auto map_entity = scene->create_entity("sprf_map");
+        for (auto i : m_elements) {
+            i->load_entities(map_entity, editor);
+        }
+        if ((snapshot != "") &&
+            (!SceneSnapshot::save(snapshot, {map_entity}, resources, source)))
+            TraceLog(LOG_WARNING, "couldn't write map snapshot %s",
+                     snapshot.c_str());
+    }
 
   public:
     Map() {}
@@ -365,22 +427,28 @@ class Map {
         m_elements.push_back(element);
     }
 
+    /**
+     * @brief Load the map into the game. Maps read from a file are cached in
+     * a snapshot next to it.
+     */
     void load(Scene* scene) {
-        MapElement::reset_ids();
-        scene->create_entity("sprf_map");
-        for (auto i : m_elements) {
-            i->load(scene,false);
-        }
+        load(scene, m_filename == "" ? "" : m_filename + ".snapshot");
     }
 
-    void load_editor(Scene* scene) {
-        MapElement::reset_ids();
-        scene->create_entity("sprf_map");
-        for (auto i : m_elements) {
-            i->load(scene,true);
-        }
+    /**
+     * @brief Load the map into the game, with its entities from `snapshot`
+     * if that was made from this map, baking it otherwise.
+     */
+    void load(Scene* scene, const std::string& snapshot) {
+        load(scene, false, snapshot);
     }
 
+    /**
+     * @brief Load the map into the editor. Editor entities can't be
+     * snapshotted, so they're always built.
+     */
+    void load_editor(Scene* scene) { load(scene, true, ""); }
+
     void load(dWorldID world, dSpaceID space,
               std::unordered_map<std::string, std::vector<MapElementInstance>>&
                   positions) {
@@ -389,19 +457,27 @@ class Map {
         }
     }
 
-    void save(std::string filename) {
-        json j;
-        j["filename"] = filename;
+    /**
+     * @brief The map's elements, as `save` writes them.
+     */
+    json serialize() {
         std::vector<json> elements;
         for (auto& i : m_elements) {
             elements.push_back(i->serialize());
         }
-        j["elements"] = elements;
+        return elements;
+    }
+
+    void save(std::string filename) {
+        json j;
+        j["filename"] = filename;
+        j["elements"] = serialize();
         std::ofstream o(filename);
         o << std::setw(2) << j << std::endl;
     }
 
     void read(std::string filename) {
+        m_filename = filename;
         std::ifstream f(filename);
         json data = json::parse(f);
         TraceLog(LOG_INFO, "opening map %s",
@@ -0,0 +1,346 @@
+/** @file metrics.hpp
+ *
+ * Server side metrics (tick timings, bandwidth, per peer RTT/loss...) that can
+ * be exported in the Prometheus text exposition format. All metrics are plain
+ * atomics so the simulation and networking threads can record them without
+ * taking a lock, and exporting only reads them.
+ *
+ */
+
+#ifndef _SPRF_NETWORKING_METRICS_HPP_
+#define _SPRF_NETWORKING_METRICS_HPP_
+
+#include "raylib.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SPRF {
+
+/**
+ * @brief Monotonically increasing count.
+ */
+class MetricCounter {
+  private:
+    std::atomic<uint64_t> m_value{0};
+
+  public:
+    void add(uint64_t n = 1) {
+        m_value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const { return m_value.load(std::memory_order_relaxed); }
+
+    void reset() { m_value.store(0, std::memory_order_relaxed); }
+};
+
+/**
+ * @brief Value that can go up and down.
+ */
+class MetricGauge {
+  private:
+    std::atomic<double> m_value{0};
+
+  public:
+    void set(double value) {
+        m_value.store(value, std::memory_order_relaxed);
+    }
+
+    double get() const { return m_value.load(std::memory_order_relaxed); }
+};
+
+/**
+ * @brief Distribution of observed values over fixed buckets.
+ *
+ * Buckets are stored non-cumulatively and summed up on export.
+ */
+class MetricHistogram {
+  private:
+    std::vector<double> m_bounds;
+    /** @brief One per bound plus the +Inf bucket */
+    std::unique_ptr<std::atomic<uint64_t>[]> m_buckets;
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<double> m_sum{0};
+
+  public:
+    /**
+     * @param bounds Upper bounds of the buckets, in increasing order.
+     */
+    MetricHistogram(std::vector<double> bounds)
+        : m_bounds(bounds),
+          m_buckets(new std::atomic<uint64_t>[bounds.size() + 1]) {
+        for (size_t i = 0; i <= m_bounds.size(); i++) {
+            m_buckets[i].store(0);
+        }
+    }
+
+    void observe(double value) {
+        size_t idx =
+            std::lower_bound(m_bounds.begin(), m_bounds.end(), value) -
+            m_bounds.begin();
+        m_buckets[idx].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        double sum = m_sum.load(std::memory_order_relaxed);
+        while (!m_sum.compare_exchange_weak(sum, sum + value,
+                                            std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+
+    double sum() const { return m_sum.load(std::memory_order_relaxed); }
+
+    const std::vector<double>& bounds() const { return m_bounds; }
+
+    uint64_t bucket(size_t idx) const {
+        return m_buckets[idx].load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @brief Metrics for one ENet peer slot.
+ */
+struct PeerMetrics {
+    std::atomic<bool> connected{false};
+    std::atomic<uint32_t> player_id{0};
+    MetricCounter bytes_in;
+    MetricCounter bytes_out;
+    MetricCounter packets_in;
+    MetricCounter packets_out;
+    /** @brief Mean round trip time reported by ENet, in seconds */
+    MetricGauge rtt;
+    /** @brief Packet loss reported by ENet, 0 to 1 */
+    MetricGauge packet_loss;
+    /** @brief Estimated bytes/s the peer can take */
+    MetricGauge send_rate;
+    /** @brief Ticks between snapshots sent to the peer */
+    MetricGauge snapshot_interval;
+    /** @brief Snapshots that left players out to fit the budget */
+    MetricCounter partial_snapshots;
+
+    /** @brief Reset when a new player takes over the slot */
+    void reset(uint32_t id) {
+        player_id = id;
+        bytes_in.reset();
+        bytes_out.reset();
+        packets_in.reset();
+        packets_out.reset();
+        partial_snapshots.reset();
+        rtt.set(0);
+        packet_loss.set(0);
+        send_rate.set(0);
+        snapshot_interval.set(1);
+        connected = true;
+    }
+};
+
+/**
+ * @brief Everything the server records.
+ *
+ * Timings are in seconds, as Prometheus expects.
+ */
+class ServerMetrics {
+  private:
+    size_t m_peer_count;
+    std::unique_ptr<PeerMetrics[]> m_peers;
+
+    static std::string fmt(double value) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.9g", value);
+        return buf;
+    }
+
+    static void header(std::string& out, const char* name, const char* help,
+                       const char* type) {
+        out += std::string("# HELP ") + name + " " + help + "\n";
+        out += std::string("# TYPE ") + name + " " + type + "\n";
+    }
+
+    static void write(std::string& out, const char* name, const char* help,
+                      const MetricCounter& counter) {
+        header(out, name, help, "counter");
+        out += std::string(name) + " " + std::to_string(counter.get()) + "\n";
+    }
+
+    static void write(std::string& out, const char* name, const char* help,
+                      const MetricGauge& gauge) {
+        header(out, name, help, "gauge");
+        out += std::string(name) + " " + fmt(gauge.get()) + "\n";
+    }
+
+    static void write(std::string& out, const char* name, const char* help,
+                      const MetricHistogram& histogram) {
+        header(out, name, help, "histogram");
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < histogram.bounds().size(); i++) {
+            cumulative += histogram.bucket(i);
+            out += std::string(name) + "_bucket{le=\"" +
+                   fmt(histogram.bounds()[i]) + "\"} " +
+                   std::to_string(cumulative) + "\n";
+        }
+        cumulative += histogram.bucket(histogram.bounds().size());
+        out += std::string(name) + "_bucket{le=\"+Inf\"} " +
+               std::to_string(cumulative) + "\n";
+        out += std::string(name) + "_sum " + fmt(histogram.sum()) + "\n";
+        out += std::string(name) + "_count " +
+               std::to_string(histogram.count()) + "\n";
+    }
+
+    template <class T>
+    void write_peers(std::string& out, const char* name, const char* help,
+                     const char* type, T get) {
+        header(out, name, help, type);
+        for (size_t i = 0; i < m_peer_count; i++) {
+            if (!m_peers[i].connected)
+                continue;
+            out += std::string(name) + "{peer=\"" + std::to_string(i) +
+                   "\",player=\"" + std::to_string(m_peers[i].player_id) +
+                   "\"} " + get(m_peers[i]) + "\n";
+        }
+    }
+
+  public:
+    /** @brief Time to step the simulation (inputs, collision, solver) */
+    MetricHistogram step_time;
+    /** @brief Time spent in collision detection */
+    MetricHistogram collide_time;
+    /** @brief Time to build and encode one peer's snapshot */
+    MetricHistogram encode_time;
+    /** @brief Time between consecutive simulation steps */
+    MetricHistogram tick_interval;
+    /** @brief Steps that took longer than a tick */
+    MetricCounter tick_overruns;
+    MetricCounter ticks;
+    MetricCounter snapshots;
+    MetricCounter bytes_in;
+    MetricCounter bytes_out;
+    MetricCounter malformed_packets;
+    MetricGauge players;
+
+    ServerMetrics(size_t peer_count)
+        : m_peer_count(peer_count), m_peers(new PeerMetrics[peer_count]),
+          step_time({0.0001, 0.00025, 0.0005, 0.001, 0.002, 0.004, 0.008,
+                     0.016, 0.032}),
+          collide_time({0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.002, 0.004,
+                        0.008}),
+          encode_time({0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005,
+                       0.001}),
+          tick_interval({0.001, 0.002, 0.005, 0.01, 0.0125, 0.015, 0.02, 0.03,
+                         0.05, 0.1}) {}
+
+    /**
+     * @brief Metrics for a peer slot (`ENetPeer::incomingPeerID`).
+     */
+    PeerMetrics* peer(size_t idx) {
+        if (idx >= m_peer_count)
+            return NULL;
+        return &m_peers[idx];
+    }
+
+    /**
+     * @brief Render every metric in the Prometheus text exposition format.
+     */
+    std::string prometheus() {
+        std::string out;
+        write(out, "sprf_step_seconds", "Time to step the simulation",
+              step_time);
+        write(out, "sprf_collide_seconds", "Time spent in collision detection",
+              collide_time);
+        write(out, "sprf_snapshot_encode_seconds",
+              "Time to build and encode one peer's snapshot", encode_time);
+        write(out, "sprf_tick_interval_seconds",
+              "Time between consecutive simulation steps", tick_interval);
+        write(out, "sprf_tick_overruns_total",
+              "Simulation steps that took longer than a tick", tick_overruns);
+        write(out, "sprf_ticks_total", "Simulation steps", ticks);
+        write(out, "sprf_snapshots_total", "Snapshots sent to peers",
+              snapshots);
+        write(out, "sprf_bytes_in_total", "Bytes recieved from all peers",
+              bytes_in);
+        write(out, "sprf_bytes_out_total", "Bytes sent to all peers",
+              bytes_out);
+        write(out, "sprf_malformed_packets_total",
+              "Packets dropped because they failed to decode",
+              malformed_packets);
+        write(out, "sprf_players", "Players in the match", players);
+        write_peers(out, "sprf_peer_bytes_in_total", "Bytes recieved per peer",
+                    "counter", [](PeerMetrics& p) {
+                        return std::to_string(p.bytes_in.get());
+                    });
+        write_peers(out, "sprf_peer_bytes_out_total", "Bytes sent per peer",
+                    "counter", [](PeerMetrics& p) {
+                        return std::to_string(p.bytes_out.get());
+                    });
+        write_peers(out, "sprf_peer_packets_in_total",
+                    "Packets recieved per peer", "counter",
+                    [](PeerMetrics& p) {
+                        return std::to_string(p.packets_in.get());
+                    });
+        write_peers(out, "sprf_peer_packets_out_total",
+                    "Packets sent per peer", "counter", [](PeerMetrics& p) {
+                        return std::to_string(p.packets_out.get());
+                    });
+        write_peers(out, "sprf_peer_rtt_seconds", "Mean round trip time",
+                    "gauge",
+                    [](PeerMetrics& p) { return fmt(p.rtt.get()); });
+        write_peers(out, "sprf_peer_packet_loss", "Packet loss (0 to 1)",
+                    "gauge",
+                    [](PeerMetrics& p) { return fmt(p.packet_loss.get()); });
+        write_peers(out, "sprf_peer_send_rate_bytes",
+                    "Estimated bytes/s the peer can take", "gauge",
+                    [](PeerMetrics& p) { return fmt(p.send_rate.get()); });
+        write_peers(out, "sprf_peer_snapshot_interval_ticks",
+                    "Ticks between snapshots sent to the peer", "gauge",
+                    [](PeerMetrics& p) {
+                        return fmt(p.snapshot_interval.get());
+                    });
+        write_peers(out, "sprf_peer_partial_snapshots_total",
+                    "Snapshots that left players out to fit the budget",
+                    "counter", [](PeerMetrics& p) {
+                        return std::to_string(p.partial_snapshots.get());
+                    });
+        return out;
+    }
+
+    /**
+     * @brief Write `prometheus()` to a file.
+     *
+     * Writes to a temporary file and renames it over `filename`, so whatever
+     * scrapes the file never sees half of it. Windows won't rename over an
+     * existing file, so there the old one is removed first and may be
+     * missing for a moment.
+     *
+     * @return bool false if the file couldn't be written.
+     */
+    bool write_file(std::string filename) {
+        std::string tmp = filename + ".tmp";
+        {
+            std::ofstream file(tmp);
+            if (!file.good())
+                return false;
+            file << prometheus();
+            if (!file.good())
+                return false;
+        }
+#ifdef _WIN32
+        std::remove(filename.c_str());
+#endif
+        if (std::rename(tmp.c_str(), filename.c_str()) != 0) {
+            TraceLog(LOG_WARNING, "couldn't rename %s to %s: %s", tmp.c_str(),
+                     filename.c_str(), strerror(errno));
+            return false;
+        }
+        return true;
+    }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_NETWORKING_METRICS_HPP_
@@ -6,46 +6,32 @@
  * initial handshake during connection establishment, and provides mechanisms
  * for transmitting and receiving client inputs.
  *
+ * The structs here are the in-memory forms used by the game. The wire format
+ * itself is generated from protocol.json (see protocol.hpp), so every
+ * `deserialize` is bounds checked and returns false on malformed packets.
+ *
  */
 
 #ifndef _SPRF_NETWORKING_PACKET_
 #define _SPRF_NETWORKING_PACKET_
 
 #include "engine/base.hpp"
-#include <cassert>
+#include "protocol.hpp"
+#include <algorithm>
 #include <enet/enet.h>
+#include <string>
 #include <vector>
 
-namespace SPRF {
-
-enum packet_type_t {
-    PACKET_PING = 0,
-    PACKET_PING_RESPONSE,
-    PACKET_USER_ACTION,
-    PACKET_USER_COMMAND,
-    PACKET_GAME_STATE,
-    PACKET_GAME_EVENT,
-    PACKET_SERVER_HANDSHAKE
-};
-
-struct packet_header {
-    packet_type_t packet_type;
-    packet_header(packet_type_t packet_type_) : packet_type(packet_type_) {}
-    packet_header() {}
-};
+/** @brief Channel for the unsequenced snapshot/input stream */
+#define CHANNEL_SNAPSHOT (0)
+/** @brief Reliable, ordered channel for game events */
+#define CHANNEL_EVENT (1)
+/** @brief Number of channels clients and the server need */
+#define N_CHANNELS (2)
+/** @brief Source id of events emitted by the server itself */
+#define GAME_EVENT_SERVER ((enet_uint32)-1)
 
-static ENetPacket*
-construct_packet(packet_type_t type, void* data, size_t size,
-                 enet_uint32 flags = (ENET_PACKET_FLAG_UNSEQUENCED)) {
-    packet_header header(type);
-    size_t total_size = sizeof(packet_header) + size;
-    void* raw = malloc(total_size);
-    memcpy(raw, &header, sizeof(packet_header));
-    memcpy(((char*)raw) + sizeof(packet_header), data, size);
-    ENetPacket* out = enet_packet_create(raw, total_size, flags);
-    free(raw);
-    return out;
-}
+namespace SPRF {
 
 struct ping_packet {
     enet_uint32 ping;
@@ -53,22 +39,39 @@ struct ping_packet {
     ping_packet() {}
 
     ENetPacket* serialize() {
-        return construct_packet(PACKET_PING, this, sizeof(*this));
+        ping_msg msg;
+        msg.ping = ping;
+        return encode_packet(msg, ENET_PACKET_FLAG_UNSEQUENCED);
     }
 };
 
 struct ping_response_packet {
+    /** @brief client send time of the ping being answered */
     enet_uint32 ping_return;
-    ping_response_packet(enet_uint32 ping_return_)
-        : ping_return(ping_return_) {}
+    /** @brief server simulation time (ms) when the ping was answered */
+    enet_uint32 server_time;
+    ping_response_packet(enet_uint32 ping_return_, enet_uint32 server_time_)
+        : ping_return(ping_return_), server_time(server_time_) {}
     ping_response_packet() {}
-    ping_response_packet(void* data, size_t datalen) {
-        assert(datalen == sizeof(packet_header) + sizeof(*this));
-        memcpy(this, (((char*)data) + sizeof(packet_header)), sizeof(*this));
+
+    /**
+     * @brief Decode a recieved packet.
+     * @return bool false if the packet is malformed.
+     */
+    bool deserialize(const ENetPacket* packet) {
+        ping_response_msg msg;
+        if (!decode_packet(packet, msg))
+            return false;
+        ping_return = msg.ping_return;
+        server_time = msg.server_time;
+        return true;
     }
 
     ENetPacket* serialize() {
-        return construct_packet(PACKET_PING_RESPONSE, this, sizeof(*this));
+        ping_response_msg msg;
+        msg.ping_return = ping_return;
+        msg.server_time = server_time;
+        return encode_packet(msg, ENET_PACKET_FLAG_UNSEQUENCED);
     }
 };
 
@@ -104,6 +107,30 @@ struct ball_state_data {
         rotation_data[2] = rot.z;
         return rotation();
     }
+
+    ball_state_msg msg() {
+        ball_state_msg out;
+        out.position = position();
+        out.rotation = rotation();
+        return out;
+    }
+
+    ball_state_data(const ball_state_msg& msg) {
+        position(msg.position);
+        rotation(msg.rotation);
+    }
+
+    ball_state_compact_msg compact_msg() {
+        ball_state_compact_msg out;
+        out.position = position();
+        out.rotation = rotation();
+        return out;
+    }
+
+    ball_state_data(const ball_state_compact_msg& msg) {
+        position(msg.position);
+        rotation(msg.rotation);
+    }
 };
 
 struct player_state_data {
@@ -168,53 +195,160 @@ struct player_state_data {
         return vec3(velocity_data[0], velocity_data[1],
                                velocity_data[2]);
     }
+
+    player_state_msg msg() {
+        player_state_msg out;
+        out.id = id;
+        out.position = position();
+        out.velocity = velocity();
+        out.rotation = rotation();
+        out.health = health_data;
+        return out;
+    }
+
+    player_state_data(const player_state_msg& msg) : id(msg.id) {
+        position(msg.position);
+        velocity(msg.velocity);
+        rotation(msg.rotation);
+        health_data = msg.health;
+    }
+
+    player_state_compact_msg compact_msg() {
+        player_state_compact_msg out;
+        out.id = id;
+        out.position = position();
+        out.velocity = velocity();
+        out.pitch = rotation_data[0];
+        out.yaw = rotation_data[1];
+        return out;
+    }
+
+    player_state_data(const player_state_compact_msg& msg) : id(msg.id) {
+        position(msg.position);
+        velocity(msg.velocity);
+        rotation(vec3(msg.pitch, msg.yaw, 0));
+        health_data = 100;
+    }
 };
 
 struct game_state_packet {
-    enet_uint32 timestamp;
+    /** @brief simulation tick the snapshot was taken at */
+    enet_uint32 tick;
+    /** @brief server simulation time of `tick` in ms. Not sent, filled in by
+     * the receiver from the tickrate. */
+    enet_uint32 timestamp = 0;
+    /** @brief Some players were left out to fit the peer's byte budget, so
+     * missing players haven't necessarily left */
+    bool partial = false;
     ball_state_data ball_state;
     std::vector<player_state_data> states;
 
-    game_state_packet(enet_uint32 timestamp_, ball_state_data ball_state_,
-                      std::vector<player_state_data> states_)
-        : timestamp(timestamp_), ball_state(ball_state_), states(states_) {}
+    game_state_packet(enet_uint32 tick_, ball_state_data ball_state_,
+                      std::vector<player_state_data> states_,
+                      bool partial_ = false)
+        : tick(tick_), partial(partial_), ball_state(ball_state_),
+          states(states_) {}
     game_state_packet() {}
 
-    game_state_packet(void* raw, size_t datalen) {
-        memcpy(&timestamp, ((char*)raw) + sizeof(packet_header),
-               sizeof(enet_uint32));
-        memcpy(&ball_state,
-               ((char*)raw) + sizeof(packet_header) + sizeof(enet_uint32),
-               sizeof(ball_state_data));
-        size_t state_size =
-            datalen - (sizeof(packet_header) + sizeof(enet_uint32) +
-                       sizeof(ball_state_data));
-        int n_states = state_size / sizeof(player_state_data);
-        states.resize(n_states);
-        memcpy(states.data(),
-               ((char*)raw) + sizeof(packet_header) + sizeof(enet_uint32) +
-                   sizeof(ball_state_data),
-               state_size);
+    /**
+     * @brief Encoded size of a snapshot with `n_players` players.
+     *
+     * @param compact Size of the `PACKET_GAME_STATE_COMPACT` encoding.
+     */
+    static size_t encoded_size(size_t n_players, bool compact) {
+        struct Sizes {
+            size_t base[2];
+            size_t player[2];
+        };
+        static const Sizes sizes = []() {
+            Sizes out;
+            PacketWriter full, full_player, small, small_player;
+            full.write_u8(PACKET_GAME_STATE);
+            game_state_msg().encode(full);
+            player_state_msg().encode(full_player);
+            small.write_u8(PACKET_GAME_STATE_COMPACT);
+            game_state_compact_msg().encode(small);
+            player_state_compact_msg().encode(small_player);
+            out.base[0] = full.size();
+            out.base[1] = small.size();
+            out.player[0] = full_player.size();
+            out.player[1] = small_player.size();
+            return out;
+        }();
+        return sizes.base[compact] + sizes.player[compact] * n_players;
     }
 
-    ENetPacket* serialize() {
-        size_t size = sizeof(enet_uint32) + sizeof(ball_state_data) +
-                      sizeof(player_state_data) * states.size();
-        void* data = malloc(size);
-        memcpy(data, &timestamp, sizeof(enet_uint32));
-        memcpy(((char*)data) + sizeof(enet_uint32), &ball_state,
-               sizeof(ball_state_data));
-        memcpy(((char*)data) + sizeof(enet_uint32) + sizeof(ball_state_data),
-               states.data(), states.size() * sizeof(player_state_data));
-        ENetPacket* out = construct_packet(PACKET_GAME_STATE, data, size);
-        free(data);
-        return out;
+    /**
+     * @brief Decode a recieved snapshot (either encoding).
+     * @return bool false if the packet is malformed.
+     */
+    bool deserialize(const ENetPacket* packet) {
+        packet_type_t type;
+        if (!peek_packet_type(packet, &type))
+            return false;
+        states.clear();
+        if (type == PACKET_GAME_STATE_COMPACT) {
+            game_state_compact_msg msg;
+            if (!decode_packet(packet, msg))
+                return false;
+            tick = msg.tick;
+            partial = msg.partial;
+            ball_state = ball_state_data(msg.ball);
+            states.reserve(msg.players.size());
+            for (auto& i : msg.players) {
+                states.push_back(player_state_data(i));
+            }
+            return true;
+        }
+        game_state_msg msg;
+        if (!decode_packet(packet, msg))
+            return false;
+        tick = msg.tick;
+        partial = msg.partial;
+        ball_state = ball_state_data(msg.ball);
+        states.reserve(msg.players.size());
+        for (auto& i : msg.players) {
+            states.push_back(player_state_data(i));
+        }
+        return true;
+    }
+
+    /**
+     * @brief Encode the snapshot.
+     *
+     * @param compact Use the lower precision `PACKET_GAME_STATE_COMPACT`
+     * encoding (for peers short on bandwidth).
+     */
+    ENetPacket* serialize(bool compact = false) {
+        if (compact) {
+            game_state_compact_msg msg;
+            msg.tick = tick;
+            msg.partial = partial;
+            msg.ball = ball_state.compact_msg();
+            msg.players.reserve(states.size());
+            for (auto& i : states) {
+                msg.players.push_back(i.compact_msg());
+            }
+            return encode_packet(msg, ENET_PACKET_FLAG_UNSEQUENCED);
+        }
+        game_state_msg msg;
+        msg.tick = tick;
+        msg.partial = partial;
+        msg.ball = ball_state.msg();
+        msg.players.reserve(states.size());
+        for (auto& i : states) {
+            msg.players.push_back(i.msg());
+        }
+        return encode_packet(msg, ENET_PACKET_FLAG_UNSEQUENCED);
     }
 };
 
 struct HandshakePacket {
+    /** @brief `PROTOCOL_VERSION` of the server */
+    enet_uint32 protocol_version = PROTOCOL_VERSION;
     enet_uint32 id;
     enet_uint32 tickrate;
+    /** @brief server simulation time (ms), used as the initial clock sync */
     enet_uint32 current_time;
     float ball_radius;
 
@@ -224,12 +358,32 @@ struct HandshakePacket {
           ball_radius(ball_radius_) {}
 
     HandshakePacket() {}
-};
 
-struct user_action_packet_serialized {
-    enet_uint32 ping;
-    enet_uint32 raw;
-    float rotation[3];
+    /**
+     * @brief Decode a recieved handshake.
+     * @return bool false if the packet is malformed or isn't a handshake.
+     */
+    bool deserialize(const ENetPacket* packet) {
+        handshake_msg msg;
+        if (!decode_packet(packet, msg))
+            return false;
+        protocol_version = msg.protocol_version;
+        id = msg.id;
+        tickrate = msg.tickrate;
+        current_time = msg.current_time;
+        ball_radius = msg.ball_radius;
+        return true;
+    }
+
+    ENetPacket* serialize() {
+        handshake_msg msg;
+        msg.protocol_version = protocol_version;
+        msg.id = id;
+        msg.tickrate = tickrate;
+        msg.current_time = current_time;
+        msg.ball_radius = ball_radius;
+        return encode_packet(msg, ENET_PACKET_FLAG_RELIABLE);
+    }
 };
 
 struct user_action_packet {
@@ -246,33 +400,36 @@ struct user_action_packet {
         : ping_send(enet_time_get()), rotation(rotation_), forward(forward_),
           backward(backward_), left(left_), right(right_), jump(jump_) {}
 
-    user_action_packet(void* rawptr, size_t datalen) {
-        assert(datalen == sizeof(packet_header) +
-                         sizeof(user_action_packet_serialized));
-        user_action_packet_serialized raw;
-        memcpy(&raw, ((char*)rawptr) + sizeof(packet_header),
-               sizeof(user_action_packet_serialized));
-        ping_send = raw.ping;
-        forward = raw.raw & (1 << 0);
-        backward = raw.raw & (1 << 1);
-        left = raw.raw & (1 << 2);
-        right = raw.raw & (1 << 3);
-        jump = raw.raw & (1 << 4);
-        rotation.x = raw.rotation[0];
-        rotation.y = raw.rotation[1];
-        rotation.z = raw.rotation[2];
+    user_action_packet() {}
+
+    /**
+     * @brief Decode a recieved input packet.
+     * @return bool false if the packet is malformed.
+     */
+    bool deserialize(const ENetPacket* packet) {
+        user_action_msg msg;
+        if (!decode_packet(packet, msg))
+            return false;
+        ping_send = msg.ping;
+        forward = msg.forward;
+        backward = msg.backward;
+        left = msg.left;
+        right = msg.right;
+        jump = msg.jump;
+        rotation = msg.rotation;
+        return true;
     }
 
     ENetPacket* serialize() {
-        user_action_packet_serialized out;
-        out.ping = ping_send;
-        out.raw = 0 | (forward << 0) | (backward << 1) | (left << 2) |
-                  (right << 3) | (jump << 4);
-        out.rotation[0] = rotation.x;
-        out.rotation[1] = rotation.y;
-        out.rotation[2] = rotation.z;
-        return construct_packet(PACKET_USER_ACTION, &out,
-                                sizeof(user_action_packet_serialized));
+        user_action_msg msg;
+        msg.ping = ping_send;
+        msg.forward = forward;
+        msg.backward = backward;
+        msg.left = left;
+        msg.right = right;
+        msg.jump = jump;
+        msg.rotation = rotation;
+        return encode_packet(msg, ENET_PACKET_FLAG_UNSEQUENCED);
     }
 
     void print() {
@@ -283,6 +440,118 @@ struct user_action_packet {
     }
 };
 
+/**
+ * @brief A single gameplay event (goal, reset, chat...).
+ *
+ * `payload` is free form, e.g. the chat message or the scoring team.
+ */
+struct game_event {
+    game_event_t type;
+    /** @brief Player id that caused the event, or `GAME_EVENT_SERVER` */
+    enet_uint32 source;
+    std::string payload;
+
+    game_event(game_event_t type_, enet_uint32 source_, std::string payload_)
+        : type(type_), source(source_), payload(payload_) {}
+    game_event() {}
+
+    game_event_msg msg() {
+        game_event_msg out;
+        out.type = type;
+        out.source = source;
+        out.payload = payload;
+        return out;
+    }
+
+    game_event(const game_event_msg& msg)
+        : type(msg.type), source(msg.source), payload(msg.payload) {}
+
+    static const char* type_name(game_event_t type) {
+        switch (type) {
+        case GAME_EVENT_GOAL:
+            return "goal";
+        case GAME_EVENT_RESET:
+            return "reset";
+        case GAME_EVENT_CHAT:
+            return "chat";
+        default:
+            return "unknown";
+        }
+    }
+
+    /**
+     * @brief Inverse of `type_name`.
+     * @return bool false if `name` isn't an event type.
+     */
+    static bool from_name(std::string name, game_event_t* out) {
+        for (int i = 0; i < GAME_EVENT_COUNT; i++) {
+            if (name == type_name((game_event_t)i)) {
+                *out = (game_event_t)i;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+/**
+ * @brief Events emitted during one tick, sent as reliable packets on
+ * `CHANNEL_EVENT` (several if there are more than one packet can carry).
+ */
+struct game_event_packet {
+    enet_uint32 tick = 0;
+    std::vector<game_event> events;
+
+    game_event_packet(enet_uint32 tick_, std::vector<game_event> events_)
+        : tick(tick_), events(events_) {}
+    game_event_packet() {}
+
+    /**
+     * @brief Split `events` into packets of at most
+     * `game_events_msg::max_events` each, in order.
+     */
+    static std::vector<game_event_packet>
+    batches(enet_uint32 tick, const std::vector<game_event>& events) {
+        std::vector<game_event_packet> out;
+        for (size_t i = 0; i < events.size();
+             i += game_events_msg::max_events) {
+            size_t end =
+                std::min(events.size(), i + game_events_msg::max_events);
+            out.push_back(game_event_packet(
+                tick, std::vector<game_event>(events.begin() + i,
+                                              events.begin() + end)));
+        }
+        return out;
+    }
+
+    /**
+     * @brief Decode a recieved event batch.
+     * @return bool false if the packet is malformed.
+     */
+    bool deserialize(const ENetPacket* packet) {
+        game_events_msg msg;
+        if (!decode_packet(packet, msg))
+            return false;
+        tick = msg.tick;
+        events.clear();
+        events.reserve(msg.events.size());
+        for (auto& i : msg.events) {
+            events.push_back(game_event(i));
+        }
+        return true;
+    }
+
+    ENetPacket* serialize() {
+        game_events_msg msg;
+        msg.tick = tick;
+        msg.events.reserve(events.size());
+        for (auto& i : events) {
+            msg.events.push_back(i.msg());
+        }
+        return encode_packet(msg, ENET_PACKET_FLAG_RELIABLE);
+    }
+};
+
 } // namespace SPRF
 
 #endif // _SPRF_NETWORKING_PACKET_
\ No newline at end of file
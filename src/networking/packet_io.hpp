@@ -0,0 +1,206 @@
+/** @file packet_io.hpp
+ *
+ * Bounds checked readers/writers for the wire format. Everything is written
+ * little endian, byte by byte, so the format doesn't depend on struct padding
+ * or the host. Every read returns false instead of reading past the end of
+ * the packet, so a truncated or malicious packet can't cause an overread.
+ *
+ * The encoders/decoders in protocol.hpp are generated on top of these (see
+ * gen_protocol.py).
+ *
+ */
+
+#ifndef _SPRF_NETWORKING_PACKET_IO_HPP_
+#define _SPRF_NETWORKING_PACKET_IO_HPP_
+
+#include "engine/base.hpp"
+#include <cmath>
+#include <cstring>
+#include <enet/enet.h>
+#include <string>
+#include <vector>
+
+namespace SPRF {
+
+/**
+ * @brief Appends values to a growing byte buffer.
+ */
+class PacketWriter {
+  private:
+    std::vector<enet_uint8> m_data;
+
+  public:
+    PacketWriter(size_t reserve = 64) { m_data.reserve(reserve); }
+
+    void write_u8(enet_uint8 value) { m_data.push_back(value); }
+
+    void write_u16(enet_uint16 value) {
+        m_data.push_back(value & 0xFF);
+        m_data.push_back((value >> 8) & 0xFF);
+    }
+
+    void write_u32(enet_uint32 value) {
+        for (int i = 0; i < 4; i++) {
+            m_data.push_back((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    void write_f32(float value) {
+        enet_uint32 bits;
+        memcpy(&bits, &value, sizeof(bits));
+        write_u32(bits);
+    }
+
+    void write_vec3(vec3 value) {
+        write_f32(value.x);
+        write_f32(value.y);
+        write_f32(value.z);
+    }
+
+    /**
+     * @brief Writes an angle wrapped to [-pi, pi) in 16 bits.
+     */
+    void write_angle16(float value) {
+        float wrapped = value - 2.0f * M_PI * floorf((value + M_PI) /
+                                                     (2.0f * M_PI));
+        float unit = (wrapped + M_PI) / (2.0f * M_PI);
+        write_u16((enet_uint16)((long)roundf(unit * 65536.0f) & 0xFFFF));
+    }
+
+    /**
+     * @brief Writes `value`, clamped to [min, max], in 16 bits.
+     */
+    void write_fixed16(float value, float min, float max) {
+        float unit = (value - min) / (max - min);
+        unit = fmaxf(0.0f, fminf(1.0f, unit));
+        write_u16((enet_uint16)roundf(unit * 65535.0f));
+    }
+
+    /**
+     * @brief Writes a string with a u16 length prefix.
+     */
+    void write_string(const std::string& value) {
+        write_u16(value.size());
+        m_data.insert(m_data.end(), value.begin(), value.end());
+    }
+
+    const enet_uint8* data() const { return m_data.data(); }
+
+    size_t size() const { return m_data.size(); }
+
+    /**
+     * @brief Wraps the written bytes in an ENet packet.
+     */
+    ENetPacket* packet(enet_uint32 flags) {
+        return enet_packet_create(m_data.data(), m_data.size(), flags);
+    }
+};
+
+/**
+ * @brief Reads values from a recieved packet.
+ *
+ * Every read checks that there are enough bytes left and returns false
+ * otherwise, leaving the output untouched.
+ */
+class PacketReader {
+  private:
+    const enet_uint8* m_data;
+    size_t m_size;
+    size_t m_offset = 0;
+
+  public:
+    PacketReader(const void* data, size_t size)
+        : m_data((const enet_uint8*)data), m_size(size) {}
+
+    PacketReader(const ENetPacket* packet)
+        : m_data(packet->data), m_size(packet->dataLength) {}
+
+    /** @brief Number of bytes that haven't been read yet */
+    size_t remaining() const { return m_size - m_offset; }
+
+    /** @brief Whether every byte of the packet has been consumed */
+    bool done() const { return m_offset == m_size; }
+
+    bool read_u8(enet_uint8* out) {
+        if (remaining() < 1)
+            return false;
+        *out = m_data[m_offset++];
+        return true;
+    }
+
+    bool read_u16(enet_uint16* out) {
+        if (remaining() < 2)
+            return false;
+        *out = (enet_uint16)m_data[m_offset] |
+               ((enet_uint16)m_data[m_offset + 1] << 8);
+        m_offset += 2;
+        return true;
+    }
+
+    bool read_u32(enet_uint32* out) {
+        if (remaining() < 4)
+            return false;
+        enet_uint32 value = 0;
+        for (int i = 0; i < 4; i++) {
+            value |= ((enet_uint32)m_data[m_offset + i]) << (8 * i);
+        }
+        *out = value;
+        m_offset += 4;
+        return true;
+    }
+
+    bool read_f32(float* out) {
+        enet_uint32 bits;
+        if (!read_u32(&bits))
+            return false;
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        // NaNs and infinities would poison the simulation
+        if (!std::isfinite(value))
+            return false;
+        *out = value;
+        return true;
+    }
+
+    bool read_vec3(vec3* out) {
+        vec3 value;
+        if (!(read_f32(&value.x) && read_f32(&value.y) && read_f32(&value.z)))
+            return false;
+        *out = value;
+        return true;
+    }
+
+    bool read_angle16(float* out) {
+        enet_uint16 raw;
+        if (!read_u16(&raw))
+            return false;
+        *out = ((float)raw / 65536.0f) * 2.0f * M_PI - M_PI;
+        return true;
+    }
+
+    bool read_fixed16(float* out, float min, float max) {
+        enet_uint16 raw;
+        if (!read_u16(&raw))
+            return false;
+        *out = min + ((float)raw / 65535.0f) * (max - min);
+        return true;
+    }
+
+    /**
+     * @brief Reads a u16 length prefixed string of at most `max` bytes.
+     */
+    bool read_string(std::string* out, size_t max) {
+        enet_uint16 len;
+        if (!read_u16(&len))
+            return false;
+        if ((len > max) || (remaining() < len))
+            return false;
+        out->assign((const char*)m_data + m_offset, len);
+        m_offset += len;
+        return true;
+    }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_NETWORKING_PACKET_IO_HPP_
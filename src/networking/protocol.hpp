@@ -0,0 +1,491 @@
+/** @file protocol.hpp
+ *
+ * GENERATED by gen_protocol.py from protocol.json, don't edit by
+ * hand. Wire messages and their bounds checked encoders/decoders.
+ *
+ */
+
+#ifndef _SPRF_NETWORKING_PROTOCOL_HPP_
+#define _SPRF_NETWORKING_PROTOCOL_HPP_
+
+#include "packet_io.hpp"
+#include <cassert>
+#include <enet/enet.h>
+#include <string>
+#include <vector>
+
+/** @brief Peers with a different version can't talk to each other */
+#define PROTOCOL_VERSION (3)
+
+namespace SPRF {
+
+enum packet_type_t : enet_uint8 {
+    PACKET_PING = 0,
+    PACKET_PING_RESPONSE,
+    PACKET_USER_ACTION,
+    PACKET_USER_COMMAND,
+    PACKET_GAME_STATE,
+    PACKET_GAME_EVENT,
+    PACKET_SERVER_HANDSHAKE,
+    PACKET_GAME_STATE_COMPACT,
+    PACKET_COUNT
+};
+
+enum game_event_t : enet_uint8 {
+    GAME_EVENT_GOAL = 0,
+    GAME_EVENT_RESET,
+    GAME_EVENT_CHAT,
+    GAME_EVENT_COUNT
+};
+
+enum disconnect_reason_t : enet_uint32 {
+    DISCONNECT_NONE = 0,
+    DISCONNECT_PROTOCOL_MISMATCH,
+    DISCONNECT_COUNT
+};
+
+struct ping_msg {
+    static const packet_type_t packet_type = PACKET_PING;
+
+    enet_uint32 ping = 0;
+
+    void encode(PacketWriter& out) const {
+        out.write_u32(ping);
+    }
+
+    bool decode(PacketReader& in) {
+        if (!in.read_u32(&ping))
+            return false;
+        return true;
+    }
+};
+
+struct ping_response_msg {
+    static const packet_type_t packet_type = PACKET_PING_RESPONSE;
+
+    enet_uint32 ping_return = 0;
+    enet_uint32 server_time = 0;
+
+    void encode(PacketWriter& out) const {
+        out.write_u32(ping_return);
+        out.write_u32(server_time);
+    }
+
+    bool decode(PacketReader& in) {
+        if (!in.read_u32(&ping_return))
+            return false;
+        if (!in.read_u32(&server_time))
+            return false;
+        return true;
+    }
+};
+
+struct user_action_msg {
+    static const packet_type_t packet_type = PACKET_USER_ACTION;
+
+    enet_uint32 ping = 0;
+    bool forward = false;
+    bool backward = false;
+    bool left = false;
+    bool right = false;
+    bool jump = false;
+    vec3 rotation = vec3(0, 0, 0);
+
+    void encode(PacketWriter& out) const {
+        out.write_u32(ping);
+        out.write_u8((forward << 0) | (backward << 1) | (left << 2) |
+                     (right << 3) | (jump << 4));
+        out.write_angle16(rotation.x);
+        out.write_angle16(rotation.y);
+        out.write_angle16(rotation.z);
+    }
+
+    bool decode(PacketReader& in) {
+        if (!in.read_u32(&ping))
+            return false;
+        enet_uint8 bits_1;
+        if (!in.read_u8(&bits_1))
+            return false;
+        forward = bits_1 & (1 << 0);
+        backward = bits_1 & (1 << 1);
+        left = bits_1 & (1 << 2);
+        right = bits_1 & (1 << 3);
+        jump = bits_1 & (1 << 4);
+        if (!in.read_angle16(&rotation.x))
+            return false;
+        if (!in.read_angle16(&rotation.y))
+            return false;
+        if (!in.read_angle16(&rotation.z))
+            return false;
+        return true;
+    }
+};
+
+struct ball_state_msg {
+    vec3 position = vec3(0, 0, 0);
+    vec3 rotation = vec3(0, 0, 0);
+
+    void encode(PacketWriter& out) const {
+        out.write_vec3(position);
+        out.write_angle16(rotation.x);
+        out.write_angle16(rotation.y);
+        out.write_angle16(rotation.z);
+    }
+
+    bool decode(PacketReader& in) {
+        if (!in.read_vec3(&position))
+            return false;
+        if (!in.read_angle16(&rotation.x))
+            return false;
+        if (!in.read_angle16(&rotation.y))
+            return false;
+        if (!in.read_angle16(&rotation.z))
+            return false;
+        return true;
+    }
+};
+
+struct player_state_msg {
+    enet_uint32 id = 0;
+    vec3 position = vec3(0, 0, 0);
+    vec3 velocity = vec3(0, 0, 0);
+    vec3 rotation = vec3(0, 0, 0);
+    float health = 0;
+
+    void encode(PacketWriter& out) const {
+        out.write_u32(id);
+        out.write_vec3(position);
+        out.write_fixed16(velocity.x, -64.0f, 64.0f);
+        out.write_fixed16(velocity.y, -64.0f, 64.0f);
+        out.write_fixed16(velocity.z, -64.0f, 64.0f);
+        out.write_angle16(rotation.x);
+        out.write_angle16(rotation.y);
+        out.write_angle16(rotation.z);
+        out.write_fixed16(health, 0.0f, 255.0f);
+    }
+
+    bool decode(PacketReader& in) {
+        if (!in.read_u32(&id))
+            return false;
+        if (!in.read_vec3(&position))
+            return false;
+        if (!in.read_fixed16(&velocity.x, -64.0f, 64.0f))
+            return false;
+        if (!in.read_fixed16(&velocity.y, -64.0f, 64.0f))
+            return false;
+        if (!in.read_fixed16(&velocity.z, -64.0f, 64.0f))
+            return false;
+        if (!in.read_angle16(&rotation.x))
+            return false;
+        if (!in.read_angle16(&rotation.y))
+            return false;
+        if (!in.read_angle16(&rotation.z))
+            return false;
+        if (!in.read_fixed16(&health, 0.0f, 255.0f))
+            return false;
+        return true;
+    }
+};
+
+struct game_state_msg {
+    static const packet_type_t packet_type = PACKET_GAME_STATE;
+
+    /** @brief Most `players` one message can carry */
+    static constexpr size_t max_players = 255;
+
+    enet_uint32 tick = 0;
+    bool partial = false;
+    ball_state_msg ball;
+    std::vector<player_state_msg> players;
+
+    void encode(PacketWriter& out) const {
+        out.write_u32(tick);
+        out.write_u8((partial << 0));
+        ball.encode(out);
+        assert(players.size() <= max_players);
+        enet_uint8 n_players = MIN(players.size(), (size_t)255);
+        out.write_u8(n_players);
+        for (size_t i = 0; i < n_players; i++) {
+            players[i].encode(out);
+        }
+    }
+
+    bool decode(PacketReader& in) {
+        if (!in.read_u32(&tick))
+            return false;
+        enet_uint8 bits_1;
+        if (!in.read_u8(&bits_1))
+            return false;
+        partial = bits_1 & (1 << 0);
+        if (!ball.decode(in))
+            return false;
+        enet_uint8 n_players;
+        if (!in.read_u8(&n_players))
+            return false;
+        players.resize(n_players);
+        for (auto& i : players) {
+            if (!i.decode(in))
+                return false;
+        }
+        return true;
+    }
+};
+
+struct ball_state_compact_msg {
+    vec3 position = vec3(0, 0, 0);
+    vec3 rotation = vec3(0, 0, 0);
+
+    void encode(PacketWriter& out) const {
+        out.write_fixed16(position.x, -256.0f, 256.0f);
+        out.write_fixed16(position.y, -256.0f, 256.0f);
+        out.write_fixed16(position.z, -256.0f, 256.0f);
+        out.write_angle16(rotation.x);
+        out.write_angle16(rotation.y);
+        out.write_angle16(rotation.z);
+    }
+
+    bool decode(PacketReader& in) {
+        if (!in.read_fixed16(&position.x, -256.0f, 256.0f))
+            return false;
+        if (!in.read_fixed16(&position.y, -256.0f, 256.0f))
+            return false;
+        if (!in.read_fixed16(&position.z, -256.0f, 256.0f))
+            return false;
+        if (!in.read_angle16(&rotation.x))
+            return false;
+        if (!in.read_angle16(&rotation.y))
+            return false;
+        if (!in.read_angle16(&rotation.z))
+            return false;
+        return true;
+    }
+};
+
+struct player_state_compact_msg {
+    enet_uint32 id = 0;
+    vec3 position = vec3(0, 0, 0);
+    vec3 velocity = vec3(0, 0, 0);
+    float pitch = 0;
+    float yaw = 0;
+
+    void encode(PacketWriter& out) const {
+        out.write_u32(id);
+        out.write_fixed16(position.x, -256.0f, 256.0f);
+        out.write_fixed16(position.y, -256.0f, 256.0f);
+        out.write_fixed16(position.z, -256.0f, 256.0f);
+        out.write_fixed16(velocity.x, -64.0f, 64.0f);
+        out.write_fixed16(velocity.y, -64.0f, 64.0f);
+        out.write_fixed16(velocity.z, -64.0f, 64.0f);
+        out.write_angle16(pitch);
+        out.write_angle16(yaw);
+    }
+
+    bool decode(PacketReader& in) {
+        if (!in.read_u32(&id))
+            return false;
+        if (!in.read_fixed16(&position.x, -256.0f, 256.0f))
+            return false;
+        if (!in.read_fixed16(&position.y, -256.0f, 256.0f))
+            return false;
+        if (!in.read_fixed16(&position.z, -256.0f, 256.0f))
+            return false;
+        if (!in.read_fixed16(&velocity.x, -64.0f, 64.0f))
+            return false;
+        if (!in.read_fixed16(&velocity.y, -64.0f, 64.0f))
+            return false;
+        if (!in.read_fixed16(&velocity.z, -64.0f, 64.0f))
+            return false;
+        if (!in.read_angle16(&pitch))
+            return false;
+        if (!in.read_angle16(&yaw))
+            return false;
+        return true;
+    }
+};
+
+struct game_state_compact_msg {
+    static const packet_type_t packet_type = PACKET_GAME_STATE_COMPACT;
+
+    /** @brief Most `players` one message can carry */
+    static constexpr size_t max_players = 255;
+
+    enet_uint32 tick = 0;
+    bool partial = false;
+    ball_state_compact_msg ball;
+    std::vector<player_state_compact_msg> players;
+
+    void encode(PacketWriter& out) const {
+        out.write_u32(tick);
+        out.write_u8((partial << 0));
+        ball.encode(out);
+        assert(players.size() <= max_players);
+        enet_uint8 n_players = MIN(players.size(), (size_t)255);
+        out.write_u8(n_players);
+        for (size_t i = 0; i < n_players; i++) {
+            players[i].encode(out);
+        }
+    }
+
+    bool decode(PacketReader& in) {
+        if (!in.read_u32(&tick))
+            return false;
+        enet_uint8 bits_1;
+        if (!in.read_u8(&bits_1))
+            return false;
+        partial = bits_1 & (1 << 0);
+        if (!ball.decode(in))
+            return false;
+        enet_uint8 n_players;
+        if (!in.read_u8(&n_players))
+            return false;
+        players.resize(n_players);
+        for (auto& i : players) {
+            if (!i.decode(in))
+                return false;
+        }
+        return true;
+    }
+};
+
+struct game_event_msg {
+    game_event_t type = (game_event_t)0;
+    enet_uint32 source = 0;
+    std::string payload;
+
+    void encode(PacketWriter& out) const {
+        out.write_u8((enet_uint8)type);
+        out.write_u32(source);
+        if (payload.size() > 256) {
+            out.write_string(payload.substr(0, 256));
+        } else {
+            out.write_string(payload);
+        }
+    }
+
+    bool decode(PacketReader& in) {
+        enet_uint8 raw_type;
+        if (!in.read_u8(&raw_type))
+            return false;
+        if (raw_type >= GAME_EVENT_COUNT)
+            return false;
+        type = (game_event_t)raw_type;
+        if (!in.read_u32(&source))
+            return false;
+        if (!in.read_string(&payload, 256))
+            return false;
+        return true;
+    }
+};
+
+struct game_events_msg {
+    static const packet_type_t packet_type = PACKET_GAME_EVENT;
+
+    /** @brief Most `events` one message can carry */
+    static constexpr size_t max_events = 4096;
+
+    enet_uint32 tick = 0;
+    std::vector<game_event_msg> events;
+
+    void encode(PacketWriter& out) const {
+        out.write_u32(tick);
+        assert(events.size() <= max_events);
+        enet_uint16 n_events = MIN(events.size(), (size_t)4096);
+        out.write_u16(n_events);
+        for (size_t i = 0; i < n_events; i++) {
+            events[i].encode(out);
+        }
+    }
+
+    bool decode(PacketReader& in) {
+        if (!in.read_u32(&tick))
+            return false;
+        enet_uint16 n_events;
+        if (!in.read_u16(&n_events))
+            return false;
+        if (n_events > 4096)
+            return false;
+        events.resize(n_events);
+        for (auto& i : events) {
+            if (!i.decode(in))
+                return false;
+        }
+        return true;
+    }
+};
+
+struct handshake_msg {
+    static const packet_type_t packet_type = PACKET_SERVER_HANDSHAKE;
+
+    enet_uint32 protocol_version = 0;
+    enet_uint32 id = 0;
+    enet_uint32 tickrate = 0;
+    enet_uint32 current_time = 0;
+    float ball_radius = 0;
+
+    void encode(PacketWriter& out) const {
+        out.write_u32(protocol_version);
+        out.write_u32(id);
+        out.write_u32(tickrate);
+        out.write_u32(current_time);
+        out.write_f32(ball_radius);
+    }
+
+    bool decode(PacketReader& in) {
+        if (!in.read_u32(&protocol_version))
+            return false;
+        if (!in.read_u32(&id))
+            return false;
+        if (!in.read_u32(&tickrate))
+            return false;
+        if (!in.read_u32(&current_time))
+            return false;
+        if (!in.read_f32(&ball_radius))
+            return false;
+        return true;
+    }
+};
+
+/**
+ * @brief Reads the packet type (the first byte of every packet).
+ *
+ * @return bool false if the packet is empty or the type is unknown.
+ */
+static inline bool peek_packet_type(const ENetPacket* packet,
+                                    packet_type_t* out) {
+    PacketReader in(packet);
+    enet_uint8 raw;
+    if (!in.read_u8(&raw) || (raw >= PACKET_COUNT))
+        return false;
+    *out = (packet_type_t)raw;
+    return true;
+}
+
+/**
+ * @brief Encodes a message (with its packet type) into an ENet packet.
+ */
+template <class T>
+static inline ENetPacket* encode_packet(const T& msg, enet_uint32 flags) {
+    PacketWriter out;
+    out.write_u8(T::packet_type);
+    msg.encode(out);
+    return out.packet(flags);
+}
+
+/**
+ * @brief Decodes a packet into `msg`.
+ *
+ * @return bool false if the packet has the wrong type, is truncated, has
+ * out of range values or trailing bytes.
+ */
+template <class T>
+static inline bool decode_packet(const ENetPacket* packet, T& msg) {
+    PacketReader in(packet);
+    enet_uint8 raw;
+    if (!in.read_u8(&raw) || (raw != T::packet_type))
+        return false;
+    return msg.decode(in) && in.done();
+}
+
+} // namespace SPRF
+
+#endif // _SPRF_NETWORKING_PROTOCOL_HPP_
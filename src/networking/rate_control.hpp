@@ -0,0 +1,171 @@
+/** @file rate_control.hpp
+ *
+ * Per peer snapshot rate control. Every peer gets an estimate of how many
+ * bytes per second it can take, starting from what the client advertised
+ * (its ENet incoming bandwidth) and adjusted AIMD style from ENet's view of
+ * the connection: packet loss, the packet throttle and RTT growing above its
+ * minimum all mean we are queueing somewhere and should back off.
+ *
+ * From the estimate the controller picks, per peer, how often to send a
+ * snapshot (every N ticks), whether to use the compact encoding, and a byte
+ * budget for each snapshot that the server fills in priority order.
+ *
+ */
+
+#ifndef _SPRF_NETWORKING_RATE_CONTROL_HPP_
+#define _SPRF_NETWORKING_RATE_CONTROL_HPP_
+
+#include <cmath>
+#include <enet/enet.h>
+
+/** @brief Initial estimate (bytes/s) for peers that don't advertise a rate */
+#define RATE_DEFAULT (64000.0)
+/** @brief Never estimate less than this (bytes/s) */
+#define RATE_MIN (4000.0)
+/** @brief Never grow the estimate past this many times what the peer needs,
+ * otherwise an idle connection "earns" a rate it was never tested at */
+#define RATE_HEADROOM (2.0)
+/** @brief Minimum time (ms) between changes to the estimate */
+#define RATE_ADJUST_INTERVAL (250)
+/** @brief Multiplicative decrease on congestion */
+#define RATE_DECREASE (0.75)
+/** @brief Multiplicative increase while the connection looks healthy */
+#define RATE_INCREASE (1.05)
+/** @brief Packet loss (0 to 1) counted as congestion */
+#define RATE_LOSS_THRESHOLD (0.02)
+/** @brief RTT (ms) above the minimum counted as queueing */
+#define RATE_RTT_SLACK (40)
+
+namespace SPRF {
+
+/**
+ * @brief Decides how much snapshot data one peer gets.
+ */
+class SendRateController {
+  private:
+    /** @brief Estimated bytes/s the peer can take */
+    double m_rate = RATE_DEFAULT;
+    /** @brief Upper limit for `m_rate` (what the peer/server allow) */
+    double m_max_rate = 0;
+    /** @brief Lowest RTT seen, the baseline for queueing delay */
+    enet_uint32 m_min_rtt = 0xFFFFFFFF;
+    enet_uint32 m_last_adjust = 0;
+
+    /** @brief Ticks between snapshots */
+    int m_interval = 1;
+    /** @brief Ticks since the last snapshot */
+    int m_ticks_since_send = 0;
+    bool m_compact = false;
+    /** @brief Bytes allowed in the next snapshot */
+    size_t m_budget = 0;
+    /** @brief Bytes/s full snapshots at the full rate would take */
+    double m_needed = RATE_DEFAULT;
+
+  public:
+    SendRateController() {}
+
+    /**
+     * @brief Start over for a new connection.
+     *
+     * @param max_rate Bytes/s the peer may get, 0 for unlimited.
+     */
+    void reset(double max_rate) {
+        m_max_rate = max_rate;
+        m_rate = RATE_DEFAULT;
+        if ((m_max_rate > 0) && (m_rate > m_max_rate))
+            m_rate = m_max_rate;
+        m_min_rtt = 0xFFFFFFFF;
+        m_last_adjust = 0;
+        m_interval = 1;
+        m_ticks_since_send = 0;
+        m_compact = false;
+    }
+
+    /**
+     * @brief Update the estimate from the peer's connection stats.
+     *
+     * @param peer The peer.
+     * @param max_rate Bytes/s the peer may get right now, 0 for unlimited.
+     * @param now Current enet time.
+     */
+    void update(const ENetPeer* peer, double max_rate, enet_uint32 now) {
+        m_max_rate = max_rate;
+        if ((peer->roundTripTime > 0) && (peer->roundTripTime < m_min_rtt))
+            m_min_rtt = peer->roundTripTime;
+        if ((now - m_last_adjust) < RATE_ADJUST_INTERVAL)
+            return;
+        m_last_adjust = now;
+
+        double loss =
+            (double)peer->packetLoss / (double)ENET_PEER_PACKET_LOSS_SCALE;
+        bool throttled =
+            peer->packetThrottle < (ENET_PEER_PACKET_THROTTLE_SCALE / 2);
+        bool queueing =
+            (m_min_rtt != 0xFFFFFFFF) &&
+            (peer->roundTripTime > (m_min_rtt * 2 + RATE_RTT_SLACK));
+        if ((loss > RATE_LOSS_THRESHOLD) || throttled || queueing) {
+            m_rate *= RATE_DECREASE;
+        } else {
+            m_rate = fmin(m_rate * RATE_INCREASE,
+                          fmax(m_rate, m_needed * RATE_HEADROOM));
+        }
+        if (m_rate < RATE_MIN)
+            m_rate = RATE_MIN;
+        if ((m_max_rate > 0) && (m_rate > m_max_rate))
+            m_rate = fmax(m_max_rate, RATE_MIN);
+    }
+
+    /**
+     * @brief Pick the snapshot interval, encoding and budget.
+     *
+     * Prefers full precision at the full tickrate, then halves the rate, then
+     * switches to the compact encoding, and finally drops players to fit.
+     *
+     * @param full_size Size of a full snapshot with every player.
+     * @param compact_size Size of a compact snapshot with every player.
+     * @param tickrate Snapshots per second at interval 1.
+     * @param max_interval Largest interval allowed.
+     */
+    void plan(size_t full_size, size_t compact_size, enet_uint32 tickrate,
+              int max_interval) {
+        m_needed = (double)full_size * (double)tickrate;
+        double per_tick = m_rate / (double)tickrate;
+        for (int compact = 0; compact < 2; compact++) {
+            size_t size = compact ? compact_size : full_size;
+            for (int interval = 1; interval <= max_interval; interval *= 2) {
+                if ((double)size <= per_tick * interval) {
+                    m_interval = interval;
+                    m_compact = compact;
+                    m_budget = size;
+                    return;
+                }
+            }
+        }
+        m_interval = max_interval;
+        m_compact = true;
+        m_budget = (size_t)(per_tick * max_interval);
+    }
+
+    /**
+     * @brief Count a tick, returns whether a snapshot is due this tick.
+     */
+    bool tick() {
+        m_ticks_since_send++;
+        if (m_ticks_since_send < m_interval)
+            return false;
+        m_ticks_since_send = 0;
+        return true;
+    }
+
+    double rate() const { return m_rate; }
+
+    int interval() const { return m_interval; }
+
+    bool compact() const { return m_compact; }
+
+    size_t budget() const { return m_budget; }
+};
+
+} // namespace SPRF
+
+#endif // _SPRF_NETWORKING_RATE_CONTROL_HPP_
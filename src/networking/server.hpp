@@ -16,12 +16,16 @@
 #define _SPRF_SERVER_SERVER_HPP_
 
 #include "engine/engine.hpp"
+#include "metrics.hpp"
 #include "packet.hpp"
 #include "physics/simulation.hpp"
+#include "rate_control.hpp"
 //#include "raylib-cpp.hpp"
 #include "scripting/scripting.hpp"
 #include "server_params.hpp"
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <enet/enet.h>
 #include <mutex>
 #include <string>
@@ -82,9 +86,89 @@ class Server {
 
     enet_uint32 m_last_packet_send = 0;
 
+    /** @brief Mutex to protect `m_pending_events` (scripts may emit events
+     * from any thread) */
+    std::mutex m_event_mutex;
+    /** @brief Events emitted since the last tick, sent as one batch */
+    std::vector<game_event> m_pending_events;
+
     /** @brief The game simulation */
     Simulation m_simulation;
 
+    /** @brief Timings, bandwidth and per peer stats */
+    ServerMetrics m_metrics;
+    /** @brief Last time `config.metrics_file` was written */
+    enet_uint32 m_last_metrics_write = 0;
+
+    /** @brief Send rate per peer slot (`ENetPeer::incomingPeerID`) */
+    std::vector<SendRateController> m_rate_control;
+
+    /**
+     * @brief Sends a packet to one peer, recording it in the metrics.
+     *
+     * @return int 0 on success (see `enet_peer_send`).
+     */
+    int send(ENetPeer* peer, enet_uint8 channel, ENetPacket* packet) {
+        size_t size = packet->dataLength;
+        int out = enet_peer_send(peer, channel, packet);
+        if (out == 0) {
+            m_metrics.bytes_out.add(size);
+            if (PeerMetrics* metrics = m_metrics.peer(peer->incomingPeerID)) {
+                metrics->bytes_out.add(size);
+                metrics->packets_out.add();
+            }
+        }
+        return out;
+    }
+
+    /**
+     * @brief Sends a packet to every peer with a player (connected and past
+     * the protocol check), recording it in the metrics.
+     *
+     * Peers still connecting, or being dropped for a protocol mismatch,
+     * don't get it: they couldn't make sense of it anyway.
+     */
+    void broadcast(enet_uint8 channel, ENetPacket* packet) {
+        for (size_t i = 0; i < m_enet_server->peerCount; i++) {
+            ENetPeer* peer = &m_enet_server->peers[i];
+            if ((peer->state != ENET_PEER_STATE_CONNECTED) ||
+                (peer->data == NULL))
+                continue;
+            if (send(peer, channel, packet) != 0)
+                TraceLog(LOG_ERROR, "packet send failed");
+        }
+        // every peer holds a reference, so nobody took it if there are none
+        if (packet->referenceCount == 0)
+            enet_packet_destroy(packet);
+    }
+
+    /**
+     * @brief Samples per peer RTT and loss from ENet and writes the metrics
+     * file every `config.metrics_interval` ms.
+     */
+    void update_metrics() {
+        for (size_t i = 0; i < m_enet_server->peerCount; i++) {
+            ENetPeer* peer = &m_enet_server->peers[i];
+            PeerMetrics* metrics = m_metrics.peer(i);
+            if ((metrics == NULL) || (peer->state != ENET_PEER_STATE_CONNECTED))
+                continue;
+            metrics->rtt.set((double)peer->roundTripTime * 0.001);
+            metrics->packet_loss.set((double)peer->packetLoss /
+                                     (double)ENET_PEER_PACKET_LOSS_SCALE);
+        }
+        m_metrics.players.set(m_player_states.size());
+
+        if (config.metrics_file == "")
+            return;
+        if ((enet_time_get() - m_last_metrics_write) < config.metrics_interval)
+            return;
+        m_last_metrics_write = enet_time_get();
+        if (!m_metrics.write_file(config.metrics_file)) {
+            TraceLog(LOG_WARNING, "couldn't write metrics to %s",
+                     config.metrics_file.c_str());
+        }
+    }
+
     /**
      * @brief Handles incoming packets from clients.
      *
@@ -94,15 +178,44 @@ class Server {
      * @param event Pointer to the ENet event containing the packet data.
      */
     void handle_recieve(ENetEvent* event) {
-        packet_header header = *(packet_header*)(event->packet->data);
-        if (header.packet_type == PACKET_USER_ACTION) {
-            user_action_packet client_packet(event->packet->data,
-                                             event->packet->dataLength);
-            PlayerBody* body = (PlayerBody*)event->peer->data;
+        PlayerBody* body = (PlayerBody*)event->peer->data;
+        // peers that failed the version check
+        if (body == NULL)
+            return;
+        packet_type_t type;
+        if (!peek_packet_type(event->packet, &type)) {
+            TraceLog(LOG_WARNING, "dropping packet with unknown type");
+            m_metrics.malformed_packets.add();
+            return;
+        }
+        if (type == PACKET_GAME_EVENT) {
+            game_event_packet events;
+            if (!events.deserialize(event->packet)) {
+                TraceLog(LOG_WARNING, "dropping malformed event packet");
+                m_metrics.malformed_packets.add();
+                return;
+            }
+            for (auto& i : events.events) {
+                // clients only get to talk, everything else is the server's
+                // call
+                if (i.type != GAME_EVENT_CHAT)
+                    continue;
+                emit_event(GAME_EVENT_CHAT, i.payload, body->id());
+            }
+            return;
+        }
+        if (type == PACKET_USER_ACTION) {
+            user_action_packet client_packet;
+            if (!client_packet.deserialize(event->packet)) {
+                TraceLog(LOG_WARNING, "dropping malformed input packet");
+                m_metrics.malformed_packets.add();
+                return;
+            }
             body->update_inputs(client_packet);
-            if (enet_peer_send(event->peer, 0,
-                               ping_response_packet(client_packet.ping_send)
-                                   .serialize()) != 0) {
+            if (send(event->peer, CHANNEL_SNAPSHOT,
+                     ping_response_packet(client_packet.ping_send,
+                                          m_simulation.tick_time())
+                         .serialize()) != 0) {
                 TraceLog(LOG_ERROR, "packet send failed");
             }
         }
@@ -113,22 +226,35 @@ class Server {
      * @brief Handles new client connections.
      *
      * This method initializes a new player in the simulation, assigns them an
-     * ID, and sends a handshake packet to the client.
+     * ID, and sends a handshake packet to the client. Clients connect with
+     * their `PROTOCOL_VERSION` as the connection data, and are disconnected
+     * with `DISCONNECT_PROTOCOL_MISMATCH` if it doesn't match ours.
      *
      * @param event Pointer to the ENet event containing the connection data.
      */
     void handle_connect(ENetEvent* event) {
         TraceLog(LOG_INFO, "Peer Connected");
+        event->peer->data = NULL;
+        if (event->data != PROTOCOL_VERSION) {
+            TraceLog(LOG_WARNING,
+                     "Peer has protocol version %u, expected %d, "
+                     "disconnecting",
+                     event->data, PROTOCOL_VERSION);
+            enet_peer_disconnect(event->peer, DISCONNECT_PROTOCOL_MISMATCH);
+            return;
+        }
         m_player_states.push_back(player_state_data(m_next_id));
         auto player = m_simulation.create_player(m_next_id);
         player->enable();
         event->peer->data = player;
-        HandshakePacket out(m_next_id, m_tickrate, enet_time_get(),
+        if (PeerMetrics* metrics = m_metrics.peer(event->peer->incomingPeerID))
+            metrics->reset(m_next_id);
+        m_rate_control[event->peer->incomingPeerID].reset(
+            max_send_rate(event->peer));
+        HandshakePacket out(m_next_id, m_tickrate, m_simulation.tick_time(),
                             m_simulation.params().ball_radius);
         m_next_id++;
-        ENetPacket* packet = enet_packet_create(&out, sizeof(HandshakePacket),
-                                                ENET_PACKET_FLAG_RELIABLE);
-        if (enet_peer_send(event->peer, 0, packet) != 0) {
+        if (send(event->peer, CHANNEL_EVENT, out.serialize()) != 0) {
             TraceLog(LOG_ERROR, "packet send failed");
         }
         enet_host_flush(m_enet_server);
@@ -144,6 +270,11 @@ class Server {
      */
     void handle_disconnect(ENetEvent* event) {
         PlayerBody* player = (PlayerBody*)event->peer->data;
+        if (player == NULL)
+            return;
+        event->peer->data = NULL;
+        if (PeerMetrics* metrics = m_metrics.peer(event->peer->incomingPeerID))
+            metrics->connected = false;
         player->disable();
         TraceLog(LOG_INFO, "ID %d disconnected", player->id());
         int to_delete = -1;
@@ -167,12 +298,17 @@ class Server {
     void get_event() {
         ENetEvent event;
         if (enet_host_service(m_enet_server, &event, (1000 / m_tickrate)) > 0) {
-            m_simulation.update(&m_tick, m_player_states, m_ball_state);
             switch (event.type) {
             case ENET_EVENT_TYPE_CONNECT:
                 handle_connect(&event);
                 break;
             case ENET_EVENT_TYPE_RECEIVE:
+                m_metrics.bytes_in.add(event.packet->dataLength);
+                if (PeerMetrics* metrics =
+                        m_metrics.peer(event.peer->incomingPeerID)) {
+                    metrics->bytes_in.add(event.packet->dataLength);
+                    metrics->packets_in.add();
+                }
                 handle_recieve(&event);
                 enet_packet_destroy(event.packet);
                 break;
@@ -186,14 +322,141 @@ class Server {
             }
         }
         if ((enet_time_get() - m_last_packet_send) >= (1000 / m_tickrate)) {
-            game_state_packet packet(enet_time_get(), m_ball_state,
-                                     m_player_states);
-            enet_host_broadcast(m_enet_server, 0, packet.serialize());
+            // sample the simulation right before sending so the snapshot is
+            // stamped with the tick it actually contains
+            m_simulation.update(&m_tick, m_player_states, m_ball_state);
+            send_snapshots();
+            flush_events();
             enet_host_flush(m_enet_server);
+            update_metrics();
             m_last_packet_send = enet_time_get();
         }
     }
 
+    /**
+     * @brief Most bytes/s a peer may get: what it advertised as its incoming
+     * bandwidth, and its share of our outgoing bandwidth (0 for unlimited).
+     */
+    double max_send_rate(const ENetPeer* peer) {
+        double rate = peer->incomingBandwidth;
+        if (m_oband == 0)
+            return rate;
+        size_t connected = 0;
+        for (size_t i = 0; i < m_enet_server->peerCount; i++) {
+            if (m_enet_server->peers[i].data != NULL)
+                connected++;
+        }
+        double share = (double)m_oband / (double)std::max(connected, (size_t)1);
+        if ((rate == 0) || (share < rate))
+            return share;
+        return rate;
+    }
+
+    /**
+     * @brief Orders players by how much `peer` cares about them: itself
+     * first, then everyone else by distance.
+     */
+    std::vector<player_state_data> prioritize_players(const ENetPeer* peer) {
+        enet_uint32 self = ((PlayerBody*)peer->data)->id();
+        std::vector<player_state_data> out = m_player_states;
+        vec3 origin;
+        for (auto& i : out) {
+            if (i.id == self)
+                origin = i.position();
+        }
+        std::sort(out.begin(), out.end(),
+                  [&](player_state_data& a, player_state_data& b) {
+                      if ((a.id == self) != (b.id == self))
+                          return a.id == self;
+                      return Vector3DistanceSqr(a.position(), origin) <
+                             Vector3DistanceSqr(b.position(), origin);
+                  });
+        return out;
+    }
+
+    /**
+     * @brief Sends the latest snapshot to every peer that is due one.
+     *
+     * Each peer gets its own snapshot, sized by its `SendRateController`:
+     * peers short on bandwidth get snapshots less often, in the compact
+     * encoding, and finally with only as many players as fit in the budget
+     * (and in a packet's player count).
+     * The peer's own player and the ball are always sent; the rest are added
+     * nearest first and the snapshot is marked `partial` if any are left out.
+     */
+    void send_snapshots() {
+        size_t full_size =
+            game_state_packet::encoded_size(m_player_states.size(), false);
+        size_t compact_size =
+            game_state_packet::encoded_size(m_player_states.size(), true);
+        enet_uint32 now = enet_time_get();
+        for (size_t i = 0; i < m_enet_server->peerCount; i++) {
+            ENetPeer* peer = &m_enet_server->peers[i];
+            if ((peer->state != ENET_PEER_STATE_CONNECTED) ||
+                (peer->data == NULL))
+                continue;
+            SendRateController& control = m_rate_control[i];
+            control.update(peer, max_send_rate(peer), now);
+            control.plan(full_size, compact_size, m_tickrate,
+                         config.max_snapshot_interval);
+            if (!control.tick())
+                continue;
+
+            auto encode_start = std::chrono::high_resolution_clock::now();
+            std::vector<player_state_data> states = prioritize_players(peer);
+            size_t limit =
+                std::min(states.size(), game_state_msg::max_players);
+            size_t count = std::min(limit, (size_t)1);
+            while ((count < limit) &&
+                   (game_state_packet::encoded_size(count + 1,
+                                                    control.compact()) <=
+                    control.budget())) {
+                count++;
+            }
+            bool partial = count < states.size();
+            states.resize(count);
+            game_state_packet packet(m_tick, m_ball_state, states, partial);
+            ENetPacket* snapshot = packet.serialize(control.compact());
+            m_metrics.encode_time.observe(
+                std::chrono::duration<double>(
+                    std::chrono::high_resolution_clock::now() - encode_start)
+                    .count());
+
+            if (send(peer, CHANNEL_SNAPSHOT, snapshot) != 0) {
+                TraceLog(LOG_ERROR, "packet send failed");
+                continue;
+            }
+            m_metrics.snapshots.add();
+            if (PeerMetrics* metrics = m_metrics.peer(i)) {
+                metrics->send_rate.set(control.rate());
+                metrics->snapshot_interval.set(control.interval());
+                if (partial)
+                    metrics->partial_snapshots.add();
+            }
+        }
+    }
+
+    /**
+     * @brief Broadcasts every event emitted since the last tick as reliable
+     * packets on `CHANNEL_EVENT`, split when there are more than one packet
+     * can carry.
+     *
+     * Reliable packets on their own channel are acked and ordered
+     * independently, so a lost event never holds up the snapshot stream.
+     */
+    void flush_events() {
+        std::vector<game_event> events;
+        {
+            std::lock_guard<std::mutex> guard(m_event_mutex);
+            if (m_pending_events.size() == 0)
+                return;
+            events.swap(m_pending_events);
+        }
+        for (auto& packet : game_event_packet::batches(m_tick, events)) {
+            broadcast(CHANNEL_EVENT, packet.serialize());
+        }
+    }
+
     /**
      * @brief Checks if the server should quit.
      *
@@ -217,11 +480,51 @@ class Server {
         }
     }
 
-    void register_scripts(){
-
+    /**
+     * @brief Registers `sprf.emit_event(type, payload)` for server scripts.
+     *
+     * `type` is one of "goal", "reset" or "chat", `payload` is optional.
+     */
+    void register_scripts() {
+        scripting.register_function(
+            [this](lua_State* L) {
+                std::string name = luaL_checkstring(L, 1);
+                std::string payload = luaL_optstring(L, 2, "");
+                game_event_t type;
+                if (!game_event::from_name(name, &type)) {
+                    TraceLog(LOG_ERROR, "LUA: unknown event type %s",
+                             name.c_str());
+                    return 0;
+                }
+                TraceLog(LOG_INFO, "LUA: emitting event %s %s", name.c_str(),
+                         payload.c_str());
+                this->emit_event(type, payload);
+                return 0;
+            },
+            "emit_event");
     }
 
   public:
+    /**
+     * @brief Queues an event to be sent to every client with the next tick.
+     *
+     * Locks `m_event_mutex`.
+     *
+     * @param type The event type.
+     * @param payload Event data (e.g. the chat message).
+     * @param source Player id that caused the event.
+     */
+    void emit_event(game_event_t type, std::string payload = "",
+                    enet_uint32 source = GAME_EVENT_SERVER) {
+        std::lock_guard<std::mutex> guard(m_event_mutex);
+        m_pending_events.push_back(game_event(type, source, payload));
+    }
+
+    /**
+     * @brief Current metrics in the Prometheus text exposition format.
+     */
+    std::string metrics() { return m_metrics.prometheus(); }
+
     /**
      * @brief Signals the server to quit.
      *
@@ -260,7 +563,15 @@ class Server {
           m_peer_count(config.peer_count),
           m_channel_count(config.channel_count), m_iband(config.iband),
           m_oband(config.oband), m_tickrate(config.tickrate),
-          m_simulation(m_tickrate, server_config) {
+          m_simulation(m_tickrate, server_config),
+          m_metrics(config.peer_count), m_rate_control(config.peer_count) {
+        if (config.max_snapshot_interval < 1)
+            config.max_snapshot_interval = 1;
+        if (m_channel_count < N_CHANNELS) {
+            TraceLog(LOG_WARNING, "channel_count %lu too small, using %d",
+                     m_channel_count, N_CHANNELS);
+            m_channel_count = N_CHANNELS;
+        }
         enet_address_set_host(&m_address, m_host.c_str());
         m_address.port = m_port;
         TraceLog(LOG_INFO,
@@ -279,9 +590,11 @@ class Server {
         }
         TraceLog(LOG_INFO, "ENet server host created");
         enet_time_set(0);
+        // before the server thread runs on_load.lua
+        register_scripts();
+        m_simulation.set_metrics(&m_metrics);
         server_thread = std::thread(&SPRF::Server::run, this);
         m_simulation.launch();
-        register_scripts();
     }
 
     /**
@@ -297,7 +610,15 @@ class Server {
           m_peer_count(config.peer_count),
           m_channel_count(config.channel_count), m_iband(config.iband),
           m_oband(config.oband), m_tickrate(config.tickrate),
-          m_simulation(m_tickrate, server_config) {
+          m_simulation(m_tickrate, server_config),
+          m_metrics(config.peer_count), m_rate_control(config.peer_count) {
+        if (config.max_snapshot_interval < 1)
+            config.max_snapshot_interval = 1;
+        if (m_channel_count < N_CHANNELS) {
+            TraceLog(LOG_WARNING, "channel_count %lu too small, using %d",
+                     m_channel_count, N_CHANNELS);
+            m_channel_count = N_CHANNELS;
+        }
         enet_address_set_host(&m_address, m_host.c_str());
         m_address.port = m_port;
         TraceLog(LOG_INFO,
@@ -316,9 +637,11 @@ class Server {
         }
         TraceLog(LOG_INFO, "ENet server host created");
         enet_time_set(0);
+        // before the server thread runs on_load.lua
+        register_scripts();
+        m_simulation.set_metrics(&m_metrics);
         server_thread = std::thread(&SPRF::Server::run, this);
         m_simulation.launch();
-        register_scripts();
     }
 
     /**
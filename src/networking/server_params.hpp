@@ -46,6 +46,13 @@ class ServerConfig {
     size_t oband = 0;
     /** @brief Default tick rate (number of simulation updates per second) */
     enet_uint32 tickrate = 64;
+    /** @brief File metrics are written to in Prometheus text format ("" means
+     * don't write metrics) */
+    std::string metrics_file = "";
+    /** @brief How often (in ms) the metrics file is rewritten */
+    enet_uint32 metrics_interval = 1000;
+    /** @brief Most ticks between snapshots for peers short on bandwidth */
+    int max_snapshot_interval = 4;
 
     /**
      * @brief Construct a new ServerConfig object.
@@ -85,6 +92,13 @@ class ServerConfig {
             DUMB_HACK(server, iband)
             DUMB_HACK(server, oband)
             DUMB_HACK(server, tickrate)
+            if (server.has("metrics_file")) {
+                metrics_file = server["metrics_file"];
+                TraceLog(LOG_INFO, "Server Config: metrics_file = %s",
+                         metrics_file.c_str());
+            }
+            DUMB_HACK(server, metrics_interval)
+            DUMB_HACK(server, max_snapshot_interval)
         }
 
         // file.write(ini); // Write any changes back to the INI file
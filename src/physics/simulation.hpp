@@ -14,6 +14,7 @@
 #define _SPRF_NETWORKING_SIMULATION_HPP_
 
 #include "networking/map.hpp"
+#include "networking/metrics.hpp"
 #include "networking/packet.hpp"
 #include "networking/server_params.hpp"
 #include "player_body.hpp"
@@ -182,6 +183,9 @@ class Simulation {
     std::chrono::nanoseconds m_time_per_tick;
     /** @brief Current simulation tick */
     enet_uint32 m_tick = 0;
+    /** @brief Wall clock time of the last step, for sub-tick timestamps */
+    std::chrono::high_resolution_clock::time_point m_last_step =
+        std::chrono::high_resolution_clock::now();
     /** @brief Flag to indicate if the simulation should quit */
     bool m_should_quit = false;
     /** @brief Time step per tick */
@@ -216,6 +220,9 @@ class Simulation {
 
     std::unordered_map<std::string,std::vector<MapElementInstance>> m_positions;
 
+    /** @brief Where step timings are recorded (optional) */
+    ServerMetrics* m_metrics = NULL;
+
   public:
     /**
      * @brief Checks if the simulation should quit.
@@ -251,6 +258,27 @@ class Simulation {
         return m_tick;
     }
 
+    /**
+     * @brief Gets the current simulation time in ms.
+     *
+     * This is the time of the current tick plus however long it has been since
+     * that tick was stepped (clamped to one tick), so it is continuous and can
+     * be used as the server clock for clock synchronization.
+     *
+     * Locks `simulation_mutex`.
+     *
+     * @return enet_uint32 The current simulation time in ms.
+     */
+    enet_uint32 tick_time() {
+        std::lock_guard<std::mutex> guard(simulation_mutex);
+        auto since_step = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now() - m_last_step);
+        if (since_step > m_time_per_tick)
+            since_step = m_time_per_tick;
+        return (enet_uint32)(((double)m_tick * 1000.0) / (double)m_tickrate +
+                             (double)since_step.count() * 1e-6);
+    }
+
     /**
      * @brief Runs the simulation loop.
      *
@@ -260,10 +288,18 @@ class Simulation {
      * remainder of the tick duration.
      */
     void run() {
+        auto last_start = std::chrono::high_resolution_clock::now();
         while (!should_quit()) {
             auto start = std::chrono::high_resolution_clock::now();
             step();
             auto finish = std::chrono::high_resolution_clock::now();
+            if (m_metrics) {
+                m_metrics->tick_interval.observe(
+                    std::chrono::duration<double>(start - last_start).count());
+                if ((finish - start) > m_time_per_tick)
+                    m_metrics->tick_overruns.add();
+            }
+            last_start = start;
             std::this_thread::sleep_for(
                 m_time_per_tick -
                 std::chrono::duration_cast<std::chrono::nanoseconds>(finish -
@@ -285,6 +321,11 @@ class Simulation {
 
     const SimulationParameters& params() { return m_sim_params; }
 
+    /**
+     * @brief Record step timings into `metrics`. Call before `launch`.
+     */
+    void set_metrics(ServerMetrics* metrics) { m_metrics = metrics; }
+
     /**
      * @brief Construct a new Simulation object.
      *
@@ -402,15 +443,27 @@ class Simulation {
      */
     void step() {
         std::lock_guard<std::mutex> guard(simulation_mutex);
+        auto start = std::chrono::high_resolution_clock::now();
         for (auto& i : m_players) {
             i.second->handle_inputs();
             i.second->reset_inputs();
         }
         m_ball->update();
+        auto collide_start = std::chrono::high_resolution_clock::now();
         dSpaceCollide(m_space, this, near_callback);
+        auto collide_end = std::chrono::high_resolution_clock::now();
         dWorldQuickStep(m_world, m_dt);
         dJointGroupEmpty(m_contact_group);
         m_tick++;
+        m_last_step = std::chrono::high_resolution_clock::now();
+        if (m_metrics) {
+            m_metrics->collide_time.observe(
+                std::chrono::duration<double>(collide_end - collide_start)
+                    .count());
+            m_metrics->step_time.observe(
+                std::chrono::duration<double>(m_last_step - start).count());
+            m_metrics->ticks.add();
+        }
     }
 
     /**